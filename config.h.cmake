@@ -32,6 +32,8 @@
 #cmakedefine HAVE_SRANDOM
 #cmakedefine HAVE_STRERROR
 #cmakedefine HAVE_WRITEV
+#cmakedefine HAVE_SPLICE
+#cmakedefine HAVE_ZLIB_H
 
 #cmakedefine HAVE_SOCKLEN_T
 #cmakedefine HAVE_ULONG
@@ -22,14 +22,16 @@
 local commands = require("proxy.commands")
 local auto_config = require("proxy.auto-config")
 
---- init the global scope
-if not proxy.global.active_queries then
-	proxy.global.active_queries = {}
-end
-
-if not proxy.global.max_active_trx then
-	proxy.global.max_active_trx = 0
-end
+-- the connections are tracked in proxy.global.kv to see the ones of all event-threads
+--
+--   active_queries.<connection_id>.state     started, idle or in_trans
+--   active_queries.<connection_id>.query     the current command
+--   active_queries.<connection_id>.db
+--   active_queries.<connection_id>.username
+--
+-- and the high-water mark of the active transactions in proxy.global.stats
+local ACTIVE_PREFIX  = "active_queries."
+local MAX_ACTIVE_TRX = "active_queries.max_active_trx"
 
 -- default config for this script
 if not proxy.global.config.active_queries then
@@ -42,11 +44,34 @@ end
 -- track the active queries and dump all queries at each state-change
 --
 
+---
+-- set the fields of a connection, nil removes them
+local function set_active_query(connection_id, state, query, db, username)
+	local prefix = ACTIVE_PREFIX .. connection_id .. "."
+
+	proxy.global.kv[prefix .. "state"]    = state
+	proxy.global.kv[prefix .. "query"]    = query
+	proxy.global.kv[prefix .. "db"]       = db
+	proxy.global.kv[prefix .. "username"] = username
+end
+
 function collect_stats()
+	local active_queries = {}
 	local num_conns = 0
 	local active_conns = 0
 
-	for k, v in pairs(proxy.global.active_queries) do
+	for k, v in pairs(proxy.global.kv()) do
+		if k:sub(1, #ACTIVE_PREFIX) == ACTIVE_PREFIX then
+			local connection_id, fld = k:sub(#ACTIVE_PREFIX + 1):match("^(%d+)%.(%a+)$")
+
+			if connection_id then
+				active_queries[connection_id] = active_queries[connection_id] or { }
+				active_queries[connection_id][fld] = v
+			end
+		end
+	end
+
+	for k, v in pairs(active_queries) do
 		num_conns = num_conns + 1
 
 		if v.state ~= "idle" then
@@ -54,14 +79,13 @@ function collect_stats()
 		end
 	end
 
-	if active_conns > proxy.global.max_active_trx then
-		proxy.global.max_active_trx = active_conns
-	end
+	proxy.global.stats:max(MAX_ACTIVE_TRX, active_conns)
 
 	return {
+		active_queries = active_queries,
 		active_conns = active_conns,
 		num_conns = num_conns,
-		max_active_trx = proxy.global.max_active_trx
+		max_active_trx = proxy.global.stats:get(MAX_ACTIVE_TRX)
 	}
 end
 
@@ -71,13 +95,9 @@ end
 function print_stats(stats)
 	local o = ""
 
-	for k, v in pairs(proxy.global.active_queries) do
+	for k, v in pairs(stats.active_queries) do
 		if v.state ~= "idle" or proxy.global.config.active_queries.show_idle_connections then
-			local cmd_query = ""
-			if v.cmd then
-				cmd_query = string.format("(%s) %q", v.cmd.type_name, v.cmd.query or "")
-			end
-			o = o .."  ["..k.."] (".. v.username .."@".. v.db ..") " .. cmd_query .." (state=" .. v.state .. ")\n"
+			o = o .."  ["..k.."] (".. (v.username or "") .."@".. (v.db or "") ..") " .. (v.query or "") .." (state=" .. tostring(v.state) .. ")\n"
 		end
 	end
 
@@ -103,12 +123,11 @@ function read_query(packet)
 	-- add the query to the global scope
 	local connection_id = proxy.connection.server.thread_id
 
-	proxy.global.active_queries[connection_id] = { 
-		state = "started",
-		cmd = cmd,
-		db = proxy.connection.client.default_db or "",
-		username = proxy.connection.client.username or ""
-	}
+	set_active_query(connection_id,
+		"started",
+		string.format("(%s) %q", cmd.type_name, cmd.query or ""),
+		proxy.connection.client.default_db or "",
+		proxy.connection.client.username or "")
 
 	print_stats(collect_stats())
 
@@ -119,18 +138,20 @@ end
 -- statement is done, track the change
 function read_query_result(inj)
 	local connection_id = proxy.connection.server.thread_id
+	local prefix = ACTIVE_PREFIX .. connection_id .. "."
+	local state = "idle"
 
-	proxy.global.active_queries[connection_id].state = "idle"
-	proxy.global.active_queries[connection_id].cmd = nil
-	
 	if inj.resultset then
 		local res = inj.resultset
 
 		if res.flags.in_trans then
-			proxy.global.active_queries[connection_id].state = "in_trans" 
+			state = "in_trans" 
 		end
 	end
 
+	proxy.global.kv[prefix .. "state"] = state
+	proxy.global.kv[prefix .. "query"] = nil
+
 	print_stats(collect_stats())
 end
 
@@ -140,9 +161,8 @@ end
 function disconnect_client()
 	local connection_id = proxy.connection.server.thread_id
 	if connection_id then
-		proxy.global.active_queries[connection_id] = nil
+		set_active_query(connection_id, nil, nil, nil, nil)
 	
 		print_stats(collect_stats())
 	end
 end
-
@@ -36,6 +36,49 @@ function read_query(packet)
 
 	local rows = { }
 	local fields = { }
+	local address, backend_type, backend_ndx, weight
+
+	-- ADD BACKEND <address> [RW|RO]
+	address, backend_type = query:match("^%s*[aA][dD][dD]%s+[bB][aA][cC][kK][eE][nN][dD]%s+(%S+)%s*(%a*)%s*$")
+	if address then
+		local types = {
+			[""] = proxy.BACKEND_TYPE_RW,
+			rw   = proxy.BACKEND_TYPE_RW,
+			ro   = proxy.BACKEND_TYPE_RO
+		}
+		local t = types[backend_type:lower()]
+
+		if not t then
+			set_error("the type of the backend has to be RW or RO, got '" .. backend_type .. "'")
+		elseif not proxy.global.backends:add(address, t) then
+			set_error("adding the backend '" .. address .. "' failed, see the log")
+		else
+			proxy.response = { type = proxy.MYSQLD_PACKET_OK, affected_rows = 1 }
+		end
+		return proxy.PROXY_SEND_RESULT
+	end
+
+	-- DRAIN BACKEND <ndx>
+	backend_ndx = query:match("^%s*[dD][rR][aA][iI][nN]%s+[bB][aA][cC][kK][eE][nN][dD]%s+(%d+)%s*$")
+	if backend_ndx then
+		if not proxy.global.backends:drain(tonumber(backend_ndx)) then
+			set_error("there is no backend " .. backend_ndx)
+		else
+			proxy.response = { type = proxy.MYSQLD_PACKET_OK, affected_rows = 1 }
+		end
+		return proxy.PROXY_SEND_RESULT
+	end
+
+	-- SET BACKEND <ndx> WEIGHT <weight>
+	backend_ndx, weight = query:match("^%s*[sS][eE][tT]%s+[bB][aA][cC][kK][eE][nN][dD]%s+(%d+)%s+[wW][eE][iI][gG][hH][tT]%s+(%d+)%s*$")
+	if backend_ndx then
+		if not proxy.global.backends:set_weight(tonumber(backend_ndx), tonumber(weight)) then
+			set_error("setting the weight of backend " .. backend_ndx .. " to " .. weight .. " failed")
+		else
+			proxy.response = { type = proxy.MYSQLD_PACKET_OK, affected_rows = 1 }
+		end
+		return proxy.PROXY_SEND_RESULT
+	end
 
 	if query:lower() == "select * from backends" then
 		fields = { 
@@ -52,6 +95,8 @@ function read_query(packet)
 			  type = proxy.MYSQL_TYPE_STRING },
 			{ name = "connected_clients", 
 			  type = proxy.MYSQL_TYPE_LONG },
+			{ name = "weight", 
+			  type = proxy.MYSQL_TYPE_LONG },
 		}
 
 		for i = 1, #proxy.global.backends do
@@ -66,14 +111,20 @@ function read_query(packet)
 				"ro"
 			}
 			local b = proxy.global.backends[i]
+			local state = states[b.state + 1] -- the C-id is pushed down starting at 0
+
+			if b.drained then
+				state = "drained"
+			end
 
 			rows[#rows + 1] = {
 				i,
 				b.dst.name,          -- configured backend address
-				states[b.state + 1], -- the C-id is pushed down starting at 0
+				state,
 				types[b.type + 1],   -- the C-id is pushed down starting at 0
 				b.uuid,              -- the MySQL Server's UUID if it is managed
-				b.connected_clients  -- currently connected clients
+				b.connected_clients, -- currently connected clients
+				b.weight             -- share of the clients under the wrr-policy
 			}
 		end
 	elseif query:lower() == "select * from help" then
@@ -85,6 +136,9 @@ function read_query(packet)
 		}
 		rows[#rows + 1] = { "SELECT * FROM help", "shows this help" }
 		rows[#rows + 1] = { "SELECT * FROM backends", "lists the backends and their state" }
+		rows[#rows + 1] = { "ADD BACKEND <address> [RW|RO]", "adds a backend, or brings a drained one back" }
+		rows[#rows + 1] = { "DRAIN BACKEND <ndx>", "sends no new clients to a backend" }
+		rows[#rows + 1] = { "SET BACKEND <ndx> WEIGHT <weight>", "changes the weight of a backend" }
 	else
 		set_error("use 'SELECT * FROM help' to see the supported commands")
 		return proxy.PROXY_SEND_RESULT
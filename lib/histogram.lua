@@ -32,15 +32,17 @@ if not proxy.global.config.histogram then
 	}
 end
 
--- init query counters
-if not proxy.global.norm_queries then
-	proxy.global.norm_queries = { }
-end
-
--- init table-usage
-if not proxy.global.tables then
-	proxy.global.tables = { }
-end
+-- the normalized queries and the table-usage are counted in proxy.global.stats
+-- which is shared by all event-threads
+--
+--   histogram.queries.count.<norm_query>
+--   histogram.queries.time.<norm_query>  sum of the query-times
+--   histogram.queries.max.<norm_query>   high-water mark of the query-time
+--   histogram.reads.<table>
+--   histogram.writes.<table>
+local QUERIES_PREFIX = "histogram.queries."
+local READS_PREFIX   = "histogram.reads."
+local WRITES_PREFIX  = "histogram.writes."
 
 function read_query(packet)
 	local cmd = commands.parse(packet)
@@ -49,8 +51,7 @@ function read_query(packet)
 	if r then return r end
 
 	if cmd.type == proxy.COM_QUERY then
-		local tokens     = assert(tokenizer.tokenize(cmd.query))
-		local norm_query = tokenizer.normalize(tokens)
+		local norm_query = tokenizer.fingerprint(cmd.query)
 
 		-- print("normalized query: " .. norm_query)
 
@@ -71,17 +72,25 @@ function read_query(packet)
 				}
 			}
 
-			local rows = {}
-			if proxy.global.norm_queries then
-				for k, v in pairs(proxy.global.norm_queries) do
-					rows[#rows + 1] = { 
-						k, 
-						v.count,
-						v.max_query_time,
-						v.avg_query_time,
-					}
+			local queries = {}
+			for k, v in pairs(proxy.global.stats:snapshot()) do
+				if k:sub(1, #QUERIES_PREFIX) == QUERIES_PREFIX then
+					local fld, q = k:sub(#QUERIES_PREFIX + 1):match("^(%a+)%.(.*)$")
+
+					queries[q] = queries[q] or { count = 0, time = 0, max = 0 }
+					queries[q][fld] = v
 				end
 			end
+
+			local rows = {}
+			for k, v in pairs(queries) do
+				rows[#rows + 1] = { 
+					k, 
+					v.count,
+					v.max,
+					v.count > 0 and v.time / v.count or 0,
+				}
+			end
 			
 			proxy.response.resultset.rows = rows
 
@@ -91,7 +100,7 @@ function read_query(packet)
 				type = proxy.MYSQLD_PACKET_OK,
 			}
 
-			proxy.global.norm_queries = {}
+			proxy.global.stats:reset(QUERIES_PREFIX)
 			return proxy.PROXY_SEND_RESULT
 		elseif norm_query == "SELECT * FROM `histogram` . `tables` " then
 			proxy.response = {
@@ -108,16 +117,27 @@ function read_query(packet)
 				}
 			}
 
-			local rows = {}
-			if proxy.global.tables then
-				for k, v in pairs(proxy.global.tables) do
-					rows[#rows + 1] = { 
-						k, 
-						v.reads,
-						v.writes,
-					}
+			local tables = {}
+			for k, v in pairs(proxy.global.stats:snapshot()) do
+				if k:sub(1, #READS_PREFIX) == READS_PREFIX then
+					local t = k:sub(#READS_PREFIX + 1)
+					tables[t] = tables[t] or { reads = 0, writes = 0 }
+					tables[t].reads = v
+				elseif k:sub(1, #WRITES_PREFIX) == WRITES_PREFIX then
+					local t = k:sub(#WRITES_PREFIX + 1)
+					tables[t] = tables[t] or { reads = 0, writes = 0 }
+					tables[t].writes = v
 				end
 			end
+
+			local rows = {}
+			for k, v in pairs(tables) do
+				rows[#rows + 1] = { 
+					k, 
+					v.reads,
+					v.writes,
+				}
+			end
 			
 			proxy.response.resultset.rows = rows
 
@@ -127,7 +147,8 @@ function read_query(packet)
 				type = proxy.MYSQLD_PACKET_OK,
 			}
 
-			proxy.global.tables = {}
+			proxy.global.stats:reset(READS_PREFIX)
+			proxy.global.stats:reset(WRITES_PREFIX)
 			return proxy.PROXY_SEND_RESULT
 		end
 
@@ -144,47 +165,25 @@ function read_query_result(inj)
 	local cmd = commands.parse(inj.query)
 
 	if cmd.type == proxy.COM_QUERY then
-		local tokens     = assert(tokenizer.tokenize(cmd.query))
-		local norm_query = tokenizer.normalize(tokens)
+		local norm_query = tokenizer.fingerprint(cmd.query)
 
 		if proxy.global.config.histogram.collect_queries then
-			if not proxy.global.norm_queries[norm_query] then
-				proxy.global.norm_queries[norm_query] = {
-					count = 0,
-					max_query_time = 0,
-					avg_query_time = 0
-				}
-			end
-	
-			-- set new max if necessary
-			if inj.query_time > proxy.global.norm_queries[norm_query].max_query_time then
-				proxy.global.norm_queries[norm_query].max_query_time = inj.query_time
-			end
-	
-			-- build rolling average
-			proxy.global.norm_queries[norm_query].avg_query_time = 
-				((proxy.global.norm_queries[norm_query].avg_query_time * proxy.global.norm_queries[norm_query].count) +
-					inj.query_time) / (proxy.global.norm_queries[norm_query].count + 1)
-			
-			proxy.global.norm_queries[norm_query].count = proxy.global.norm_queries[norm_query].count + 1
+			-- the average is taken from the sum when the histogram is read
+			proxy.global.stats:inc(QUERIES_PREFIX .. "count." .. norm_query)
+			proxy.global.stats:inc(QUERIES_PREFIX .. "time." .. norm_query, inj.query_time)
+			proxy.global.stats:max(QUERIES_PREFIX .. "max." .. norm_query, inj.query_time)
 		end
 	
 		if proxy.global.config.histogram.collect_tables then
 			-- extract the tables from the queries
+			local tokens = assert(tokenizer.tokenize(cmd.query))
 			tables = parser.get_tables(tokens)
 	
 			for table, qtype in pairs(tables) do
-				if not proxy.global.tables[table] then
-					proxy.global.tables[table] = {
-						reads = 0,
-						writes = 0
-					}
-				end
-	
 				if qtype == "read" then
-					proxy.global.tables[table].reads = proxy.global.tables[table].reads + 1
+					proxy.global.stats:inc(READS_PREFIX .. table)
 				else
-					proxy.global.tables[table].writes = proxy.global.tables[table].writes + 1
+					proxy.global.stats:inc(WRITES_PREFIX .. table)
 				end
 			end
 		end
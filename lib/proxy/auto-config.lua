@@ -80,6 +80,20 @@ local function tbl2str(tbl, indent)
 	return s
 end
 
+---
+-- get the options of a module as a plain table
+--
+-- in the proxy the modules of proxy.global.config keep their options in
+-- proxy.global.kv and return a copy of them when called
+local function module_options(options)
+	local mt = getmetatable(options)
+
+	if mt and mt.__call then
+		return options()
+	end
+
+	return options
+end
 
 ---
 -- turn a string into a case-insensitive lpeg-pattern
@@ -193,7 +207,7 @@ function handle(tbl, cmd)
 		local rows = { }
 
 		for mod, options in pairs(tbl) do
-			for option, val in pairs(options) do
+			for option, val in pairs(module_options(options)) do
 				rows[#rows + 1] = { mod, option, tostring(val), type(val) }
 			end
 		end
@@ -252,7 +266,13 @@ function handle(tbl, cmd)
 end
 
 function save(tbl, filename)
-	local content = "return {\n" .. tbl2str(tbl, "  ") .. "}"
+	local options = { }
+
+	for mod, mod_options in pairs(tbl) do
+		options[mod] = module_options(mod_options)
+	end
+
+	local content = "return {\n" .. tbl2str(options, "  ") .. "}"
 
 	local file, errmsg = io.open(filename, "w")
 
@@ -30,6 +30,7 @@ function idle_failsafe_rw()
 		
 		if conns.cur_idle_connections > 0 and 
 		   s.state ~= proxy.BACKEND_STATE_DOWN and 
+		   not s.drained and 
 		   s.type == proxy.BACKEND_TYPE_RW then
 			backend_ndx = i
 			break
@@ -39,17 +40,24 @@ function idle_failsafe_rw()
 	return backend_ndx
 end
 
-function idle_ro() 
+---
+-- pick the slave with the fewest clients that has idling connections
+--
+-- @param max_lag skip slaves that are more seconds behind their master (optional)
+function idle_ro(max_lag) 
 	local max_conns = -1
 	local max_conns_ndx = 0
 
 	for i = 1, #proxy.global.backends do
 		local s = proxy.global.backends[i]
 		local conns = s.pool.users[proxy.connection.client.username]
+		local lag = s.replication_lag
 
 		-- pick a slave which has some idling connections
 		if s.type == proxy.BACKEND_TYPE_RO and 
 		   s.state ~= proxy.BACKEND_STATE_DOWN and 
+		   not s.drained and
+		   (not max_lag or not lag or lag <= max_lag) and
 		   conns.cur_idle_connections > 0 then
 			if max_conns == -1 or 
 			   s.connected_clients < max_conns then
@@ -109,6 +109,19 @@ function tokenize(packet)
 	return tokenizer.tokenize(packet)
 end
 
+---
+-- normalize a query and fingerprint it
+--
+-- same as normalize(tokenize(packet)), but done in C without creating
+-- the tokens in lua
+--
+-- @param packet a SQL query
+-- @return normalized SQL query
+-- @return 64bit hash of the normalized query as 16 hex-digits
+function fingerprint(packet)
+	return tokenizer.fingerprint(packet)
+end
+
 ---
 -- return the first command token
 --
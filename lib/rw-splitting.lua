@@ -28,7 +28,6 @@
 -- 
 
 local commands    = require("proxy.commands")
-local tokenizer   = require("proxy.tokenizer")
 local lb          = require("proxy.balance")
 local auto_config = require("proxy.auto-config")
 
@@ -40,6 +39,10 @@ if not proxy.global.config.rwsplit then
 		min_idle_connections = 4,
 		max_idle_connections = 8,
 
+		-- don't read from slaves that are more seconds behind the master, nil for no limit
+		-- needs --proxy-backend-check-user to learn the lag
+		max_replication_lag = nil,
+
 		is_debug = false
 	}
 end
@@ -90,8 +93,11 @@ function connect_server()
 			print("  [".. i .."].state = " .. s.state)
 		end
 
+		-- drained backends get no new clients
+		if s.drained then
+			-- skip it
 		-- prefer connections to the master 
-		if s.type == proxy.BACKEND_TYPE_RW and
+		elseif s.type == proxy.BACKEND_TYPE_RW and
 		   s.state ~= proxy.BACKEND_STATE_DOWN and
 		   cur_idle < pool.min_idle_connections then
 			proxy.connection.backend_ndx = i
@@ -172,9 +178,6 @@ function read_query( packet )
 	local r = auto_config.handle(cmd)
 	if r then return r end
 
-	local tokens
-	local norm_query
-
 	-- looks like we have to forward this statement to a backend
 	if is_debug then
 		print("[read_query] " .. proxy.connection.client.src.name)
@@ -220,48 +223,23 @@ function read_query( packet )
 	-- send all non-transactional SELECTs to a slave
 	if not is_in_transaction and
 	   cmd.type == proxy.COM_QUERY then
-		tokens     = tokens or assert(tokenizer.tokenize(cmd.query))
-
-		local stmt = tokenizer.first_stmt_token(tokens)
-
-		if stmt.token_name == "TK_SQL_SELECT" then
-			is_in_select_calc_found_rows = false
-			local is_insert_id = false
-
-			for i = 1, #tokens do
-				local token = tokens[i]
-				-- SQL_CALC_FOUND_ROWS + FOUND_ROWS() have to be executed 
-				-- on the same connection
-				-- print("token: " .. token.token_name)
-				-- print("  val: " .. token.text)
-				
-				if not is_in_select_calc_found_rows and token.token_name == "TK_SQL_SQL_CALC_FOUND_ROWS" then
-					is_in_select_calc_found_rows = true
-				elseif not is_insert_id and token.token_name == "TK_LITERAL" then
-					local utext = token.text:upper()
-
-					if utext == "LAST_INSERT_ID" or
-					   utext == "@@INSERT_ID" then
-						is_insert_id = true
-					end
-				end
+		local stmt, is_for_update, is_calc_found_rows, is_insert_id = proxy.classify(packet)
 
-				-- we found the two special token, we can't find more
-				if is_insert_id and is_in_select_calc_found_rows then
-					break
-				end
-			end
+		if stmt == proxy.STMT_SELECT then
+			-- SQL_CALC_FOUND_ROWS + FOUND_ROWS() have to be executed 
+			-- on the same connection
+			is_in_select_calc_found_rows = is_calc_found_rows
 
 			-- if we ask for the last-insert-id we have to ask it on the original 
-			-- connection
-			if not is_insert_id then
-				local backend_ndx = lb.idle_ro()
+			-- connection, a locking read has to go to the master
+			if is_insert_id then
+				print("   found a SELECT LAST_INSERT_ID(), staying on the same backend")
+			elseif not is_for_update then
+				local backend_ndx = lb.idle_ro(proxy.global.config.rwsplit.max_replication_lag)
 
 				if backend_ndx > 0 then
 					proxy.connection.backend_ndx = backend_ndx
 				end
-			else
-				print("   found a SELECT LAST_INSERT_ID(), staying on the same backend")
 			end
 		end
 	end
@@ -0,0 +1,206 @@
+/* $%BEGINLICENSE%$
+ Copyright (c) 2008, 2012, Oracle and/or its affiliates. All rights reserved.
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License as
+ published by the Free Software Foundation; version 2 of the
+ License.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ 02110-1301  USA
+
+ $%ENDLICENSE%$ */
+
+/**
+ * a arena for the tokens of a query
+ *
+ * sql_tokenizer() allocates a sql_token, a GString and its buffer for each token.
+ * The arena hands out the same memory from a few large blocks instead and frees
+ * them all at once.
+ *
+ * a freed arena is kept by the thread and handed out again by the next
+ * sql_tokens_arena_new(), in the steady state tokenizing doesn't call malloc() at all.
+ */
+
+#include <string.h>
+
+#include "sql-tokenizer.h"
+
+/**
+ * size of the first block of a arena
+ */
+#define SQL_TOKENS_ARENA_BLOCK_SIZE (8 * 1024)
+
+/**
+ * larger arenas are freed instead of kept for the next query
+ */
+#define SQL_TOKENS_ARENA_CACHE_MAX_SIZE (1 * 1024 * 1024)
+
+#define SQL_TOKENS_ARENA_ALIGN(p) \
+	((gchar *)((GPOINTER_TO_SIZE(p) + G_MEM_ALIGN - 1) & ~((gsize)G_MEM_ALIGN - 1)))
+
+/**
+ * a sql_token and its GString in one allocation
+ */
+typedef struct {
+	sql_token token;
+	GString text;
+} sql_tokens_arena_token;
+
+/**
+ * the per-thread cache of a free arena
+ */
+typedef struct {
+	sql_tokens_arena *arena;
+} sql_tokens_arena_cache;
+
+static GStaticPrivate sql_tokens_arena_cache_key = G_STATIC_PRIVATE_INIT;
+
+static void sql_tokens_arena_destroy(sql_tokens_arena *arena) {
+	guint i;
+
+	for (i = 0; i < arena->blocks->len; i++) {
+		g_free(arena->blocks->pdata[i]);
+	}
+	g_ptr_array_free(arena->blocks, TRUE);
+	g_ptr_array_free(arena->tokens, TRUE);
+
+	g_free(arena);
+}
+
+static void sql_tokens_arena_cache_free(gpointer _cache) {
+	sql_tokens_arena_cache *cache = _cache;
+
+	if (cache->arena) sql_tokens_arena_destroy(cache->arena);
+
+	g_free(cache);
+}
+
+sql_tokens_arena *sql_tokens_arena_new(void) {
+	sql_tokens_arena_cache *cache;
+	sql_tokens_arena *arena;
+
+	if (NULL != (cache = g_static_private_get(&sql_tokens_arena_cache_key)) &&
+	    NULL != cache->arena) {
+		arena = cache->arena;
+		cache->arena = NULL;
+
+		return arena;
+	}
+
+	arena = g_new0(sql_tokens_arena, 1);
+	arena->tokens = g_ptr_array_new();
+	arena->blocks = g_ptr_array_new();
+
+	return arena;
+}
+
+void sql_tokens_arena_free(sql_tokens_arena *arena) {
+	sql_tokens_arena_cache *cache;
+
+	if (!arena) return;
+
+	if (NULL == (cache = g_static_private_get(&sql_tokens_arena_cache_key))) {
+		cache = g_new0(sql_tokens_arena_cache, 1);
+		g_static_private_set(&sql_tokens_arena_cache_key, cache, sql_tokens_arena_cache_free);
+	}
+
+	if (NULL == cache->arena && arena->size <= SQL_TOKENS_ARENA_CACHE_MAX_SIZE) {
+		sql_tokens_arena_reset(arena);
+		cache->arena = arena;
+
+		return;
+	}
+
+	sql_tokens_arena_destroy(arena);
+}
+
+void sql_tokens_arena_reset(sql_tokens_arena *arena) {
+	g_ptr_array_set_size(arena->tokens, 0);
+
+	if (arena->blocks->len > 1) {
+		/* the last query needed all the blocks, make it one block for the next one */
+		guint i;
+
+		for (i = 0; i < arena->blocks->len; i++) {
+			g_free(arena->blocks->pdata[i]);
+		}
+		g_ptr_array_set_size(arena->blocks, 0);
+		g_ptr_array_add(arena->blocks, g_malloc(arena->size));
+	}
+
+	if (arena->blocks->len > 0) {
+		arena->cur = arena->blocks->pdata[0];
+		arena->end = arena->cur + arena->size;
+	}
+}
+
+gpointer sql_tokens_arena_alloc(sql_tokens_arena *arena, gsize size) {
+	gchar *p = NULL;
+
+	if (NULL != arena->cur) {
+		p = SQL_TOKENS_ARENA_ALIGN(arena->cur);
+
+		if (p > arena->end || (gsize)(arena->end - p) < size) p = NULL;
+	}
+
+	if (NULL == p) {
+		/* double the size of the arena with each new block */
+		gsize block_size = MAX(SQL_TOKENS_ARENA_BLOCK_SIZE, MAX(arena->size, size));
+
+		p = g_malloc(block_size);
+		g_ptr_array_add(arena->blocks, p);
+		arena->size += block_size;
+		arena->end = p + block_size;
+	}
+
+	arena->cur = p + size;
+
+	return p;
+}
+
+sql_token *sql_tokens_arena_token_new(sql_tokens_arena *arena, sql_token_id token_id, const gchar *text, gsize text_len) {
+	sql_tokens_arena_token *tk;
+
+	tk = sql_tokens_arena_alloc(arena, sizeof(*tk));
+
+	/* the text follows right after the token */
+	tk->text.str = sql_tokens_arena_alloc(arena, text_len + 1);
+	tk->text.len = text_len;
+	tk->text.allocated_len = text_len + 1;
+	memcpy(tk->text.str, text, text_len);
+	tk->text.str[text_len] = '\0';
+
+	tk->token.token_id = token_id;
+	tk->token.text = &(tk->text);
+
+	return &(tk->token);
+}
+
+void sql_tokens_arena_token_append(sql_tokens_arena *arena, sql_token *token, const gchar *text, gsize text_len) {
+	GString *s = token->text;
+
+	if (s->str + s->allocated_len == arena->cur &&
+	    (gsize)(arena->end - arena->cur) >= text_len) {
+		/* the text is the last thing in the block, grow it in place */
+		arena->cur += text_len;
+		s->allocated_len += text_len;
+	} else {
+		gchar *str = sql_tokens_arena_alloc(arena, s->len + text_len + 1);
+
+		memcpy(str, s->str, s->len);
+		s->str = str;
+		s->allocated_len = s->len + text_len + 1;
+	}
+
+	memcpy(s->str + s->len, text, text_len);
+	s->len += text_len;
+	s->str[s->len] = '\0';
+}
@@ -24,43 +24,192 @@
 
 #include "sql-tokenizer.h"
 
-gboolean trav(gpointer _a, gpointer _b, gpointer _udata) {
-	gboolean *is_first = _udata;
-	const char *key = _a;
-	gint value = GPOINTER_TO_INT(_b);
-
-	if (!*is_first) {
-		printf(",");
-	}
-	printf("\n\t%d /* %s */", value, key);
-
-	*is_first = FALSE;
-	return FALSE;
+/**
+ * generate the keyword table of the tokenizer
+ *
+ * the keywords are stored in a minimal perfect hash (hash and displace):
+ *
+ * - all keywords are hashed with seed 0 into (n + 1) / 2 buckets
+ * - starting with the biggest bucket, search a seed (the displacement) that maps all
+ *   keywords of the bucket to free slots of the keyword table of size n
+ *
+ * looking up a name is:
+ *
+ *   slot = hash(name, displacements[hash(name, 0) % buckets]) % n
+ *
+ * and a single compare against the keyword in that slot.
+ *
+ * @see sql_token_get_id_len()
+ */
+
+#define MAX_DISPLACEMENT (1 << 24)
+
+typedef struct {
+	gchar *name;       /* the lower-cased keyword */
+	gsize name_len;
+	gint token_id;
+} keyword;
+
+typedef struct {
+	GPtrArray *keywords; /* array(keyword) */
+	guint ndx;
+} bucket;
+
+static gint bucket_cmp(gconstpointer _a, gconstpointer _b) {
+	const bucket *a = *(const bucket **)_a;
+	const bucket *b = *(const bucket **)_b;
+
+	/* biggest buckets first, keep the order stable */
+	if (a->keywords->len != b->keywords->len) return (gint)b->keywords->len - (gint)a->keywords->len;
+
+	return (gint)a->ndx - (gint)b->ndx;
 }
 
 int main() {
-	GTree *tokens;
-	gboolean is_first = TRUE;
-	gint i;
+	GPtrArray *keywords;
+	GPtrArray *buckets, *sorted_buckets;
+	keyword **slots;
+	guint32 *displacements;
+	guint n_buckets;
+	gsize max_len = 0;
+	guint i, j;
+	gint token_id;
 
-	tokens = g_tree_new((GCompareFunc)g_ascii_strcasecmp);
+	keywords = g_ptr_array_new();
+
+	for (token_id = 0; token_id < sql_token_get_last_id(); token_id++) {
+		const char *name = sql_token_get_name(token_id, NULL);
+		keyword *kw;
 
-	for (i = 0; i < sql_token_get_last_id(); i++) {
 		/** only tokens with TK_SQL_* are keyworks */
-		if (0 != strncmp(sql_token_get_name(i, NULL), "TK_SQL_", sizeof("TK_SQL_") - 1)) continue;
+		if (0 != strncmp(name, "TK_SQL_", sizeof("TK_SQL_") - 1)) continue;
+
+		kw = g_new0(keyword, 1);
+		kw->name = g_ascii_strdown(name + sizeof("TK_SQL_") - 1, -1);
+		kw->name_len = strlen(kw->name);
+		kw->token_id = token_id;
+
+		if (kw->name_len > max_len) max_len = kw->name_len;
+
+		g_ptr_array_add(keywords, kw);
+	}
+
+	/* spread the keywords over the buckets */
+	n_buckets = (keywords->len + 1) / 2;
+	buckets = g_ptr_array_new();
+	sorted_buckets = g_ptr_array_new();
+
+	for (i = 0; i < n_buckets; i++) {
+		bucket *b = g_new0(bucket, 1);
+
+		b->keywords = g_ptr_array_new();
+		b->ndx = i;
 
-		g_tree_insert(tokens, (sql_token_get_name(i, NULL) + sizeof("TK_SQL_") - 1), GINT_TO_POINTER(i));
+		g_ptr_array_add(buckets, b);
+		g_ptr_array_add(sorted_buckets, b);
 	}
 
-	/* traverse the tree and output all keywords in a sorted way */
-	printf("static int sql_keywords[] = {");
-	g_tree_foreach(tokens, trav, &is_first);
-	printf("\n};\n");
+	for (i = 0; i < keywords->len; i++) {
+		keyword *kw = keywords->pdata[i];
+		bucket *b = buckets->pdata[sql_token_hash((unsigned char *)kw->name, kw->name_len, 0) % n_buckets];
+
+		g_ptr_array_add(b->keywords, kw);
+	}
+
+	g_ptr_array_sort(sorted_buckets, bucket_cmp);
+
+	/* find a displacement for each bucket */
+	slots = g_new0(keyword *, keywords->len);
+	displacements = g_new0(guint32, n_buckets);
+
+	for (i = 0; i < sorted_buckets->len; i++) {
+		bucket *b = sorted_buckets->pdata[i];
+		guint32 d;
+
+		if (b->keywords->len == 0) continue;
+
+		for (d = 1; d < MAX_DISPLACEMENT; d++) {
+			gboolean is_free = TRUE;
+
+			for (j = 0; is_free && j < b->keywords->len; j++) {
+				keyword *kw = b->keywords->pdata[j];
+				guint slot = sql_token_hash((unsigned char *)kw->name, kw->name_len, d) % keywords->len;
+				guint k;
+
+				if (slots[slot]) is_free = FALSE;
+
+				/* two keywords of the same bucket may not collide either */
+				for (k = 0; is_free && k < j; k++) {
+					keyword *other = b->keywords->pdata[k];
 
-	printf("int *sql_keywords_get() { return sql_keywords; }\n");
-	printf("int sql_keywords_get_count() { return sizeof(sql_keywords) / sizeof(sql_keywords[0]); }\n");
+					if (slot == sql_token_hash((unsigned char *)other->name, other->name_len, d) % keywords->len) is_free = FALSE;
+				}
+			}
 
-	g_tree_destroy(tokens);
+			if (is_free) break;
+		}
+
+		if (d == MAX_DISPLACEMENT) {
+			fprintf(stderr, "%s: no displacement found for bucket %u\n", G_STRLOC, b->ndx);
+			return EXIT_FAILURE;
+		}
+
+		for (j = 0; j < b->keywords->len; j++) {
+			keyword *kw = b->keywords->pdata[j];
+
+			slots[sql_token_hash((unsigned char *)kw->name, kw->name_len, d) % keywords->len] = kw;
+		}
+
+		displacements[b->ndx] = d;
+	}
+
+	printf("/* generated by sql-tokenizer-gen, don't edit */\n");
+	printf("#include \"sql-tokenizer.h\"\n");
+	printf("#include \"sql-tokenizer-keywords.h\"\n\n");
+
+	printf("const sql_keyword sql_keywords[] = {");
+	for (i = 0; i < keywords->len; i++) {
+		keyword *kw = slots[i];
+
+		printf("%s\n\t{ \"%s\", %"G_GSIZE_FORMAT", %d /* %s */ }", i == 0 ? "" : ",", kw->name, kw->name_len, kw->token_id, sql_token_get_name(kw->token_id, NULL));
+	}
+	printf("\n};\n\n");
+
+	printf("const guint32 sql_keywords_displacements[] = {");
+	for (i = 0; i < n_buckets; i++) {
+		printf("%s%s%u", i == 0 ? "" : ",", i % 8 == 0 ? "\n\t" : " ", displacements[i]);
+	}
+	printf("\n};\n\n");
+
+	/* case-folding table, the input is folded before it is hashed and compared */
+	printf("const unsigned char sql_keywords_fold[256] = {");
+	for (i = 0; i < 256; i++) {
+		printf("%s%s0x%02x", i == 0 ? "" : ",", i % 8 == 0 ? "\n\t" : " ", (unsigned char)g_ascii_tolower(i));
+	}
+	printf("\n};\n\n");
+
+	printf("const guint sql_keywords_count = %u;\n", keywords->len);
+	printf("const guint sql_keywords_displacements_count = %u;\n", n_buckets);
+	printf("const gsize sql_keywords_max_len = %"G_GSIZE_FORMAT";\n", max_len);
+
+	for (i = 0; i < buckets->len; i++) {
+		bucket *b = buckets->pdata[i];
+
+		g_ptr_array_free(b->keywords, TRUE);
+		g_free(b);
+	}
+	g_ptr_array_free(buckets, TRUE);
+	g_ptr_array_free(sorted_buckets, TRUE);
+
+	for (i = 0; i < keywords->len; i++) {
+		keyword *kw = keywords->pdata[i];
+
+		g_free(kw->name);
+		g_free(kw);
+	}
+	g_ptr_array_free(keywords, TRUE);
+	g_free(slots);
+	g_free(displacements);
 
 	return 0;
 }
@@ -20,7 +20,27 @@
 #ifndef __SQL_TOKENIZER_KEYWORDS_H__
 #define __SQL_TOKENIZER_KEYWORDS_H__
 
-int *sql_keywords_get(void);
-int sql_keywords_get_count(void);
+#include <glib.h>
+
+/**
+ * the keywords of the tokenizer in a minimal perfect hash
+ *
+ * generated by sql-tokenizer-gen into sql-tokenizer-keywords.c
+ *
+ * @see sql_token_get_id_len()
+ */
+typedef struct {
+	const char *name;   /**< lower-case keyword */
+	gsize name_len;
+	int token_id;
+} sql_keyword;
+
+extern const sql_keyword sql_keywords[];                /**< sql_keywords_count slots, all used */
+extern const guint32 sql_keywords_displacements[];      /**< seeds of the buckets */
+extern const unsigned char sql_keywords_fold[256];      /**< maps a byte to its lower-case */
+
+extern const guint sql_keywords_count;
+extern const guint sql_keywords_displacements_count;
+extern const gsize sql_keywords_max_len;
 
 #endif
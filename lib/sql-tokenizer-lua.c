@@ -63,7 +63,8 @@ int sql_tokenizer_lua_token_getmetatable(lua_State *L) {
  *
  */
 static int proxy_tokenize_get(lua_State *L) {
-	GPtrArray *tokens = *(GPtrArray **)luaL_checkself(L); 
+	sql_tokens_arena *arena = *(sql_tokens_arena **)luaL_checkself(L); 
+	GPtrArray *tokens = arena->tokens;
 	int ndx = luaL_checkinteger(L, 2);
 	sql_token *token;
 	sql_token **token_p;
@@ -96,12 +97,13 @@ static int proxy_tokenize_get(lua_State *L) {
 /**
  * a settor for the tokens
  *
- * only allow to unset a token in the tokens array to free its memory
+ * only allow to unset a token in the tokens array. Its memory belongs to the
+ * arena and is freed with the whole array.
  */
 static int proxy_tokenize_set(lua_State *L) {
-	GPtrArray *tokens = *(GPtrArray **)luaL_checkself(L); 
+	sql_tokens_arena *arena = *(sql_tokens_arena **)luaL_checkself(L); 
+	GPtrArray *tokens = arena->tokens;
 	int ndx = luaL_checkinteger(L, 2);
-	sql_token *token;
 
 	luaL_checktype(L, 3, LUA_TNIL); /* for now we can only use = nil */
 
@@ -114,28 +116,24 @@ static int proxy_tokenize_set(lua_State *L) {
 		return 0;
 	}
 
-	token = tokens->pdata[ndx - 1];
-	if (NULL != token) {
-		sql_token_free(token);
-		tokens->pdata[ndx - 1] = NULL;
-	}
+	tokens->pdata[ndx - 1] = NULL;
 
 	return 0;
 }
 
 
 static int proxy_tokenize_len(lua_State *L) {
-	GPtrArray *tokens = *(GPtrArray **)luaL_checkself(L); 
+	sql_tokens_arena *arena = *(sql_tokens_arena **)luaL_checkself(L); 
 
-	lua_pushinteger(L, tokens->len);
+	lua_pushinteger(L, arena->tokens->len);
 
 	return 1;
 }
 
 static int proxy_tokenize_gc(lua_State *L) {
-	GPtrArray *tokens = *(GPtrArray **)luaL_checkself(L); 
+	sql_tokens_arena *arena = *(sql_tokens_arena **)luaL_checkself(L); 
 
-	sql_tokens_free(tokens);
+	sql_tokens_arena_free(arena);
 
 	return 0;
 }
@@ -158,13 +156,13 @@ static int sql_tokenizer_lua_getmetatable(lua_State *L) {
 int proxy_tokenize(lua_State *L) {
 	size_t str_len;
 	const char *str = luaL_checklstring(L, 1, &str_len);
-	GPtrArray *tokens = sql_tokens_new();
-	GPtrArray **tokens_p;
+	sql_tokens_arena *arena = sql_tokens_arena_new();
+	sql_tokens_arena **arena_p;
 
-	sql_tokenizer(tokens, str, str_len);
+	sql_tokenizer_arena(arena, str, str_len);
 
-	tokens_p = lua_newuserdata(L, sizeof(tokens));                          /* (sp += 1) */
-	*tokens_p = tokens;
+	arena_p = lua_newuserdata(L, sizeof(arena));                          /* (sp += 1) */
+	*arena_p = arena;
 
 	sql_tokenizer_lua_getmetatable(L);
 	lua_setmetatable(L, -2);          /* tie the metatable to the udata   (sp -= 1) */
@@ -172,6 +170,36 @@ int proxy_tokenize(lua_State *L) {
 	return 1;
 }
 
+/**
+ * normalize a SQL query and fingerprint it
+ *
+ *   local norm, fp = tokenizer.fingerprint(query)
+ *
+ * the fingerprint is a 64bit hash and returned as 16 hex-digits as a lua-number
+ * can't hold it.
+ */
+static int proxy_fingerprint(lua_State *L) {
+	size_t str_len;
+	const char *str = luaL_checklstring(L, 1, &str_len);
+	GString *norm = g_string_sized_new(str_len + 16);
+	guint64 fingerprint = 0;
+	char fingerprint_hex[17];
+
+	if (0 != sql_tokenizer_fingerprint(str, str_len, norm, &fingerprint)) {
+		g_string_free(norm, TRUE);
+		return luaL_error(L, "tokenizer.fingerprint() failed to tokenize the query");
+	}
+
+	g_snprintf(fingerprint_hex, sizeof(fingerprint_hex), "%016"G_GINT64_MODIFIER"x", fingerprint);
+
+	lua_pushlstring(L, S(norm));
+	lua_pushlstring(L, fingerprint_hex, 16);
+
+	g_string_free(norm, TRUE);
+
+	return 2;
+}
+
 /*
 ** Assumes the table is on top of the stack.
 */
@@ -190,6 +218,7 @@ static void set_info (lua_State *L) {
 
 static const struct luaL_reg mysql_tokenizerlib[] = {
 	{"tokenize", proxy_tokenize},
+	{"fingerprint", proxy_fingerprint},
 	{NULL, NULL},
 };
 
@@ -0,0 +1,203 @@
+/* $%BEGINLICENSE%$
+ Copyright (c) 2008, 2012, Oracle and/or its affiliates. All rights reserved.
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License as
+ published by the Free Software Foundation; version 2 of the
+ License.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ 02110-1301  USA
+
+ $%ENDLICENSE%$ */
+
+/**
+ * normalize a query and fingerprint it
+ *
+ * the rules are the same as normalize() in lib/proxy/tokenizer.lua, a query
+ * normalized here and one normalized in lua result in the same string.
+ */
+
+#include <string.h>
+
+#include "sql-tokenizer.h"
+
+#define C(x) x, sizeof(x) - 1
+
+/**
+ * append a string in upper-case
+ */
+static void g_string_append_upper_len(GString *dst, const gchar *str, gsize len) {
+	gsize i;
+
+	for (i = 0; i < len; i++) {
+		g_string_append_c(dst, g_ascii_toupper(str[i]));
+	}
+}
+
+/**
+ * check if a literal is one of the statements the tokenizer doesn't know as keyword
+ *
+ * COMMIT, ROLLBACK, BEGIN and START are only SQL commands if they start the query
+ */
+static gboolean sql_token_is_literal_keyword(GString *text) {
+	return (0 == g_ascii_strcasecmp(text->str, "COMMIT") ||
+		0 == g_ascii_strcasecmp(text->str, "ROLLBACK") ||
+		0 == g_ascii_strcasecmp(text->str, "BEGIN") ||
+		0 == g_ascii_strcasecmp(text->str, "START"));
+}
+
+#define FNV_OFFSET_BASIS G_GUINT64_CONSTANT(14695981039346656037)
+#define FNV_PRIME        G_GUINT64_CONSTANT(1099511628211)
+
+/**
+ * start normalizing into dst
+ *
+ * @param normalizer  state to initialize
+ * @param dst         the normalized query is appended to it
+ */
+void sql_tokens_normalizer_init(sql_tokens_normalizer *normalizer, GString *dst) {
+	normalizer->dst = dst;
+	normalizer->start_offset = dst->len;
+	normalizer->first_len = 0;
+	normalizer->parts = 0;
+
+	normalizer->hash = FNV_OFFSET_BASIS;
+	normalizer->hashed_len = dst->len;
+}
+
+/**
+ * normalize one token
+ *
+ * - remove comments
+ * - quote literals
+ * - turn constants into ?
+ * - turn tokens into uppercase
+ *
+ * the bytes appended to dst are added to the hash right away
+ *
+ * @param normalizer  state of the normalized query
+ * @param token       the next token of the query
+ */
+void sql_tokens_normalizer_add(sql_tokens_normalizer *normalizer, sql_token *token) {
+	GString *dst = normalizer->dst;
+	gsize i;
+
+	switch (token->token_id) {
+	case TK_COMMENT:
+		return;
+	case TK_COMMENT_MYSQL:
+		/* we can't look into the comment as we don't know which server-version
+		 * we will talk to, pass it on verbatimly */
+		g_string_append_len(dst, C("/*!"));
+		g_string_append_len(dst, token->text->str, token->text->len);
+		g_string_append_len(dst, C("*/ "));
+		break;
+	case TK_LITERAL:
+		if (token->text->len > 0 && token->text->str[0] == '@') {
+			/* session variables as is */
+			g_string_append_len(dst, token->text->str, token->text->len);
+			g_string_append_c(dst, ' ');
+		} else if (normalizer->parts == 0 && sql_token_is_literal_keyword(token->text)) {
+			g_string_append_upper_len(dst, token->text->str, token->text->len);
+			g_string_append_c(dst, ' ');
+		} else if (normalizer->parts == 1 &&
+				normalizer->first_len == sizeof("START ") - 1 &&
+				0 == memcmp(dst->str + normalizer->start_offset, C("START ")) &&
+				0 == g_ascii_strcasecmp(token->text->str, "TRANSACTION")) {
+			g_string_append_len(dst, C("TRANSACTION "));
+		} else {
+			g_string_append_c(dst, '`');
+			g_string_append_len(dst, token->text->str, token->text->len);
+			g_string_append_len(dst, C("` "));
+		}
+		break;
+	case TK_STRING:
+	case TK_INTEGER:
+	case TK_FLOAT:
+		g_string_append_len(dst, C("? "));
+		break;
+	case TK_FUNCTION:
+		g_string_append_upper_len(dst, token->text->str, token->text->len);
+		break;
+	default:
+		g_string_append_upper_len(dst, token->text->str, token->text->len);
+		g_string_append_c(dst, ' ');
+		break;
+	}
+
+	if (normalizer->parts == 0) normalizer->first_len = dst->len - normalizer->start_offset;
+	normalizer->parts++;
+
+	for (i = normalizer->hashed_len; i < dst->len; i++) {
+		normalizer->hash ^= (guchar)dst->str[i];
+		normalizer->hash *= FNV_PRIME;
+	}
+	normalizer->hashed_len = dst->len;
+}
+
+/**
+ * normalize a token stream
+ *
+ * @param tokens  tokens as created by sql_tokenizer()
+ * @param dst     the normalized query is appended to it
+ * @see sql_tokens_normalizer_add()
+ */
+void sql_tokens_normalize(GPtrArray *tokens, GString *dst) {
+	sql_tokens_normalizer normalizer;
+	guint i;
+
+	sql_tokens_normalizer_init(&normalizer, dst);
+
+	for (i = 0; i < tokens->len; i++) {
+		sql_tokens_normalizer_add(&normalizer, tokens->pdata[i]);
+	}
+}
+
+/**
+ * hash a normalized query
+ *
+ * FNV-1a, 64bit. The value only depends on the bytes of the string and is
+ * stable across runs and platforms.
+ */
+guint64 sql_fingerprint_hash(const gchar *str, gsize len) {
+	guint64 h = FNV_OFFSET_BASIS;
+	gsize i;
+
+	for (i = 0; i < len; i++) {
+		h ^= (guchar)str[i];
+		h *= FNV_PRIME;
+	}
+
+	return h;
+}
+
+/**
+ * normalize a query and get its fingerprint
+ *
+ * the tokens are folded into norm and hashed while the query is scanned
+ *
+ * @param str          SQL string to normalize
+ * @param len          length of str
+ * @param norm         the normalized query is appended to it
+ * @param fingerprint  (out) hash of the normalized query
+ * @return 0 on success
+ */
+int sql_tokenizer_fingerprint(const gchar *str, gsize len, GString *norm, guint64 *fingerprint) {
+	sql_tokens_normalizer normalizer;
+	int ret;
+
+	sql_tokens_normalizer_init(&normalizer, norm);
+
+	ret = sql_tokenizer_normalize(&normalizer, str, len);
+	if (0 == ret && fingerprint) *fingerprint = normalizer.hash;
+
+	return ret;
+}
@@ -318,6 +318,24 @@ const gchar *sql_token_get_name(sql_token_id token_id, size_t *name_len) {
 	return token_names[token_id].token;
 }
 
+/**
+ * hash a case-folded keyword
+ *
+ * FNV-1a, seeded. Used by sql-tokenizer-gen to build the perfect hash of the keywords
+ * and by sql_token_get_id_len() to look them up, both sides have to agree on it.
+ */
+guint32 sql_token_hash(const unsigned char *name, size_t name_len, guint32 seed) {
+	guint32 h = 2166136261U ^ seed;
+	size_t i;
+
+	for (i = 0; i < name_len; i++) {
+		h ^= name[i];
+		h *= 16777619U;
+	}
+
+	return h;
+}
+
 int sql_token_get_last_id() {
 	return (sizeof(token_names)/sizeof(token_names[0])) - 1; /* the last one is not a token */
 }
@@ -321,6 +321,40 @@ typedef struct {
 	GString *text;
 } sql_token;
 
+/**
+ * a token list that keeps its tokens in one reusable chunk of memory
+ *
+ * the sql_token, its GString and the text are carved one after the other
+ * out of the blocks. After a reset the blocks are merged into one, the next
+ * query of the same size fits into a single block without calling malloc().
+ *
+ * the text of the tokens can't be modified with the g_string_*() functions.
+ */
+typedef struct {
+	GPtrArray *tokens; /**< array(sql_token *), pointing into the blocks */
+
+	GPtrArray *blocks; /**< array(gchar *), the last one is the current block */
+	gsize size;        /**< size of all blocks together */
+	gchar *cur;        /**< next free byte in the current block */
+	gchar *end;        /**< end of the current block */
+} sql_tokens_arena;
+
+/**
+ * the state of normalizing a token stream one token at a time
+ *
+ * the normalized query is hashed while it is appended, the fingerprint is
+ * ready when the last token is added.
+ */
+typedef struct {
+	GString *dst;        /**< the normalized query is appended to it */
+	gsize start_offset;  /**< length of dst before we started */
+	gsize first_len;     /**< length of the first part, to look for START TRANSACTION */
+	guint parts;         /**< tokens added so far, without the comments */
+
+	guint64 hash;        /**< FNV-1a of dst from start_offset up to hashed_len */
+	gsize hashed_len;
+} sql_tokens_normalizer;
+
 /** @defgroup sql SQL Tokenizer
  * 
  * SQL tokenizer
@@ -405,8 +439,117 @@ GPtrArray * sql_tokens_new(void);
  */
 void sql_tokens_free(GPtrArray *tokens);
 
+/**
+ * get a token arena
+ *
+ * each thread keeps one freed arena around and hands it out again
+ *
+ * @return a empty token arena
+ */
+sql_tokens_arena *sql_tokens_arena_new(void);
+
+/**
+ * free a token arena and all its tokens
+ *
+ * the arena is kept for reuse by the current thread if it has none yet
+ */
+void sql_tokens_arena_free(sql_tokens_arena *arena);
+
+/**
+ * drop all tokens and merge the blocks into one
+ */
+void sql_tokens_arena_reset(sql_tokens_arena *arena);
+
+/**
+ * get memory from the arena
+ *
+ * @internal       used by the tokenizer
+ */
+gpointer sql_tokens_arena_alloc(sql_tokens_arena *arena, gsize size);
+
+/**
+ * create a token in the arena
+ *
+ * @internal       used by the tokenizer
+ */
+sql_token *sql_tokens_arena_token_new(sql_tokens_arena *arena, sql_token_id token_id, const gchar *text, gsize text_len);
+
+/**
+ * append text to a token of the arena
+ *
+ * @internal       used by the tokenizer
+ */
+void sql_tokens_arena_token_append(sql_tokens_arena *arena, sql_token *token, const gchar *text, gsize text_len);
+
+/**
+ * scan a string into SQL tokens kept in a arena
+ *
+ * the arena is reset before, the tokens are in arena->tokens
+ *
+ * @param arena    a token arena
+ * @param str      SQL string to tokenize
+ * @param len      length of str
+ * @return 0 on success
+ */
+int sql_tokenizer_arena(sql_tokens_arena *arena, const gchar *str, gsize len);
+
 int sql_token_get_last_id();
 
+/**
+ * hash a case-folded keyword
+ *
+ * @internal       shared by sql-tokenizer-gen and the keyword lookup
+ */
+guint32 sql_token_hash(const unsigned char *name, size_t name_len, guint32 seed);
+
+/**
+ * normalize a token list
+ *
+ * same rules as normalize() in proxy/tokenizer.lua
+ *
+ * @param tokens   a token list as created by sql_tokenizer()
+ * @param dst      the normalized query is appended to it
+ */
+void sql_tokens_normalize(GPtrArray *tokens, GString *dst);
+
+/**
+ * start normalizing into dst
+ */
+void sql_tokens_normalizer_init(sql_tokens_normalizer *normalizer, GString *dst);
+
+/**
+ * normalize the next token and hash what it appended
+ */
+void sql_tokens_normalizer_add(sql_tokens_normalizer *normalizer, sql_token *token);
+
+/**
+ * scan a string and pass each token to the normalizer as soon as it is complete
+ *
+ * no token list is built, only the token that is still being scanned is kept
+ *
+ * @param normalizer  a initialized normalizer
+ * @param str         SQL string to tokenize
+ * @param len         length of str
+ * @return 0 on success
+ */
+int sql_tokenizer_normalize(sql_tokens_normalizer *normalizer, const gchar *str, gsize len);
+
+/**
+ * hash a normalized query (FNV-1a, 64bit)
+ */
+guint64 sql_fingerprint_hash(const gchar *str, gsize len);
+
+/**
+ * normalize a SQL string and hash it
+ *
+ * @param str          SQL string to normalize
+ * @param len          length of str
+ * @param norm         the normalized query is appended to it
+ * @param fingerprint  (out) hash of the normalized query, may be NULL
+ * @return 0 on success
+ */
+int sql_tokenizer_fingerprint(const gchar *str, gsize len, GString *norm, guint64 *fingerprint);
+
 /*@}*/
 
 #endif
@@ -484,14 +484,13 @@ NETWORK_MYSQLD_PLUGIN_PROTO(server_read_query) {
  */
 NETWORK_MYSQLD_PLUGIN_PROTO(admin_disconnect_client) {
 	network_mysqld_con_lua_t *st = con->plugin_con_state;
-	lua_scope  *sc = con->srv->priv->sc;
 
 	if (st == NULL) return NETWORK_SOCKET_SUCCESS;
 	
 #ifdef HAVE_LUA_H
 	/* remove this cached script from registry */
 	if (st->L_ref > 0) {
-		luaL_unref(sc->L, LUA_REGISTRYINDEX, st->L_ref);
+		luaL_unref(st->sc->L, LUA_REGISTRYINDEX, st->L_ref);
 	}
 #endif
 
@@ -604,6 +603,7 @@ static int network_mysqld_admin_plugin_apply_config(chassis *chas, chassis_plugi
 	config->listen_con = con;
 	
 	listen_sock = network_socket_new();
+	listen_sock->listen_backlog = chas->listen_backlog;
 	con->server = listen_sock;
 
 	/* set the plugin hooks as we want to apply them to the new connections too later */
@@ -130,7 +130,7 @@ int plugin_debug_con_handle_stmt(chassis *chas, network_mysqld_con *con, GString
 			network_mysqld_con_send_resultset(con->client, fields, rows);
 		} else {
 			MYSQL_FIELD *field = NULL;
-			lua_State *L = chas->priv->sc->L;
+			lua_State *L = network_mysqld_con_get_lua_scope(con)->L;
 
 			if (0 == luaL_loadstring(L, s->str + NET_HEADER_SIZE + 1) &&
 			    0 == lua_pcall(L, 0, 1, 0)) {
@@ -410,6 +410,7 @@ static int network_mysqld_debug_plugin_apply_config(chassis *chas, chassis_plugi
 	config->listen_con = con;
 	
 	listen_sock = network_socket_new();
+	listen_sock->listen_backlog = chas->listen_backlog;
 	con->server = listen_sock;
 
 	/* set the plugin hooks as we want to apply them to the new connections too later */
@@ -130,6 +130,7 @@ typedef int socklen_t;
 #include "network-mysqld.h"
 #include "network-mysqld-proto.h"
 #include "network-mysqld-packet.h"
+#include "network-mysqld-classify.h"
 
 #include "network-mysqld-lua.h"
 
@@ -140,6 +141,7 @@ typedef int socklen_t;
 #include "network-injection.h"
 #include "network-injection-lua.h"
 #include "network-backend.h"
+#include "network-backend-check.h"
 #include "glib-ext.h"
 #include "lua-env.h"
 
@@ -200,12 +202,70 @@ struct chassis_plugin_config {
 	gint start_proxy;
 
 	network_mysqld_con *listen_con;
+	GPtrArray *listen_cons;           /**< all listen-connections, one per event-thread with --listen-reuseport */
 
 	gdouble connect_timeout_dbl; /* exposed in the config as double */
 	gdouble read_timeout_dbl; /* exposed in the config as double */
 	gdouble write_timeout_dbl; /* exposed in the config as double */
+
+	gint client_compress;             /**< offer CLIENT_COMPRESS to the clients */
+	gint backend_compress;            /**< use the compressed protocol to the backends if they support it */
+	gint compress_min_length;         /**< frames smaller than this are sent uncompressed */
+
+	gint query_cache_size;            /**< size of the query-cache in MByte, 0 disables it */
+	gdouble query_cache_ttl_dbl;      /**< results expire after this many seconds */
+	network_query_cache *query_cache; /**< shared by all connections, NULL if it is disabled */
+
+	gint stmt_multiplexing;           /**< map the prepared statements of the clients to the pooled backend connections */
+
+	gint multiplex;                   /**< return the backend connections to the pool between transactions */
+	gdouble multiplex_wait_timeout_dbl; /**< a command waits this many seconds for a pooled connection if all are busy, 0 to fail at once */
+	GMutex *multiplex_parkings_mutex;
+	GPtrArray *multiplex_parkings;    /**< proxy_multiplex_parking *, one per event-thread that parked a command */
+
+	gdouble backend_check_interval_dbl; /**< health-check the backends every n seconds, 0 disables it */
+	gdouble backend_check_timeout_dbl;  /**< a health-check that takes longer failed */
+	gint backend_check_rise;          /**< successful checks to bring a DOWN backend UP */
+	gint backend_check_fall;          /**< failed checks to mark a backend DOWN */
+	gchar *backend_check_user;        /**< log in and COM_PING as this user, needed by the health-checks */
+	gchar *backend_check_password;
+	gchar *backend_check_lag_query;   /**< ask the read-only backends for their replication-lag, SHOW SLAVE STATUS by default, empty to not ask */
+	network_backends_checker_t *backend_checker; /**< NULL if the health-checks are disabled */
+
+	gchar **pool_warm_users;          /**< user[:password] the health-checker keeps idle connections of in the pools */
+	gint pool_min_idle;               /**< idle connections per backend and warm-user */
+	gint pool_max_idle_time;          /**< close pooled connections that idled longer, in seconds, 0 for no limit */
+
+	gchar *balance;                   /**< policy to pick a read-write backend: sqf, wrr, p2c, latency, hash-user or hash-schema */
+	gchar *read_only_balance;         /**< policy to pick a read-only backend in proxy.connection:balance() */
+	gint read_only_max_lag;           /**< proxy.connection:balance() skips read-only backends that lag more seconds, -1 for no limit */
 };
 
+/**
+ * convert a double into a timeval
+ */
+static gboolean
+timeval_from_double(struct timeval *dst, double t) {
+	g_return_val_if_fail(dst != NULL, FALSE);
+	g_return_val_if_fail(t >= 0, FALSE);
+
+	dst->tv_sec = floor(t);
+	dst->tv_usec = floor((t - dst->tv_sec) * 1000000);
+
+	return TRUE;
+}
+
+/**
+ * check if we use the compressed protocol to a backend
+ *
+ * @param server  the backend-side of the connection, with the challenge of the server
+ */
+static gboolean proxy_backend_compress(chassis_plugin_config *config, network_socket *server) {
+	return config->backend_compress &&
+		server->challenge &&
+		(server->challenge->capabilities & CLIENT_COMPRESS);
+}
+
 /**
  * handle event-timeouts on the different states
  *
@@ -522,6 +582,8 @@ NETWORK_MYSQLD_PLUGIN_PROTO(proxy_read_handshake) {
 	network_socket *recv_sock, *send_sock;
 	network_mysqld_auth_challenge *challenge;
 	GString *challenge_packet;
+	chassis_plugin_config *config = con->config;
+	guint32 server_capabilities;
 	guint8 status = 0;
 	int err = 0;
 
@@ -556,9 +618,18 @@ NETWORK_MYSQLD_PLUGIN_PROTO(proxy_read_handshake) {
 
  	con->server->challenge = challenge;
 
-	/* we can't sniff compressed packets nor do we support SSL */
-	challenge->capabilities &= ~(CLIENT_COMPRESS);
+	/* we don't support SSL
+	 *
+	 * compression is negotiated for each side on its own, the client gets 
+	 * CLIENT_COMPRESS if --proxy-client-compress is set. The server-side is
+	 * handled in proxy_read_auth() */
+	server_capabilities = challenge->capabilities;
 	challenge->capabilities &= ~(CLIENT_SSL);
+	if (config->client_compress) {
+		challenge->capabilities |= CLIENT_COMPRESS;
+	} else {
+		challenge->capabilities &= ~(CLIENT_COMPRESS);
+	}
 
 	switch (proxy_lua_read_handshake(con)) {
 	case PROXY_NO_DECISION:
@@ -587,6 +658,11 @@ NETWORK_MYSQLD_PLUGIN_PROTO(proxy_read_handshake) {
 	/* copy the pack to the client */
 	g_assert(con->client->challenge == NULL);
 	con->client->challenge = network_mysqld_auth_challenge_copy(challenge);
+	con->client->compress_min_length = config->compress_min_length;
+
+	/* remember if the server can compress */
+	challenge->capabilities &= ~(CLIENT_COMPRESS);
+	challenge->capabilities |= (server_capabilities & CLIENT_COMPRESS);
 	
 	con->state = CON_STATE_SEND_HANDSHAKE;
 
@@ -682,6 +758,213 @@ static network_mysqld_lua_stmt_ret proxy_lua_read_auth(network_mysqld_con *con)
 	return ret;
 }
 
+/**
+ * free the names of the system-variables a SET changes
+ */
+static void proxy_session_vars_clear(GPtrArray *vars) {
+	while (vars->len > 0) g_free(g_ptr_array_remove_index(vars, vars->len - 1));
+}
+
+/**
+ * set up the session-tracking after a successful auth
+ *
+ * the server-side tracks the session if the server and the client agreed on
+ * CLIENT_SESSION_TRACK in the handshake. A COM_CHANGE_USER resets the session.
+ * The client expects the session the server reported.
+ *
+ * @param packet  the OK packet of the auth
+ */
+static void proxy_session_track_auth_result(network_mysqld_con *con, GString *packet) {
+	network_socket *server = con->server;
+	network_socket *client = con->client;
+
+	if (server->is_authed) {
+		if (server->session) network_mysqld_session_clear(server->session);
+	} else if (server->challenge && server->response &&
+	           (server->challenge->capabilities & server->response->client_capabilities & CLIENT_SESSION_TRACK)) {
+		server->session = network_mysqld_session_new();
+	}
+
+	if (NULL == server->session) {
+		network_mysqld_session_free(client->session);
+		client->session = NULL;
+
+		return;
+	}
+
+	if (packet->len > NET_HEADER_SIZE && packet->str[NET_HEADER_SIZE] == MYSQLD_PACKET_OK) {
+		network_mysqld_ok_packet_t *ok_packet;
+		network_packet p;
+
+		p.data = packet;
+		p.offset = NET_HEADER_SIZE;
+
+		ok_packet = network_mysqld_ok_packet_new();
+		ok_packet->capabilities |= CLIENT_SESSION_TRACK;
+
+		if (0 != network_mysqld_proto_get_ok_packet(&p, ok_packet) ||
+		    network_mysqld_session_apply(server->session, S(ok_packet->session_state), NULL, NULL) < 0) {
+			server->session->is_unknown = TRUE;
+		}
+
+		network_mysqld_ok_packet_free(ok_packet);
+	}
+
+	if (NULL == client->session) client->session = network_mysqld_session_new();
+	network_mysqld_session_copy(client->session, server->session);
+}
+
+/**
+ * check if a authed connection from the pool can be handed to the client without a COM_CHANGE_USER
+ *
+ * the server has to report that the session wasn't changed since the connection
+ * was authed and the client has to use the same charset and default-db. The
+ * credentials are checked like with --proxy-pool-no-change-user.
+ */
+static gboolean proxy_session_is_reusable(network_mysqld_con *con) {
+	network_socket *server = con->server;
+
+	if (NULL == server->session || server->session->is_unknown) return FALSE;
+
+	/* we don't know the defaults to set the variables back to */
+	if (g_hash_table_size(server->session->sysvars) > 0) return FALSE;
+
+	if (server->response->charset != con->client->response->charset) return FALSE;
+	if (!g_string_equal(server->default_db, con->client->default_db)) return FALSE;
+
+	return TRUE;
+}
+
+/**
+ * mark the session as having state we don't track
+ *
+ * the client-side is marked too: the client depends on its backend connection now
+ */
+static void proxy_session_set_unknown(network_mysqld_con *con) {
+	con->server->session->is_unknown = TRUE;
+	if (con->client->session) con->client->session->is_unknown = TRUE;
+}
+
+/**
+ * track if a command leaves state in the session the server doesn't report
+ *
+ * a SET of system-variables and a USE are fine if the server reports the
+ * changes, see proxy_session_track_result()
+ */
+static void proxy_session_track_query(network_mysqld_con *con, const char *packet, gsize packet_len) {
+	network_mysqld_con_lua_t *st = con->plugin_con_state;
+	network_mysqld_stmt_t stmt;
+	guint flags;
+
+	if (NULL == con->server || NULL == con->server->session || packet_len < 1) return;
+
+	proxy_session_vars_clear(st->session_vars);
+	st->session_expects_schema = FALSE;
+
+	switch ((guint8)packet[0]) {
+	case COM_QUERY:
+		stmt = network_mysqld_classify_query(packet + 1, packet_len - 1, &flags);
+
+		if (stmt == NETWORK_MYSQLD_STMT_USE) {
+			st->session_expects_schema = TRUE;
+			break;
+		}
+
+		if (!(flags & NETWORK_MYSQLD_STMT_FLAG_SESSION_STATE)) break;
+
+		if (stmt == NETWORK_MYSQLD_STMT_SET &&
+		    network_mysqld_classify_set_vars(packet + 1, packet_len - 1, st->session_vars) > 0) {
+			break;
+		}
+
+		proxy_session_set_unknown(con);
+
+		break;
+	case COM_STMT_PREPARE:
+		/* without --proxy-stmt-multiplexing we don't know which statements are prepared */
+		if (NULL == st->stmts) proxy_session_set_unknown(con);
+
+		break;
+	case COM_CHANGE_USER:
+	case COM_SET_OPTION:
+	case COM_BINLOG_DUMP:
+	case COM_REGISTER_SLAVE:
+	case NETWORK_MYSQLD_COM_RESET_CONNECTION:
+		proxy_session_set_unknown(con);
+
+		break;
+	default:
+		break;
+	}
+}
+
+/**
+ * apply the session-state changes of a result
+ *
+ * the client expects the same changes. A SET or USE whose changes weren't
+ * reported leaves the session unknown.
+ */
+static void proxy_session_track_result(network_mysqld_con *con) {
+	network_mysqld_con_lua_t *st = con->plugin_con_state;
+	network_mysqld_com_query_result_t *com_query;
+	network_socket *server = con->server;
+	network_socket *client = con->client;
+	GPtrArray *reported;
+	GString *schema;
+	int types = 0;
+	guint i, j;
+
+	if (NULL == server || NULL == server->session) return;
+
+	if ((con->parse.command != COM_QUERY && con->parse.command != COM_STMT_EXECUTE) || NULL == con->parse.data) return;
+
+	com_query = con->parse.data;
+
+	if (com_query->query_status != MYSQLD_PACKET_OK) {
+		proxy_session_vars_clear(st->session_vars);
+		st->session_expects_schema = FALSE;
+
+		return;
+	}
+
+	reported = g_ptr_array_new();
+	schema = g_string_new(NULL);
+
+	if (com_query->session_state->len > 0) {
+		types = network_mysqld_session_apply(server->session, S(com_query->session_state), schema, reported);
+
+		if (types < 0) {
+			proxy_session_set_unknown(con);
+			types = 0;
+		} else if (client->session) {
+			network_mysqld_session_apply(client->session, S(com_query->session_state), NULL, NULL);
+		}
+	}
+
+	if (types & (1 << NETWORK_MYSQLD_SESSION_TRACK_SCHEMA)) {
+		g_string_assign_len(server->default_db, S(schema));
+		g_string_assign_len(client->default_db, S(schema));
+	} else if (st->session_expects_schema) {
+		proxy_session_set_unknown(con);
+	}
+
+	for (i = 0; i < st->session_vars->len; i++) {
+		for (j = 0; j < reported->len; j++) {
+			if (0 == strcmp(st->session_vars->pdata[i], reported->pdata[j])) break;
+		}
+
+		/* the variable isn't in the session_track_system_variables */
+		if (j == reported->len) proxy_session_set_unknown(con);
+	}
+
+	proxy_session_vars_clear(reported);
+	g_ptr_array_free(reported, TRUE);
+	g_string_free(schema, TRUE);
+
+	proxy_session_vars_clear(st->session_vars);
+	st->session_expects_schema = FALSE;
+}
+
 NETWORK_MYSQLD_PLUGIN_PROTO(proxy_read_auth) {
 	/* read auth from client */
 	network_packet packet;
@@ -692,6 +975,7 @@ NETWORK_MYSQLD_PLUGIN_PROTO(proxy_read_auth) {
 	gboolean free_client_packet = TRUE;
 	network_mysqld_con_lua_t *st = con->plugin_con_state;
 	gboolean got_all_data = TRUE;
+	gboolean is_auth_packet = (con->client->response == NULL); /* and not the win-auth extra data */
 
 	recv_sock = con->client;
 	send_sock = con->server;
@@ -810,9 +1094,12 @@ NETWORK_MYSQLD_PLUGIN_PROTO(proxy_read_auth) {
 			 *
 			 * for performance reasons this extra reauth can be disabled. But
 			 * that leaves temp-tables on the connection.
+			 *
+			 * it isn't needed either if the server reported that the session is
+			 * unchanged since the connection was authed
 			 */
 			if (con->server->is_authed) {
-				if (config->pool_change_user) {
+				if (config->pool_change_user && !proxy_session_is_reusable(con)) {
 					GString *com_change_user = g_string_new(NULL);
 
 					/* copy incl. the nul */
@@ -840,6 +1127,9 @@ NETWORK_MYSQLD_PLUGIN_PROTO(proxy_read_auth) {
 					/* we just injected a com_change_user packet so let's set the flag to track it on the connection */
 					st->is_in_com_change_user = TRUE;
 
+					/* ... which drops the prepared statements of the connection */
+					if (send_sock->prepared_stmts) network_stmt_cache_clear(send_sock->prepared_stmts);
+
 					/**
 					 * the server is already authenticated, the client isn't
 					 *
@@ -880,6 +1170,12 @@ NETWORK_MYSQLD_PLUGIN_PROTO(proxy_read_auth) {
 						network_mysqld_proto_append_ok_packet(auth_resp, ok_packet);
 						
 						network_mysqld_ok_packet_free(ok_packet);
+
+						/* the client gets the session of the pooled connection */
+						if (con->server->session) {
+							if (NULL == con->client->session) con->client->session = network_mysqld_session_new();
+							network_mysqld_session_copy(con->client->session, con->server->session);
+						}
 					}
 
 					network_mysqld_queue_append(recv_sock, recv_sock->send_queue, 
@@ -895,6 +1191,16 @@ NETWORK_MYSQLD_PLUGIN_PROTO(proxy_read_auth) {
 					g_string_free(auth_resp, TRUE);
 				}
 			} else {
+				/* the client may or may not compress, the server-side decides on its own.
+				 * CLIENT_COMPRESS is in the first byte of the capabilities */
+				if (is_auth_packet) {
+					if (proxy_backend_compress(config, send_sock)) {
+						packet.data->str[NET_HEADER_SIZE] |= CLIENT_COMPRESS;
+					} else {
+						packet.data->str[NET_HEADER_SIZE] &= ~CLIENT_COMPRESS;
+					}
+				}
+
 				network_mysqld_queue_append_raw(send_sock, send_sock->send_queue, packet.data);
 				con->state = CON_STATE_SEND_AUTH;
 
@@ -924,140 +1230,679 @@ NETWORK_MYSQLD_PLUGIN_PROTO(proxy_read_auth) {
 	return NETWORK_SOCKET_SUCCESS;
 }
 
-static network_mysqld_lua_stmt_ret proxy_lua_read_auth_result(network_mysqld_con *con) {
-	network_mysqld_lua_stmt_ret ret = PROXY_NO_DECISION;
-
-#ifdef HAVE_LUA_H
+/**
+ * track if a command leaves state on the backend connection
+ *
+ * a multiplexed client keeps its backend connection for the rest of the session
+ * if it does
+ */
+static void proxy_multiplex_track_query(network_mysqld_con *con, const char *packet, gsize packet_len) {
 	network_mysqld_con_lua_t *st = con->plugin_con_state;
-	network_socket *recv_sock = con->server;
-	GList *chunk = recv_sock->recv_queue->chunks->tail;
-	GString *packet = chunk->data;
-	lua_State *L;
+	network_mysqld_stmt_t stmt;
+	guint flags;
 
-	/* call the lua script to pick a backend
-	   ignore the return code from network_mysqld_con_lua_register_callback, because we cannot do anything about it,
-	   it would always show up as ERROR 2013, which is not helpful.	
-	*/
-	(void)network_mysqld_con_lua_register_callback(con, con->config->lua_script);
+	if (st->multiplex_backend_ndx < 0 || packet_len < 1) return;
 
-	if (!st->L) return 0;
+	st->multiplex_pin_next = FALSE;
 
-	L = st->L;
+	switch ((guint8)packet[0]) {
+	case COM_QUERY:
+		stmt = network_mysqld_classify_query(packet + 1, packet_len - 1, &flags);
 
-	g_assert(lua_isfunction(L, -1));
-	lua_getfenv(L, -1);
-	g_assert(lua_istable(L, -1));
-	
-	lua_getfield_literal(L, -1, C("read_auth_result"));
-	if (lua_isfunction(L, -1)) {
+		/* a tracked session is switched with the next command, see proxy_multiplex_prepare_session() */
+		if (NULL == con->server->session) {
+			/* the default-db is only tracked for COM_INIT_DB */
+			if (stmt == NETWORK_MYSQLD_STMT_USE) st->multiplex_is_pinned = TRUE;
 
-		/* export
-		 *
-		 * every thing we know about it
-		 *  */
+			if (flags & NETWORK_MYSQLD_STMT_FLAG_SESSION_STATE) st->multiplex_is_pinned = TRUE;
+		}
 
-		lua_newtable(L);
+		/* only the first statement is classified, the others may leave anything behind */
+		if (flags & NETWORK_MYSQLD_STMT_FLAG_MULTI_STATEMENT) st->multiplex_is_pinned = TRUE;
 
-		lua_pushlstring(L, packet->str + NET_HEADER_SIZE, packet->len - NET_HEADER_SIZE);
-		lua_setfield(L, -2, "packet");
+		/* the client wants the FOUND_ROWS() of this one next */
+		if (flags & NETWORK_MYSQLD_STMT_FLAG_SQL_CALC_FOUND_ROWS) st->multiplex_pin_next = TRUE;
 
-		if (lua_pcall(L, 1, 1, 0) != 0) {
-			g_critical("(read_auth_result) %s", lua_tostring(L, -1));
+		break;
+	case COM_STMT_PREPARE:
+		/* without --proxy-stmt-multiplexing the statement only exists on this connection */
+		if (NULL == st->stmts) st->multiplex_is_pinned = TRUE;
 
-			lua_pop(L, 1); /* errmsg */
+		break;
+	case COM_CHANGE_USER:
+	case COM_SET_OPTION:
+	case COM_BINLOG_DUMP:
+	case COM_REGISTER_SLAVE:
+		st->multiplex_is_pinned = TRUE;
 
-			/* the script failed, but we have a useful default */
-		} else {
-			if (lua_isnumber(L, -1)) {
-				ret = lua_tonumber(L, -1);
-			}
-			lua_pop(L, 1);
-		}
+		break;
+	default:
+		break;
+	}
+}
 
-		switch (ret) {
-		case PROXY_NO_DECISION:
-			break;
-		case PROXY_SEND_RESULT:
-			/* answer directly */
+/**
+ * track the server-status of a result for proxy_multiplex_release()
+ */
+static void proxy_multiplex_track_result(network_mysqld_con *con) {
+	network_mysqld_con_lua_t *st = con->plugin_con_state;
+	network_mysqld_com_query_result_t *com_query;
 
-			if (network_mysqld_con_lua_handle_proxy_response(con, con->config->lua_script)) {
-				/**
-				 * handling proxy.response failed
-				 *
-				 * send a ERR packet
-				 */
-		
-				network_mysqld_con_send_error(con->client, C("(lua) handling proxy.response failed, check error-log"));
-			}
+	if (st->multiplex_backend_ndx < 0) return;
 
-			break;
-		default:
-			ret = PROXY_NO_DECISION;
-			break;
-		}
+	if ((con->parse.command != COM_QUERY && con->parse.command != COM_STMT_EXECUTE) || NULL == con->parse.data) return;
 
-		/* ret should be a index into */
+	com_query = con->parse.data;
 
-	} else if (lua_isnil(L, -1)) {
-		lua_pop(L, 1); /* pop the nil */
-	} else {
-		g_message("%s.%d: %s", __FILE__, __LINE__, lua_typename(L, lua_type(L, -1)));
-		lua_pop(L, 1); /* pop the ... */
-	}
-	lua_pop(L, 1); /* fenv */
+	/* a ERR doesn't end the transaction */
+	if (com_query->query_status != MYSQLD_PACKET_OK) return;
 
-	g_assert(lua_isfunction(L, -1));
-#endif
-	return ret;
+	st->multiplex_server_status = com_query->server_status;
+
+	/* the client may ask for the LAST_INSERT_ID() next */
+	if (!com_query->was_resultset && com_query->insert_id > 0) st->multiplex_pin_next = TRUE;
 }
 
+/**
+ * take a idle connection of the client's user from the pool
+ *
+ * the connection isn't re-authed, only connections of the same user and charset are taken.
+ * One that has the session the client expects is preferred.
+ *
+ * @return FALSE if all connections of the user are busy
+ */
+static gboolean proxy_multiplex_acquire(network_mysqld_con *con) {
+	network_mysqld_con_lua_t *st = con->plugin_con_state;
+	chassis_private *g = con->srv->priv;
+	network_backend_t *backend;
 
-NETWORK_MYSQLD_PLUGIN_PROTO(proxy_read_auth_result) {
-	GString *packet;
-	GList *chunk;
-	network_socket *recv_sock, *send_sock;
+	backend = network_backends_get(g->backends, st->multiplex_backend_ndx);
+	if (NULL == backend || backend->state == BACKEND_STATE_DOWN || backend->is_drained) return FALSE;
 
-	recv_sock = con->server;
-	send_sock = con->client;
+	con->server = network_connection_pool_get_authed(backend->pool,
+			con->client->response->username,
+			con->client->default_db,
+			con->client->response->charset,
+			con->client->session);
+	if (NULL == con->server) return FALSE;
 
-	chunk = recv_sock->recv_queue->chunks->tail;
-	packet = chunk->data;
+	st->backend = backend;
+	st->backend_ndx = st->multiplex_backend_ndx;
+	st->backend->connected_clients++;
 
-	/* send the auth result to the client */
-	if (con->server->is_authed) {
-		/**
-		 * we injected a COM_CHANGE_USER above and have to correct to 
-		 * packet-id now 
-		 */
-		packet->str[3] = 2;
-	}
+	return TRUE;
+}
 
-	/**
-	 * copy the 
-	 * - default-db, 
-	 * - username, 
-	 * - scrambed_password
-	 *
-	 * to the server-side 
-	 */
-	g_string_assign_len(recv_sock->default_db, S(send_sock->default_db));
+/**
+ * return the backend connection to the pool
+ *
+ * it stays with the client while a transaction or cursor is open, in
+ * autocommit = 0 and if the session has state on it that isn't tracked
+ */
+static void proxy_multiplex_release(network_mysqld_con *con) {
+	network_mysqld_con_lua_t *st = con->plugin_con_state;
 
-	if (con->server->response) {
-		/* in case we got the connection from the pool it has the response from the previous auth */
-		network_mysqld_auth_response_free(con->server->response);
-		con->server->response = NULL;
-	}
-	con->server->response = network_mysqld_auth_response_copy(con->client->response);
+	if (st->multiplex_backend_ndx < 0 || NULL == con->server || NULL == st->backend) return;
 
-	/**
-	 * recv_sock still points to the old backend that
-	 * we received the packet from. 
-	 *
-	 * backend_ndx = 0 might have reset con->server
-	 */
+	if (st->multiplex_is_pinned || st->multiplex_pin_next) return;
 
-	switch (proxy_lua_read_auth_result(con)) {
-	case PROXY_SEND_RESULT:
+	if (con->server->session && con->server->session->is_unknown) return;
+
+	if ((st->multiplex_server_status & (SERVER_STATUS_IN_TRANS | SERVER_STATUS_CURSOR_EXISTS)) ||
+	    !(st->multiplex_server_status & SERVER_STATUS_AUTOCOMMIT)) {
+		return;
+	}
+
+	network_connection_pool_lua_add_connection(con);
+}
+
+/**
+ * the commands of a event-thread that wait for a pooled connection
+ *
+ * the connections may be added to the pool by any thread, the waiter only pings
+ * the event-thread. It hands the commands to proxy_read_query() again.
+ */
+typedef struct {
+	network_connection_pool_waiter waiter;
+	chassis_event_thread_t *event_thread;
+
+	struct event wakeup;             /**< runs proxy_multiplex_parking_wakeup() in the event-thread */
+	volatile gint wakeup_is_pending; /**< the wakeup is added already */
+
+	GQueue *cons;                    /**< network_mysqld_con *, the parked commands, oldest first */
+} proxy_multiplex_parking;
+
+/**
+ * hand the parked commands of the event-thread to proxy_read_query() again
+ *
+ * the ones that still find no connection are parked again
+ */
+static void proxy_multiplex_parking_wakeup(int G_GNUC_UNUSED event_fd, short G_GNUC_UNUSED events, void *user_data) {
+	proxy_multiplex_parking *parking = user_data;
+	network_mysqld_con *con;
+	GQueue *cons;
+
+	g_atomic_int_set(&(parking->wakeup_is_pending), 0);
+
+	cons = parking->cons;
+	parking->cons = g_queue_new();
+
+	while ((con = g_queue_pop_head(cons))) {
+		network_mysqld_con_lua_t *st = con->plugin_con_state;
+
+		st->multiplex_wait_link = NULL;
+
+		network_mysqld_con_handle(-1, 0, con);
+	}
+
+	g_queue_free(cons);
+}
+
+/**
+ * wake up the event-thread, called by the thread that added a connection to the pool
+ */
+static void proxy_multiplex_parking_ping(gpointer user_data) {
+	proxy_multiplex_parking *parking = user_data;
+	struct timeval now = { 0, 0 };
+
+	if (!g_atomic_int_compare_and_exchange(&(parking->wakeup_is_pending), 0, 1)) return;
+
+	chassis_event_thread_add_with_timeout(parking->event_thread, &(parking->wakeup), &now);
+}
+
+/**
+ * get the parked commands of a event-thread
+ *
+ * they are kept until the plugin is freed, the pools may still wake them up after
+ * the last command left
+ */
+static proxy_multiplex_parking *proxy_multiplex_parking_get(chassis_plugin_config *config, chassis_event_thread_t *event_thread) {
+	proxy_multiplex_parking *parking = NULL;
+	guint i;
+
+	g_mutex_lock(config->multiplex_parkings_mutex);
+	for (i = 0; i < config->multiplex_parkings->len; i++) {
+		proxy_multiplex_parking *p = config->multiplex_parkings->pdata[i];
+
+		if (p->event_thread == event_thread) {
+			parking = p;
+			break;
+		}
+	}
+
+	if (NULL == parking) {
+		parking = g_new0(proxy_multiplex_parking, 1);
+		parking->waiter.wakeup = proxy_multiplex_parking_ping;
+		parking->waiter.user_data = parking;
+		parking->event_thread = event_thread;
+		parking->cons = g_queue_new();
+		evtimer_set(&(parking->wakeup), proxy_multiplex_parking_wakeup, parking);
+
+		g_ptr_array_add(config->multiplex_parkings, parking);
+	}
+	g_mutex_unlock(config->multiplex_parkings_mutex);
+
+	return parking;
+}
+
+/**
+ * stop waiting for the pools and free the parked commands of all event-threads
+ *
+ * the event-threads have to be stopped and the connections be closed
+ */
+static void proxy_multiplex_parkings_free(chassis_plugin_config *config) {
+	guint i, j;
+
+	for (i = 0; i < config->multiplex_parkings->len; i++) {
+		proxy_multiplex_parking *parking = config->multiplex_parkings->pdata[i];
+		chassis_private *g = parking->event_thread->chas->priv;
+
+		for (j = 0; j < network_backends_count(g->backends); j++) {
+			network_backend_t *backend = network_backends_get(g->backends, j);
+
+			network_connection_pool_unwait(backend->pool, &(parking->waiter));
+		}
+
+		/* the wakeup may still be pending in the event-base of the thread */
+		event_del(&(parking->wakeup));
+
+		g_assert(g_queue_is_empty(parking->cons));
+		g_queue_free(parking->cons);
+		g_free(parking);
+	}
+
+	g_ptr_array_free(config->multiplex_parkings, TRUE);
+	g_mutex_free(config->multiplex_parkings_mutex);
+}
+
+/**
+ * give up waiting for a pooled connection
+ */
+static void proxy_multiplex_wait_timeout(int G_GNUC_UNUSED event_fd, short G_GNUC_UNUSED events, void *user_data) {
+	network_mysqld_con *con = user_data;
+	network_mysqld_con_lua_t *st = con->plugin_con_state;
+
+	st->multiplex_is_waiting = FALSE;
+	st->multiplex_wait_expired = TRUE;
+
+	/* let proxy_read_query() try a last time and send the error */
+	network_mysqld_con_handle(-1, 0, con);
+}
+
+/**
+ * park the command until a connection is added to the pool of the backend
+ *
+ * waits up to --proxy-multiplex-wait-timeout for all tries of the command together
+ *
+ * @return TRUE if the command is parked, FALSE if it got a connection meanwhile or waits no longer
+ */
+static gboolean proxy_multiplex_park(network_mysqld_con *con) {
+	network_mysqld_con_lua_t *st = con->plugin_con_state;
+	chassis_plugin_config *config = con->config;
+	chassis_private *g = con->srv->priv;
+	proxy_multiplex_parking *parking;
+	network_backend_t *backend;
+	struct timeval timeout;
+
+	if (config->multiplex_wait_timeout_dbl <= 0 || st->multiplex_wait_expired) return FALSE;
+
+	/* nothing comes back from a backend that is gone */
+	backend = network_backends_get(g->backends, st->multiplex_backend_ndx);
+	if (NULL == backend || backend->state == BACKEND_STATE_DOWN || backend->is_drained) return FALSE;
+
+	parking = proxy_multiplex_parking_get(config, con->event_thread);
+	network_connection_pool_wait(backend->pool, &(parking->waiter));
+
+	/* a connection may have been added before we waited for it */
+	if (proxy_multiplex_acquire(con)) return FALSE;
+
+	if (!st->multiplex_is_waiting) {
+		timeval_from_double(&timeout, config->multiplex_wait_timeout_dbl);
+
+		evtimer_set(&(st->multiplex_wait_timer), proxy_multiplex_wait_timeout, con);
+		chassis_event_thread_add_with_timeout(con->event_thread, &(st->multiplex_wait_timer), &timeout);
+
+		st->multiplex_is_waiting = TRUE;
+	}
+
+	if (NULL == st->multiplex_wait_link) {
+		g_queue_push_tail(parking->cons, con);
+		st->multiplex_wait_link = parking->cons->tail;
+	}
+
+	return TRUE;
+}
+
+/**
+ * the command stops waiting for a pooled connection
+ */
+static void proxy_multiplex_unpark(network_mysqld_con *con) {
+	network_mysqld_con_lua_t *st = con->plugin_con_state;
+
+	if (st->multiplex_wait_link) {
+		proxy_multiplex_parking *parking = proxy_multiplex_parking_get(con->config, con->event_thread);
+
+		g_queue_delete_link(parking->cons, st->multiplex_wait_link);
+		st->multiplex_wait_link = NULL;
+	}
+
+	if (st->multiplex_is_waiting) {
+		event_del(&(st->multiplex_wait_timer));
+		st->multiplex_is_waiting = FALSE;
+	}
+
+	st->multiplex_wait_expired = FALSE;
+}
+
+/**
+ * queue the commands that switch the session of a connection from the pool to the one the client expects
+ *
+ * if the connection only lacks some system-variables of the client they are SET,
+ * otherwise the session is reset with COM_RESET_CONNECTION first. Call it before
+ * proxy_stmt_send_query() as the reset drops the prepared statements.
+ */
+static void proxy_multiplex_prepare_session(network_mysqld_con *con) {
+	network_mysqld_con_lua_t *st = con->plugin_con_state;
+	network_socket *server = con->server;
+	network_mysqld_session *base;
+	GString *packet;
+
+	if (st->multiplex_backend_ndx < 0) return;
+
+	if (NULL == server->session || NULL == con->client->session) return;
+
+	/* the client is pinned to its connection, don't reset the state it left on it */
+	if (con->client->session->is_unknown) return;
+
+	if (!server->session->is_unknown &&
+	    network_mysqld_session_is_equal(server->session, con->client->session)) {
+		return;
+	}
+
+	packet = g_queue_peek_head(server->send_queue->chunks);
+	if (NULL == packet || packet->len <= NET_HEADER_SIZE) return;
+
+	switch ((guint8)packet->str[NET_HEADER_SIZE]) {
+	case COM_CHANGE_USER:
+	case COM_QUIT:
+		return;
+	default:
+		break;
+	}
+
+	if (!server->session->is_unknown &&
+	    network_mysqld_session_is_subset(server->session, con->client->session)) {
+		base = server->session;
+	} else {
+		/* we can't set a variable back to its default, start from a fresh session */
+		packet = g_string_new(NULL);
+		g_string_append_c(packet, NETWORK_MYSQLD_COM_RESET_CONNECTION);
+		g_queue_push_tail(st->multiplex_prelude, packet);
+
+		if (server->prepared_stmts) network_stmt_cache_clear(server->prepared_stmts);
+
+		base = network_mysqld_session_new();
+	}
+
+	packet = g_string_new(NULL);
+	g_string_append_c(packet, COM_QUERY);
+
+	if (network_mysqld_session_append_set_query(base, con->client->session, packet) > 0) {
+		g_queue_push_tail(st->multiplex_prelude, packet);
+	} else {
+		g_string_free(packet, TRUE);
+	}
+
+	if (base != server->session) network_mysqld_session_free(base);
+}
+
+/**
+ * send the commands that switch the session of a connection from the pool to the one of the client
+ *
+ * the session was queued by proxy_multiplex_prepare_session(), the default-db is
+ * switched with a COM_INIT_DB. The command in the send-queue is held back until
+ * they succeeded, see proxy_multiplex_read_query_result()
+ */
+static void proxy_multiplex_send_prelude(network_mysqld_con *con) {
+	network_mysqld_con_lua_t *st = con->plugin_con_state;
+	network_socket *server = con->server;
+	GString *packet;
+	guint8 command;
+
+	if (st->multiplex_backend_ndx < 0) return;
+
+	packet = g_queue_peek_head(server->send_queue->chunks);
+	if (NULL == packet || packet->len <= NET_HEADER_SIZE) return;
+
+	command = packet->str[NET_HEADER_SIZE];
+
+	/* there is no way back to no default-db */
+	if (con->client->default_db->len > 0 &&
+	    !g_string_equal(server->default_db, con->client->default_db) &&
+	    command != COM_INIT_DB &&
+	    command != COM_CHANGE_USER &&
+	    command != COM_QUIT) {
+		GString *init_db;
+
+		init_db = g_string_sized_new(con->client->default_db->len + 1);
+		g_string_append_c(init_db, COM_INIT_DB);
+		g_string_append_len(init_db, S(con->client->default_db));
+
+		g_queue_push_tail(st->multiplex_prelude, init_db);
+	}
+
+	if (g_queue_is_empty(st->multiplex_prelude)) return;
+
+	st->multiplex_held_packets = network_queue_pop_string(server->send_queue, server->send_queue->len, NULL);
+
+	packet = g_queue_pop_head(st->multiplex_prelude);
+
+	network_mysqld_queue_reset(server);
+	network_mysqld_queue_append(server, server->send_queue, S(packet));
+
+	g_string_free(packet, TRUE);
+}
+
+/**
+ * handle the responses to the commands of proxy_multiplex_send_prelude()
+ *
+ * on success the next one or the held back command is sent, otherwise the client
+ * gets the ERR as response to it
+ *
+ * @return TRUE if the packet was handled and the result isn't forwarded
+ */
+static gboolean proxy_multiplex_read_query_result(network_mysqld_con *con, int is_finished) {
+	network_mysqld_con_lua_t *st = con->plugin_con_state;
+	network_socket *server = con->server;
+	GString *packet;
+
+	if (NULL == st->multiplex_held_packets) return FALSE;
+
+	packet = g_queue_peek_tail(server->recv_queue->chunks);
+
+	if (packet->len > NET_HEADER_SIZE && (guint8)packet->str[NET_HEADER_SIZE] == MYSQLD_PACKET_ERR) {
+		network_stmt_con *sc = st->stmts;
+		guint8 command;
+
+		/* the command of the client may be held back behind a COM_STMT_PREPARE too */
+		if (sc && sc->held_packets) {
+			command = sc->held_packets->str[NET_HEADER_SIZE];
+
+			g_string_free(sc->held_packets, TRUE);
+			sc->held_packets = NULL;
+		} else {
+			command = st->multiplex_held_packets->str[NET_HEADER_SIZE];
+		}
+		if (sc) sc->is_preparing = FALSE;
+
+		g_string_free(st->multiplex_held_packets, TRUE);
+		st->multiplex_held_packets = NULL;
+
+		/* we don't know how far we got */
+		while ((packet = g_queue_pop_head(st->multiplex_prelude))) g_string_free(packet, TRUE);
+		if (server->session) server->session->is_unknown = TRUE;
+
+		if (command != COM_STMT_SEND_LONG_DATA && command != COM_STMT_CLOSE) return FALSE;
+
+		/* the client doesn't expect a response for these */
+		g_string_free(g_queue_pop_tail(server->recv_queue->chunks), TRUE);
+
+		network_mysqld_queue_reset(con->client);
+		network_mysqld_queue_reset(server);
+
+		con->state = CON_STATE_READ_QUERY;
+
+		return TRUE;
+	}
+
+	g_string_free(g_queue_pop_tail(server->recv_queue->chunks), TRUE);
+
+	if (!is_finished) return TRUE;
+
+	network_mysqld_queue_reset(server);
+
+	if ((packet = g_queue_pop_head(st->multiplex_prelude))) {
+		network_mysqld_queue_append(server, server->send_queue, S(packet));
+		g_string_free(packet, TRUE);
+	} else {
+		if (server->session && con->client->session) network_mysqld_session_copy(server->session, con->client->session);
+
+		network_queue_append(server->send_queue, st->multiplex_held_packets);
+		st->multiplex_held_packets = NULL;
+	}
+
+	network_mysqld_con_reset_command_response_state(con);
+
+	con->state = CON_STATE_SEND_QUERY;
+
+	return TRUE;
+}
+
+static network_mysqld_lua_stmt_ret proxy_lua_read_auth_result(network_mysqld_con *con) {
+	network_mysqld_lua_stmt_ret ret = PROXY_NO_DECISION;
+
+#ifdef HAVE_LUA_H
+	network_mysqld_con_lua_t *st = con->plugin_con_state;
+	network_socket *recv_sock = con->server;
+	GList *chunk = recv_sock->recv_queue->chunks->tail;
+	GString *packet = chunk->data;
+	lua_State *L;
+
+	/* call the lua script to pick a backend
+	   ignore the return code from network_mysqld_con_lua_register_callback, because we cannot do anything about it,
+	   it would always show up as ERROR 2013, which is not helpful.	
+	*/
+	(void)network_mysqld_con_lua_register_callback(con, con->config->lua_script);
+
+	if (!st->L) return 0;
+
+	L = st->L;
+
+	g_assert(lua_isfunction(L, -1));
+	lua_getfenv(L, -1);
+	g_assert(lua_istable(L, -1));
+	
+	lua_getfield_literal(L, -1, C("read_auth_result"));
+	if (lua_isfunction(L, -1)) {
+
+		/* export
+		 *
+		 * every thing we know about it
+		 *  */
+
+		lua_newtable(L);
+
+		lua_pushlstring(L, packet->str + NET_HEADER_SIZE, packet->len - NET_HEADER_SIZE);
+		lua_setfield(L, -2, "packet");
+
+		if (lua_pcall(L, 1, 1, 0) != 0) {
+			g_critical("(read_auth_result) %s", lua_tostring(L, -1));
+
+			lua_pop(L, 1); /* errmsg */
+
+			/* the script failed, but we have a useful default */
+		} else {
+			if (lua_isnumber(L, -1)) {
+				ret = lua_tonumber(L, -1);
+			}
+			lua_pop(L, 1);
+		}
+
+		switch (ret) {
+		case PROXY_NO_DECISION:
+			break;
+		case PROXY_SEND_RESULT:
+			/* answer directly */
+
+			if (network_mysqld_con_lua_handle_proxy_response(con, con->config->lua_script)) {
+				/**
+				 * handling proxy.response failed
+				 *
+				 * send a ERR packet
+				 */
+		
+				network_mysqld_con_send_error(con->client, C("(lua) handling proxy.response failed, check error-log"));
+			}
+
+			break;
+		default:
+			ret = PROXY_NO_DECISION;
+			break;
+		}
+
+		/* ret should be a index into */
+
+	} else if (lua_isnil(L, -1)) {
+		lua_pop(L, 1); /* pop the nil */
+	} else {
+		g_message("%s.%d: %s", __FILE__, __LINE__, lua_typename(L, lua_type(L, -1)));
+		lua_pop(L, 1); /* pop the ... */
+	}
+	lua_pop(L, 1); /* fenv */
+
+	g_assert(lua_isfunction(L, -1));
+#endif
+	return ret;
+}
+
+
+NETWORK_MYSQLD_PLUGIN_PROTO(proxy_read_auth_result) {
+	GString *packet;
+	GList *chunk;
+	network_socket *recv_sock, *send_sock;
+	gboolean server_compress;
+	gboolean is_auth_ok;
+
+	recv_sock = con->server;
+	send_sock = con->client;
+
+	chunk = recv_sock->recv_queue->chunks->tail;
+	packet = chunk->data;
+
+	is_auth_ok = (packet->len > NET_HEADER_SIZE && packet->str[NET_HEADER_SIZE] == MYSQLD_PACKET_OK);
+
+	/* send the auth result to the client */
+	if (con->server->is_authed) {
+		/**
+		 * we injected a COM_CHANGE_USER above and have to correct to 
+		 * packet-id now 
+		 */
+		packet->str[3] = 2;
+	}
+
+	/**
+	 * copy the 
+	 * - default-db, 
+	 * - username, 
+	 * - scrambed_password
+	 *
+	 * to the server-side 
+	 */
+	g_string_assign_len(recv_sock->default_db, S(send_sock->default_db));
+
+	if (con->server->response) {
+		/* in case we got the connection from the pool it has the response from the previous auth */
+		network_mysqld_auth_response_free(con->server->response);
+		con->server->response = NULL;
+	}
+	con->server->response = network_mysqld_auth_response_copy(con->client->response);
+
+	/* a connection from the pool keeps the protocol it was authed with, 
+	 * otherwise we patched CLIENT_COMPRESS in proxy_read_auth() */
+	if (recv_sock->is_authed) {
+		server_compress = (recv_sock->compress != NULL);
+	} else {
+		server_compress = proxy_backend_compress(con->config, recv_sock);
+	}
+
+	if (server_compress) {
+		recv_sock->response->client_capabilities |= CLIENT_COMPRESS;
+	} else {
+		recv_sock->response->client_capabilities &= ~CLIENT_COMPRESS;
+	}
+
+	if (is_auth_ok) proxy_session_track_auth_result(con, packet);
+
+	/* after the OK the server only sends compressed frames */
+	if (server_compress &&
+	    packet->len > NET_HEADER_SIZE &&
+	    packet->str[NET_HEADER_SIZE] == MYSQLD_PACKET_OK) {
+		recv_sock->compress_min_length = con->config->compress_min_length;
+
+		if (0 != network_socket_set_compressed(recv_sock)) {
+			return NETWORK_SOCKET_ERROR;
+		}
+	}
+
+	/**
+	 * recv_sock still points to the old backend that
+	 * we received the packet from. 
+	 *
+	 * backend_ndx = 0 might have reset con->server
+	 */
+
+	switch (proxy_lua_read_auth_result(con)) {
+	case PROXY_SEND_RESULT:
 		/**
 		 * we already have content in the send-sock 
 		 *
@@ -1090,6 +1935,9 @@ NETWORK_MYSQLD_PLUGIN_PROTO(proxy_read_auth_result) {
 	 */
 	network_mysqld_queue_reset(send_sock);
 	network_mysqld_queue_reset(recv_sock);
+
+	/* a idle client doesn't keep its backend connection */
+	if (is_auth_ok) proxy_multiplex_release(con);
 	
 	con->state = CON_STATE_SEND_AUTH_RESULT;
 
@@ -1264,45 +2112,527 @@ static network_mysqld_lua_stmt_ret proxy_lua_read_query(network_mysqld_con *con)
 				if (st->injected.queries->length) {
 					injection *inj;
 
-					g_critical("%s: proxy.queue:append() or :prepend() used without 'return proxy.PROXY_SEND_QUERY'. Discarding %d elements from the queue.",
-							G_STRLOC,
-							st->injected.queries->length);
+					g_critical("%s: proxy.queue:append() or :prepend() used without 'return proxy.PROXY_SEND_QUERY'. Discarding %d elements from the queue.",
+							G_STRLOC,
+							st->injected.queries->length);
+
+					while ((inj = g_queue_pop_head(st->injected.queries))) injection_free(inj);
+				}
+			
+				break;
+			case PROXY_SEND_QUERY:
+				/* send the injected queries
+				 *
+				 * injection_new(..., query);
+				 * 
+				 *  */
+
+				if (st->injected.queries->length == 0) {
+					g_critical("%s: 'return proxy.PROXY_SEND_QUERY' used without proxy.queue:append() or :prepend(). Assuming 'nil' was returned",
+							G_STRLOC);
+				} else {
+					ret = PROXY_SEND_INJECTION;
+				}
+	
+				break;
+			default:
+				break;
+			}
+			lua_pop(L, 1); /* fenv */
+		} else {
+			lua_pop(L, 2); /* fenv + nil */
+		}
+
+		g_assert(lua_isfunction(L, -1));
+
+		if (ret != PROXY_NO_DECISION) {
+			return ret;
+		}
+	}
+#endif
+	return PROXY_NO_DECISION;
+}
+
+/**
+ * max size of the SET statements we keep in the cache-key of a connection
+ */
+#define PROXY_QUERY_CACHE_MAX_SESSION_LEN 4096
+
+/**
+ * build the cache-key of a query
+ *
+ * the result of a query depends on the user, the charset, the default-db and the
+ * SET statements of the connection, not only on the query
+ */
+static GString *proxy_query_cache_key(network_mysqld_con *con, const char *query, gsize query_len) {
+	network_mysqld_con_lua_t *st = con->plugin_con_state;
+	network_mysqld_auth_response *auth = con->client->response;
+	GString *key;
+
+	key = g_string_sized_new(query_len + st->query_cache->session->len + 64);
+
+	if (auth) {
+		g_string_append_len(key, S(auth->username));
+		g_string_append_c(key, '\0');
+		g_string_append_c(key, auth->charset);
+	}
+	g_string_append_c(key, '\0');
+	g_string_append_len(key, S(con->client->default_db));
+	g_string_append_c(key, '\0');
+	g_string_append_len(key, S(st->query_cache->session));
+	g_string_append_c(key, '\0');
+	g_string_append_len(key, query, query_len);
+
+	return key;
+}
+
+/**
+ * remember the SET statements of a connection
+ *
+ * repeating the last statement doesn't change the session
+ */
+static void proxy_query_cache_track_set(network_query_cache_con *qc, const char *query, gsize query_len) {
+	GString *session = qc->session;
+
+	if (session->len >= query_len + 1 &&
+	    0 == memcmp(session->str + session->len - query_len - 1, query, query_len) &&
+	    (session->len == query_len + 1 || session->str[session->len - query_len - 2] == '\0')) {
+		return;
+	}
+
+	g_string_append_len(session, query, query_len);
+	g_string_append_c(session, '\0');
+
+	if (session->len > PROXY_QUERY_CACHE_MAX_SESSION_LEN) {
+		qc->session_is_unknown = TRUE;
+	}
+}
+
+/**
+ * remember the tables a query writes
+ *
+ * called for each query we send to the backend. The tables are invalidated when the
+ * transaction is committed, see proxy_query_cache_track_result()
+ *
+ * @param packet  payload of the packet, starting with the command-byte
+ */
+static void proxy_query_cache_track_query(network_mysqld_con *con, const char *packet, gsize packet_len) {
+	network_mysqld_con_lua_t *st = con->plugin_con_state;
+	network_query_cache_con *qc = st->query_cache;
+	const char *query;
+	gsize query_len;
+	GPtrArray *tables, *written_tables;
+	gboolean *written_all;
+	network_mysqld_stmt_t stmt;
+	guint8 command;
+	guint flags;
+	guint i;
+	int ret;
+
+	if (NULL == qc || packet_len < 1) return;
+
+	command = packet[0];
+	query = packet + 1;
+	query_len = packet_len - 1;
+
+	switch (command) {
+	case COM_QUERY:
+		written_tables = qc->written_tables;
+		written_all = &(qc->written_all);
+		break;
+	case COM_STMT_PREPARE:
+		/* the tables are written when the statement is executed */
+		written_tables = qc->prepared_tables;
+		written_all = &(qc->prepared_all);
+		break;
+	case COM_STMT_EXECUTE:
+		/* we don't track the statement-ids, assume the statement writes what all prepared statements write */
+		for (i = 0; i < qc->prepared_tables->len; i++) {
+			network_query_cache_con_add_table(qc->written_tables, qc->prepared_tables->pdata[i]);
+		}
+		if (qc->prepared_all) qc->written_all = TRUE;
+		return;
+	case COM_CHANGE_USER:
+		g_string_truncate(qc->session, 0);
+		qc->session_is_unknown = FALSE;
+		return;
+	default:
+		return;
+	}
+
+	stmt = network_mysqld_classify_query(query, query_len, &flags);
+
+	if (flags & NETWORK_MYSQLD_STMT_FLAG_MULTI_STATEMENT) {
+		/* we only classify the first statement, the others may write any table or change the session */
+		*written_all = TRUE;
+		if (command == COM_QUERY) qc->session_is_unknown = TRUE;
+		return;
+	}
+
+	switch (stmt) {
+	case NETWORK_MYSQLD_STMT_SELECT:
+	case NETWORK_MYSQLD_STMT_SHOW:
+	case NETWORK_MYSQLD_STMT_BEGIN:
+	case NETWORK_MYSQLD_STMT_COMMIT:
+	case NETWORK_MYSQLD_STMT_ROLLBACK:
+		return;
+	case NETWORK_MYSQLD_STMT_SET:
+		if (command == COM_QUERY) proxy_query_cache_track_set(qc, query, query_len);
+		return;
+	case NETWORK_MYSQLD_STMT_USE:
+		/* con->client->default_db doesn't know about it */
+		if (command == COM_QUERY) qc->session_is_unknown = TRUE;
+		return;
+	case NETWORK_MYSQLD_STMT_INSERT:
+	case NETWORK_MYSQLD_STMT_UPDATE:
+	case NETWORK_MYSQLD_STMT_DELETE:
+	case NETWORK_MYSQLD_STMT_REPLACE:
+		break;
+	default:
+		/* DDL, CALL, LOAD DATA, ... may write any table */
+		*written_all = TRUE;
+		return;
+	}
+
+	if (qc->session_is_unknown) {
+		/* we don't know the default-db of the table-names */
+		*written_all = TRUE;
+		return;
+	}
+
+	tables = g_ptr_array_new();
+	ret = network_mysqld_classify_tables(query, query_len, con->client->default_db->str, tables);
+	if (ret <= 0) *written_all = TRUE;
+
+	for (i = 0; i < tables->len; i++) {
+		if (ret > 0) network_query_cache_con_add_table(written_tables, tables->pdata[i]);
+		g_free(tables->pdata[i]);
+	}
+	g_ptr_array_free(tables, TRUE);
+}
+
+/**
+ * look up a query in the query-cache
+ *
+ * on a hit the cached packets are appended to the send-queue of the client. On a
+ * miss the result is copied into a new entry, if the query can be cached.
+ *
+ * only SELECTs which read tables and don't use functions like NOW() are cached,
+ * in autocommit-mode outside of transactions.
+ *
+ * @param packet  the query-packet of the client
+ * @return TRUE on a hit
+ */
+static gboolean proxy_query_cache_lookup(network_mysqld_con *con, GString *packet) {
+	network_mysqld_con_lua_t *st = con->plugin_con_state;
+	network_query_cache_con *qc = st->query_cache;
+	network_query_cache *cache = con->config->query_cache;
+	network_query_cache_entry *entry;
+	const char *query;
+	gsize query_len;
+	GQueue *packets;
+	GString *key, *cached_packet;
+	guint flags;
+	gboolean is_hit;
+
+	if (NULL == qc || qc->session_is_unknown) return FALSE;
+	if (!(qc->server_status & SERVER_STATUS_AUTOCOMMIT) ||
+	    (qc->server_status & SERVER_STATUS_IN_TRANS)) {
+		return FALSE;
+	}
+
+	/* a COM_QUERY in one packet */
+	if (NULL == packet || packet->len <= NET_HEADER_SIZE + 1) return FALSE;
+	if (con->client->recv_queue->chunks->length != 1) return FALSE;
+	if ((guint8)packet->str[NET_HEADER_SIZE] != COM_QUERY) return FALSE;
+
+	query = packet->str + NET_HEADER_SIZE + 1;
+	query_len = packet->len - NET_HEADER_SIZE - 1;
+
+	if (NETWORK_MYSQLD_STMT_SELECT != network_mysqld_classify_query(query, query_len, &flags) ||
+	    0 != flags) {
+		return FALSE;
+	}
+
+	key = proxy_query_cache_key(con, query, query_len);
+
+	packets = g_queue_new();
+	is_hit = network_query_cache_get(cache, key, chassis_get_rel_microseconds(), packets);
+	while ((cached_packet = g_queue_pop_head(packets))) {
+		network_mysqld_queue_append_raw(con->client, con->client->send_queue, cached_packet);
+	}
+	g_queue_free(packets);
+
+	if (is_hit) {
+		g_string_free(key, TRUE);
+
+		return TRUE;
+	}
+
+	/* copy the result, if we know the tables to invalidate it */
+	entry = network_query_cache_entry_new(cache, key);
+	if (network_mysqld_classify_tables(query, query_len, con->client->default_db->str, entry->tables) <= 0) {
+		network_query_cache_entry_free(entry);
+
+		return FALSE;
+	}
+
+	network_query_cache_entry_free(qc->entry);
+	qc->entry = entry;
+	con->resultset_is_copied = TRUE;
+
+	return FALSE;
+}
+
+/**
+ * copy a packet of the result into the entry of the query-cache
+ */
+static void proxy_query_cache_copy_packet(network_mysqld_con *con, GString *packet) {
+	network_mysqld_con_lua_t *st = con->plugin_con_state;
+	network_query_cache_con *qc = st->query_cache;
+
+	if (NULL == qc || NULL == qc->entry) return;
+
+	if (!network_query_cache_entry_append(con->config->query_cache, qc->entry, packet)) {
+		/* too big for the cache */
+		network_query_cache_entry_free(qc->entry);
+		qc->entry = NULL;
+		con->resultset_is_copied = FALSE;
+	}
+}
+
+/**
+ * track the end of a result
+ *
+ * stores the copied result in the cache and invalidates the tables the connection
+ * wrote, if they are committed
+ */
+static void proxy_query_cache_track_result(network_mysqld_con *con) {
+	network_mysqld_con_lua_t *st = con->plugin_con_state;
+	network_query_cache_con *qc = st->query_cache;
+	network_query_cache *cache = con->config->query_cache;
+	network_mysqld_com_query_result_t *com_query = NULL;
+
+	if (NULL == qc) return;
+
+	if ((con->parse.command == COM_QUERY || con->parse.command == COM_STMT_EXECUTE) && con->parse.data) {
+		com_query = con->parse.data;
+
+		if (com_query->query_status == MYSQLD_PACKET_OK) qc->server_status = com_query->server_status;
+	}
+
+	if (qc->entry) {
+		if (com_query &&
+		    com_query->was_resultset &&
+		    com_query->query_status == MYSQLD_PACKET_OK &&
+		    !(qc->server_status & SERVER_STATUS_IN_TRANS)) {
+			network_query_cache_store(cache, qc->entry, chassis_get_rel_microseconds());
+		} else {
+			network_query_cache_entry_free(qc->entry);
+		}
+		qc->entry = NULL;
+		con->resultset_is_copied = FALSE;
+	}
+
+	if (!(qc->server_status & SERVER_STATUS_IN_TRANS)) {
+		network_query_cache_con_invalidate(cache, qc);
+	}
+}
+
+/**
+ * map the statement-id of a command from the client to the one of the backend
+ *
+ * called right before the command in the send-queue of the backend is sent. If the
+ * statement isn't prepared on this backend connection, the command is held back and
+ * the query is prepared first, see proxy_stmt_read_query_result()
+ */
+static void proxy_stmt_send_query(network_mysqld_con *con) {
+	network_mysqld_con_lua_t *st = con->plugin_con_state;
+	network_stmt_con *sc = st->stmts;
+	network_socket *server = con->server;
+	network_packet p;
+	GString *packet, *query;
+	guint8 command;
+	guint32 stmt_id, server_stmt_id;
+
+	if (NULL == sc) return;
+
+	packet = g_queue_peek_head(server->send_queue->chunks);
+	if (NULL == packet || packet->len <= NET_HEADER_SIZE) return;
+
+	if (NULL == server->prepared_stmts) {
+		server->prepared_stmts = network_stmt_cache_new(NETWORK_STMT_CACHE_MAX_STMTS);
+	}
+
+	p.data = packet;
+	p.offset = NET_HEADER_SIZE;
+
+	if (0 != network_mysqld_proto_get_int8(&p, &command)) return;
+
+	switch (command) {
+	case COM_QUIT:
+		return;
+	case COM_CHANGE_USER:
+		/* the server drops all statements of the connection */
+		network_stmt_con_clear(sc);
+		network_stmt_cache_clear(server->prepared_stmts);
+		return;
+	case COM_STMT_PREPARE:
+		/* a query that doesn't fit into one packet isn't mapped, the client gets the statement-id of the server */
+		if (packet->len - NET_HEADER_SIZE < PACKET_LEN_MAX) {
+			g_string_truncate(sc->prepare_query, 0);
+			g_string_append_len(sc->prepare_query, packet->str + NET_HEADER_SIZE + 1, packet->len - NET_HEADER_SIZE - 1);
+			sc->is_preparing = TRUE;
+		}
+		break;
+	case COM_STMT_EXECUTE:
+	case COM_STMT_SEND_LONG_DATA:
+	case COM_STMT_RESET:
+	case COM_STMT_FETCH:
+	case COM_STMT_CLOSE:
+		if (0 != network_mysqld_proto_get_int32(&p, &stmt_id)) break;
+
+		/* not one of ours, let the server complain about it */
+		if (NULL == (query = network_stmt_con_get(sc, stmt_id))) break;
+
+		if (network_stmt_cache_get(server->prepared_stmts, query, &server_stmt_id)) {
+			network_stmt_set_id(packet, server_stmt_id);
+
+			if (command == COM_STMT_CLOSE) network_stmt_cache_remove(server->prepared_stmts, query);
+		} else if (command == COM_STMT_CLOSE) {
+			/* it isn't prepared on this backend, there is nothing to close */
+			network_stmt_set_id(packet, 0);
+		} else {
+			GString *prepare;
+
+			sc->held_packets = network_queue_pop_string(server->send_queue, server->send_queue->len, NULL);
+
+			g_string_truncate(sc->prepare_query, 0);
+			g_string_append_len(sc->prepare_query, S(query));
+			sc->is_preparing = TRUE;
+
+			prepare = g_string_sized_new(query->len + 1);
+			g_string_append_c(prepare, COM_STMT_PREPARE);
+			g_string_append_len(prepare, S(query));
+
+			network_mysqld_queue_reset(server);
+			network_mysqld_queue_append(server, server->send_queue, S(prepare));
+
+			g_string_free(prepare, TRUE);
+		}
+
+		if (command == COM_STMT_CLOSE) network_stmt_con_remove(sc, stmt_id);
+
+		break;
+	}
+
+	network_stmt_cache_append_closes(server->prepared_stmts, server->send_queue);
+}
+
+/**
+ * handle the response to a COM_STMT_PREPARE
+ *
+ * - the client gets a statement-id of its own for the statement of the backend
+ * - if we prepared the statement for a held back command, the response is
+ *   dropped and the command is sent instead
+ *
+ * @return TRUE if the packet was handled and the result isn't forwarded
+ */
+static gboolean proxy_stmt_read_query_result(network_mysqld_con *con, int is_finished) {
+	network_mysqld_con_lua_t *st = con->plugin_con_state;
+	network_stmt_con *sc = st->stmts;
+	network_socket *server = con->server;
+	GString *packet;
+	guint32 stmt_id;
+
+	if (NULL == sc) return FALSE;
+
+	packet = g_queue_peek_tail(server->recv_queue->chunks);
+
+	if (sc->is_preparing) {
+		sc->is_preparing = FALSE;
+
+		if (packet->len > NET_HEADER_SIZE && (guint8)packet->str[NET_HEADER_SIZE] == MYSQLD_PACKET_OK) {
+			network_mysqld_stmt_prepare_ok_packet_t *prepare_ok;
+			network_packet p;
+
+			p.data = packet;
+			p.offset = NET_HEADER_SIZE;
 
-					while ((inj = g_queue_pop_head(st->injected.queries))) injection_free(inj);
-				}
-			
-				break;
-			case PROXY_SEND_QUERY:
-				/* send the injected queries
-				 *
-				 * injection_new(..., query);
-				 * 
-				 *  */
+			prepare_ok = network_mysqld_stmt_prepare_ok_packet_new();
+			if (0 == network_mysqld_proto_get_stmt_prepare_ok_packet(&p, prepare_ok)) {
+				network_stmt_cache_add(server->prepared_stmts, sc->prepare_query, prepare_ok->stmt_id);
 
-				if (st->injected.queries->length == 0) {
-					g_critical("%s: 'return proxy.PROXY_SEND_QUERY' used without proxy.queue:append() or :prepend(). Assuming 'nil' was returned",
-							G_STRLOC);
-				} else {
-					ret = PROXY_SEND_INJECTION;
+				if (NULL == sc->held_packets) {
+					network_stmt_set_id(packet, network_stmt_con_add(sc, sc->prepare_query));
 				}
-	
-				break;
-			default:
-				break;
 			}
-			lua_pop(L, 1); /* fenv */
-		} else {
-			lua_pop(L, 2); /* fenv + nil */
-		}
+			network_mysqld_stmt_prepare_ok_packet_free(prepare_ok);
+		} else if (sc->held_packets) {
+			/* the query can't be prepared on this backend (the table is gone, ...) */
+			guint8 command = sc->held_packets->str[NET_HEADER_SIZE];
 
-		g_assert(lua_isfunction(L, -1));
+			g_string_free(sc->held_packets, TRUE);
+			sc->held_packets = NULL;
 
-		if (ret != PROXY_NO_DECISION) {
-			return ret;
+			if (command != COM_STMT_SEND_LONG_DATA) {
+				/* the error is the response to the held back command */
+				return FALSE;
+			}
+
+			/* ... but the client doesn't expect a response for the long data, the COM_STMT_EXECUTE will fail too */
+			g_string_free(g_queue_pop_tail(server->recv_queue->chunks), TRUE);
+
+			network_mysqld_queue_reset(con->client);
+			network_mysqld_queue_reset(server);
+
+			con->state = CON_STATE_READ_QUERY;
+
+			return TRUE;
 		}
 	}
-#endif
-	return PROXY_NO_DECISION;
+
+	if (NULL == sc->held_packets) return FALSE;
+
+	/* the response to our own COM_STMT_PREPARE */
+	g_string_free(g_queue_pop_tail(server->recv_queue->chunks), TRUE);
+
+	if (!is_finished) return TRUE;
+
+	network_mysqld_queue_reset(server);
+
+	if (network_stmt_cache_get(server->prepared_stmts, sc->prepare_query, &stmt_id)) {
+		network_stmt_set_id(sc->held_packets, stmt_id);
+	}
+	network_queue_append(server->send_queue, sc->held_packets);
+	sc->held_packets = NULL;
+
+	network_stmt_cache_append_closes(server->prepared_stmts, server->send_queue);
+
+	network_mysqld_con_reset_command_response_state(con);
+
+	con->state = CON_STATE_SEND_QUERY;
+
+	return TRUE;
+}
+
+/**
+ * count the query as in flight on the backend until its result is read
+ *
+ * for the p2c balancing
+ */
+static void proxy_backend_query_start(network_mysqld_con_lua_t *st) {
+	if (st->in_flight_backend || NULL == st->backend) return;
+
+	st->in_flight_backend = st->backend;
+	g_atomic_int_inc(&(st->in_flight_backend->in_flight));
+}
+
+static void proxy_backend_query_done(network_mysqld_con_lua_t *st) {
+	if (NULL == st->in_flight_backend) return;
+
+	g_atomic_int_add(&(st->in_flight_backend->in_flight), -1);
+	st->in_flight_backend = NULL;
 }
 
 /**
@@ -1330,10 +2660,50 @@ NETWORK_MYSQLD_PLUGIN_PROTO(proxy_read_query) {
 	 */
 	st->is_in_com_change_user = FALSE;
 
+	if (NULL == con->server && st->multiplex_backend_ndx >= 0) {
+		packet = g_queue_peek_head(recv_sock->recv_queue->chunks);
+
+		if (packet->len > NET_HEADER_SIZE && packet->str[NET_HEADER_SIZE] == COM_QUIT) {
+			/* the backend connection is in the pool, there is nothing to forward */
+			con->state = CON_STATE_CLOSE_CLIENT;
+
+			return NETWORK_SOCKET_SUCCESS;
+		}
+
+		if (!proxy_multiplex_acquire(con) && proxy_multiplex_park(con)) {
+			/* proxy_multiplex_parking_wakeup() or the timeout hands us the command again */
+			return NETWORK_SOCKET_WAIT_FOR_EVENT;
+		}
+
+		proxy_multiplex_unpark(con);
+
+		if (NULL == con->server) {
+			/**
+			 * we can't open a new connection for the client as we don't know its password
+			 * and we waited long enough for one to come back to the pool
+			 */
+			while ((packet = g_queue_pop_head(recv_sock->recv_queue->chunks))) g_string_free(packet, TRUE);
+
+			network_mysqld_con_reset_command_response_state(con);
+			network_mysqld_con_send_error(con->client, C("(proxy) all backend connections are busy"));
+
+			con->state = CON_STATE_SEND_QUERY_RESULT;
+			con->resultset_is_finished = TRUE;
+
+			return NETWORK_SOCKET_SUCCESS;
+		}
+	}
+
 	NETWORK_MYSQLD_CON_TRACK_TIME(con, "proxy::ready_query::enter_lua");
 	ret = proxy_lua_read_query(con);
 	NETWORK_MYSQLD_CON_TRACK_TIME(con, "proxy::ready_query::leave_lua");
 
+	if (ret == PROXY_NO_DECISION &&
+	    proxy_query_cache_lookup(con, g_queue_peek_head(recv_sock->recv_queue->chunks))) {
+		/* the cached result is in the send-queue already, handle it like a result from lua */
+		ret = PROXY_SEND_RESULT;
+	}
+
 	/**
 	 * if we disconnected in read_query_result() we have no connection open
 	 * when we try to execute the next query 
@@ -1351,6 +2721,13 @@ NETWORK_MYSQLD_PLUGIN_PROTO(proxy_read_query) {
 	case PROXY_SEND_QUERY:
 		send_sock = con->server;
 
+		packet = g_queue_peek_head(recv_sock->recv_queue->chunks);
+		if (packet && packet->len > NET_HEADER_SIZE) {
+			proxy_query_cache_track_query(con, packet->str + NET_HEADER_SIZE, packet->len - NET_HEADER_SIZE);
+			proxy_multiplex_track_query(con, packet->str + NET_HEADER_SIZE, packet->len - NET_HEADER_SIZE);
+			proxy_session_track_query(con, packet->str + NET_HEADER_SIZE, packet->len - NET_HEADER_SIZE);
+		}
+
 		/* no injection, pass on the chunks as is */
 		while ((packet = g_queue_pop_head(recv_sock->recv_queue->chunks))) {
 			network_mysqld_queue_append_raw(send_sock, send_sock->send_queue, packet);
@@ -1393,6 +2770,10 @@ NETWORK_MYSQLD_PLUGIN_PROTO(proxy_read_query) {
 
 		send_sock = con->server;
 
+		proxy_query_cache_track_query(con, S(inj->query));
+		proxy_multiplex_track_query(con, S(inj->query));
+		proxy_session_track_query(con, S(inj->query));
+
 		network_mysqld_queue_reset(send_sock);
 		network_mysqld_queue_append(send_sock, send_sock->send_queue, S(inj->query));
 
@@ -1404,6 +2785,11 @@ NETWORK_MYSQLD_PLUGIN_PROTO(proxy_read_query) {
 	}
 
 	if (proxy_query) {
+		proxy_multiplex_prepare_session(con);
+		proxy_stmt_send_query(con);
+		proxy_multiplex_send_prelude(con);
+		proxy_backend_query_start(st);
+
 		con->state = CON_STATE_SEND_QUERY;
 	} else {
 		GList *cur;
@@ -1472,6 +2858,8 @@ NETWORK_MYSQLD_PLUGIN_PROTO(proxy_send_query_result) {
 	if (st->injected.queries->length == 0) {
 		/* we have nothing more to send, let's see what the next state is */
 
+		proxy_multiplex_release(con);
+
 		con->state = CON_STATE_READ_QUERY;
 
 		return NETWORK_SOCKET_SUCCESS;
@@ -1495,11 +2883,18 @@ NETWORK_MYSQLD_PLUGIN_PROTO(proxy_send_query_result) {
 	g_assert(inj);
 	g_assert(send_sock);
 
+	proxy_query_cache_track_query(con, S(inj->query));
+	proxy_multiplex_track_query(con, S(inj->query));
+	proxy_session_track_query(con, S(inj->query));
+
 	network_mysqld_queue_reset(send_sock);
 	network_mysqld_queue_append(send_sock, send_sock->send_queue, S(inj->query));
 
 	network_mysqld_con_reset_command_response_state(con);
 
+	proxy_stmt_send_query(con);
+	proxy_backend_query_start(st);
+
 	con->state = CON_STATE_SEND_QUERY;
 
 	return NETWORK_SOCKET_SUCCESS;
@@ -1548,9 +2943,19 @@ NETWORK_MYSQLD_PLUGIN_PROTO(proxy_read_query_result) {
 
 	con->resultset_is_finished = is_finished;
 
+	/* the session was switched for a held back command */
+	if (proxy_multiplex_read_query_result(con, is_finished)) return NETWORK_SOCKET_SUCCESS;
+
+	/* the statement was prepared for a held back command */
+	if (proxy_stmt_read_query_result(con, is_finished)) return NETWORK_SOCKET_SUCCESS;
+
 	/* copy the packet over to the send-queue if we don't need it */
 	if (!con->resultset_is_needed) {
-		network_mysqld_queue_append_raw(send_sock, send_sock->send_queue, g_queue_pop_tail(recv_sock->recv_queue->chunks));
+		GString *chunk = g_queue_pop_tail(recv_sock->recv_queue->chunks);
+
+		if (con->resultset_is_copied) proxy_query_cache_copy_packet(con, chunk);
+
+		network_mysqld_queue_append_raw(send_sock, send_sock->send_queue, chunk);
 	}
 
 	if (is_finished) {
@@ -1585,6 +2990,11 @@ NETWORK_MYSQLD_PLUGIN_PROTO(proxy_read_query_result) {
 		
 		network_mysqld_queue_reset(recv_sock); /* reset the packet-id checks as the server-side is finished */
 
+		proxy_backend_query_done(st);
+		proxy_query_cache_track_result(con);
+		proxy_multiplex_track_result(con);
+		proxy_session_track_result(con);
+
 		NETWORK_MYSQLD_CON_TRACK_TIME(con, "proxy::ready_query_result::enter_lua");
 		ret = proxy_lua_read_query_result(con);
 		NETWORK_MYSQLD_CON_TRACK_TIME(con, "proxy::ready_query_result::leave_lua");
@@ -1602,6 +3012,8 @@ NETWORK_MYSQLD_PLUGIN_PROTO(proxy_read_query_result) {
 		} else {
 			g_assert_cmpint(con->resultset_is_needed, ==, 1); /* we already forwarded the resultset, no way someone has flushed the resultset-queue */
 
+			proxy_multiplex_release(con);
+
 			con->state = CON_STATE_READ_QUERY;
 		}
 	}
@@ -1737,9 +3149,8 @@ static network_mysqld_lua_stmt_ret proxy_lua_connect_server(network_mysqld_con *
  */
 NETWORK_MYSQLD_PLUGIN_PROTO(proxy_connect_server) {
 	network_mysqld_con_lua_t *st = con->plugin_con_state;
+	chassis_plugin_config *config = con->config;
 	chassis_private *g = con->srv->priv;
-	guint min_connected_clients = G_MAXUINT;
-	guint i;
 	gboolean use_pooled_connection = FALSE;
 	network_backend_t *cur;
 
@@ -1805,15 +3216,15 @@ NETWORK_MYSQLD_PLUGIN_PROTO(proxy_connect_server) {
 	}
 
 	/* protect the typecast below */
-	g_assert_cmpint(g->backends->backends->len, <, G_MAXINT);
+	g_assert_cmpint(network_backends_count(g->backends), <, G_MAXINT);
 
 	/**
-	 * if the current backend is down, ignore it 
+	 * if the current backend is down or drained, ignore it 
 	 */
 	cur = network_backends_get(g->backends, st->backend_ndx);
 
 	if (cur) {
-		if (cur->state == BACKEND_STATE_DOWN) {
+		if (cur->state == BACKEND_STATE_DOWN || cur->is_drained) {
 			st->backend_ndx = -1;
 		}
 	}
@@ -1833,23 +3244,10 @@ NETWORK_MYSQLD_PLUGIN_PROTO(proxy_connect_server) {
 		/**
 		 * we can choose between different back addresses 
 		 *
-		 * prefer SQF (shorted queue first) to load all backends equally
+		 * pick one of the writable backends that isn't down by the --proxy-balance
+		 * policy, the client isn't authed yet
 		 */ 
-
-		for (i = 0; i < network_backends_count(g->backends); i++) {
-			cur = network_backends_get(g->backends, i);
-	
-			/**
-			 * skip backends which are down or not writable
-			 */	
-			if (cur->state == BACKEND_STATE_DOWN ||
-			    cur->type != BACKEND_TYPE_RW) continue;
-	
-			if (cur->connected_clients < min_connected_clients) {
-				st->backend_ndx = i;
-				min_connected_clients = cur->connected_clients;
-			}
-		}
+		st->backend_ndx = network_backends_balance(g->backends, BACKEND_TYPE_RW, NULL, NULL);
 
 		if ((cur = network_backends_get(g->backends, st->backend_ndx))) {
 			st->backend = cur;
@@ -1866,6 +3264,19 @@ NETWORK_MYSQLD_PLUGIN_PROTO(proxy_connect_server) {
 		return NETWORK_SOCKET_ERROR;
 	}
 
+	if (config->multiplex) st->multiplex_backend_ndx = st->backend_ndx;
+
+	/**
+	 * re-auth a idle connection of any user in proxy_read_auth() instead of opening a new one
+	 *
+	 * with --proxy-pool-warm-user the health-checker keeps them in the pool for us
+	 */
+	if ((config->multiplex || config->pool_warm_users) &&
+	    NULL == con->server &&
+	    NULL != (con->server = network_connection_pool_get_authed(st->backend->pool, NULL, NULL, 0, NULL))) {
+		st->backend->connected_clients++;
+	}
+
 	/**
 	 * check if we have a connection in the pool for this backend
 	 */
@@ -1931,20 +3342,6 @@ NETWORK_MYSQLD_PLUGIN_PROTO(proxy_connect_server) {
 	return NETWORK_SOCKET_SUCCESS;
 }
 
-/**
- * convert a double into a timeval
- */
-static gboolean
-timeval_from_double(struct timeval *dst, double t) {
-	g_return_val_if_fail(dst != NULL, FALSE);
-	g_return_val_if_fail(t >= 0, FALSE);
-
-	dst->tv_sec = floor(t);
-	dst->tv_usec = floor((t - dst->tv_sec) * 1000000);
-
-	return TRUE;
-}
-
 NETWORK_MYSQLD_PLUGIN_PROTO(proxy_init) {
 	network_mysqld_con_lua_t *st = con->plugin_con_state;
 	chassis_plugin_config *config = con->config;
@@ -1953,6 +3350,17 @@ NETWORK_MYSQLD_PLUGIN_PROTO(proxy_init) {
 
 	st = network_mysqld_con_lua_new();
 
+	if (config->query_cache) {
+		st->query_cache = network_query_cache_con_new();
+		st->query_cache->server_status = SERVER_STATUS_AUTOCOMMIT;
+	}
+
+	if (config->stmt_multiplexing) {
+		st->stmts = network_stmt_con_new();
+	}
+
+	st->multiplex_server_status = SERVER_STATUS_AUTOCOMMIT;
+
 	con->plugin_con_state = st;
 	
 	con->state = CON_STATE_CONNECT_SERVER;
@@ -2055,10 +3463,15 @@ static network_mysqld_lua_stmt_ret proxy_lua_disconnect_client(network_mysqld_co
  */
 NETWORK_MYSQLD_PLUGIN_PROTO(proxy_disconnect_client) {
 	network_mysqld_con_lua_t *st = con->plugin_con_state;
-	lua_scope  *sc = con->srv->priv->sc;
 	gboolean use_pooled_connection = FALSE;
 
 	if (st == NULL) return NETWORK_SOCKET_SUCCESS;
+
+	/* the client went away while a query was in flight */
+	proxy_backend_query_done(st);
+
+	/* ... or while its command waited for a pooled connection */
+	proxy_multiplex_unpark(con);
 	
 	/**
 	 * let the lua-level decide if we want to keep the connection in the pool
@@ -2093,10 +3506,15 @@ NETWORK_MYSQLD_PLUGIN_PROTO(proxy_disconnect_client) {
 		st->backend->connected_clients--;
 	}
 
+	if (st->query_cache) {
+		/* we may have missed the result of a write */
+		network_query_cache_con_invalidate(con->config->query_cache, st->query_cache);
+	}
+
 #ifdef HAVE_LUA_H
 	/* remove this cached script from registry */
 	if (st->L_ref > 0) {
-		luaL_unref(sc->L, LUA_REGISTRYINDEX, st->L_ref);
+		luaL_unref(st->sc->L, LUA_REGISTRYINDEX, st->L_ref);
 	}
 #endif
 
@@ -2267,6 +3685,22 @@ chassis_plugin_config * network_mysqld_proxy_plugin_new(void) {
 	config->read_timeout_dbl = -1.0;
 	config->write_timeout_dbl = -1.0;
 
+	config->compress_min_length = NETWORK_MYSQLD_COMPRESS_MIN_LENGTH;
+
+	config->query_cache_ttl_dbl = 5.0;
+
+	config->backend_check_timeout_dbl = 2.0;
+	config->backend_check_rise = 2;
+	config->backend_check_fall = 3;
+
+	config->read_only_max_lag = -1;
+
+	config->pool_min_idle = 1;
+
+	config->multiplex_wait_timeout_dbl = 5.0;
+	config->multiplex_parkings_mutex = g_mutex_new();
+	config->multiplex_parkings = g_ptr_array_new();
+
 	return config;
 }
 
@@ -2283,6 +3717,11 @@ void network_mysqld_proxy_plugin_free(chassis_plugin_config *config) {
 #endif
 	}
 
+	if (config->listen_cons) {
+		/* the connections are free()ed by network_mysqld_free() too */
+		g_ptr_array_free(config->listen_cons, TRUE);
+	}
+
 	if (config->backend_addresses) {
 		for (i = 0; config->backend_addresses[i]; i++) {
 			g_free(config->backend_addresses[i]);
@@ -2299,6 +3738,18 @@ void network_mysqld_proxy_plugin_free(chassis_plugin_config *config) {
 
 	if (config->lua_script) g_free(config->lua_script);
 
+	network_query_cache_free(config->query_cache);
+
+	network_backends_checker_free(config->backend_checker);
+	if (config->backend_check_user) g_free(config->backend_check_user);
+	if (config->backend_check_password) g_free(config->backend_check_password);
+	if (config->backend_check_lag_query) g_free(config->backend_check_lag_query);
+	if (config->balance) g_free(config->balance);
+	if (config->read_only_balance) g_free(config->read_only_balance);
+	if (config->pool_warm_users) g_strfreev(config->pool_warm_users);
+
+	proxy_multiplex_parkings_free(config);
+
 	g_free(config);
 }
 
@@ -2328,6 +3779,33 @@ static GOptionEntry * network_mysqld_proxy_plugin_get_options(chassis_plugin_con
 		{ "proxy-connect-timeout",    0, 0, G_OPTION_ARG_DOUBLE, NULL, "connect timeout in seconds (default: 2.0 seconds)", NULL },
 		{ "proxy-read-timeout",    0, 0, G_OPTION_ARG_DOUBLE, NULL, "read timeout in seconds (default: 8 hours)", NULL },
 		{ "proxy-write-timeout",    0, 0, G_OPTION_ARG_DOUBLE, NULL, "write timeout in seconds (default: 8 hours)", NULL },
+
+		{ "proxy-client-compress",    0, 0, G_OPTION_ARG_NONE, NULL, "offer the compressed protocol to the clients (default: disabled)", NULL },
+		{ "proxy-backend-compress",   0, 0, G_OPTION_ARG_NONE, NULL, "use the compressed protocol to the backends (default: disabled)", NULL },
+		{ "proxy-compress-min-length", 0, 0, G_OPTION_ARG_INT, NULL, "don't compress packets smaller than this (default: 50)", "<bytes>" },
+
+		{ "proxy-query-cache-size",   0, 0, G_OPTION_ARG_INT, NULL, "size of the result-cache in MByte (default: 0, disabled)", "<mbytes>" },
+		{ "proxy-query-cache-ttl",    0, 0, G_OPTION_ARG_DOUBLE, NULL, "cached results expire after this many seconds (default: 5.0)", "<seconds>" },
+
+		{ "proxy-stmt-multiplexing",  0, 0, G_OPTION_ARG_NONE, NULL, "prepare the statements of the clients again on the pooled backend connection that executes them (default: disabled)", NULL },
+		{ "proxy-multiplex",          0, 0, G_OPTION_ARG_NONE, NULL, "return the backend connections to the pool between transactions (default: disabled)", NULL },
+		{ "proxy-multiplex-wait-timeout", 0, 0, G_OPTION_ARG_DOUBLE, NULL, "a command waits this many seconds for a pooled connection if all are busy, 0 to fail at once (default: 5.0)", "<seconds>" },
+
+		{ "proxy-backend-check-interval", 0, 0, G_OPTION_ARG_DOUBLE, NULL, "health-check the backends every n seconds (default: 0, disabled)", "<seconds>" },
+		{ "proxy-backend-check-timeout", 0, 0, G_OPTION_ARG_DOUBLE, NULL, "a health-check that takes longer failed (default: 2.0)", "<seconds>" },
+		{ "proxy-backend-check-rise", 0, 0, G_OPTION_ARG_INT, NULL, "successful health-checks in a row to bring a backend UP again (default: 2)", "<checks>" },
+		{ "proxy-backend-check-fall", 0, 0, G_OPTION_ARG_INT, NULL, "failed health-checks in a row to mark a backend DOWN (default: 3)", "<checks>" },
+		{ "proxy-backend-check-user", 0, 0, G_OPTION_ARG_STRING, NULL, "log in as this user and send a COM_PING, needed by --proxy-backend-check-interval (default: not set)", "<user>" },
+		{ "proxy-backend-check-password", 0, 0, G_OPTION_ARG_STRING, NULL, "password of the --proxy-backend-check-user (default: empty)", "<password>" },
+		{ "proxy-backend-check-lag-query", 0, 0, G_OPTION_ARG_STRING, NULL, "query for the replication-lag of the read-only backends, the Seconds_Behind_Master column or the first one of the first row, empty to not ask (default: SHOW SLAVE STATUS)", "<query>" },
+
+		{ "proxy-balance",            0, 0, G_OPTION_ARG_STRING, NULL, "how to pick a read-write backend: sqf, wrr, p2c, latency, hash-user or hash-schema (default: sqf)", "<policy>" },
+		{ "proxy-read-only-balance",  0, 0, G_OPTION_ARG_STRING, NULL, "how proxy.connection:balance() picks a read-only backend (default: sqf)", "<policy>" },
+		{ "proxy-read-only-max-lag",  0, 0, G_OPTION_ARG_INT, NULL, "proxy.connection:balance() skips read-only backends that are more seconds behind their master, needs --proxy-backend-check-interval (default: -1, no limit)", "<seconds>" },
+
+		{ "proxy-pool-warm-user",     0, 0, G_OPTION_ARG_STRING_ARRAY, NULL, "keep idle connections of this user in the pools of the backends, needs --proxy-backend-check-interval (default: not set)", "<user>[:<password>]" },
+		{ "proxy-pool-min-idle",      0, 0, G_OPTION_ARG_INT, NULL, "idle connections to keep per backend and --proxy-pool-warm-user (default: 1)", "<conns>" },
+		{ "proxy-pool-max-idle-time", 0, 0, G_OPTION_ARG_INT, NULL, "close pooled connections that idled longer, keep it below the wait_timeout of the backends (default: 0, no limit)", "<seconds>" },
 		
 		{ NULL,                       0, 0, G_OPTION_ARG_NONE,   NULL, NULL, NULL }
 	};
@@ -2346,10 +3824,85 @@ static GOptionEntry * network_mysqld_proxy_plugin_get_options(chassis_plugin_con
 	config_entries[i++].arg_data = &(config->connect_timeout_dbl);
 	config_entries[i++].arg_data = &(config->read_timeout_dbl);
 	config_entries[i++].arg_data = &(config->write_timeout_dbl);
+	config_entries[i++].arg_data = &(config->client_compress);
+	config_entries[i++].arg_data = &(config->backend_compress);
+	config_entries[i++].arg_data = &(config->compress_min_length);
+	config_entries[i++].arg_data = &(config->query_cache_size);
+	config_entries[i++].arg_data = &(config->query_cache_ttl_dbl);
+	config_entries[i++].arg_data = &(config->stmt_multiplexing);
+	config_entries[i++].arg_data = &(config->multiplex);
+	config_entries[i++].arg_data = &(config->multiplex_wait_timeout_dbl);
+	config_entries[i++].arg_data = &(config->backend_check_interval_dbl);
+	config_entries[i++].arg_data = &(config->backend_check_timeout_dbl);
+	config_entries[i++].arg_data = &(config->backend_check_rise);
+	config_entries[i++].arg_data = &(config->backend_check_fall);
+	config_entries[i++].arg_data = &(config->backend_check_user);
+	config_entries[i++].arg_data = &(config->backend_check_password);
+	config_entries[i++].arg_data = &(config->backend_check_lag_query);
+	config_entries[i++].arg_data = &(config->balance);
+	config_entries[i++].arg_data = &(config->read_only_balance);
+	config_entries[i++].arg_data = &(config->read_only_max_lag);
+	config_entries[i++].arg_data = &(config->pool_warm_users);
+	config_entries[i++].arg_data = &(config->pool_min_idle);
+	config_entries[i++].arg_data = &(config->pool_max_idle_time);
 
 	return config_entries;
 }
 
+/**
+ * open a listen-socket and register it in a event-thread
+ *
+ * @param event_thread the event-thread that shall accept() the connections, NULL for the main-thread
+ * @param addr         address to bind to, if NULL config->address is used
+ * @param reuse_port   set SO_REUSEPORT on the socket
+ * @return the listen-connection or NULL on error
+ */
+static network_mysqld_con *network_mysqld_proxy_listen(chassis *chas, chassis_plugin_config *config, 
+		chassis_event_thread_t *event_thread, network_address *addr, gboolean reuse_port) {
+	network_mysqld_con *con;
+	network_socket *listen_sock;
+
+	/** 
+	 * create a connection handle for the listen socket 
+	 */
+	con = network_mysqld_con_new();
+	network_mysqld_add_connection(chas, con);
+	con->config = config;
+
+	/* new connections stay in the thread that accept()ed them */
+	con->event_thread = event_thread;
+
+	g_ptr_array_add(config->listen_cons, con);
+	
+	listen_sock = network_socket_new();
+	con->server = listen_sock;
+
+	listen_sock->listen_backlog = chas->listen_backlog;
+	listen_sock->reuse_port     = reuse_port;
+
+	/* set the plugin hooks as we want to apply them to the new connections too later */
+	network_mysqld_proxy_connection_init(con);
+
+	if (NULL != addr) {
+		network_address_copy(listen_sock->dst, addr);
+	} else if (0 != network_address_set_address(listen_sock->dst, config->address)) {
+		return NULL;
+	}
+
+	if (0 != network_socket_bind(listen_sock)) {
+		return NULL;
+	}
+
+	/**
+	 * call network_mysqld_con_accept() with this connection when we are done
+	 */
+	event_set(&(listen_sock->event), listen_sock->fd, EV_READ|EV_PERSIST, network_mysqld_con_accept, con);
+	event_base_set(event_thread ? event_thread->event_base : chas->event_base, &(listen_sock->event));
+	event_add(&(listen_sock->event), NULL);
+
+	return con;
+}
+
 /**
  * init the plugin with the parsed config
  */
@@ -2357,6 +3910,10 @@ int network_mysqld_proxy_plugin_apply_config(chassis *chas, chassis_plugin_confi
 	network_mysqld_con *con;
 	network_socket *listen_sock;
 	chassis_private *g = chas->priv;
+	chassis_event_threads_t *threads = chas->threads;
+	backend_balance_t balance = BACKEND_BALANCE_SQF;
+	backend_balance_t read_only_balance = BACKEND_BALANCE_SQF;
+	gboolean reuse_port;
 	guint i;
 
 	if (!config->start_proxy) {
@@ -2369,29 +3926,119 @@ int network_mysqld_proxy_plugin_apply_config(chassis *chas, chassis_plugin_confi
 		config->backend_addresses[0] = g_strdup("127.0.0.1:3306");
 	}
 
-	/** 
-	 * create a connection handle for the listen socket 
-	 */
-	con = network_mysqld_con_new();
-	network_mysqld_add_connection(chas, con);
-	con->config = config;
+	if ((config->client_compress || config->backend_compress) &&
+	    !network_mysqld_compress_is_supported()) {
+		g_critical("%s: --proxy-client-compress and --proxy-backend-compress need zlib, this build doesn't support them", G_STRLOC);
+		return -1;
+	}
 
-	config->listen_con = con;
-	
-	listen_sock = network_socket_new();
-	con->server = listen_sock;
+	if (config->compress_min_length < 0) {
+		g_critical("%s: --proxy-compress-min-length has to be >= 0, got %d", G_STRLOC, config->compress_min_length);
+		return -1;
+	}
 
-	/* set the plugin hooks as we want to apply them to the new connections too later */
-	network_mysqld_proxy_connection_init(con);
+	if (config->query_cache_size < 0 || config->query_cache_ttl_dbl < 0) {
+		g_critical("%s: --proxy-query-cache-size and --proxy-query-cache-ttl have to be >= 0", G_STRLOC);
+		return -1;
+	}
 
-	if (0 != network_address_set_address(listen_sock->dst, config->address)) {
+	if (config->multiplex && !config->pool_change_user) {
+		g_critical("%s: --proxy-multiplex re-auths the pooled connections with COM_CHANGE_USER, it can't be used with --proxy-pool-no-change-user", G_STRLOC);
 		return -1;
 	}
 
-	if (0 != network_socket_bind(listen_sock)) {
+	if (config->multiplex_wait_timeout_dbl < 0) {
+		g_critical("%s: --proxy-multiplex-wait-timeout has to be >= 0, got %.2f", G_STRLOC, config->multiplex_wait_timeout_dbl);
+		return -1;
+	}
+
+	if (config->backend_check_interval_dbl < 0 ||
+	    config->backend_check_timeout_dbl <= 0 ||
+	    config->backend_check_rise < 1 ||
+	    config->backend_check_fall < 1) {
+		g_critical("%s: --proxy-backend-check-interval has to be >= 0, --proxy-backend-check-timeout > 0 and --proxy-backend-check-rise and -fall >= 1", G_STRLOC);
+		return -1;
+	}
+
+	if (config->backend_check_interval_dbl > 0 && NULL == config->backend_check_user) {
+		/* a check that only waits for the handshake is a connect-error for the server and trips max_connect_errors */
+		g_critical("%s: --proxy-backend-check-interval needs --proxy-backend-check-user", G_STRLOC);
+		return -1;
+	}
+
+	if ((config->balance && 0 != network_backends_balance_from_string(config->balance, &balance)) ||
+	    (config->read_only_balance && 0 != network_backends_balance_from_string(config->read_only_balance, &read_only_balance))) {
+		g_critical("%s: --proxy-balance and --proxy-read-only-balance have to be one of sqf, wrr, p2c, latency, hash-user or hash-schema", G_STRLOC);
+		return -1;
+	}
+
+	if (config->read_only_max_lag < -1) {
+		g_critical("%s: --proxy-read-only-max-lag has to be >= 0 or -1", G_STRLOC);
+		return -1;
+	}
+
+	if (config->read_only_max_lag >= 0 && config->backend_check_interval_dbl == 0) {
+		/* without the health-checks nobody asks for the lag */
+		g_critical("%s: --proxy-read-only-max-lag needs --proxy-backend-check-interval", G_STRLOC);
+		return -1;
+	}
+
+	if (config->pool_min_idle < 0 || config->pool_max_idle_time < 0) {
+		g_critical("%s: --proxy-pool-min-idle and --proxy-pool-max-idle-time have to be >= 0", G_STRLOC);
+		return -1;
+	}
+
+	if (config->pool_warm_users &&
+	    (config->backend_check_interval_dbl == 0 || !config->pool_change_user)) {
+		/* the health-checker opens the connections, the clients re-auth them */
+		g_critical("%s: --proxy-pool-warm-user needs --proxy-backend-check-interval and can't be used with --proxy-pool-no-change-user", G_STRLOC);
+		return -1;
+	}
+
+	if (config->query_cache_size > 0) {
+		config->query_cache = network_query_cache_new((gsize)config->query_cache_size * 1024 * 1024,
+				(guint64)(config->query_cache_ttl_dbl * G_USEC_PER_SEC));
+	}
+
+	config->listen_cons = g_ptr_array_new();
+
+	/**
+	 * with --listen-reuseport each event-thread gets its own listen-socket and
+	 * accept()s and handles its connections itself
+	 *
+	 * the event-threads are already created, but not started yet
+	 */
+	reuse_port = chas->listen_reuseport && threads->event_threads->len > 1;
+
+	if (NULL == (con = network_mysqld_proxy_listen(chas, config, 
+			reuse_port ? threads->event_threads->pdata[0] : NULL, NULL, reuse_port))) {
 		return -1;
 	}
-	g_message("proxy listening on port %s", config->address);
+	config->listen_con = con;
+	listen_sock = con->server;
+
+	if (reuse_port &&
+	    (listen_sock->dst->addr.common.sa_family == AF_INET ||
+	     listen_sock->dst->addr.common.sa_family == AF_INET6)) {
+		for (i = 1; i < threads->event_threads->len; i++) {
+			/* bind to the same address, even if the port was picked by the first bind() */
+			if (NULL == network_mysqld_proxy_listen(chas, config, threads->event_threads->pdata[i], listen_sock->dst, TRUE)) {
+				return -1;
+			}
+		}
+
+		g_message("proxy listening on port %s (%d listen-sockets)", config->address, threads->event_threads->len);
+	} else {
+		if (reuse_port) {
+			/* unix-sockets can't be shared, stay with one listen-socket */
+			g_message("%s: --listen-reuseport is ignored for %s", G_STRLOC, config->address);
+		}
+
+		g_message("proxy listening on port %s", config->address);
+	}
+
+	/* the pools of the backends get it when they are added */
+	g->backends->pool_max_idle_time = config->pool_max_idle_time;
 
 	for (i = 0; config->backend_addresses && config->backend_addresses[i]; i++) {
 		if (-1 == network_backends_add(g->backends, config->backend_addresses[i],
@@ -2407,16 +4054,42 @@ int network_mysqld_proxy_plugin_apply_config(chassis *chas, chassis_plugin_confi
 		}
 	}
 
-	/* load the script and setup the global tables */
-	network_mysqld_lua_setup_global(chas->priv->sc->L, g);
+	network_backends_set_balance(g->backends, BACKEND_TYPE_RW, balance);
+	network_backends_set_balance(g->backends, BACKEND_TYPE_RO, read_only_balance);
+	network_backends_set_max_lag(g->backends, BACKEND_TYPE_RO, config->read_only_max_lag);
+
+	if (config->backend_check_interval_dbl > 0) {
+		network_backends_checker_t *checker;
+
+		checker = network_backends_checker_new(g->backends);
+		timeval_from_double(&checker->interval, config->backend_check_interval_dbl);
+		timeval_from_double(&checker->timeout, config->backend_check_timeout_dbl);
+		checker->rise = config->backend_check_rise;
+		checker->fall = config->backend_check_fall;
+		checker->username = g_strdup(config->backend_check_user);
+		if (config->backend_check_password) checker->password = g_strdup(config->backend_check_password);
+		if (NULL == config->backend_check_lag_query) {
+			checker->lag_query = g_strdup("SHOW SLAVE STATUS");
+		} else if (*config->backend_check_lag_query) {
+			checker->lag_query = g_strdup(config->backend_check_lag_query);
+		}
 
-	/**
-	 * call network_mysqld_con_accept() with this connection when we are done
-	 */
+		checker->min_idle = config->pool_min_idle;
+		for (i = 0; config->pool_warm_users && config->pool_warm_users[i]; i++) {
+			gchar **user_password = g_strsplit(config->pool_warm_users[i], ":", 2);
 
-	event_set(&(listen_sock->event), listen_sock->fd, EV_READ|EV_PERSIST, network_mysqld_con_accept, con);
-	event_base_set(chas->event_base, &(listen_sock->event));
-	event_add(&(listen_sock->event), NULL);
+			network_backends_checker_add_warm_user(checker, user_password[0], user_password[1]);
+
+			g_strfreev(user_password);
+		}
+
+		/* the checks run in the main-thread */
+		network_backends_checker_start(checker, chas->event_base);
+		config->backend_checker = checker;
+	}
+
+	/* load the script and setup the global tables */
+	network_mysqld_lua_setup_global(chas->priv->sc->L, g);
 
 	return 0;
 }
@@ -44,7 +44,12 @@
 
 #include <event.h>
 
+#ifdef HAVE_LUA_H
+#include <lua.h>
+#endif
+
 #include "chassis-event-thread.h"
+#include "lua-registry-keys.h"
 
 #define C(x) x, sizeof(x) - 1
 #ifndef WIN32
@@ -127,19 +132,41 @@ chassis_event_op_set_timeout(chassis_event_op_t *op, struct timeval *tv) {
 	}
 }
 
-void chassis_event_add_with_timeout(chassis *chas, struct event *ev, struct timeval *tv) {
-	chassis_event_op_t *op = chassis_event_op_new();
+GPrivate *tls_event_base_key = NULL;
+GPrivate *tls_event_thread_key = NULL;
+
+/**
+ * send a event-op to a event-thread
+ *
+ * if we are called from the event-thread itself the event is added directly to its event-base,
+ * otherwise the op is pushed to the event-queue of the thread and its notification-fd is pinged
+ *
+ * @see chassis_event_handle()
+ */
+void chassis_event_thread_add_with_timeout(chassis_event_thread_t *event_thread, struct event *ev, struct timeval *tv) {
+	chassis_event_op_t *op;
 	gssize ret;
 
+	g_assert(event_thread);
+
+	if (event_thread == g_private_get(tls_event_thread_key)) {
+		/* we are in the thread that owns the event, no need to go through the queue */
+		event_base_set(event_thread->event_base, ev);
+		event_add(ev, tv);
+
+		return;
+	}
+
+	op = chassis_event_op_new();
+
 	op->type = CHASSIS_EVENT_OP_ADD;
 	op->ev   = ev;
 	chassis_event_op_set_timeout(op, tv);
 
-	g_async_queue_lock(chas->threads->event_queue);
-	g_async_queue_push_unlocked(chas->threads->event_queue, op);
+	g_async_queue_push(event_thread->event_queue, op);
 
 	/* ping the event handler */
-	if (1 != (ret = send(chas->threads->event_notify_fds[1], C("."), 0))) {
+	if (1 != (ret = send(event_thread->notify_send_fd, C("."), 0))) {
 		int last_errno; 
 
 #ifdef _WIN32
@@ -151,37 +178,49 @@ void chassis_event_add_with_timeout(chassis *chas, struct event *ev, struct time
 		switch (last_errno) {
 		case EAGAIN:
 		case E_NET_WOULDBLOCK:
-			/* that's fine ... */
+			/* that's fine, the thread has enough pings pending to wake up */
 			g_debug("%s: send() to event-notify-pipe failed: %s (len = %d)",
 					G_STRLOC,
-					g_strerror(errno),
-					g_async_queue_length_unlocked(chas->threads->event_queue));
+					g_strerror(last_errno),
+					g_async_queue_length(event_thread->event_queue));
 			break;
 		default:
 			g_critical("%s: send() to event-notify-pipe failed: %s (len = %d)",
 					G_STRLOC,
-					g_strerror(errno),
-					g_async_queue_length_unlocked(chas->threads->event_queue));
+					g_strerror(last_errno),
+					g_async_queue_length(event_thread->event_queue));
 			break;
 		}
 	}
-	g_async_queue_unlock(chas->threads->event_queue);
 }
 
 /**
  * add a event asynchronously
  *
- * the event is added to the global event-queue and a fd-notification is sent allowing any
- * of the event-threads to handle it
+ * the event is added to the event-queue of the current event-thread. If we aren't called
+ * from a event-thread, the event is handed to the next event-thread in a round-robin fashion.
+ *
+ * events which have to stay on a thread should use chassis_event_thread_add_with_timeout()
+ */
+void chassis_event_add_with_timeout(chassis *chas, struct event *ev, struct timeval *tv) {
+	chassis_event_thread_t *event_thread;
+
+	if (NULL == (event_thread = g_private_get(tls_event_thread_key))) {
+		event_thread = chassis_event_threads_get_next(chas->threads);
+	}
+
+	chassis_event_thread_add_with_timeout(event_thread, ev, tv);
+}
+
+/**
+ * add a event asynchronously
  *
- * @see network_mysqld_con_handle()
+ * @see chassis_event_add_with_timeout()
  */
 void chassis_event_add(chassis *chas, struct event *ev) {
 	chassis_event_add_with_timeout(chas, ev, NULL);
 }
 
-GPrivate *tls_event_base_key = NULL;
-
 /**
  * add a event to the current thread 
  *
@@ -211,58 +250,55 @@ void chassis_event_add_local_with_timeout(chassis G_GNUC_UNUSED *chas, struct ev
 void chassis_event_add_local(chassis *chas, struct event *ev) {
 	chassis_event_add_local_with_timeout(chas, ev, NULL);
 }
+
 /**
- * handled events sent through the global event-queue 
+ * handle the events sent through the event-queue of a event-thread
+ *
+ * each event-thread listens on its own notification-fd and calls 
+ * chassis_event_handle() with its own event-base
  *
- * each event-thread has its own listener on the event-queue and 
- * calls chassis_event_handle() with its own event-base
+ * we first drain the notification-fd and then the queue. A op that gets pushed 
+ * after we drained the queue comes with a new ping and wakes us up again.
  *
- * @see chassis_event_add()
+ * @see chassis_event_thread_add_with_timeout()
  */
 void chassis_event_handle(int G_GNUC_UNUSED event_fd, short G_GNUC_UNUSED events, void *user_data) {
 	chassis_event_thread_t *event_thread = user_data;
 	struct event_base *event_base = event_thread->event_base;
-	chassis *chas = event_thread->chas;
 	chassis_event_op_t *op;
+	char ping[256];
+	gssize ret;
 
-	do {
-		char ping[1];
-
-		g_async_queue_lock(chas->threads->event_queue);
-		if ((op = g_async_queue_try_pop_unlocked(chas->threads->event_queue))) {
-			gsize ret;
-			chassis_event_op_apply(op, event_base);
+	while ((ret = recv(event_thread->notify_fd, ping, sizeof(ping), 0)) > 0);
 
-			chassis_event_op_free(op);
-	       
-			if (1 != (ret = recv(event_thread->notify_fd, ping, 1, 0))) {
-				/* we failed to pull .'s from the notify-queue */
-				int last_errno; 
+	if (-1 == ret) {
+		/* we failed to pull .'s from the notify-queue */
+		int last_errno; 
 
 #ifdef WIN32
-				last_errno = WSAGetLastError();
+		last_errno = WSAGetLastError();
 #else
-				last_errno = errno;
+		last_errno = errno;
 #endif
 
-				switch (last_errno) {
-				case EAGAIN:
-				case E_NET_WOULDBLOCK:
-					/* that's fine ... */
-					g_debug("%s: recv() from event-notify-fd failed: %s",
-							G_STRLOC,
-							g_strerror(last_errno));
-					break;
-				default:
-					g_critical("%s: recv() from event-notify-fd failed: %s",
-							G_STRLOC,
-							g_strerror(last_errno));
-					break;
-				}
-			}
+		switch (last_errno) {
+		case EAGAIN:
+		case E_NET_WOULDBLOCK:
+			/* that's fine, we drained the notify-fd */
+			break;
+		default:
+			g_critical("%s: recv() from event-notify-fd failed: %s",
+					G_STRLOC,
+					g_strerror(last_errno));
+			break;
 		}
-		g_async_queue_unlock(chas->threads->event_queue);
-	} while (op); /* even if op is 'free()d' it still is != NULL */
+	}
+
+	while ((op = g_async_queue_try_pop(event_thread->event_queue))) {
+		chassis_event_op_apply(op, event_base);
+
+		chassis_event_op_free(op);
+	}
 }
 
 /**
@@ -272,6 +308,8 @@ chassis_event_thread_t *chassis_event_thread_new() {
 	chassis_event_thread_t *event_thread;
 
 	event_thread = g_new0(chassis_event_thread_t, 1);
+	event_thread->notify_fd = -1;
+	event_thread->notify_send_fd = -1;
 
 	return event_thread;
 }
@@ -282,68 +320,92 @@ chassis_event_thread_t *chassis_event_thread_new() {
  * joins the event-thread, closes notification-pipe and free's the event-base
  */
 void chassis_event_thread_free(chassis_event_thread_t *event_thread) {
-	gboolean is_thread = (event_thread->thr != NULL);
+	gboolean is_thread;
+	chassis_event_op_t *op;
 
 	if (!event_thread) return;
 
+	/* the 1st thread runs on the global event-base, its thr is NULL. chassis_event_threads_join()
+	 * resets thr too, look at the event-base instead */
+	is_thread = (event_thread->chas && event_thread->event_base != event_thread->chas->event_base);
+
 	if (event_thread->thr) g_thread_join(event_thread->thr);
 
 	if (event_thread->notify_fd != -1) {
 		event_del(&(event_thread->notify_fd_event));
 		closesocket(event_thread->notify_fd);
 	}
+	if (event_thread->notify_send_fd != -1) {
+		closesocket(event_thread->notify_send_fd);
+	}
+
+	/* free the events that are still in the queue */
+	if (event_thread->event_queue) {
+		while ((op = g_async_queue_try_pop(event_thread->event_queue))) {
+			chassis_event_op_free(op);
+		}
+		g_async_queue_unref(event_thread->event_queue);
+	}
 
 	/* we don't want to free the global event-base */
 	if (is_thread && event_thread->event_base) event_base_free(event_thread->event_base);
 
+	if (event_thread->sc) lua_scope_free(event_thread->sc);
+
 	g_free(event_thread);
 }
 
 /**
  * set the event-based for the current event-thread
  *
- * @see chassis_event_add_local()
+ * @see chassis_event_add_local(), chassis_event_thread_self()
  */
-void chassis_event_thread_set_event_base(chassis_event_thread_t G_GNUC_UNUSED *e, struct event_base *event_base) {
+void chassis_event_thread_set_event_base(chassis_event_thread_t *e, struct event_base *event_base) {
 	g_private_set(tls_event_base_key, event_base);
+	g_private_set(tls_event_thread_key, e);
+}
+
+/**
+ * get the event-thread we are running in
+ *
+ * @return the current event-thread or NULL if not called from a event-thread
+ */
+chassis_event_thread_t *chassis_event_thread_self(void) {
+	return g_private_get(tls_event_thread_key);
+}
+
+/**
+ * data waiting for the event-threads to leave its epoch
+ */
+typedef struct {
+	gint epoch;
+	gpointer data;
+	GDestroyNotify free_func;
+} chassis_event_retired_t;
+
+static void chassis_event_retired_free(chassis_event_retired_t *retired) {
+	retired->free_func(retired->data);
+
+	g_free(retired);
 }
 
 /**
  * create the event-threads handler
  *
- * provides the event-queue that is contains the event_ops from the event-threads
- * and notifies all the idling event-threads for the new event-ops to process
+ * the event-queues and notification-fds are per event-thread and created 
+ * in chassis_event_threads_init_thread()
  */
 chassis_event_threads_t *chassis_event_threads_new() {
 	chassis_event_threads_t *threads;
 
 	tls_event_base_key = g_private_new(NULL);
+	tls_event_thread_key = g_private_new(NULL);
 
 	threads = g_new0(chassis_event_threads_t, 1);
 
-	/* create the ping-fds
-	 *
-	 * the event-thread write a byte to the ping-pipe to trigger a fd-event when
-	 * something is available in the event-async-queues
-	 */
-	if (0 != evutil_socketpair(AF_UNIX, SOCK_STREAM, 0, threads->event_notify_fds)) {
-		int err;
-#ifdef _WIN32
-		err = WSAGetLastError();
-#else
-		err = errno;
-#endif
-		g_error("%s: evutil_socketpair() failed: %s (%d)", 
-				G_STRLOC,
-				g_strerror(err),
-				err);
-	}
 	threads->event_threads = g_ptr_array_new();
-	threads->event_queue = g_async_queue_new();
-
-	/* make both ends non-blocking */
-	evutil_make_socket_nonblocking(threads->event_notify_fds[0]);
-	evutil_make_socket_nonblocking(threads->event_notify_fds[1]);
+	threads->retired_mutex = g_mutex_new();
+	threads->retired = g_queue_new();
 
 	return threads;
 }
@@ -351,11 +413,11 @@ chassis_event_threads_t *chassis_event_threads_new() {
 /**
  * free all event-threads
  *
- * frees all the registered event-threads and event-queue
+ * frees all the registered event-threads and their event-queues
  */
 void chassis_event_threads_free(chassis_event_threads_t *threads) {
+	chassis_event_retired_t *retired;
 	guint i;
-	chassis_event_op_t *op;
 
 	if (!threads) return;
 
@@ -368,22 +430,54 @@ void chassis_event_threads_free(chassis_event_threads_t *threads) {
 
 	g_ptr_array_free(threads->event_threads, TRUE);
 
-	/* free the events that are still in the queue */
-	while ((op = g_async_queue_try_pop(threads->event_queue))) {
-		chassis_event_op_free(op);
+	/* the threads are gone, nobody can see the retired data anymore */
+	while ((retired = g_queue_pop_head(threads->retired))) {
+		chassis_event_retired_free(retired);
 	}
-	g_async_queue_unref(threads->event_queue);
+	g_queue_free(threads->retired);
+	g_mutex_free(threads->retired_mutex);
 
-	/* close the notification pipe */
-	if (threads->event_notify_fds[0] != -1) {
-		closesocket(threads->event_notify_fds[0]);
-	}
-	if (threads->event_notify_fds[1] != -1) {
-		closesocket(threads->event_notify_fds[1]);
+	g_free(threads);
+}
+
+/**
+ * wait until all event-threads left their event-loop
+ *
+ * they leave it within a second after chassis_set_shutdown_location() was called.
+ * Afterwards only the calling thread touches the connections.
+ */
+void chassis_event_threads_join(chassis_event_threads_t *threads) {
+	guint i;
+
+	for (i = 0; i < threads->event_threads->len; i++) {
+		chassis_event_thread_t *event_thread = threads->event_threads->pdata[i];
+
+		if (event_thread->thr) {
+			g_thread_join(event_thread->thr);
+			event_thread->thr = NULL;
+		}
 	}
+}
+
+/**
+ * free the lua-scopes of all event-threads
+ *
+ * the scripts in the scopes may call into the plugins and the lua-modules they
+ * loaded. The scopes have to be gone before the plugins are shut down.
+ *
+ * @see chassis_event_threads_join()
+ */
+void chassis_event_threads_free_lua_scopes(chassis_event_threads_t *threads) {
+	guint i;
 
+	for (i = 0; i < threads->event_threads->len; i++) {
+		chassis_event_thread_t *event_thread = threads->event_threads->pdata[i];
 
-	g_free(threads);
+		if (event_thread->sc) {
+			lua_scope_free(event_thread->sc);
+			event_thread->sc = NULL;
+		}
+	}
 }
 
 /**
@@ -393,50 +487,122 @@ void chassis_event_threads_add(chassis_event_threads_t *threads, chassis_event_t
 	g_ptr_array_add(threads->event_threads, thread);
 }
 
+/**
+ * pick a event-thread in a round-robin fashion
+ *
+ * used to spread new connections over all event-threads
+ */
+chassis_event_thread_t *chassis_event_threads_get_next(chassis_event_threads_t *threads) {
+	guint ndx;
+
+	g_assert(threads->event_threads->len > 0);
+
+	ndx = (guint)g_atomic_int_exchange_and_add(&(threads->next_thread), 1);
+
+	return threads->event_threads->pdata[ndx % threads->event_threads->len];
+}
 
 /**
- * setup the notification-fd of a event-thread
+ * free data once no event-thread can see it anymore
  *
- * all event-threads listen on the same notification pipe
+ * the data has to be unreachable for new readers already, like a array that
+ * got replaced by a new one
+ *
+ * @see chassis_event_threads_reclaim()
+ */
+void chassis_event_threads_retire(chassis_event_threads_t *threads, gpointer data, GDestroyNotify free_func) {
+	chassis_event_retired_t *retired;
+
+	retired = g_new0(chassis_event_retired_t, 1);
+	retired->data = data;
+	retired->free_func = free_func;
+
+	g_mutex_lock(threads->retired_mutex);
+	retired->epoch = g_atomic_int_exchange_and_add(&(threads->epoch), 1) + 1;
+	g_queue_push_tail(threads->retired, retired);
+	g_mutex_unlock(threads->retired_mutex);
+}
+
+/**
+ * free the retired data of the epochs all event-threads have left
+ *
+ * called by each event-thread between two runs of its event-loop
+ */
+void chassis_event_threads_reclaim(chassis_event_threads_t *threads) {
+	chassis_event_retired_t *retired;
+	gint min_epoch = G_MAXINT;
+	guint i;
+
+	g_mutex_lock(threads->retired_mutex);
+	if (g_queue_is_empty(threads->retired)) {
+		g_mutex_unlock(threads->retired_mutex);
+		return;
+	}
+
+	for (i = 0; i < threads->event_threads->len; i++) {
+		chassis_event_thread_t *event_thread = threads->event_threads->pdata[i];
+
+		min_epoch = MIN(min_epoch, g_atomic_int_get(&(event_thread->epoch)));
+	}
+
+	while ((retired = g_queue_peek_head(threads->retired)) &&
+	       retired->epoch <= min_epoch) {
+		g_queue_pop_head(threads->retired);
+		chassis_event_retired_free(retired);
+	}
+	g_mutex_unlock(threads->retired_mutex);
+}
+
+/**
+ * setup the event-queue and notification-fds of a event-thread
+ *
+ * each event-thread gets its own socket-pair. Other threads send a byte to it 
+ * when they pushed a event-op to the event-queue of this thread.
+ *
+ * the thread also gets its own lua-scope, the lua-code of connections in different
+ * event-threads runs in parallel
  *
  * @see chassis_event_handle()
  */ 
-int chassis_event_threads_init_thread(chassis_event_threads_t *threads, chassis_event_thread_t *event_thread, chassis *chas) {
-#ifdef _WIN32
-	LPWSAPROTOCOL_INFO lpProtocolInfo;
-#endif
+int chassis_event_threads_init_thread(chassis_event_threads_t G_GNUC_UNUSED *threads, chassis_event_thread_t *event_thread, chassis *chas) {
+	int notify_fds[2];
+
 	event_thread->event_base = event_base_new();
 	event_thread->chas = chas;
-#ifdef _WIN32
-	lpProtocolInfo = g_malloc(sizeof(WSAPROTOCOL_INFO));
-	if (SOCKET_ERROR == WSADuplicateSocket(threads->event_notify_fds[0], GetCurrentProcessId(), lpProtocolInfo)) {
-		int _errno = WSAGetLastError();
 
-		g_critical("%s: Could not duplicate socket: %s (%d)", G_STRLOC, g_strerror(_errno), _errno);
-		g_free(lpProtocolInfo);
-		return -1;
-	}
-	event_thread->notify_fd = WSASocket(FROM_PROTOCOL_INFO, FROM_PROTOCOL_INFO, FROM_PROTOCOL_INFO, lpProtocolInfo, 0, 0);
-	if (INVALID_SOCKET == event_thread->notify_fd) {
-		int _errno = WSAGetLastError();
-
-		g_critical("%s: Could not create duplicated socket: %s (%d)", G_STRLOC, g_strerror(_errno), _errno);
-		g_free(lpProtocolInfo);
-		return -1;
-	}
-	g_free(lpProtocolInfo);
+	if (0 != evutil_socketpair(AF_UNIX, SOCK_STREAM, 0, notify_fds)) {
+		int err;
+#ifdef _WIN32
+		err = WSAGetLastError();
 #else
-	event_thread->notify_fd = dup(threads->event_notify_fds[0]);
-	if (-1 == event_thread->notify_fd) {
-		g_critical("%s: Could not create duplicated socket: %s (%d)", G_STRLOC, g_strerror(errno), errno);
+		err = errno;
+#endif
+		g_critical("%s: evutil_socketpair() failed: %s (%d)", 
+				G_STRLOC,
+				g_strerror(err),
+				err);
 		return -1;
 	}
-#endif
+
+	/* make both ends non-blocking */
+	evutil_make_socket_nonblocking(notify_fds[0]);
+	evutil_make_socket_nonblocking(notify_fds[1]);
+
+	event_thread->notify_fd = notify_fds[0];
+	event_thread->notify_send_fd = notify_fds[1];
+	event_thread->event_queue = g_async_queue_new();
 
 	event_set(&(event_thread->notify_fd_event), event_thread->notify_fd, EV_READ | EV_PERSIST, chassis_event_handle, event_thread);
 	event_base_set(event_thread->event_base, &(event_thread->notify_fd_event));
 	event_add(&(event_thread->notify_fd_event), NULL);
 
+	event_thread->sc = lua_scope_new();
+#ifdef HAVE_LUA_H
+	/* store the pointer to the chassis in the Lua registry, like network_mysqld_init() does for the global scope */
+	lua_pushlightuserdata(event_thread->sc->L, (void*)chas);
+	lua_setfield(event_thread->sc->L, LUA_REGISTRYINDEX, CHASSIS_LUA_REGISTRY_KEY);
+#endif
+
 	return 0;
 }
 
@@ -451,9 +617,14 @@ void *chassis_event_thread_loop(chassis_event_thread_t *event_thread) {
 	 * check once a second if we shall shutdown the proxy
 	 */
 	while (!chassis_is_shutdown()) {
+		chassis_event_threads_t *threads = event_thread->chas->threads;
 		struct timeval timeout;
 		int r;
 
+		/* no event-handler runs, we hold no pointer to retired data */
+		g_atomic_int_set(&(event_thread->epoch), g_atomic_int_get(&(threads->epoch)));
+		chassis_event_threads_reclaim(threads);
+
 		timeout.tv_sec = 1;
 		timeout.tv_usec = 0;
 
@@ -26,6 +26,7 @@
 
 #include "chassis-exports.h"
 #include "chassis-mainloop.h"
+#include "lua-scope.h"
 
 /**
  * event operations
@@ -55,35 +56,62 @@ CHASSIS_API void chassis_event_add_local_with_timeout(chassis *chas, struct even
 
 /**
  * a event-thread
+ *
+ * each event-thread owns its event-queue and the notification socket-pair to wake it up
  */
 typedef struct {
 	chassis *chas;
 
-	int notify_fd;
+	GAsyncQueue *event_queue; /**< event-ops sent to this thread by other threads */
+
+	int notify_fd;            /**< receiving side of the notification socket-pair */
+	int notify_send_fd;       /**< sending side of the notification socket-pair */
 	struct event notify_fd_event;
 
 	GThread *thr;
 
 	struct event_base *event_base;
+
+	lua_scope *sc;            /**< the lua-scope of this thread, only used by the connections pinned to it */
+
+	volatile gint epoch;      /**< the epoch of the event-threads when this thread last went back to its event-loop */
 } chassis_event_thread_t;
 
 CHASSIS_API chassis_event_thread_t *chassis_event_thread_new();
 CHASSIS_API void chassis_event_thread_free(chassis_event_thread_t *e);
+CHASSIS_API chassis_event_thread_t *chassis_event_thread_self(void);
+CHASSIS_API void chassis_event_thread_add_with_timeout(chassis_event_thread_t *event_thread, struct event *ev, struct timeval *tv);
 CHASSIS_API void chassis_event_handle(int event_fd, short events, void *user_data);
 CHASSIS_API void chassis_event_thread_set_event_base(chassis_event_thread_t *e, struct event_base *event_base);
 CHASSIS_API void *chassis_event_thread_loop(chassis_event_thread_t *);
 
+/**
+ * the event-threads
+ *
+ * shared data that readers use without a lock is retired instead of freed when
+ * a writer replaced it. Each retire starts a new epoch. Between two events a
+ * thread holds no pointer to shared data and announces the epoch it saw; the
+ * data is freed once all threads announced its epoch.
+ */
 struct chassis_event_threads_t {
  	GPtrArray *event_threads;
 
-	GAsyncQueue *event_queue;
-	int event_notify_fds[2];
+	volatile gint next_thread; /**< round-robin counter for chassis_event_threads_get_next() */
+
+	volatile gint epoch;       /**< bumped by chassis_event_threads_retire() */
+	GMutex *retired_mutex;
+	GQueue *retired;           /**< chassis_event_retired_t, the oldest epoch first */
 };
 
 CHASSIS_API chassis_event_threads_t *chassis_event_threads_new();
 CHASSIS_API void chassis_event_threads_free(chassis_event_threads_t *threads);
+CHASSIS_API void chassis_event_threads_join(chassis_event_threads_t *threads);
+CHASSIS_API void chassis_event_threads_free_lua_scopes(chassis_event_threads_t *threads);
 CHASSIS_API int chassis_event_threads_init_thread(chassis_event_threads_t *threads, chassis_event_thread_t *event_thread, chassis *chas);
 CHASSIS_API void chassis_event_threads_add(chassis_event_threads_t *threads, chassis_event_thread_t *thread);
 CHASSIS_API void chassis_event_threads_start(chassis_event_threads_t *threads);
+CHASSIS_API chassis_event_thread_t *chassis_event_threads_get_next(chassis_event_threads_t *threads);
+CHASSIS_API void chassis_event_threads_retire(chassis_event_threads_t *threads, gpointer data, GDestroyNotify free_func);
+CHASSIS_API void chassis_event_threads_reclaim(chassis_event_threads_t *threads);
 
 #endif
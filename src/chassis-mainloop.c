@@ -116,6 +116,8 @@ chassis *chassis_new() {
 
 	chas->threads = chassis_event_threads_new();
 
+	chas->listen_backlog = 128;
+
 	chas->event_hdr_version = g_strdup(_EVENT_VERSION);
 
 	chas->shutdown_hooks = chassis_shutdown_hooks_new();
@@ -139,8 +141,14 @@ void chassis_free(chassis *chas) {
 
 	if (!chas) return;
 
+	/* the connections belong to the event-threads until they left their loop */
+	if (chas->threads) chassis_event_threads_join(chas->threads);
+
 	/* init the shutdown, without freeing share structures */	
 	if (chas->priv_shutdown) chas->priv_shutdown(chas, chas->priv);
+
+	/* the connections are gone, free their lua-scopes while the plugins are still loaded */
+	if (chas->threads) chassis_event_threads_free_lua_scopes(chas->threads);
 	
 
 	/* call the destructor for all plugins */
@@ -260,6 +268,26 @@ int chassis_mainloop(void *_chas) {
 	g_assert(chas->event_base);
 
 
+	if (chas->event_thread_count < 1) chas->event_thread_count = 1;
+
+	/* create the event-threads
+	 *
+	 * - setup the event-queues and their notification-fds
+	 *
+	 * they are started after the plugins applied their config, which allows
+	 * plugins to register events (like per-thread listen-sockets) in all event-bases
+	 * */
+	for (i = 1; i < (guint)chas->event_thread_count; i++) { /* we already have 1 event-thread running, the main-thread */
+		chassis_event_thread_t *event_thread;
+	
+		event_thread = chassis_event_thread_new();
+		if (0 != chassis_event_threads_init_thread(chas->threads, event_thread, chas)) {
+			chassis_event_thread_free(event_thread);
+			return -1;
+		}
+		chassis_event_threads_add(chas->threads, event_thread);
+	}
+
 	/* setup all plugins all plugins */
 	for (i = 0; i < chas->modules->len; i++) {
 		chassis_plugin *p = chas->modules->pdata[i];
@@ -328,24 +356,6 @@ int chassis_mainloop(void *_chas) {
 	}
 #endif
 
-	if (chas->event_thread_count < 1) chas->event_thread_count = 1;
-
-	/* create the event-threads
-	 *
-	 * - dup the async-queue-ping-fds
-	 * - setup the events notification
-	 * */
-	for (i = 1; i < (guint)chas->event_thread_count; i++) { /* we already have 1 event-thread running, the main-thread */
-		chassis_event_thread_t *event_thread;
-	
-		event_thread = chassis_event_thread_new();
-		if (0 != chassis_event_threads_init_thread(chas->threads, event_thread, chas)) {
-			chassis_event_thread_free(event_thread);
-			return -1;
-		}
-		chassis_event_threads_add(chas->threads, event_thread);
-	}
-
 	/* start the event threads */
 	if (chas->event_thread_count > 1) {
 		chassis_event_threads_start(chas->threads);
@@ -74,6 +74,9 @@ struct chassis {
 	/* network-io threads */
 	gint event_thread_count;
 
+	gint listen_backlog;            /**< backlog of the listen-sockets */
+	gboolean listen_reuseport;      /**< open a SO_REUSEPORT listen-socket per event-thread */
+
 	chassis_event_threads_t *threads;
 
 	chassis_shutdown_hooks_t *shutdown_hooks;
@@ -129,6 +129,9 @@ typedef struct {
 
 	gint event_thread_count;
 
+	gint listen_backlog;
+	int listen_reuseport;
+
 	gchar *log_level;
 	gchar *log_filename;
 	int    use_syslog;
@@ -146,6 +149,7 @@ chassis_frontend_t *chassis_frontend_new(void) {
 
 	frontend = g_slice_new0(chassis_frontend_t);
 	frontend->event_thread_count = 1;
+	frontend->listen_backlog = 128;
 	frontend->max_files_number = 0;
 
 	return frontend;
@@ -228,6 +232,12 @@ int chassis_frontend_set_chassis_options(chassis_frontend_t *frontend, chassis_o
 	chassis_options_add(opts,
 		"event-threads",            0, 0, G_OPTION_ARG_INT, &(frontend->event_thread_count), "number of event-handling threads (default: 1)", NULL);
 
+	chassis_options_add(opts,
+		"listen-backlog",           0, 0, G_OPTION_ARG_INT, &(frontend->listen_backlog), "backlog of the listening sockets (default: 128)", NULL);
+
+	chassis_options_add(opts,
+		"listen-reuseport",         0, 0, G_OPTION_ARG_NONE, &(frontend->listen_reuseport), "open a SO_REUSEPORT listening socket per event-thread", NULL);
+
 	chassis_options_add(opts,
 		"lua-path",                 0, 0, G_OPTION_ARG_STRING, &(frontend->lua_path), "set the LUA_PATH", "<...>");
 
@@ -533,6 +543,15 @@ int main_cmdline(int argc, char **argv) {
 	}
 
 	srv->event_thread_count = frontend->event_thread_count;
+
+	if (frontend->listen_backlog < 1) {
+		g_critical("--listen-backlog has to be >= 1, is %d", frontend->listen_backlog);
+
+		GOTO_EXIT(EXIT_FAILURE);
+	}
+
+	srv->listen_backlog = frontend->listen_backlog;
+	srv->listen_reuseport = frontend->listen_reuseport;
 	
 #ifndef _WIN32	
 	signal(SIGPIPE, SIG_IGN);
@@ -0,0 +1,776 @@
+/* $%BEGINLICENSE%$
+ Copyright (c) 2008, 2012, Oracle and/or its affiliates. All rights reserved.
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License as
+ published by the Free Software Foundation; version 2 of the
+ License.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ 02110-1301  USA
+
+ $%ENDLICENSE%$ */
+
+/**
+ * active health-checks of the backends
+ *
+ * without the checks a backend is only marked DOWN when a client fails to
+ * connect to it and is woken up again after 4 seconds to let the next client
+ * find out if it is back. The checker runs on the event-base of the main-thread
+ * and opens a non-blocking connection to each backend every interval:
+ *
+ *   connect() -> handshake -> auth -> COM_PING [-> lag-query] -> COM_QUIT
+ *
+ * the time until the handshake arrived and the round-trip of the COM_PING are
+ * added to the EWMA of the connect- and query-latency of the backend.
+ *
+ * The read-only backends are asked for their replication-lag with the
+ * lag-query: SHOW SLAVE STATUS or a SELECT on a heartbeat-table. The lag is
+ * taken from the Seconds_Behind_Master column of the first row or, if there is
+ * no such column, from the first column. Without a row the backend isn't a
+ * replica and its lag is unknown.
+ *
+ * The checks always log in and quit: a connection that is closed right after
+ * the handshake counts as a connect-error of our host and once the server saw
+ * max_connect_errors of them it blocks the host. The user has to be able to
+ * log in without a database.
+ *
+ * To take the connect and the auth off the first query of the clients, the
+ * checker also keeps min_idle authed connections of each warm-user in the
+ * pools of the UP backends:
+ *
+ *   connect() -> handshake -> auth -> network_connection_pool_add_shared()
+ *
+ * The pools are topped up every interval and right after a backend came UP.
+ * Before that, the connections that idled for the max_idle_time of the pool
+ * are closed. The clients get the warm connections re-authed with a
+ * COM_CHANGE_USER.
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "network-backend-check.h"
+#include "network-mysqld.h"
+#include "network-mysqld-proto.h"
+#include "network-mysqld-packet.h"
+#include "chassis-timings.h"
+#include "glib-ext.h"
+
+#define C(x) x, sizeof(x) - 1
+#define S(x) x->str, x->len
+
+typedef enum {
+	CHECK_STATE_CONNECT,
+	CHECK_STATE_READ_HANDSHAKE,
+	CHECK_STATE_SEND_AUTH,
+	CHECK_STATE_READ_AUTH_RESULT,
+	CHECK_STATE_SEND_PING,
+	CHECK_STATE_READ_PING_RESULT,
+	CHECK_STATE_SEND_LAG_QUERY,
+	CHECK_STATE_READ_LAG_RESULT
+} network_backend_check_state_t;
+
+typedef struct {
+	network_backends_checker_t *checker;
+	network_backend_t *backend;
+	network_backends_warm_user_t *warm_user; /**< log in as this user and hand the connection to the pool, NULL for a health-check */
+
+	network_socket *sock;
+	network_backend_check_state_t state;
+
+	guint64 started_at;   /**< when we called connect(), in usec */
+	guint64 ping_sent_at; /**< when we queued the COM_PING, in usec */
+
+	guint64 lag_columns;     /**< columns of the result of the lag-query, 0 until we got them */
+	guint64 lag_fields_read; /**< field-definitions of the result we got so far */
+	guint64 lag_column;      /**< column with the lag */
+	gboolean is_lag_rows;    /**< the field-definitions are done, the rows follow */
+	gboolean has_lag_row;    /**< we got the first row */
+	gint lag;                /**< the lag of the first row */
+} network_backend_check_t;
+
+static void network_backend_check_handle(int event_fd, short events, void *user_data);
+static void network_backends_checker_warm_up(network_backends_checker_t *checker, network_backend_t *backend);
+
+static network_backend_check_t *network_backend_check_new(network_backends_checker_t *checker, network_backend_t *backend,
+		network_backends_warm_user_t *warm_user) {
+	network_backend_check_t *check;
+
+	check = g_new0(network_backend_check_t, 1);
+	check->checker = checker;
+	check->backend = backend;
+	check->warm_user = warm_user;
+	check->sock = network_socket_new();
+	network_address_copy(check->sock->dst, backend->addr);
+
+	return check;
+}
+
+static void network_backend_check_free(network_backend_check_t *check) {
+	if (!check) return;
+
+	network_socket_free(check->sock);
+
+	g_free(check);
+}
+
+/**
+ * update the state of the backend and forget about the check
+ *
+ * @param reason  why the check failed, ignored if the backend is alive
+ */
+static void network_backend_check_finish(network_backend_check_t *check, gboolean is_alive, const gchar *reason) {
+	network_backends_checker_t *checker = check->checker;
+	network_backend_t *backend = check->backend;
+
+	if (check->warm_user) {
+		/* the health-checks find out about the backend themselves */
+		if (!is_alive) {
+			g_debug("%s: warming up the pool of backend %s failed: %s", G_STRLOC, backend->addr->name->str, reason);
+		}
+
+		g_ptr_array_remove_fast(checker->checks, check);
+		network_backend_check_free(check);
+		return;
+	}
+
+	if (network_backend_check_done(backend, is_alive, checker->rise, checker->fall)) {
+		if (is_alive) {
+			g_message("%s: backend %s is UP again", G_STRLOC, backend->addr->name->str);
+
+			network_backends_checker_warm_up(checker, backend);
+		} else {
+			g_critical("%s: backend %s is DOWN: %s", G_STRLOC, backend->addr->name->str, reason);
+		}
+	} else if (!is_alive) {
+		g_debug("%s: health-check of backend %s failed: %s", G_STRLOC, backend->addr->name->str, reason);
+	}
+
+	/* the latency or the state changed, the fastest backend may be another one */
+	network_backends_update_latency(checker->backends);
+
+	g_ptr_array_remove_fast(checker->checks, check);
+	network_backend_check_free(check);
+}
+
+/**
+ * wait for the socket, but not longer than the timeout of the whole check
+ */
+static void network_backend_check_wait(network_backend_check_t *check, short ev_type) {
+	network_backends_checker_t *checker = check->checker;
+	network_socket *sock = check->sock;
+	guint64 timeout = (guint64)checker->timeout.tv_sec * G_USEC_PER_SEC + checker->timeout.tv_usec;
+	guint64 elapsed = chassis_get_rel_microseconds() - check->started_at;
+	struct timeval tv;
+
+	/* a timeout of 0 fires right away */
+	timeout = elapsed < timeout ? timeout - elapsed : 0;
+	tv.tv_sec = timeout / G_USEC_PER_SEC;
+	tv.tv_usec = timeout % G_USEC_PER_SEC;
+
+	event_set(&(sock->event), sock->fd, ev_type, network_backend_check_handle, check);
+	event_base_set(checker->event_base, &(sock->event));
+	event_add(&(sock->event), &tv);
+}
+
+/**
+ * get the next packet of the server into the recv_queue
+ */
+static network_socket_retval_t network_backend_check_read_packet(network_socket *sock) {
+	network_socket_retval_t ret;
+
+	/* a earlier read may have fetched it already */
+	if (NETWORK_SOCKET_WAIT_FOR_EVENT != (ret = network_mysqld_con_get_packet(NULL, sock))) return ret;
+
+	if (NETWORK_SOCKET_SUCCESS != (ret = network_socket_read_all(sock))) return ret;
+
+	return network_mysqld_con_get_packet(NULL, sock);
+}
+
+/**
+ * build the auth-response for the handshake of the server
+ *
+ * we only speak mysql_native_password. The handshake and the auth-response
+ * stay with the socket, the pool needs them to hand the connection out.
+ *
+ * the connections for the pool get the capabilities the clients usually
+ * ask for, COM_CHANGE_USER doesn't change them
+ */
+static int network_backend_check_append_auth(network_backend_check_t *check, network_packet *packet) {
+	network_backends_checker_t *checker = check->checker;
+	network_mysqld_auth_challenge *shake;
+	network_mysqld_auth_response *auth;
+	GString *auth_packet;
+	const gchar *username = check->warm_user ? check->warm_user->username->str : checker->username;
+	const gchar *password = check->warm_user ? check->warm_user->password : checker->password;
+
+	shake = network_mysqld_auth_challenge_new();
+	if (0 != network_mysqld_proto_get_auth_challenge(packet, shake)) {
+		network_mysqld_auth_challenge_free(shake);
+		return -1;
+	}
+
+	auth = network_mysqld_auth_response_new(shake->capabilities);
+	auth->client_capabilities = shake->capabilities &
+		(CLIENT_PROTOCOL_41 | CLIENT_SECURE_CONNECTION | CLIENT_LONG_PASSWORD | CLIENT_LONG_FLAG | CLIENT_TRANSACTIONS);
+	if (check->warm_user) {
+		auth->client_capabilities |= shake->capabilities & (CLIENT_MULTI_STATEMENTS | CLIENT_MULTI_RESULTS);
+	}
+	auth->charset = shake->charset;
+	g_string_assign(auth->username, username);
+
+	if (password && *password) {
+		GString *hashed_password;
+
+		hashed_password = g_string_new(NULL);
+		network_mysqld_proto_password_hash(hashed_password, password, strlen(password));
+		network_mysqld_proto_password_scramble(auth->auth_plugin_data, S(shake->auth_plugin_data), S(hashed_password));
+		g_string_free(hashed_password, TRUE);
+	}
+
+	auth_packet = g_string_new(NULL);
+	network_mysqld_proto_append_auth_response(auth_packet, auth);
+	network_mysqld_queue_append(check->sock, check->sock->send_queue, S(auth_packet));
+
+	g_string_free(auth_packet, TRUE);
+
+	/* we don't speak SSL to the clients, like in proxy_read_handshake() */
+	shake->capabilities &= ~(CLIENT_SSL);
+
+	check->sock->challenge = shake;
+	check->sock->response = auth;
+
+	return 0;
+}
+
+/**
+ * send a COM_QUIT and forget about the connection
+ *
+ * if the COM_QUIT doesn't fit into the socket-buffer, the server sees a close() instead
+ */
+static void network_backend_check_quit(network_backend_check_t *check) {
+	network_socket *sock = check->sock;
+
+	sock->packet_id_is_reset = TRUE;
+	network_mysqld_queue_append(sock, sock->send_queue, C("\x01")); /* COM_QUIT */
+	network_socket_write(sock, -1);
+}
+
+/**
+ * hand the authed connection of a warm-up to the pool of the backend
+ */
+static void network_backend_check_pool(network_backend_check_t *check) {
+	network_socket *sock = check->sock;
+
+	sock->is_authed = 1;
+
+	if (check->backend->is_drained) {
+		network_backend_check_quit(check);
+	} else {
+		network_connection_pool_add_shared(check->backend->pool, sock);
+		check->sock = NULL;
+	}
+
+	network_backend_check_finish(check, TRUE, NULL);
+}
+
+/**
+ * get the lag from a row of the result of the lag-query
+ *
+ * a NULL (a stopped replication) is a infinite lag, a negative one (the clocks
+ * of the master and the replica disagree on the heartbeat) is no lag
+ */
+static int network_backend_check_get_lag(network_backend_check_t *check, network_packet *packet) {
+	network_mysqld_lenenc_type type;
+	guint64 i;
+	gchar *value = NULL;
+	gdouble lag;
+	int err = 0;
+
+	for (i = 0; i < check->lag_column; i++) {
+		guint64 len;
+
+		err = err || network_mysqld_proto_peek_lenenc_type(packet, &type);
+		if (!err && type == NETWORK_MYSQLD_LENENC_TYPE_NULL) {
+			err = err || network_mysqld_proto_skip(packet, 1);
+		} else {
+			err = err || network_mysqld_proto_get_lenenc_int(packet, &len);
+			err = err || network_mysqld_proto_skip(packet, len);
+		}
+	}
+
+	err = err || network_mysqld_proto_peek_lenenc_type(packet, &type);
+	if (err) return -1;
+
+	if (type == NETWORK_MYSQLD_LENENC_TYPE_NULL) {
+		check->lag = NETWORK_BACKEND_LAG_STOPPED;
+
+		return 0;
+	}
+
+	if (network_mysqld_proto_get_lenenc_string(packet, &value, NULL)) return -1;
+
+	lag = g_ascii_strtod(value, NULL);
+	g_free(value);
+
+	if (lag <= 0) {
+		check->lag = 0;
+	} else if (lag >= NETWORK_BACKEND_LAG_STOPPED) {
+		check->lag = NETWORK_BACKEND_LAG_STOPPED;
+	} else {
+		check->lag = (gint)lag;
+	}
+
+	return 0;
+}
+
+/**
+ * handle a packet of the result of the lag-query
+ *
+ * @return 0 if more packets follow, 1 if the result is done, -1 on error
+ */
+static int network_backend_check_process_lag(network_backend_check_t *check, network_packet *packet, guint8 status) {
+	network_mysqld_lenenc_type type;
+
+	if (check->lag_columns == 0) {
+		/* not a result-set, nothing to learn from */
+		if (status == MYSQLD_PACKET_OK) return 1;
+
+		if (network_mysqld_proto_get_lenenc_int(packet, &check->lag_columns)) return -1;
+		if (check->lag_columns == 0) return -1;
+
+		return 0;
+	}
+
+	if (check->lag_fields_read < check->lag_columns) {
+		network_mysqld_proto_fielddef_t *field;
+		int err;
+
+		field = network_mysqld_proto_fielddef_new();
+		err = network_mysqld_proto_get_fielddef(packet, field, CLIENT_PROTOCOL_41);
+		if (!err && field->name && 0 == strcmp(field->name, "Seconds_Behind_Master")) {
+			check->lag_column = check->lag_fields_read;
+		}
+		network_mysqld_proto_fielddef_free(field);
+
+		check->lag_fields_read++;
+
+		return err ? -1 : 0;
+	}
+
+	if (network_mysqld_proto_peek_lenenc_type(packet, &type)) return -1;
+
+	if (type == NETWORK_MYSQLD_LENENC_TYPE_EOF) {
+		if (check->is_lag_rows) return 1;
+
+		check->is_lag_rows = TRUE;
+
+		return 0;
+	}
+
+	/* only the first row counts */
+	if (check->has_lag_row) return 0;
+	check->has_lag_row = TRUE;
+
+	return network_backend_check_get_lag(check, packet);
+}
+
+/**
+ * handle the packet of the server
+ *
+ * @return 0 if the check goes on, -1 if it is finished
+ */
+static int network_backend_check_process(network_backend_check_t *check) {
+	network_backends_checker_t *checker = check->checker;
+	network_backend_t *backend = check->backend;
+	network_socket *sock = check->sock;
+	network_packet packet;
+	guint64 now = chassis_get_rel_microseconds();
+	guint8 status;
+	int err = 0;
+
+	packet.data = g_queue_pop_head(sock->recv_queue->chunks);
+	packet.offset = 0;
+
+	err = err || network_mysqld_proto_skip_network_header(&packet);
+	err = err || network_mysqld_proto_peek_int8(&packet, &status);
+
+	if (err) {
+		g_string_free(packet.data, TRUE);
+		network_backend_check_finish(check, FALSE, "malformed packet");
+		return -1;
+	}
+
+	if (status == MYSQLD_PACKET_ERR) {
+		network_mysqld_err_packet_t *err_packet;
+		gchar *reason;
+
+		err_packet = network_mysqld_err_packet_new();
+		if (0 == network_mysqld_proto_get_err_packet(&packet, err_packet)) {
+			reason = g_strdup_printf("%s (%d)", err_packet->errmsg->str, err_packet->errcode);
+		} else {
+			/* the ERR packets before the handshake don't have a SQLSTATE */
+			reason = g_strdup("the server sent a ERR packet");
+		}
+		network_mysqld_err_packet_free(err_packet);
+		g_string_free(packet.data, TRUE);
+
+		if (check->state == CHECK_STATE_READ_AUTH_RESULT && check->warm_user) {
+			g_critical("%s: can't warm up the pool of backend %s as '%s': %s",
+					G_STRLOC, backend->addr->name->str, check->warm_user->username->str, reason);
+
+			network_backend_check_finish(check, TRUE, NULL);
+		} else if (check->state == CHECK_STATE_READ_AUTH_RESULT) {
+			/* the server is fine, our user isn't */
+			g_critical("%s: health-check of backend %s can't log in as '%s': %s",
+					G_STRLOC, backend->addr->name->str, checker->username, reason);
+
+			network_backend_check_finish(check, TRUE, NULL);
+		} else if (check->state == CHECK_STATE_READ_LAG_RESULT) {
+			/* a missing REPLICATION CLIENT privilege or heartbeat-table */
+			g_critical("%s: health-check of backend %s can't get the replication-lag with '%s': %s",
+					G_STRLOC, backend->addr->name->str, checker->lag_query, reason);
+
+			g_atomic_int_set(&(backend->replication_lag), NETWORK_BACKEND_LAG_UNKNOWN);
+			network_backend_check_quit(check);
+			network_backend_check_finish(check, TRUE, NULL);
+		} else {
+			network_backend_check_finish(check, FALSE, reason);
+		}
+		g_free(reason);
+
+		return -1;
+	}
+
+	switch (check->state) {
+	case CHECK_STATE_READ_HANDSHAKE:
+		network_backend_latency_update(&backend->connect_latency, now - check->started_at);
+
+		err = network_backend_check_append_auth(check, &packet);
+		g_string_free(packet.data, TRUE);
+
+		if (err) {
+			network_backend_check_finish(check, FALSE, "malformed handshake");
+			return -1;
+		}
+
+		check->state = CHECK_STATE_SEND_AUTH;
+		break;
+	case CHECK_STATE_READ_AUTH_RESULT:
+		g_string_free(packet.data, TRUE);
+
+		if (status != MYSQLD_PACKET_OK) {
+			/* a auth-switch to a plugin we don't speak, the server is alive anyway */
+			network_backend_check_finish(check, check->warm_user == NULL, "auth-switch to a unsupported auth-plugin");
+			return -1;
+		}
+
+		if (check->warm_user) {
+			network_backend_check_pool(check);
+			return -1;
+		}
+
+		sock->packet_id_is_reset = TRUE;
+		network_mysqld_queue_append(sock, sock->send_queue, C("\x0e")); /* COM_PING */
+		check->ping_sent_at = now;
+
+		check->state = CHECK_STATE_SEND_PING;
+		break;
+	case CHECK_STATE_READ_PING_RESULT:
+		g_string_free(packet.data, TRUE);
+
+		network_backend_latency_update(&backend->query_latency, now - check->ping_sent_at);
+
+		if (backend->type == BACKEND_TYPE_RO && checker->lag_query) {
+			GString *query_packet;
+
+			query_packet = g_string_new(NULL);
+			g_string_append_c(query_packet, '\x03'); /* COM_QUERY */
+			g_string_append(query_packet, checker->lag_query);
+
+			sock->packet_id_is_reset = TRUE;
+			network_mysqld_queue_append(sock, sock->send_queue, S(query_packet));
+			g_string_free(query_packet, TRUE);
+
+			check->lag = NETWORK_BACKEND_LAG_UNKNOWN;
+			check->state = CHECK_STATE_SEND_LAG_QUERY;
+			break;
+		}
+
+		network_backend_check_quit(check);
+		network_backend_check_finish(check, TRUE, NULL);
+		return -1;
+	case CHECK_STATE_READ_LAG_RESULT:
+		err = network_backend_check_process_lag(check, &packet, status);
+		g_string_free(packet.data, TRUE);
+
+		if (err < 0) {
+			network_backend_check_finish(check, FALSE, "malformed result of the lag-query");
+			return -1;
+		} else if (err > 0) {
+			g_atomic_int_set(&(backend->replication_lag), check->lag);
+
+			network_backend_check_quit(check);
+			network_backend_check_finish(check, TRUE, NULL);
+			return -1;
+		}
+		break;
+	default:
+		g_assert_not_reached();
+		break;
+	}
+
+	return 0;
+}
+
+/**
+ * move the check forward until it has to wait for the socket
+ */
+static void network_backend_check_handle(int G_GNUC_UNUSED event_fd, short events, void *user_data) {
+	network_backend_check_t *check = user_data;
+	network_socket *sock = check->sock;
+
+	if (events == EV_TIMEOUT) {
+		network_backend_check_finish(check, FALSE, "timeout");
+		return;
+	}
+
+	for (;;) {
+		switch (check->state) {
+		case CHECK_STATE_CONNECT:
+			if (NETWORK_SOCKET_SUCCESS != network_socket_connect_finish(sock)) {
+				network_backend_check_finish(check, FALSE, g_strerror(errno));
+				return;
+			}
+
+			check->state = CHECK_STATE_READ_HANDSHAKE;
+			break;
+		case CHECK_STATE_READ_HANDSHAKE:
+		case CHECK_STATE_READ_AUTH_RESULT:
+		case CHECK_STATE_READ_PING_RESULT:
+		case CHECK_STATE_READ_LAG_RESULT:
+			switch (network_backend_check_read_packet(sock)) {
+			case NETWORK_SOCKET_SUCCESS:
+				break;
+			case NETWORK_SOCKET_WAIT_FOR_EVENT:
+				network_backend_check_wait(check, EV_READ);
+				return;
+			default:
+				network_backend_check_finish(check, FALSE, "connection closed");
+				return;
+			}
+
+			if (0 != network_backend_check_process(check)) return;
+			break;
+		case CHECK_STATE_SEND_AUTH:
+		case CHECK_STATE_SEND_PING:
+		case CHECK_STATE_SEND_LAG_QUERY:
+			switch (network_socket_write(sock, -1)) {
+			case NETWORK_SOCKET_SUCCESS:
+				break;
+			case NETWORK_SOCKET_WAIT_FOR_EVENT:
+				network_backend_check_wait(check, EV_WRITE);
+				return;
+			default:
+				network_backend_check_finish(check, FALSE, "write failed");
+				return;
+			}
+
+			switch (check->state) {
+			case CHECK_STATE_SEND_AUTH:
+				check->state = CHECK_STATE_READ_AUTH_RESULT;
+				break;
+			case CHECK_STATE_SEND_PING:
+				check->state = CHECK_STATE_READ_PING_RESULT;
+				break;
+			default:
+				check->state = CHECK_STATE_READ_LAG_RESULT;
+				break;
+			}
+			break;
+		}
+	}
+}
+
+static void network_backends_checker_start_check(network_backends_checker_t *checker, network_backend_t *backend,
+		network_backends_warm_user_t *warm_user) {
+	network_backend_check_t *check;
+
+	check = network_backend_check_new(checker, backend, warm_user);
+	g_ptr_array_add(checker->checks, check);
+
+	check->started_at = chassis_get_rel_microseconds();
+
+	switch (network_socket_connect(check->sock)) {
+	case NETWORK_SOCKET_ERROR_RETRY:
+		check->state = CHECK_STATE_CONNECT;
+		network_backend_check_wait(check, EV_WRITE);
+		break;
+	case NETWORK_SOCKET_SUCCESS:
+		check->state = CHECK_STATE_READ_HANDSHAKE;
+		network_backend_check_wait(check, EV_READ);
+		break;
+	default:
+		network_backend_check_finish(check, FALSE, "connect() failed");
+		break;
+	}
+}
+
+/**
+ * open connections until the pool of the backend has min_idle of each warm-user
+ *
+ * the warm-ups in flight count as idle connections already, no more than
+ * max_idle_connections of the pool are opened
+ */
+static void network_backends_checker_warm_up(network_backends_checker_t *checker, network_backend_t *backend) {
+	network_connection_pool *pool = backend->pool;
+	guint idle, in_flight = 0;
+	guint i, j;
+
+	if (0 == checker->min_idle || backend->state != BACKEND_STATE_UP || backend->is_drained) return;
+
+	for (j = 0; j < checker->checks->len; j++) {
+		network_backend_check_t *check = checker->checks->pdata[j];
+
+		if (check->backend == backend && check->warm_user) in_flight++;
+	}
+	idle = network_connection_pool_get_idle(pool, NULL) + in_flight;
+
+	for (i = 0; i < checker->warm_users->len; i++) {
+		network_backends_warm_user_t *warm_user = checker->warm_users->pdata[i];
+		guint user_idle;
+
+		user_idle = network_connection_pool_get_idle(pool, warm_user->username);
+		for (j = 0; j < checker->checks->len; j++) {
+			network_backend_check_t *check = checker->checks->pdata[j];
+
+			if (check->backend == backend && check->warm_user == warm_user) user_idle++;
+		}
+
+		for (; user_idle < checker->min_idle; user_idle++, idle++) {
+			if (pool->max_idle_connections > 0 && idle >= pool->max_idle_connections) return;
+
+			network_backends_checker_start_check(checker, backend, warm_user);
+		}
+	}
+}
+
+/**
+ * start a check of each backend that isn't checked already or drained and warm up the pools
+ */
+static void network_backends_checker_timer_handle(int G_GNUC_UNUSED event_fd, short G_GNUC_UNUSED events, void *user_data) {
+	network_backends_checker_t *checker = user_data;
+	guint i, j;
+
+	for (i = 0; i < network_backends_count(checker->backends); i++) {
+		network_backend_t *backend = network_backends_get(checker->backends, i);
+		gboolean is_in_flight = FALSE;
+
+		/* the server closes them after wait_timeout, close them before */
+		network_connection_pool_reap(backend->pool);
+
+		if (backend->is_drained) continue;
+
+		for (j = 0; j < checker->checks->len; j++) {
+			network_backend_check_t *check = checker->checks->pdata[j];
+
+			if (check->backend == backend && NULL == check->warm_user) {
+				is_in_flight = TRUE;
+				break;
+			}
+		}
+
+		if (!is_in_flight) network_backends_checker_start_check(checker, backend, NULL);
+
+		network_backends_checker_warm_up(checker, backend);
+	}
+
+	evtimer_add(&(checker->timer), &(checker->interval));
+}
+
+network_backends_checker_t *network_backends_checker_new(network_backends_t *backends) {
+	network_backends_checker_t *checker;
+
+	checker = g_new0(network_backends_checker_t, 1);
+	checker->backends = backends;
+	checker->checks = g_ptr_array_new();
+	checker->warm_users = g_ptr_array_new();
+
+	checker->interval.tv_sec = 1;
+	checker->timeout.tv_sec = 2;
+	checker->rise = 2;
+	checker->fall = 3;
+
+	return checker;
+}
+
+void network_backends_checker_free(network_backends_checker_t *checker) {
+	guint i;
+
+	if (!checker) return;
+
+	if (checker->timer.ev_base) { /* if .ev_base isn't set, the timer never got added */
+		evtimer_del(&(checker->timer));
+	}
+
+	for (i = 0; i < checker->checks->len; i++) {
+		network_backend_check_free(checker->checks->pdata[i]);
+	}
+	g_ptr_array_free(checker->checks, TRUE);
+
+	for (i = 0; i < checker->warm_users->len; i++) {
+		network_backends_warm_user_t *warm_user = checker->warm_users->pdata[i];
+
+		g_string_free(warm_user->username, TRUE);
+		if (warm_user->password) g_free(warm_user->password);
+		g_free(warm_user);
+	}
+	g_ptr_array_free(checker->warm_users, TRUE);
+
+	if (checker->username) g_free(checker->username);
+	if (checker->password) g_free(checker->password);
+	if (checker->lag_query) g_free(checker->lag_query);
+
+	g_free(checker);
+}
+
+/**
+ * keep min_idle connections of the user in the pool of each UP backend
+ *
+ * @param password  the password of the user, NULL for none
+ */
+void network_backends_checker_add_warm_user(network_backends_checker_t *checker, const gchar *username, const gchar *password) {
+	network_backends_warm_user_t *warm_user;
+
+	warm_user = g_new0(network_backends_warm_user_t, 1);
+	warm_user->username = g_string_new(username);
+	warm_user->password = g_strdup(password);
+
+	g_ptr_array_add(checker->warm_users, warm_user);
+}
+
+/**
+ * check the backends right away and then every interval
+ *
+ * the DOWN backends are no longer woken up by network_backends_check()
+ */
+void network_backends_checker_start(network_backends_checker_t *checker, struct event_base *event_base) {
+	struct timeval now = { 0, 0 };
+
+	checker->event_base = event_base;
+	checker->backends->is_health_checked = TRUE;
+
+	evtimer_set(&(checker->timer), network_backends_checker_timer_handle, checker);
+	event_base_set(event_base, &(checker->timer));
+	evtimer_add(&(checker->timer), &now);
+}
@@ -0,0 +1,83 @@
+/* $%BEGINLICENSE%$
+ Copyright (c) 2008, 2012, Oracle and/or its affiliates. All rights reserved.
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License as
+ published by the Free Software Foundation; version 2 of the
+ License.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ 02110-1301  USA
+
+ $%ENDLICENSE%$ */
+
+
+#ifndef _NETWORK_BACKEND_CHECK_H_
+#define _NETWORK_BACKEND_CHECK_H_
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <glib.h>
+#include <event.h>
+
+#include "network-backend.h"
+
+#include "network-exports.h"
+
+/**
+ * health-checks all backends in the background
+ *
+ * every interval a connection is opened to each backend on the event-base of
+ * the main-thread. We log in as username, send a COM_PING and close the
+ * connection with a COM_QUIT.
+ * The read-only backends are also asked for their replication-lag.
+ *
+ * With warm-users the pools of the UP backends are kept at min_idle
+ * authed connections of each of them.
+ */
+typedef struct {
+	network_backends_t *backends;
+
+	struct event_base *event_base;
+	struct event timer;
+
+	struct timeval interval;   /**< time between two checks of a backend */
+	struct timeval timeout;    /**< a check that takes longer failed */
+
+	guint rise;                /**< successful checks in a row to bring a DOWN backend UP */
+	guint fall;                /**< failed checks in a row to mark a backend DOWN */
+
+	gchar *username;           /**< user to log in with */
+	gchar *password;
+
+	gchar *lag_query;          /**< query for the replication-lag of the read-only backends, NULL to not ask */
+
+	GPtrArray *warm_users;     /**< network_backends_warm_user_t, the users to keep idle connections of */
+	guint min_idle;            /**< idle connections to keep per backend and warm-user */
+
+	GPtrArray *checks;         /**< the checks in flight */
+} network_backends_checker_t;
+
+/**
+ * a user the checker logs in as to warm up the pools
+ */
+typedef struct {
+	GString *username;
+	gchar *password;
+} network_backends_warm_user_t;
+
+NETWORK_API network_backends_checker_t *network_backends_checker_new(network_backends_t *backends);
+NETWORK_API void network_backends_checker_free(network_backends_checker_t *checker);
+NETWORK_API void network_backends_checker_add_warm_user(network_backends_checker_t *checker, const gchar *username, const gchar *password);
+NETWORK_API void network_backends_checker_start(network_backends_checker_t *checker, struct event_base *event_base);
+
+#endif /* _NETWORK_BACKEND_CHECK_H_ */
@@ -17,6 +17,8 @@
  02110-1301  USA
 
  $%ENDLICENSE%$ */
+#include <math.h>
+
 #include <lua.h>
 
 #include "lua-env.h"
@@ -40,6 +42,12 @@
  *   address           => ip:port or unix-path of to the backend
  *   state             => int(BACKEND_STATE_UP|BACKEND_STATE_DOWN) 
  *   type              => int(BACKEND_TYPE_RW|BACKEND_TYPE_RO) 
+ *   connect_latency   => EWMA of the connect-time of the health-checks in usec, nil if unknown
+ *   query_latency     => EWMA of the COM_PING round-trip of the health-checks in usec, nil if unknown
+ *   weight            => share of the load for the wrr, hash-user and hash-schema balancing
+ *   in_flight         => queries that wait for their result
+ *   replication_lag   => seconds behind the master, math.huge if the replication is stopped, nil if unknown
+ *   drained           => true if it gets no new clients
  *
  * @return nil or requested information
  * @see backend_state_t backend_type_t
@@ -57,6 +65,34 @@ static int proxy_backend_get(lua_State *L) {
 		lua_pushinteger(L, backend->state);
 	} else if (strleq(key, keysize, C("type"))) {
 		lua_pushinteger(L, backend->type);
+	} else if (strleq(key, keysize, C("connect_latency"))) {
+		if (backend->connect_latency > 0) {
+			lua_pushnumber(L, backend->connect_latency);
+		} else {
+			lua_pushnil(L);
+		}
+	} else if (strleq(key, keysize, C("query_latency"))) {
+		if (backend->query_latency > 0) {
+			lua_pushnumber(L, backend->query_latency);
+		} else {
+			lua_pushnil(L);
+		}
+	} else if (strleq(key, keysize, C("weight"))) {
+		lua_pushinteger(L, backend->weight);
+	} else if (strleq(key, keysize, C("in_flight"))) {
+		lua_pushinteger(L, g_atomic_int_get(&(backend->in_flight)));
+	} else if (strleq(key, keysize, C("replication_lag"))) {
+		gint lag = g_atomic_int_get(&(backend->replication_lag));
+
+		if (lag == NETWORK_BACKEND_LAG_UNKNOWN) {
+			lua_pushnil(L);
+		} else if (lag == NETWORK_BACKEND_LAG_STOPPED) {
+			lua_pushnumber(L, HUGE_VAL);
+		} else {
+			lua_pushinteger(L, lag);
+		}
+	} else if (strleq(key, keysize, C("drained"))) {
+		lua_pushboolean(L, backend->is_drained);
 	} else if (strleq(key, keysize, C("uuid"))) {
 		if (backend->uuid->len) {
 			lua_pushlstring(L, S(backend->uuid));
@@ -113,11 +149,73 @@ int network_backend_lua_getmetatable(lua_State *L) {
 	return proxy_getmetatable(L, methods);
 }
 
+/**
+ * add a backend while the proxy is running
+ *
+ *   proxy.global.backends:add("10.0.0.20:3306@2", proxy.BACKEND_TYPE_RO)
+ *
+ * the type defaults to BACKEND_TYPE_RW, adding a drained backend again brings it back
+ *
+ * @return true on success, false if the address is invalid or already known
+ */
+static int proxy_backends_add(lua_State *L) {
+	network_backends_t *bs = *(network_backends_t **)luaL_checkself(L);
+	const char *address = luaL_checkstring(L, 2);
+	lua_Integer type = luaL_optinteger(L, 3, BACKEND_TYPE_RW);
+	gchar *addr;
+
+	if (type != BACKEND_TYPE_RW && type != BACKEND_TYPE_RO) {
+		return luaL_error(L, "proxy.global.backends:add() expects proxy.BACKEND_TYPE_RW or proxy.BACKEND_TYPE_RO, got %d", (int)type);
+	}
+
+	addr = g_strdup(address);
+	lua_pushboolean(L, 0 == network_backends_add(bs, addr, type));
+	g_free(addr);
+
+	return 1;
+}
+
+/**
+ * send no new clients to a backend
+ *
+ *   proxy.global.backends:drain(2)
+ *
+ * @return true on success, false if there is no such backend
+ */
+static int proxy_backends_drain(lua_State *L) {
+	network_backends_t *bs = *(network_backends_t **)luaL_checkself(L);
+	int backend_ndx = luaL_checkinteger(L, 2) - 1;
+
+	lua_pushboolean(L, backend_ndx >= 0 && 0 == network_backends_drain(bs, backend_ndx));
+
+	return 1;
+}
+
+/**
+ * change the weight of a backend
+ *
+ *   proxy.global.backends:set_weight(2, 5)
+ *
+ * @return true on success, false if there is no such backend or the weight isn't valid
+ */
+static int proxy_backends_set_weight(lua_State *L) {
+	network_backends_t *bs = *(network_backends_t **)luaL_checkself(L);
+	int backend_ndx = luaL_checkinteger(L, 2) - 1;
+	lua_Integer weight = luaL_checkinteger(L, 3);
+
+	lua_pushboolean(L, backend_ndx >= 0 && weight > 0 &&
+			0 == network_backends_set_weight(bs, backend_ndx, weight));
+
+	return 1;
+}
+
 /**
  * get proxy.global.backends[ndx]
  *
  * get the backend from the array of mysql backends.
  *
+ * proxy.global.backends:add(), :drain() and :set_weight() change the array
+ *
  * @return nil or the backend
  * @see proxy_backend_get
  */
@@ -126,7 +224,26 @@ static int proxy_backends_get(lua_State *L) {
 	network_backend_t **backend_p;
 
 	network_backends_t *bs = *(network_backends_t **)luaL_checkself(L);
-	int backend_ndx = luaL_checkinteger(L, 2) - 1; /** lua is indexes from 1, C from 0 */
+	int backend_ndx;
+
+	if (lua_type(L, 2) == LUA_TSTRING) {
+		gsize keysize = 0;
+		const char *key = lua_tolstring(L, 2, &keysize);
+
+		if (strleq(key, keysize, C("add"))) {
+			lua_pushcfunction(L, proxy_backends_add);
+		} else if (strleq(key, keysize, C("drain"))) {
+			lua_pushcfunction(L, proxy_backends_drain);
+		} else if (strleq(key, keysize, C("set_weight"))) {
+			lua_pushcfunction(L, proxy_backends_set_weight);
+		} else {
+			lua_pushnil(L);
+		}
+
+		return 1;
+	}
+
+	backend_ndx = luaL_checkinteger(L, 2) - 1; /** lua is indexes from 1, C from 0 */
 	
 	/* check that we are in range for a _int_ */
 	if (NULL == (backend = network_backends_get(bs, backend_ndx))) {
@@ -18,12 +18,14 @@
 
  $%ENDLICENSE%$ */
  
+#include <stdlib.h>
 #include <string.h>
 
 #include <glib.h>
 
 #include "network-backend.h"
 #include "chassis-plugin.h"
+#include "chassis-event-thread.h"
 #include "glib-ext.h"
 
 #define C(x) x, sizeof(x) - 1
@@ -45,6 +47,8 @@ network_backend_t *network_backend_new() {
 	b->pool = network_connection_pool_new();
 	b->uuid = g_string_new(NULL);
 	b->addr = network_address_new();
+	b->weight = 1;
+	b->replication_lag = NETWORK_BACKEND_LAG_UNKNOWN;
 
 	return b;
 }
@@ -68,12 +72,121 @@ void network_backend_free(network_backend_t *b) {
 	g_free(b);
 }
 
+/**
+ * add a sample to the EWMA of a latency
+ *
+ * the first sample is taken as is
+ *
+ * @param latency  the EWMA in usec, 0 if we have no sample yet
+ * @param sample   the latency we measured in usec
+ */
+void network_backend_latency_update(gdouble *latency, gdouble sample) {
+	if (*latency == 0.0) {
+		*latency = sample;
+	} else {
+		*latency += NETWORK_BACKEND_LATENCY_WEIGHT * (sample - *latency);
+	}
+}
+
+/**
+ * update the state of a backend with the result of a health-check
+ *
+ * a backend goes DOWN after 'fall' failed checks in a row and back UP after
+ * 'rise' successful checks in a row. A backend in the UNKNOWN state goes UP
+ * with the first successful check.
+ *
+ * @return 1 if the state changed, 0 otherwise
+ */
+int network_backend_check_done(network_backend_t *b, gboolean is_alive, guint rise, guint fall) {
+	if (is_alive) {
+		b->check_failures = 0;
+
+		if (b->state == BACKEND_STATE_UP) return 0;
+		if (b->state == BACKEND_STATE_DOWN && ++b->check_successes < rise) return 0;
+
+		b->check_successes = 0;
+		b->state = BACKEND_STATE_UP;
+	} else {
+		b->check_successes = 0;
+
+		if (b->state == BACKEND_STATE_DOWN) return 0;
+		if (++b->check_failures < fall) return 0;
+
+		b->check_failures = 0;
+		b->state = BACKEND_STATE_DOWN;
+	}
+
+	g_get_current_time(&b->state_since);
+
+	return 1;
+}
+
+/**
+ * is the backend more than max_lag seconds behind its master
+ *
+ * a backend with a unknown lag isn't lagging, one with a stopped replication always is
+ *
+ * @param max_lag  seconds, -1 for no limit
+ */
+gboolean network_backend_is_lagging(network_backend_t *b, gint max_lag) {
+	gint lag;
+
+	if (max_lag < 0) return FALSE;
+
+	lag = g_atomic_int_get(&(b->replication_lag));
+	if (lag == NETWORK_BACKEND_LAG_UNKNOWN) return FALSE;
+
+	return lag > max_lag;
+}
+
+static network_backends_snapshot_t *network_backends_snapshot_new(void) {
+	network_backends_snapshot_t *snapshot;
+	guint i;
+
+	snapshot = g_new0(network_backends_snapshot_t, 1);
+	snapshot->backends = g_ptr_array_new();
+
+	for (i = 0; i < BACKEND_TYPE_MAX; i++) {
+		network_backends_group_t *group = &(snapshot->groups[i]);
+
+		group->policy = BACKEND_BALANCE_SQF;
+		group->members = g_array_new(FALSE, FALSE, sizeof(guint));
+		group->schedule = g_array_new(FALSE, FALSE, sizeof(guint));
+		group->ring = g_array_new(FALSE, FALSE, sizeof(network_backends_ring_point_t));
+		group->fastest = -1;
+		group->max_lag = -1;
+	}
+
+	return snapshot;
+}
+
+/**
+ * free a snapshot, but not its backends
+ */
+static void network_backends_snapshot_free(network_backends_snapshot_t *snapshot) {
+	guint i;
+
+	if (!snapshot) return;
+
+	g_ptr_array_free(snapshot->backends, TRUE);
+
+	for (i = 0; i < BACKEND_TYPE_MAX; i++) {
+		network_backends_group_t *group = &(snapshot->groups[i]);
+
+		g_array_free(group->members, TRUE);
+		g_array_free(group->schedule, TRUE);
+		g_array_free(group->ring, TRUE);
+	}
+
+	g_free(snapshot);
+}
+
 network_backends_t *network_backends_new() {
 	network_backends_t *bs;
 
 	bs = g_new0(network_backends_t, 1);
 
-	bs->backends = g_ptr_array_new();
+	bs->snapshot = network_backends_snapshot_new();
 	bs->backends_mutex = g_mutex_new();
 
 	return bs;
@@ -84,52 +197,281 @@ void network_backends_free(network_backends_t *bs) {
 
 	if (!bs) return;
 
+	/* the old snapshots only point to backends of the current one */
 	g_mutex_lock(bs->backends_mutex);
-	for (i = 0; i < bs->backends->len; i++) {
-		network_backend_t *backend = bs->backends->pdata[i];
+	for (i = 0; i < bs->snapshot->backends->len; i++) {
+		network_backend_t *backend = bs->snapshot->backends->pdata[i];
 		
 		network_backend_free(backend);
 	}
 	g_mutex_unlock(bs->backends_mutex);
 
-	g_ptr_array_free(bs->backends, TRUE);
+	network_backends_snapshot_free(bs->snapshot);
 	g_mutex_free(bs->backends_mutex);
 
 	g_free(bs);
 }
 
+/**
+ * hash a string for the consistent-hashing ring
+ *
+ * FNV-1a with the finalizer of murmur3 to spread similar keys over the ring
+ */
+static guint32 network_backends_hash(const char *s, gsize len) {
+	guint32 h = 2166136261U;
+	gsize i;
+
+	for (i = 0; i < len; i++) {
+		h ^= (guint8)s[i];
+		h *= 16777619U;
+	}
+
+	h ^= h >> 16;
+	h *= 0x85ebca6bU;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35U;
+	h ^= h >> 16;
+
+	return h;
+}
+
+static gint network_backends_ring_point_cmp(gconstpointer _a, gconstpointer _b) {
+	const network_backends_ring_point_t *a = _a;
+	const network_backends_ring_point_t *b = _b;
+
+	if (a->hash != b->hash) return a->hash < b->hash ? -1 : 1;
+
+	return a->backend_ndx < b->backend_ndx ? -1 : (a->backend_ndx > b->backend_ndx);
+}
+
+static guint network_backends_gcd(guint a, guint b) {
+	while (b) {
+		guint t = a % b;
+
+		a = b;
+		b = t;
+	}
+
+	return a;
+}
+
+/**
+ * points each unit of weight gets on the consistent-hashing ring
+ */
+#define NETWORK_BACKENDS_RING_POINTS 64
+
+/**
+ * build the members, the round-robin schedule and the ring of a group
+ *
+ * the schedule is the sequence of the smooth weighted round-robin: with the
+ * weights 5, 1, 1 it is a a b a c a a instead of a a a a a b c. The weights are
+ * divided by their GCD to keep it short.
+ */
+static void network_backends_group_build(network_backends_snapshot_t *snapshot, backend_type_t type) {
+	network_backends_group_t *group = &(snapshot->groups[type]);
+	guint i, j, gcd = 0, total = 0;
+	gint *current;
+
+	for (i = 0; i < snapshot->backends->len; i++) {
+		network_backend_t *backend = snapshot->backends->pdata[i];
+
+		if (backend->type != type || backend->is_drained) continue;
+
+		g_array_append_val(group->members, i);
+		gcd = network_backends_gcd(backend->weight, gcd);
+	}
+
+	if (group->members->len == 0) return;
+
+	for (i = 0; i < group->members->len; i++) {
+		network_backend_t *backend = snapshot->backends->pdata[g_array_index(group->members, guint, i)];
+
+		total += backend->weight / gcd;
+	}
+
+	current = g_new0(gint, group->members->len);
+	for (j = 0; j < total; j++) {
+		guint best = 0;
+
+		for (i = 0; i < group->members->len; i++) {
+			network_backend_t *backend = snapshot->backends->pdata[g_array_index(group->members, guint, i)];
+
+			current[i] += backend->weight / gcd;
+			if (current[i] > current[best]) best = i;
+		}
+		current[best] -= total;
+
+		g_array_append_val(group->schedule, g_array_index(group->members, guint, best));
+	}
+	g_free(current);
+
+	for (i = 0; i < group->members->len; i++) {
+		guint backend_ndx = g_array_index(group->members, guint, i);
+		network_backend_t *backend = snapshot->backends->pdata[backend_ndx];
+
+		for (j = 0; j < backend->weight * NETWORK_BACKENDS_RING_POINTS; j++) {
+			network_backends_ring_point_t point;
+			gchar *name;
+
+			/* the points only depend on the address, not on the order of the backends */
+			name = g_strdup_printf("%s#%u", backend->addr->name->str, j);
+			point.hash = network_backends_hash(name, strlen(name));
+			point.backend_ndx = backend_ndx;
+			g_free(name);
+
+			g_array_append_val(group->ring, point);
+		}
+	}
+	g_array_sort(group->ring, network_backends_ring_point_cmp);
+}
+
+/**
+ * split the weight off a backend-address
+ *
+ * "127.0.0.1:3306@3" gets 3 times the load of a backend with the default weight of 1
+ *
+ * @return the address without the weight, NULL if the weight isn't valid
+ */
+static gchar *network_backends_get_weight(const gchar *address, guint *weight) {
+	const gchar *at;
+	gchar *end = NULL;
+	gulong w;
+
+	*weight = 1;
+
+	/* a unix-socket may have a @ in its path, only take it if a number follows */
+	if (NULL == (at = strrchr(address, '@')) ||
+	    at[1] == '\0' ||
+	    strspn(at + 1, "0123456789") != strlen(at + 1)) {
+		return g_strdup(address);
+	}
+
+	w = strtoul(at + 1, &end, 10);
+	if (w < 1 || w > NETWORK_BACKEND_MAX_WEIGHT) {
+		g_critical("%s: the weight of backend %s has to be between 1 and %d",
+				G_STRLOC, address, NETWORK_BACKEND_MAX_WEIGHT);
+		return NULL;
+	}
+	*weight = w;
+
+	return g_strndup(address, at - address);
+}
+
+static void network_backends_group_update_latency(network_backends_snapshot_t *snapshot, network_backends_group_t *group);
+
+/**
+ * copy the current snapshot for a writer
+ *
+ * has to be called with the backends_mutex held
+ */
+static network_backends_snapshot_t *network_backends_snapshot_copy(network_backends_t *bs) {
+	network_backends_snapshot_t *snapshot;
+	guint i;
+
+	snapshot = network_backends_snapshot_new();
+
+	for (i = 0; i < bs->snapshot->backends->len; i++) {
+		g_ptr_array_add(snapshot->backends, bs->snapshot->backends->pdata[i]);
+	}
+
+	for (i = 0; i < BACKEND_TYPE_MAX; i++) {
+		snapshot->groups[i].policy = bs->snapshot->groups[i].policy;
+		snapshot->groups[i].max_lag = bs->snapshot->groups[i].max_lag;
+	}
+
+	return snapshot;
+}
+
+/**
+ * build the groups of a new snapshot and swap it in
+ *
+ * the readers may still use the old snapshot, it is retired to the epochs of
+ * the event-threads
+ *
+ * has to be called with the backends_mutex held
+ */
+static void network_backends_publish(network_backends_t *bs, network_backends_snapshot_t *snapshot) {
+	network_backends_snapshot_t *old_snapshot = bs->snapshot;
+	guint i;
+
+	for (i = 0; i < BACKEND_TYPE_MAX; i++) {
+		network_backends_group_build(snapshot, i);
+		network_backends_group_update_latency(snapshot, &(snapshot->groups[i]));
+	}
+	snapshot->version = old_snapshot->version + 1;
+
+	g_atomic_pointer_set(&(bs->snapshot), snapshot);
+
+	if (bs->threads) {
+		chassis_event_threads_retire(bs->threads, old_snapshot, (GDestroyNotify)network_backends_snapshot_free);
+	} else {
+		network_backends_snapshot_free(old_snapshot);
+	}
+}
+
+/**
+ * get the current snapshot of the backends
+ *
+ * it stays valid until the event-handler returns
+ */
+network_backends_snapshot_t *network_backends_get_snapshot(network_backends_t *bs) {
+	return g_atomic_pointer_get(&(bs->snapshot));
+}
+
 /*
  * FIXME: 1) remove _set_address, make this function callable with result of same
  *        2) differentiate between reasons for "we didn't add" (now -1 in all cases)
+ *
+ * adding a drained backend again brings it back
  */
 int network_backends_add(network_backends_t *bs, /* const */ gchar *address, backend_type_t type) {
+	network_backends_snapshot_t *snapshot;
 	network_backend_t *new_backend;
+	gchar *addr_str;
+	guint weight;
 	guint i;
 
+	if (NULL == (addr_str = network_backends_get_weight(address, &weight))) return -1;
+
 	new_backend = network_backend_new();
 	new_backend->type = type;
+	new_backend->weight = weight;
+	new_backend->pool->max_idle_time = bs->pool_max_idle_time;
 
-	if (0 != network_address_set_address(new_backend->addr, address)) {
+	if (0 != network_address_set_address(new_backend->addr, addr_str)) {
+		g_free(addr_str);
 		network_backend_free(new_backend);
 		return -1;
 	}
+	g_free(addr_str);
 
 	/* check if this backend is already known */
 	g_mutex_lock(bs->backends_mutex);
-	for (i = 0; i < bs->backends->len; i++) {
-		network_backend_t *old_backend = bs->backends->pdata[i];
+	for (i = 0; i < bs->snapshot->backends->len; i++) {
+		network_backend_t *old_backend = bs->snapshot->backends->pdata[i];
 
 		if (strleq(S(old_backend->addr->name), S(new_backend->addr->name))) {
 			network_backend_free(new_backend);
 
+			if (old_backend->is_drained && old_backend->type == type) {
+				old_backend->is_drained = FALSE;
+				old_backend->weight = weight;
+				network_backends_publish(bs, network_backends_snapshot_copy(bs));
+				g_mutex_unlock(bs->backends_mutex);
+
+				g_message("%s: backend %s is back", G_STRLOC, address);
+				return 0;
+			}
+
 			g_mutex_unlock(bs->backends_mutex);
 			g_critical("backend %s is already known!", address);
 			return -1;
 		}
 	}
 
-
-	g_ptr_array_add(bs->backends, new_backend);
+	snapshot = network_backends_snapshot_copy(bs);
+	g_ptr_array_add(snapshot->backends, new_backend);
+	network_backends_publish(bs, snapshot);
 	g_mutex_unlock(bs->backends_mutex);
 
 	g_message("added %s backend: %s", (type == BACKEND_TYPE_RW) ?
@@ -144,14 +486,19 @@ int network_backends_add(network_backends_t *bs, /* const */ gchar *address, bac
  *
  * we only check once a second to reduce the overhead on connection setup
  *
+ * if the backends are health-checked, the checker brings them back UP
+ *
  * @returns   number of updated backends
  */
 int network_backends_check(network_backends_t *bs) {
+	network_backends_snapshot_t *snapshot;
 	GTimeVal now;
 	guint i;
 	int backends_woken_up = 0;
 	gint64	t_diff;
 
+	if (bs->is_health_checked) return 0;
+
 	g_get_current_time(&now);
 	ge_gtimeval_diff(&bs->backend_last_check, &now, &t_diff);
 
@@ -172,8 +519,9 @@ int network_backends_check(network_backends_t *bs) {
 
 	bs->backend_last_check = now;
 
-	for (i = 0; i < bs->backends->len; i++) {
-		network_backend_t *cur = bs->backends->pdata[i];
+	snapshot = bs->snapshot;
+	for (i = 0; i < snapshot->backends->len; i++) {
+		network_backend_t *cur = snapshot->backends->pdata[i];
 
 		if (cur->state != BACKEND_STATE_DOWN) continue;
 
@@ -193,20 +541,342 @@ int network_backends_check(network_backends_t *bs) {
 	return backends_woken_up;
 }
 
+/**
+ * get a backend by its index
+ *
+ * doesn't lock, the backend stays valid as backends are only drained, never removed
+ */
 network_backend_t *network_backends_get(network_backends_t *bs, guint ndx) {
-	if (ndx >= network_backends_count(bs)) return NULL;
+	network_backends_snapshot_t *snapshot = network_backends_get_snapshot(bs);
+
+	if (ndx >= snapshot->backends->len) return NULL;
 
-	/* FIXME: shouldn't we copy the backend or add ref-counting ? */	
-	return bs->backends->pdata[ndx];
+	return snapshot->backends->pdata[ndx];
 }
 
 guint network_backends_count(network_backends_t *bs) {
-	guint len;
+	return network_backends_get_snapshot(bs)->backends->len;
+}
+
+/**
+ * stop sending new clients to a backend
+ *
+ * the connected clients stay until they disconnect, their connections aren't
+ * pooled anymore. network_backends_add() brings it back.
+ *
+ * @return 0 on success, -1 if there is no such backend
+ */
+int network_backends_drain(network_backends_t *bs, guint ndx) {
+	network_backend_t *backend;
 
 	g_mutex_lock(bs->backends_mutex);
-	len = bs->backends->len;
+	if (ndx >= bs->snapshot->backends->len) {
+		g_mutex_unlock(bs->backends_mutex);
+		return -1;
+	}
+
+	backend = bs->snapshot->backends->pdata[ndx];
+	if (!backend->is_drained) {
+		backend->is_drained = TRUE;
+		network_backends_publish(bs, network_backends_snapshot_copy(bs));
+
+		g_message("%s: draining backend %s", G_STRLOC, backend->addr->name->str);
+	}
 	g_mutex_unlock(bs->backends_mutex);
 
-	return len;
+	return 0;
+}
+
+/**
+ * change the weight of a backend
+ *
+ * @return 0 on success, -1 if there is no such backend or the weight isn't valid
+ */
+int network_backends_set_weight(network_backends_t *bs, guint ndx, guint weight) {
+	network_backend_t *backend;
+
+	if (weight < 1 || weight > NETWORK_BACKEND_MAX_WEIGHT) return -1;
+
+	g_mutex_lock(bs->backends_mutex);
+	if (ndx >= bs->snapshot->backends->len) {
+		g_mutex_unlock(bs->backends_mutex);
+		return -1;
+	}
+
+	backend = bs->snapshot->backends->pdata[ndx];
+	if (backend->weight != weight) {
+		backend->weight = weight;
+		network_backends_publish(bs, network_backends_snapshot_copy(bs));
+	}
+	g_mutex_unlock(bs->backends_mutex);
+
+	return 0;
+}
+
+int network_backends_balance_from_string(const gchar *name, backend_balance_t *policy) {
+	static const struct {
+		const gchar *name;
+		backend_balance_t policy;
+	} policies[] = {
+		{ "sqf", BACKEND_BALANCE_SQF },
+		{ "wrr", BACKEND_BALANCE_WRR },
+		{ "p2c", BACKEND_BALANCE_P2C },
+		{ "latency", BACKEND_BALANCE_LATENCY },
+		{ "hash-user", BACKEND_BALANCE_HASH_USER },
+		{ "hash-schema", BACKEND_BALANCE_HASH_SCHEMA },
+		{ NULL, BACKEND_BALANCE_SQF }
+	};
+	guint i;
+
+	for (i = 0; policies[i].name; i++) {
+		if (0 == strcmp(name, policies[i].name)) {
+			*policy = policies[i].policy;
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+void network_backends_set_balance(network_backends_t *bs, backend_type_t type, backend_balance_t policy) {
+	network_backends_snapshot_t *snapshot;
+
+	g_mutex_lock(bs->backends_mutex);
+	snapshot = network_backends_snapshot_copy(bs);
+	snapshot->groups[type].policy = policy;
+	network_backends_publish(bs, snapshot);
+	g_mutex_unlock(bs->backends_mutex);
+}
+
+void network_backends_set_max_lag(network_backends_t *bs, backend_type_t type, gint max_lag) {
+	network_backends_snapshot_t *snapshot;
+
+	g_mutex_lock(bs->backends_mutex);
+	snapshot = network_backends_snapshot_copy(bs);
+	snapshot->groups[type].max_lag = max_lag;
+	network_backends_publish(bs, snapshot);
+	g_mutex_unlock(bs->backends_mutex);
+}
+
+static gboolean network_backend_is_usable(network_backend_t *backend, gint max_lag) {
+	return backend->state != BACKEND_STATE_DOWN && !network_backend_is_lagging(backend, max_lag);
+}
+
+/**
+ * the latency of the queries if we know it, otherwise the one of the connects
+ */
+static gdouble network_backend_get_latency(network_backend_t *backend) {
+	return backend->query_latency > 0 ? backend->query_latency : backend->connect_latency;
+}
+
+/**
+ * the backend with the fewest connected clients
+ *
+ * on a tie the one the health-checks connect to faster
+ */
+static gint network_backends_balance_sqf(network_backends_snapshot_t *snapshot, network_backends_group_t *group, gint max_lag) {
+	guint min_connected_clients = G_MAXUINT;
+	gdouble min_connect_latency = 0;
+	gint ndx = -1;
+	guint i;
+
+	for (i = 0; i < group->members->len; i++) {
+		guint backend_ndx = g_array_index(group->members, guint, i);
+		network_backend_t *cur = snapshot->backends->pdata[backend_ndx];
+
+		if (!network_backend_is_usable(cur, max_lag)) continue;
+
+		if (cur->connected_clients < min_connected_clients ||
+		    (cur->connected_clients == min_connected_clients &&
+		     cur->connect_latency > 0 &&
+		     (min_connect_latency == 0 || cur->connect_latency < min_connect_latency))) {
+			ndx = backend_ndx;
+			min_connected_clients = cur->connected_clients;
+			min_connect_latency = cur->connect_latency;
+		}
+	}
+
+	return ndx;
 }
 
+/**
+ * the next backend of the schedule that isn't DOWN or lagging
+ */
+static gint network_backends_balance_wrr(network_backends_snapshot_t *snapshot, network_backends_group_t *group, gint max_lag) {
+	guint i;
+
+	for (i = 0; i < group->schedule->len; i++) {
+		guint pos = (guint)g_atomic_int_exchange_and_add(&(group->schedule_pos), 1) % group->schedule->len;
+		guint backend_ndx = g_array_index(group->schedule, guint, pos);
+
+		if (network_backend_is_usable(snapshot->backends->pdata[backend_ndx], max_lag)) return backend_ndx;
+	}
+
+	return -1;
+}
+
+/**
+ * the power of two choices: the one with less queries in flight of two random backends
+ *
+ * if both are DOWN or lagging we look at all of them
+ */
+static gint network_backends_balance_p2c(network_backends_snapshot_t *snapshot, network_backends_group_t *group, gint max_lag) {
+	guint a_ndx, b_ndx;
+	network_backend_t *a, *b;
+	guint n = group->members->len;
+
+	if (n == 1) {
+		a_ndx = g_array_index(group->members, guint, 0);
+
+		return network_backend_is_usable(snapshot->backends->pdata[a_ndx], max_lag) ? (gint)a_ndx : -1;
+	}
+
+	a_ndx = g_random_int_range(0, n);
+	b_ndx = g_random_int_range(0, n - 1);
+	if (b_ndx >= a_ndx) b_ndx++;
+
+	a_ndx = g_array_index(group->members, guint, a_ndx);
+	b_ndx = g_array_index(group->members, guint, b_ndx);
+	a = snapshot->backends->pdata[a_ndx];
+	b = snapshot->backends->pdata[b_ndx];
+
+	if (!network_backend_is_usable(a, max_lag) && !network_backend_is_usable(b, max_lag)) return network_backends_balance_sqf(snapshot, group, max_lag);
+	if (!network_backend_is_usable(a, max_lag)) return b_ndx;
+	if (!network_backend_is_usable(b, max_lag)) return a_ndx;
+
+	if (g_atomic_int_get(&(a->in_flight)) != g_atomic_int_get(&(b->in_flight))) {
+		return g_atomic_int_get(&(a->in_flight)) < g_atomic_int_get(&(b->in_flight)) ? a_ndx : b_ndx;
+	}
+
+	return a->connected_clients <= b->connected_clients ? a_ndx : b_ndx;
+}
+
+/**
+ * the first backend on the ring after the hash of the key that isn't DOWN or lagging
+ */
+static gint network_backends_balance_hash(network_backends_snapshot_t *snapshot, network_backends_group_t *group, const GString *key, gint max_lag) {
+	guint32 hash = network_backends_hash(S(key));
+	guint lo = 0, hi = group->ring->len;
+	guint i;
+
+	/* the first point with a hash >= ours */
+	while (lo < hi) {
+		guint mid = lo + (hi - lo) / 2;
+
+		if (g_array_index(group->ring, network_backends_ring_point_t, mid).hash < hash) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	for (i = 0; i < group->ring->len; i++) {
+		network_backends_ring_point_t *point = &g_array_index(group->ring, network_backends_ring_point_t, (lo + i) % group->ring->len);
+
+		if (network_backend_is_usable(snapshot->backends->pdata[point->backend_ndx], max_lag)) return point->backend_ndx;
+	}
+
+	return -1;
+}
+
+/**
+ * pick a backend of a type by the policy of its group
+ *
+ * the hash policies need the username or default-db of the client. Before the
+ * client is authed or without a default-db they fall back to the weighted
+ * round-robin.
+ *
+ * @param username    the username of the client, may be NULL
+ * @param default_db  the default-db of the client, may be NULL
+ * @param max_lag     skip backends that are more seconds behind their master, -1 for no limit
+ * @return the index of the backend, -1 if all backends of the type are DOWN or lagging
+ */
+gint network_backends_balance_max_lag(network_backends_t *bs, backend_type_t type, const GString *username, const GString *default_db, gint max_lag) {
+	network_backends_snapshot_t *snapshot = network_backends_get_snapshot(bs);
+	network_backends_group_t *group = &(snapshot->groups[type]);
+	gint ndx = -1;
+
+	if (group->members->len > 0) {
+		switch (group->policy) {
+		case BACKEND_BALANCE_SQF:
+			ndx = network_backends_balance_sqf(snapshot, group, max_lag);
+			break;
+		case BACKEND_BALANCE_WRR:
+			ndx = network_backends_balance_wrr(snapshot, group, max_lag);
+			break;
+		case BACKEND_BALANCE_P2C:
+			ndx = network_backends_balance_p2c(snapshot, group, max_lag);
+			break;
+		case BACKEND_BALANCE_LATENCY:
+			ndx = g_atomic_int_get(&(group->fastest));
+
+			/* without latencies we only know the queries in flight */
+			if (ndx < 0 || !network_backend_is_usable(snapshot->backends->pdata[ndx], max_lag)) {
+				ndx = network_backends_balance_p2c(snapshot, group, max_lag);
+			}
+			break;
+		case BACKEND_BALANCE_HASH_USER:
+		case BACKEND_BALANCE_HASH_SCHEMA: {
+			const GString *key = group->policy == BACKEND_BALANCE_HASH_USER ? username : default_db;
+
+			if (key && key->len > 0) {
+				ndx = network_backends_balance_hash(snapshot, group, key, max_lag);
+			} else {
+				ndx = network_backends_balance_wrr(snapshot, group, max_lag);
+			}
+			break; }
+		}
+	}
+
+	return ndx;
+}
+
+/**
+ * pick a backend of a type with the max-lag of its group
+ *
+ * @see network_backends_balance_max_lag()
+ */
+gint network_backends_balance(network_backends_t *bs, backend_type_t type, const GString *username, const GString *default_db) {
+	return network_backends_balance_max_lag(bs, type, username, default_db, network_backends_get_snapshot(bs)->groups[type].max_lag);
+}
+
+/**
+ * find the fastest backend of a group
+ */
+static void network_backends_group_update_latency(network_backends_snapshot_t *snapshot, network_backends_group_t *group) {
+	gdouble min_latency = 0;
+	gint fastest = -1;
+	guint i;
+
+	if (group->policy != BACKEND_BALANCE_LATENCY) return;
+
+	for (i = 0; i < group->members->len; i++) {
+		guint backend_ndx = g_array_index(group->members, guint, i);
+		network_backend_t *backend = snapshot->backends->pdata[backend_ndx];
+		gdouble latency = network_backend_get_latency(backend);
+
+		if (!network_backend_is_usable(backend, -1) || latency <= 0) continue;
+
+		if (fastest == -1 || latency < min_latency) {
+			fastest = backend_ndx;
+			min_latency = latency;
+		}
+	}
+
+	g_atomic_int_set(&(group->fastest), fastest);
+}
+
+/**
+ * find the fastest backend of each group
+ *
+ * called when the health-checks updated the latencies to keep it out of the
+ * way of the clients
+ */
+void network_backends_update_latency(network_backends_t *bs) {
+	network_backends_snapshot_t *snapshot = network_backends_get_snapshot(bs);
+	guint i;
+
+	for (i = 0; i < BACKEND_TYPE_MAX; i++) {
+		network_backends_group_update_latency(snapshot, &(snapshot->groups[i]));
+	}
+}
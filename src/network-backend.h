@@ -43,6 +43,19 @@ typedef enum {
 	BACKEND_TYPE_RO
 } backend_type_t;
 
+#define BACKEND_TYPE_MAX (BACKEND_TYPE_RO + 1)
+
+typedef enum {
+	BACKEND_BALANCE_SQF,         /**< fewest connected clients (shortest queue first) */
+	BACKEND_BALANCE_WRR,         /**< weighted round-robin */
+	BACKEND_BALANCE_P2C,         /**< the one with less queries in flight of two random backends */
+	BACKEND_BALANCE_LATENCY,     /**< least EWMA latency of the health-checks */
+	BACKEND_BALANCE_HASH_USER,   /**< consistent hashing on the username */
+	BACKEND_BALANCE_HASH_SCHEMA  /**< consistent hashing on the default-db */
+} backend_balance_t;
+
+#define NETWORK_BACKEND_MAX_WEIGHT 100
+
 typedef struct {
 	network_address *addr;
    
@@ -56,8 +69,38 @@ typedef struct {
 	guint connected_clients; /**< number of open connections to this backend for SQF */
 
 	GString *uuid;           /**< the UUID of the backend */
+
+	gdouble connect_latency; /**< EWMA of the time until the handshake arrived in usec, 0 if unknown */
+	gdouble query_latency;   /**< EWMA of the round-trip of a COM_PING in usec, 0 if unknown */
+
+	guint check_successes;   /**< successful health-checks in a row while DOWN */
+	guint check_failures;    /**< failed health-checks in a row while not DOWN */
+
+	guint weight;            /**< share of the load relative to the other backends of the same type, 1 by default */
+	volatile gint in_flight; /**< queries sent to this backend that wait for their result */
+
+	volatile gint replication_lag; /**< seconds the replica is behind its master, see NETWORK_BACKEND_LAG_* */
+
+	gboolean is_drained;     /**< gets no new clients, stays in the backend-array to keep the indexes stable */
 } network_backend_t;
 
+/**
+ * the replication-lag of a backend isn't known
+ *
+ * it isn't a replica, it isn't health-checked or the check-user may not ask
+ */
+#define NETWORK_BACKEND_LAG_UNKNOWN (-1)
+
+/**
+ * the replication of a backend is stopped, it is infinitely behind
+ */
+#define NETWORK_BACKEND_LAG_STOPPED G_MAXINT
+
+/**
+ * weight of a new sample in the EWMA of the latencies
+ */
+#define NETWORK_BACKEND_LATENCY_WEIGHT 0.2
+
 typedef network_backend_t backend_t G_GNUC_DEPRECATED;
 
 NETWORK_API network_backend_t *backend_init() G_GNUC_DEPRECATED;
@@ -65,12 +108,65 @@ NETWORK_API void backend_free(network_backend_t *b) G_GNUC_DEPRECATED;
 
 NETWORK_API network_backend_t *network_backend_new();
 NETWORK_API void network_backend_free(network_backend_t *b);
+NETWORK_API void network_backend_latency_update(gdouble *latency, gdouble sample);
+NETWORK_API int network_backend_check_done(network_backend_t *b, gboolean is_alive, guint rise, guint fall);
+NETWORK_API gboolean network_backend_is_lagging(network_backend_t *b, gint max_lag);
+
+/**
+ * a point of the consistent-hashing ring
+ */
+typedef struct {
+	guint32 hash;
+	guint backend_ndx;
+} network_backends_ring_point_t;
+
+/**
+ * the backends of one type and how we balance between them
+ *
+ * part of a snapshot, only schedule_pos and fastest change after it got published
+ */
+typedef struct {
+	backend_balance_t policy;
+
+	GArray *members;             /**< guint, index of each backend of this type */
+
+	GArray *schedule;            /**< guint, BACKEND_BALANCE_WRR: each backend weight times, interleaved */
+	volatile gint schedule_pos;  /**< next position in the schedule */
+
+	GArray *ring;                /**< network_backends_ring_point_t sorted by hash, BACKEND_BALANCE_HASH_* */
 
+	volatile gint fastest;       /**< BACKEND_BALANCE_LATENCY: backend with the least latency, -1 if unknown */
+
+	gint max_lag;                /**< skip backends that are more seconds behind their master, -1 for no limit */
+} network_backends_group_t;
+
+/**
+ * a immutable version of the backend-array
+ *
+ * readers use the current snapshot without a lock. Adding, draining or
+ * re-weighting a backend builds a new snapshot and swaps it in, the old one is
+ * freed when the event-threads can't see it anymore. Backends are never removed
+ * from the array, a index stays valid.
+ */
 typedef struct {
-	GPtrArray *backends;
-	GMutex    *backends_mutex;
+	guint version;
+
+	GPtrArray *backends;        /**< network_backend_t, owned by the network_backends_t */
+
+	network_backends_group_t groups[BACKEND_TYPE_MAX]; /**< indexed by backend_type_t */
+} network_backends_snapshot_t;
+
+typedef struct {
+	network_backends_snapshot_t *snapshot; /**< the current snapshot, see network_backends_get_snapshot() */
+	GMutex    *backends_mutex;   /**< serializes the writers */
 	
 	GTimeVal backend_last_check;
+
+	gboolean is_health_checked; /**< a network_backends_checker_t sets the state, don't wake up DOWN backends */
+
+	chassis_event_threads_t *threads; /**< retire the replaced snapshots to their epochs, NULL to free them right away */
+
+	guint pool_max_idle_time;   /**< max_idle_time of the pools of the added backends */
 } network_backends_t;
 
 NETWORK_API network_backends_t *network_backends_new();
@@ -79,6 +175,16 @@ NETWORK_API int network_backends_add(network_backends_t *backends, /* const */ g
 NETWORK_API int network_backends_check(network_backends_t *backends);
 NETWORK_API network_backend_t * network_backends_get(network_backends_t *backends, guint ndx);
 NETWORK_API guint network_backends_count(network_backends_t *backends);
+NETWORK_API network_backends_snapshot_t *network_backends_get_snapshot(network_backends_t *backends);
+NETWORK_API int network_backends_drain(network_backends_t *backends, guint ndx);
+NETWORK_API int network_backends_set_weight(network_backends_t *backends, guint ndx, guint weight);
+
+NETWORK_API int network_backends_balance_from_string(const gchar *name, backend_balance_t *policy);
+NETWORK_API void network_backends_set_balance(network_backends_t *backends, backend_type_t type, backend_balance_t policy);
+NETWORK_API void network_backends_set_max_lag(network_backends_t *backends, backend_type_t type, gint max_lag);
+NETWORK_API gint network_backends_balance(network_backends_t *backends, backend_type_t type, const GString *username, const GString *default_db);
+NETWORK_API gint network_backends_balance_max_lag(network_backends_t *backends, backend_type_t type, const GString *username, const GString *default_db, gint max_lag);
+NETWORK_API void network_backends_update_latency(network_backends_t *backends);
 
 #endif /* _BACKEND_H_ */
 
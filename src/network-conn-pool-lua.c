@@ -63,12 +63,12 @@
  * @return nil or requested information
  */
 static int proxy_pool_queue_get(lua_State *L) {
-	GQueue *queue = *(GQueue **)luaL_checkself(L); 
+	guint idle = *(guint *)luaL_checkself(L); 
 	gsize keysize = 0;
 	const char *key = luaL_checklstring(L, 2, &keysize);
 
 	if (strleq(key, keysize, C("cur_idle_connections"))) {
-		lua_pushinteger(L, queue ? queue->length : 0);
+		lua_pushinteger(L, idle);
 	} else {
 		lua_pushnil(L);
 	}
@@ -89,16 +89,19 @@ int network_connection_pool_queue_getmetatable(lua_State *L) {
 /**
  * get the info connection pool 
  *
+ * the idle connections of the user are counted when the user is looked up,
+ * "" counts the connections of all users
+ *
  * @return nil or requested information
  */
 static int proxy_pool_users_get(lua_State *L) {
 	network_connection_pool *pool = *(network_connection_pool **)luaL_checkself(L); 
 	const char *key = luaL_checkstring(L, 2); /** the username */
 	GString *s = g_string_new(key);
-	GQueue **q_p = NULL;
+	guint *idle_p = NULL;
 
-	q_p = lua_newuserdata(L, sizeof(*q_p)); 
-	*q_p = network_connection_pool_get_conns(pool, s, NULL);
+	idle_p = lua_newuserdata(L, sizeof(*idle_p)); 
+	*idle_p = network_connection_pool_get_idle(pool, s);
 	g_string_free(s, TRUE);
 
 	network_connection_pool_queue_getmetatable(L);
@@ -125,6 +128,10 @@ static int proxy_pool_get(lua_State *L) {
 		lua_pushinteger(L, pool->max_idle_connections);
 	} else if (strleq(key, keysize, C("min_idle_connections"))) {
 		lua_pushinteger(L, pool->min_idle_connections);
+	} else if (strleq(key, keysize, C("max_idle_time"))) {
+		lua_pushinteger(L, pool->max_idle_time);
+	} else if (strleq(key, keysize, C("cur_idle_connections"))) {
+		lua_pushinteger(L, network_connection_pool_get_idle(pool, NULL));
 	} else if (strleq(key, keysize, C("users"))) {
 		network_connection_pool **pool_p;
 
@@ -150,6 +157,8 @@ static int proxy_pool_set(lua_State *L) {
 		pool->max_idle_connections = lua_tointeger(L, -1);
 	} else if (strleq(key, keysize, C("min_idle_connections"))) {
 		pool->min_idle_connections = lua_tointeger(L, -1);
+	} else if (strleq(key, keysize, C("max_idle_time"))) {
+		pool->max_idle_time = lua_tointeger(L, -1);
 	} else {
 		return luaL_error(L, "proxy.backend[...].%s is not writable", key);
 	}
@@ -213,11 +222,19 @@ int network_connection_pool_lua_add_connection(network_mysqld_con *con) {
 	/* the server connection is still authed */
 	con->server->is_authed = 1;
 
-	/* insert the server socket into the connection pool */
-	pool_entry = network_connection_pool_add(st->backend->pool, con->server);
+	if (st->backend->is_drained) {
+		/* the backend goes away, don't keep connections to it */
+		network_socket_free(con->server);
+	} else {
+		/* insert the server socket into the connection pool */
+		pool_entry = network_connection_pool_add(st->backend->pool, con->server);
+	}
 
-	event_set(&(con->server->event), con->server->fd, EV_READ, network_mysqld_con_idle_handle, pool_entry);
-	chassis_event_add_local(con->srv, &(con->server->event)); /* add a event, but stay in the same thread */
+	/* the connections in the overflow may be taken by other threads already, they can't have a event in ours */
+	if (NULL != pool_entry) {
+		event_set(&(con->server->event), con->server->fd, EV_READ, network_mysqld_con_idle_handle, pool_entry);
+		chassis_event_add_local(con->srv, &(con->server->event)); /* add a event, but stay in the same thread */
+	}
 	
 	st->backend->connected_clients--;
 	st->backend = NULL;
@@ -250,7 +267,7 @@ network_socket *network_connection_pool_lua_swap(network_mysqld_con *con, int ba
 	 */
 
 	backend = network_backends_get(g->backends, backend_ndx);
-	if (!backend) return NULL;
+	if (!backend || backend->is_drained) return NULL;
 
 
 	/**
@@ -34,8 +34,24 @@
  * - make sure we don't run out of seconds
  * - if the client is authed, we have to pick connection with the same user
  * - ...  
+ *
+ * each event-thread adds and takes connections from its own shard of the pool. Only
+ * if it has none that fits, it looks into the overflow which is shared by all threads.
+ *
+ * connections that idled for max_idle_time aren't handed out anymore. The server
+ * would close them soon and the client would see a "server has gone away".
  */
 
+#define S(x) x->str, x->len
+
+/**
+ * the shard of the current thread, +1 to tell "not assigned yet" apart from shard 0
+ *
+ * a thread uses the same shard in all pools
+ */
+static GStaticPrivate pool_shard_key = G_STATIC_PRIVATE_INIT;
+static volatile gint pool_next_shard = 0;
+
 /**
  * create a empty connection pool entry
  *
@@ -65,26 +81,36 @@ void network_connection_pool_entry_free(network_connection_pool_entry *e, gboole
 		network_socket_free(sock);
 	}
 
+	if (e->key) g_string_free(e->key, TRUE);
+
 	g_free(e);
 }
 
 /**
- * free all pool entries of the queue
- *
- * used as GDestroyFunc in the user-hash of the pool
+ * free a queue of the shard-index
  *
- * @param q a GQueue to free
- *
- * @see network_connection_pool_new
- * @see GDestroyFunc
+ * the entries are freed through shard->entries
  */
-static void g_queue_free_all(gpointer q) {
-	GQueue *queue = q;
+static void network_connection_pool_queue_free(gpointer q) {
+	g_queue_free(q);
+}
+
+static void network_connection_pool_shard_init(network_connection_pool_shard *shard) {
+	shard->mutex = g_mutex_new();
+	shard->keys = g_hash_table_new_full(g_hash_table_string_hash, g_hash_table_string_equal, g_hash_table_string_free, network_connection_pool_queue_free);
+	shard->users = g_hash_table_new_full(g_hash_table_string_hash, g_hash_table_string_equal, g_hash_table_string_free, network_connection_pool_queue_free);
+	shard->entries = g_queue_new();
+}
+
+static void network_connection_pool_shard_clear(network_connection_pool_shard *shard) {
 	network_connection_pool_entry *entry;
 
-	while ((entry = g_queue_pop_head(queue))) network_connection_pool_entry_free(entry, TRUE);
+	while ((entry = g_queue_pop_head(shard->entries))) network_connection_pool_entry_free(entry, TRUE);
 
-	g_queue_free(queue);
+	g_queue_free(shard->entries);
+	g_hash_table_destroy(shard->users);
+	g_hash_table_destroy(shard->keys);
+	g_mutex_free(shard->mutex);
 }
 
 /**
@@ -99,10 +125,17 @@ network_connection_pool *network_connection_pool_init(void) {
  */
 network_connection_pool *network_connection_pool_new(void) {
 	network_connection_pool *pool;
+	guint i;
 
 	pool = g_new0(network_connection_pool, 1);
 
-	pool->users = g_hash_table_new_full(g_hash_table_string_hash, g_hash_table_string_equal, g_hash_table_string_free, g_queue_free_all);
+	for (i = 0; i < NETWORK_CONNECTION_POOL_SHARDS; i++) {
+		network_connection_pool_shard_init(&(pool->shards[i]));
+	}
+	network_connection_pool_shard_init(&(pool->overflow));
+
+	pool->waiters_mutex = g_mutex_new();
+	pool->waiters = g_queue_new();
 
 	return pool;
 }
@@ -112,54 +145,252 @@ network_connection_pool *network_connection_pool_new(void) {
  *
  */
 void network_connection_pool_free(network_connection_pool *pool) {
+	guint i;
+
 	if (!pool) return;
 
-	g_hash_table_foreach_remove(pool->users, g_hash_table_true, NULL);
+	for (i = 0; i < NETWORK_CONNECTION_POOL_SHARDS; i++) {
+		network_connection_pool_shard_clear(&(pool->shards[i]));
+	}
+	network_connection_pool_shard_clear(&(pool->overflow));
 
-	g_hash_table_destroy(pool->users);
+	/* the waiters belong to who added them */
+	g_queue_free(pool->waiters);
+	g_mutex_free(pool->waiters_mutex);
 
 	g_free(pool);
 }
 
 /**
- * find the entry which has more than max_idle connections idling
- * 
- * @return TRUE for the first entry having more than _user_data idling connections
- * @see network_connection_pool_get_conns 
+ * get the shard of the current thread
+ *
+ * threads get their shard assigned on first use. If there are more threads than shards,
+ * the others only use the overflow
  */
-static gboolean find_idle_conns(gpointer UNUSED_PARAM(_key), gpointer _val, gpointer _user_data) {
-	guint min_idle_conns = *(gint *)_user_data;
-	GQueue *conns = _val;
+static network_connection_pool_shard *network_connection_pool_get_shard(network_connection_pool *pool) {
+	guint ndx;
+
+	ndx = GPOINTER_TO_UINT(g_static_private_get(&pool_shard_key));
+	if (0 == ndx) {
+		ndx = (guint)g_atomic_int_exchange_and_add(&pool_next_shard, 1) + 1;
+
+		g_static_private_set(&pool_shard_key, GUINT_TO_POINTER(ndx), NULL);
+	}
+
+	if (ndx > NETWORK_CONNECTION_POOL_SHARDS) return &(pool->overflow);
 
-	return (conns->length > min_idle_conns);
+	return &(pool->shards[ndx - 1]);
 }
 
-GQueue *network_connection_pool_get_conns(network_connection_pool *pool, GString *username, GString *UNUSED_PARAM(default_db)) {
-	GQueue *conns = NULL;
+/**
+ * build the key of a connection in shard->keys
+ */
+static GString *network_connection_pool_key_new(GString *username, GString *default_db, guint8 charset) {
+	GString *key;
+
+	key = g_string_sized_new(username->len + default_db->len + 3);
+	g_string_append_len(key, S(username));
+	g_string_append_c(key, '\0');
+	g_string_append_len(key, S(default_db));
+	g_string_append_c(key, '\0');
+	g_string_append_c(key, charset);
 
+	return key;
+}
 
-	if (username && username->len > 0) {
-		conns = g_hash_table_lookup(pool->users, username);
-		/**
-		 * if we know this use, return a authed connection 
-		 */
-#ifdef DEBUG_CONN_POOL
-		g_debug("%s: (get_conns) get user-specific idling connection for '%s' -> %p", G_STRLOC, username->str, conns);
-#endif
-		if (conns) return conns;
+/**
+ * add a entry to the tail of a queue of the shard-index
+ *
+ * @return the link of the entry in the queue
+ */
+static GList *network_connection_pool_index_add(GHashTable *index, GString *key, network_connection_pool_entry *entry) {
+	GQueue *conns;
+
+	if (NULL == (conns = g_hash_table_lookup(index, key))) {
+		conns = g_queue_new();
+
+		g_hash_table_insert(index, g_string_dup(key), conns);
 	}
 
-	/**
-	 * we don't have a entry yet, check the others if we have more than 
-	 * min_idle waiting
-	 */
+	g_queue_push_tail(conns, entry);
+
+	return conns->tail;
+}
 
-	conns = g_hash_table_find(pool->users, find_idle_conns, &(pool->min_idle_connections));
-#ifdef DEBUG_CONN_POOL
-	g_debug("%s: (get_conns) try to find max-idling conns for user '%s' -> %p", G_STRLOC, username ? username->str : "", conns);
-#endif
+/**
+ * remove a entry from a queue of the shard-index
+ */
+static void network_connection_pool_index_remove(GHashTable *index, GString *key, GList *link) {
+	GQueue *conns;
+
+	if (NULL == (conns = g_hash_table_lookup(index, key))) return;
+
+	g_queue_delete_link(conns, link);
+
+	/* all connections are gone, remove it from the hash */
+	if (conns->length == 0) g_hash_table_remove(index, key);
+}
+
+/**
+ * add a entry to a shard
+ *
+ * the shard has to be locked
+ */
+static void network_connection_pool_shard_add(network_connection_pool_shard *shard, network_connection_pool_entry *entry) {
+	entry->shard = shard;
+
+	g_queue_push_tail(shard->entries, entry);
+	entry->link = shard->entries->tail;
+
+	entry->key_link = network_connection_pool_index_add(shard->keys, entry->key, entry);
+	entry->user_link = network_connection_pool_index_add(shard->users, entry->sock->response->username, entry);
+}
+
+/**
+ * remove a entry from its shard
+ *
+ * the shard has to be locked
+ */
+static void network_connection_pool_shard_remove(network_connection_pool_entry *entry) {
+	network_connection_pool_shard *shard = entry->shard;
+
+	network_connection_pool_index_remove(shard->users, entry->sock->response->username, entry->user_link);
+	network_connection_pool_index_remove(shard->keys, entry->key, entry->key_link);
+
+	g_queue_delete_link(shard->entries, entry->link);
+
+	entry->shard = NULL;
+	entry->link = entry->key_link = entry->user_link = NULL;
+}
+
+/**
+ * count the idle connections of a user in a shard
+ *
+ * the shard has to be locked
+ */
+static guint network_connection_pool_shard_user_idle(network_connection_pool_shard *shard, GString *username) {
+	GQueue *conns;
 
-	return conns;
+	if (NULL == (conns = g_hash_table_lookup(shard->users, username))) return 0;
+
+	return conns->length;
+}
+
+/**
+ * find a connection of any user that has more than min_idle connections idling
+ *
+ * the shard has to be locked
+ */
+static network_connection_pool_entry *network_connection_pool_shard_find_any(network_connection_pool_shard *shard, guint min_idle) {
+	GList *link;
+
+	for (link = shard->entries->tail; link; link = link->prev) {
+		network_connection_pool_entry *entry = link->data;
+
+		if (network_connection_pool_shard_user_idle(shard, entry->sock->response->username) > min_idle) return entry;
+	}
+
+	return NULL;
+}
+
+/**
+ * find a authed connection in a shard
+ *
+ * a connection with the same default-db and session-state is preferred, it saves the
+ * COM_INIT_DB and the SET. They are found by key, only if there is none with the same
+ * default-db all connections of the user are looked at.
+ *
+ * the shard has to be locked
+ */
+static network_connection_pool_entry *network_connection_pool_shard_find_authed(network_connection_pool_shard *shard,
+		GString *username,
+		GString *default_db,
+		guint8 charset,
+		network_mysqld_session *session) {
+	network_connection_pool_entry *entry, *found = NULL;
+	GQueue *conns;
+	GList *link;
+	guint found_score = 0;
+
+	if (default_db) {
+		GString *key;
+
+		key = network_connection_pool_key_new(username, default_db, charset);
+		conns = g_hash_table_lookup(shard->keys, key);
+		g_string_free(key, TRUE);
+
+		if (conns) {
+			if (NULL == session) return conns->tail->data;
+
+			for (link = conns->tail; link; link = link->prev) {
+				entry = link->data;
+
+				if (entry->sock->session &&
+				    !entry->sock->session->is_unknown &&
+				    network_mysqld_session_is_equal(entry->sock->session, session)) {
+					return entry;
+				}
+			}
+
+			return conns->tail->data;
+		}
+	}
+
+	if (NULL == (conns = g_hash_table_lookup(shard->users, username))) return NULL;
+
+	for (link = conns->tail; link; link = link->prev) {
+		guint score = 1;
+
+		entry = link->data;
+
+		if (entry->sock->response->charset != charset) continue;
+
+		if (NULL == session ||
+		    (entry->sock->session &&
+		     !entry->sock->session->is_unknown &&
+		     network_mysqld_session_is_equal(entry->sock->session, session))) {
+			score++;
+		}
+
+		if (score > found_score) {
+			found = entry;
+			found_score = score;
+		}
+
+		if (score == 2) break;
+	}
+
+	return found;
+}
+
+/**
+ * check if a connection idled for max_idle_time already
+ *
+ * @param now  the current time, ignored if max_idle_time is 0
+ */
+static gboolean network_connection_pool_entry_is_expired(network_connection_pool *pool, network_connection_pool_entry *entry, GTimeVal *now) {
+	if (0 == pool->max_idle_time) return FALSE;
+
+	return now->tv_sec - entry->added_ts.tv_sec >= (glong)pool->max_idle_time;
+}
+
+/**
+ * take the socket of a entry out of the pool
+ *
+ * the shard of the entry has to be locked
+ */
+static network_socket *network_connection_pool_take(network_connection_pool *pool, network_connection_pool_entry *entry) {
+	network_socket *sock = entry->sock;
+
+	network_connection_pool_shard_remove(entry);
+	network_connection_pool_entry_free(entry, FALSE);
+
+	g_atomic_int_add(&(pool->idle_connections), -1);
+
+	/* remove the idle handler from the socket, the connections in the overflow have none */
+	event_del(&(sock->event));
+
+	return sock;
 }
 
 /**
@@ -175,90 +406,404 @@ GQueue *network_connection_pool_get_conns(network_connection_pool *pool, GString
 network_socket *network_connection_pool_get(network_connection_pool *pool,
 		GString *username,
 		GString *UNUSED_PARAM(default_db)) {
-
-	network_connection_pool_entry *entry = NULL;
+	network_connection_pool_shard *shards[2];
 	network_socket *sock = NULL;
+	GTimeVal now = { 0, 0 };
+	guint i;
+
+	if (pool->max_idle_time > 0) g_get_current_time(&now);
 
-	GQueue *conns = network_connection_pool_get_conns(pool, username, NULL);
+	shards[0] = network_connection_pool_get_shard(pool);
+	shards[1] = &(pool->overflow);
 
-	/**
-	 * if we know this use, return a authed connection 
-	 */
-	if (conns) {
-		entry = g_queue_pop_head(conns);
+	for (i = 0; i < G_N_ELEMENTS(shards) && NULL == sock; i++) {
+		network_connection_pool_shard *shard = shards[i];
+		network_connection_pool_entry *entry = NULL;
+		gboolean is_expired;
+
+		if (i > 0 && shard == shards[0]) break;
+
+		g_mutex_lock(shard->mutex);
+		do {
+			GQueue *conns = NULL;
 
-		if (conns->length == 0) {
 			/**
-			 * all connections are gone, remove it from the hash
+			 * if we know this use, return a authed connection 
 			 */
-			g_hash_table_remove(pool->users, username);
-		}
+			if (username && username->len > 0) {
+				conns = g_hash_table_lookup(shard->users, username);
+			}
+
+			if (conns) {
+				entry = conns->head->data;
+			} else {
+				/**
+				 * we don't have a entry yet, check the others if we have more than 
+				 * min_idle waiting
+				 */
+				entry = network_connection_pool_shard_find_any(shard, pool->min_idle_connections);
+			}
+
+			if (NULL == entry) break;
+
+			is_expired = network_connection_pool_entry_is_expired(pool, entry, &now);
+			sock = network_connection_pool_take(pool, entry);
+
+			if (is_expired ||
+			    (shard == &(pool->overflow) && !network_socket_is_alive(sock))) {
+				network_socket_free(sock);
+				sock = NULL;
+			}
+		} while (NULL == sock);
+		g_mutex_unlock(shard->mutex);
 	}
 
-	if (!entry) {
 #ifdef DEBUG_CONN_POOL
-		g_debug("%s: (get) no entry for user '%s' -> %p", G_STRLOC, username ? username->str : "", conns);
+	g_debug("%s: (get) got socket for user '%s' -> %p", G_STRLOC, username ? username->str : "", sock);
 #endif
-		return NULL;
-	}
 
-	sock = entry->sock;
+	return sock;
+}
 
-	network_connection_pool_entry_free(entry, FALSE);
+/**
+ * get a connection that is handed out without re-authing it
+ *
+ * unlike network_connection_pool_get() it never returns a connection of another
+ * user. The last added connections are preferred as they are the least likely to
+ * hit the wait_timeout, a connection with the same default-db and session-state is
+ * preferred over them as it saves the COM_INIT_DB and the SET.
+ *
+ * the shard of the current thread is looked at first, then the overflow.
+ *
+ * @param pool       connection pool to get the connection from
+ * @param username   the user the connection has to be authed as, NULL for any user
+ * @param default_db (optional) the default-db we prefer
+ * @param charset    the charset the connection has to use, ignored if username is NULL
+ * @param session    (optional) the session-state we prefer
+ * @return NULL if there is no such connection in the pool
+ */
+network_socket *network_connection_pool_get_authed(network_connection_pool *pool,
+		GString *username,
+		GString *default_db,
+		guint8 charset,
+		network_mysqld_session *session) {
+	network_connection_pool_shard *shards[2];
+	network_socket *sock = NULL;
+	GTimeVal now = { 0, 0 };
+	guint i;
+
+	if (pool->max_idle_time > 0) g_get_current_time(&now);
+
+	shards[0] = network_connection_pool_get_shard(pool);
+	shards[1] = &(pool->overflow);
+
+	for (i = 0; i < G_N_ELEMENTS(shards) && NULL == sock; i++) {
+		network_connection_pool_shard *shard = shards[i];
+		network_connection_pool_entry *entry;
+		gboolean is_expired;
+
+		if (i > 0 && shard == shards[0]) break;
+
+		g_mutex_lock(shard->mutex);
+		do {
+			if (username) {
+				entry = network_connection_pool_shard_find_authed(shard, username, default_db, charset, session);
+			} else {
+				/* a connection for a re-auth, don't take the last ones of a user */
+				entry = network_connection_pool_shard_find_any(shard, pool->min_idle_connections);
+			}
+
+			if (NULL == entry) break;
+
+			is_expired = network_connection_pool_entry_is_expired(pool, entry, &now);
+			sock = network_connection_pool_take(pool, entry);
+
+			/* the server may have closed it while it was idling in the overflow or is about to */
+			if (is_expired ||
+			    (shard == &(pool->overflow) && !network_socket_is_alive(sock))) {
+				network_socket_free(sock);
+				sock = NULL;
+			}
+		} while (NULL == sock);
+		g_mutex_unlock(shard->mutex);
+	}
 
-	/* remove the idle handler from the socket */	
-	event_del(&(sock->event));
-		
 #ifdef DEBUG_CONN_POOL
-	g_debug("%s: (get) got socket for user '%s' -> %p", G_STRLOC, username ? username->str : "", sock);
+	if (sock) g_debug("%s: (get_authed) got socket for user '%s' -> %p", G_STRLOC, sock->response->username->str, sock);
 #endif
 
 	return sock;
 }
 
 /**
- * add a connection to the connection pool
+ * count the idle connections of a user
  *
+ * @param username the user, NULL or "" for all users
  */
-network_connection_pool_entry *network_connection_pool_add(network_connection_pool *pool, network_socket *sock) {
+guint network_connection_pool_get_idle(network_connection_pool *pool, GString *username) {
+	guint idle = 0;
+	guint i;
+
+	if (NULL == username || 0 == username->len) return g_atomic_int_get(&(pool->idle_connections));
+
+	for (i = 0; i <= NETWORK_CONNECTION_POOL_SHARDS; i++) {
+		network_connection_pool_shard *shard = (i < NETWORK_CONNECTION_POOL_SHARDS) ? &(pool->shards[i]) : &(pool->overflow);
+
+		g_mutex_lock(shard->mutex);
+		idle += network_connection_pool_shard_user_idle(shard, username);
+		g_mutex_unlock(shard->mutex);
+	}
+
+	return idle;
+}
+
+/**
+ * close the oldest connection of a shard
+ *
+ * the shard has to be locked
+ *
+ * @return FALSE if the shard is empty
+ */
+static gboolean network_connection_pool_shard_close_oldest(network_connection_pool *pool, network_connection_pool_shard *shard) {
+	network_connection_pool_entry *entry;
+
+	if (NULL == (entry = g_queue_peek_head(shard->entries))) return FALSE;
+
+	network_socket_free(network_connection_pool_take(pool, entry));
+
+	return TRUE;
+}
+
+/**
+ * close the oldest connection of the overflow or the shard if the pool has max_idle_connections
+ */
+static void network_connection_pool_make_room(network_connection_pool *pool, network_connection_pool_shard *shard) {
+	gboolean is_closed;
+
+	if (0 == pool->max_idle_connections ||
+	    (guint)g_atomic_int_get(&(pool->idle_connections)) < pool->max_idle_connections) {
+		return;
+	}
+
+	g_mutex_lock(pool->overflow.mutex);
+	is_closed = network_connection_pool_shard_close_oldest(pool, &(pool->overflow));
+	g_mutex_unlock(pool->overflow.mutex);
+
+	if (!is_closed && shard != &(pool->overflow)) {
+		g_mutex_lock(shard->mutex);
+		network_connection_pool_shard_close_oldest(pool, shard);
+		g_mutex_unlock(shard->mutex);
+	}
+}
+
+/**
+ * create the entry of a connection that gets added to the pool
+ */
+static network_connection_pool_entry *network_connection_pool_entry_create(network_connection_pool *pool, network_socket *sock) {
 	network_connection_pool_entry *entry;
-	GQueue *conns = NULL;
 
 	entry = network_connection_pool_entry_new();
 	entry->sock = sock;
 	entry->pool = pool;
+	entry->key = network_connection_pool_key_new(sock->response->username, sock->default_db, sock->response->charset);
 
 	g_get_current_time(&(entry->added_ts));
 	
 #ifdef DEBUG_CONN_POOL
-	g_debug("%s: (add) adding socket to pool for user '%s' -> %p", G_STRLOC, sock->username->str, sock);
+	g_debug("%s: (add) adding socket to pool for user '%s' -> %p", G_STRLOC, sock->response->username->str, sock);
 #endif
 
-	if (NULL == (conns = g_hash_table_lookup(pool->users, sock->response->username))) {
-		conns = g_queue_new();
+	g_atomic_int_inc(&(pool->idle_connections));
+
+	return entry;
+}
+
+/**
+ * wait for the next connection that is added to the pool
+ *
+ * the waiter is woken up once by the thread that adds the connection, which may be
+ * any thread. Its wakeup() is called with the waiters locked, it must not call into
+ * the pool. As long as someone waits, the connections are added to the overflow
+ * where all threads can take them.
+ *
+ * waiting again before the waiter is woken up is a no-op.
+ */
+void network_connection_pool_wait(network_connection_pool *pool, network_connection_pool_waiter *waiter) {
+	g_mutex_lock(pool->waiters_mutex);
+	if (NULL == g_queue_find(pool->waiters, waiter)) {
+		g_queue_push_tail(pool->waiters, waiter);
 
-		g_hash_table_insert(pool->users, g_string_dup(sock->response->username), conns);
+		g_atomic_int_set(&(pool->has_waiters), 1);
 	}
+	g_mutex_unlock(pool->waiters_mutex);
+}
 
-	g_queue_push_tail(conns, entry);
+/**
+ * stop waiting for a connection
+ *
+ * after it returned the wakeup() of the waiter isn't called anymore
+ */
+void network_connection_pool_unwait(network_connection_pool *pool, network_connection_pool_waiter *waiter) {
+	g_mutex_lock(pool->waiters_mutex);
+	g_queue_remove(pool->waiters, waiter);
 
-	return entry;
+	if (g_queue_is_empty(pool->waiters)) g_atomic_int_set(&(pool->has_waiters), 0);
+	g_mutex_unlock(pool->waiters_mutex);
 }
 
 /**
- * remove the connection referenced by entry from the pool 
+ * wake up all waiters after a connection was added
+ *
+ * they race for the connection, the losers have to wait again
  */
-void network_connection_pool_remove(network_connection_pool *pool, network_connection_pool_entry *entry) {
-	network_socket *sock = entry->sock;
-	GQueue *conns;
+static void network_connection_pool_wakeup(network_connection_pool *pool) {
+	network_connection_pool_waiter *waiter;
 
-	if (NULL == (conns = g_hash_table_lookup(pool->users, sock->response->username))) {
-		return;
+	if (0 == g_atomic_int_get(&(pool->has_waiters))) return;
+
+	g_mutex_lock(pool->waiters_mutex);
+	while ((waiter = g_queue_pop_head(pool->waiters))) {
+		waiter->wakeup(waiter->user_data);
 	}
 
-	network_connection_pool_entry_free(entry, TRUE);
+	g_atomic_int_set(&(pool->has_waiters), 0);
+	g_mutex_unlock(pool->waiters_mutex);
+}
 
-	g_queue_remove(conns, entry);
+/**
+ * add a connection to the connection pool
+ *
+ * the connection is added to the shard of the current thread. If the shard has
+ * more than NETWORK_CONNECTION_POOL_LOCAL_IDLE connections, the oldest is moved to
+ * the overflow.
+ *
+ * if the pool has max_idle_connections already, the oldest connection of the
+ * overflow or of the shard is closed first. The connections in the shards of other
+ * threads can't be closed from here, the limit may be exceeded until they are taken.
+ *
+ * if someone waits for a connection, it is added to the overflow and the waiters are woken up.
+ *
+ * @return the entry of the connection to add the idle-handler for, NULL if it was added to the overflow
+ */
+network_connection_pool_entry *network_connection_pool_add(network_connection_pool *pool, network_socket *sock) {
+	network_connection_pool_shard *shard = network_connection_pool_get_shard(pool);
+	network_connection_pool_entry *entry;
+
+	if (g_atomic_int_get(&(pool->has_waiters))) {
+		/* the waiter may be in another thread, it can only take it from the overflow */
+		network_connection_pool_add_shared(pool, sock);
+
+		return NULL;
+	}
+
+	network_connection_pool_make_room(pool, shard);
+
+	entry = network_connection_pool_entry_create(pool, sock);
+
+	g_mutex_lock(shard->mutex);
+	network_connection_pool_shard_add(shard, entry);
+
+	if (shard == &(pool->overflow)) {
+		/* other threads may take it as soon as we unlock */
+		entry = NULL;
+
+		g_mutex_unlock(shard->mutex);
+	} else if (shard->entries->length > NETWORK_CONNECTION_POOL_LOCAL_IDLE) {
+		network_connection_pool_entry *oldest = g_queue_peek_head(shard->entries);
+
+		/* we own the event-base of the idle-handler, remove it before anyone else can take the connection */
+		event_del(&(oldest->sock->event));
+
+		network_connection_pool_shard_remove(oldest);
+		g_mutex_unlock(shard->mutex);
+
+		g_mutex_lock(pool->overflow.mutex);
+		network_connection_pool_shard_add(&(pool->overflow), oldest);
+		g_mutex_unlock(pool->overflow.mutex);
+	} else {
+		g_mutex_unlock(shard->mutex);
+	}
+
+	return entry;
 }
 
+/**
+ * add a connection to the overflow of the pool
+ *
+ * for connections that no event-thread handed back, like the ones opened in
+ * the background to warm up the pool. All threads can take them.
+ */
+void network_connection_pool_add_shared(network_connection_pool *pool, network_socket *sock) {
+	network_connection_pool_entry *entry;
 
+	network_connection_pool_make_room(pool, &(pool->overflow));
+
+	entry = network_connection_pool_entry_create(pool, sock);
+
+	g_mutex_lock(pool->overflow.mutex);
+	network_connection_pool_shard_add(&(pool->overflow), entry);
+	g_mutex_unlock(pool->overflow.mutex);
+
+	network_connection_pool_wakeup(pool);
+}
+
+/**
+ * close the connections that idled for max_idle_time
+ *
+ * only the shard of the current thread and the overflow are looked at. The
+ * other threads close their old connections when they would hand them out.
+ *
+ * @return the number of closed connections
+ */
+guint network_connection_pool_reap(network_connection_pool *pool) {
+	network_connection_pool_shard *shards[2];
+	GTimeVal now;
+	guint closed = 0;
+	guint i;
+
+	if (0 == pool->max_idle_time) return 0;
+
+	g_get_current_time(&now);
+
+	shards[0] = network_connection_pool_get_shard(pool);
+	shards[1] = &(pool->overflow);
+
+	for (i = 0; i < G_N_ELEMENTS(shards); i++) {
+		network_connection_pool_shard *shard = shards[i];
+		GList *link, *next;
+
+		if (i > 0 && shard == shards[0]) break;
+
+		g_mutex_lock(shard->mutex);
+		for (link = shard->entries->head; link; link = next) {
+			network_connection_pool_entry *entry = link->data;
+
+			next = link->next;
+
+			if (network_connection_pool_entry_is_expired(pool, entry, &now)) {
+				network_socket_free(network_connection_pool_take(pool, entry));
+				closed++;
+			}
+		}
+		g_mutex_unlock(shard->mutex);
+	}
+
+	return closed;
+}
+
+/**
+ * remove the connection referenced by entry from the pool 
+ */
+void network_connection_pool_remove(network_connection_pool *pool, network_connection_pool_entry *entry) {
+	network_connection_pool_shard *shard = entry->shard;
+
+	if (NULL == shard) return;
+
+	g_mutex_lock(shard->mutex);
+	network_connection_pool_shard_remove(entry);
+	g_mutex_unlock(shard->mutex);
+
+	g_atomic_int_add(&(pool->idle_connections), -1);
+
+	network_connection_pool_entry_free(entry, TRUE);
+}
@@ -27,11 +27,65 @@
 #include "network-socket.h"
 #include "network-exports.h"
 
+/**
+ * a shard of the connection pool
+ *
+ * the connections are indexed by (username, default-db, charset) and by username,
+ * the oldest connection is at the head of each queue.
+ */
 typedef struct {
-	GHashTable *users; /** GHashTable<GString, GQueue<network_connection_pool_entry>> */
-	
-	guint max_idle_connections;
-	guint min_idle_connections;
+	GMutex *mutex;      /**< protects the shard, only contended by the readers of the counters */
+
+	GHashTable *keys;   /**< hash<GString "username\0default-db\0charset", GQueue<network_connection_pool_entry>> */
+	GHashTable *users;  /**< hash<GString username, GQueue<network_connection_pool_entry>> */
+	GQueue *entries;    /**< all connections of the shard */
+} network_connection_pool_shard;
+
+/**
+ * the number of event-threads that get their own shard of the pool
+ *
+ * further event-threads only use the overflow
+ */
+#define NETWORK_CONNECTION_POOL_SHARDS 16
+
+/**
+ * the idle connections a event-thread keeps in its own shard
+ *
+ * older ones are moved to the overflow
+ */
+#define NETWORK_CONNECTION_POOL_LOCAL_IDLE 16
+
+/**
+ * waits for a connection to be added to a pool
+ *
+ * @see network_connection_pool_wait()
+ */
+typedef struct {
+	void (*wakeup)(gpointer user_data); /**< called by the thread that adds the connection, the waiters of the pool are locked */
+	gpointer user_data;
+} network_connection_pool_waiter;
+
+/**
+ * the idle connections of a backend
+ *
+ * each event-thread has its own shard of the pool. The idle-handler of a connection
+ * in the shard is registered at the event-base of the thread, only the thread itself
+ * takes it out again. The overflow is shared by all threads, its connections have no
+ * idle-handler and are checked with network_socket_is_alive() before they are handed out.
+ */
+typedef struct {
+	network_connection_pool_shard shards[NETWORK_CONNECTION_POOL_SHARDS];
+	network_connection_pool_shard overflow;
+
+	volatile gint idle_connections; /**< idle connections in all shards */
+
+	guint max_idle_connections;     /**< close the oldest idle connections if there are more, 0 for no limit */
+	guint min_idle_connections;     /**< don't take connections of a user for another user if it has less */
+	guint max_idle_time;            /**< close connections that idled longer, in seconds, keep it below the wait_timeout of the server, 0 for no limit */
+
+	GMutex *waiters_mutex;
+	GQueue *waiters;                /**< network_connection_pool_waiter *, woken up by the next connection that is added */
+	volatile gint has_waiters;      /**< the waiters aren't empty, checked without the lock */
 } network_connection_pool;
 
 typedef struct {
@@ -40,14 +94,29 @@ typedef struct {
 	network_connection_pool *pool; /** a pointer back to the pool */
 
 	GTimeVal added_ts;             /** added at ... we want to make sure we don't hit wait_timeout */
+
+	network_connection_pool_shard *shard; /** the shard the connection is in */
+	GString *key;                  /** the key of the connection in shard->keys */
+	GList *link;                   /** the link in shard->entries */
+	GList *key_link;               /** the link in the queue of shard->keys */
+	GList *user_link;              /** the link in the queue of shard->users */
 } network_connection_pool_entry;
 
 NETWORK_API network_socket *network_connection_pool_get(network_connection_pool *pool,
 		GString *username,
 		GString *default_db);
+NETWORK_API network_socket *network_connection_pool_get_authed(network_connection_pool *pool,
+		GString *username,
+		GString *default_db,
+		guint8 charset,
+		network_mysqld_session *session);
 NETWORK_API network_connection_pool_entry *network_connection_pool_add(network_connection_pool *pool, network_socket *sock);
+NETWORK_API void network_connection_pool_add_shared(network_connection_pool *pool, network_socket *sock);
+NETWORK_API guint network_connection_pool_reap(network_connection_pool *pool);
 NETWORK_API void network_connection_pool_remove(network_connection_pool *pool, network_connection_pool_entry *entry);
-NETWORK_API GQueue *network_connection_pool_get_conns(network_connection_pool *pool, GString *username, GString *);
+NETWORK_API guint network_connection_pool_get_idle(network_connection_pool *pool, GString *username);
+NETWORK_API void network_connection_pool_wait(network_connection_pool *pool, network_connection_pool_waiter *waiter);
+NETWORK_API void network_connection_pool_unwait(network_connection_pool *pool, network_connection_pool_waiter *waiter);
 
 NETWORK_API network_connection_pool *network_connection_pool_init(void) G_GNUC_DEPRECATED;
 NETWORK_API network_connection_pool *network_connection_pool_new(void);
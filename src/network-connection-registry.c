@@ -0,0 +1,213 @@
+/* $%BEGINLICENSE%$
+ Copyright (c) 2008, 2012, Oracle and/or its affiliates. All rights reserved.
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License as
+ published by the Free Software Foundation; version 2 of the
+ License.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ 02110-1301  USA
+
+ $%ENDLICENSE%$ */
+
+/**
+ * the registry of all open connections
+ *
+ * connections are added and removed from all event-threads. Instead of one array
+ * behind one lock the connections are spread over NETWORK_CONNECTION_REGISTRY_SHARDS
+ * shards, each with its own lock.
+ *
+ * - add() appends to the shard
+ * - remove() moves the last entry of the shard into the hole
+ *
+ * both are O(1) as each entry knows its position in the shard.
+ */
+
+#include <glib.h>
+
+#include "network-connection-registry.h"
+
+network_connection_registry *network_connection_registry_new(void) {
+	network_connection_registry *reg;
+	guint i;
+
+	reg = g_new0(network_connection_registry, 1);
+
+	for (i = 0; i < NETWORK_CONNECTION_REGISTRY_SHARDS; i++) {
+		network_connection_registry_shard *shard = &(reg->shards[i]);
+
+		shard->mutex = g_mutex_new();
+		shard->entries = g_ptr_array_new();
+	}
+
+	return reg;
+}
+
+/**
+ * free the registry
+ *
+ * the registered items aren't touched, only the entries are freed
+ */
+void network_connection_registry_free(network_connection_registry *reg) {
+	guint i, j;
+
+	if (!reg) return;
+
+	for (i = 0; i < NETWORK_CONNECTION_REGISTRY_SHARDS; i++) {
+		network_connection_registry_shard *shard = &(reg->shards[i]);
+
+		for (j = 0; j < shard->entries->len; j++) {
+			g_free(shard->entries->pdata[j]);
+		}
+
+		g_ptr_array_free(shard->entries, TRUE);
+		g_mutex_free(shard->mutex);
+	}
+
+	g_free(reg);
+}
+
+/**
+ * map a item to its shard
+ *
+ * the lower bits of a heap-address are always 0, skip them
+ */
+static guint network_connection_registry_shard_ndx(gpointer data) {
+	return (guint)((GPOINTER_TO_SIZE(data) >> 4) % NETWORK_CONNECTION_REGISTRY_SHARDS);
+}
+
+/**
+ * register a item
+ *
+ * @return the entry to pass to network_connection_registry_remove()
+ */
+network_connection_registry_entry *network_connection_registry_add(network_connection_registry *reg, gpointer data) {
+	network_connection_registry_entry *entry;
+	network_connection_registry_shard *shard;
+
+	entry = g_new0(network_connection_registry_entry, 1);
+	entry->data = data;
+	entry->shard_ndx = network_connection_registry_shard_ndx(data);
+
+	shard = &(reg->shards[entry->shard_ndx]);
+
+	g_mutex_lock(shard->mutex);
+	entry->ndx = shard->entries->len;
+	g_ptr_array_add(shard->entries, entry);
+	g_mutex_unlock(shard->mutex);
+
+	return entry;
+}
+
+/**
+ * unregister a item and free the entry
+ */
+void network_connection_registry_remove(network_connection_registry *reg, network_connection_registry_entry *entry) {
+	network_connection_registry_shard *shard;
+	network_connection_registry_entry *last;
+
+	if (!entry) return;
+
+	shard = &(reg->shards[entry->shard_ndx]);
+
+	g_mutex_lock(shard->mutex);
+	g_assert_cmpint(entry->ndx, <, shard->entries->len);
+	g_assert(shard->entries->pdata[entry->ndx] == entry);
+
+	/* move the last entry into our slot and update its position */
+	last = shard->entries->pdata[shard->entries->len - 1];
+	shard->entries->pdata[entry->ndx] = last;
+	last->ndx = entry->ndx;
+	g_ptr_array_set_size(shard->entries, shard->entries->len - 1);
+	g_mutex_unlock(shard->mutex);
+
+	g_free(entry);
+}
+
+/**
+ * get the number of registered items
+ *
+ * the shards are counted one after the other, the result is only exact if no other thread
+ * adds or removes items at the same time
+ */
+guint network_connection_registry_count(network_connection_registry *reg) {
+	guint i, count = 0;
+
+	for (i = 0; i < NETWORK_CONNECTION_REGISTRY_SHARDS; i++) {
+		network_connection_registry_shard *shard = &(reg->shards[i]);
+
+		g_mutex_lock(shard->mutex);
+		count += shard->entries->len;
+		g_mutex_unlock(shard->mutex);
+	}
+
+	return count;
+}
+
+/**
+ * get any of the registered items
+ *
+ * @return a registered item or NULL if the registry is empty
+ */
+gpointer network_connection_registry_peek(network_connection_registry *reg) {
+	gpointer data = NULL;
+	guint i;
+
+	for (i = 0; NULL == data && i < NETWORK_CONNECTION_REGISTRY_SHARDS; i++) {
+		network_connection_registry_shard *shard = &(reg->shards[i]);
+
+		g_mutex_lock(shard->mutex);
+		if (shard->entries->len > 0) {
+			network_connection_registry_entry *entry = shard->entries->pdata[0];
+
+			data = entry->data;
+		}
+		g_mutex_unlock(shard->mutex);
+	}
+
+	return data;
+}
+
+/**
+ * copy all registered items into a new array
+ *
+ * all shards are locked while copying to get a consistent view. The items in the
+ * array are not protected against being freed after the locks are released: the caller
+ * has to make sure no event-thread runs anymore, like network_mysqld_priv_shutdown() does.
+ *
+ * @return array of the registered items, free it with g_ptr_array_free(..., TRUE)
+ */
+GPtrArray *network_connection_registry_snapshot(network_connection_registry *reg) {
+	GPtrArray *snapshot;
+	guint i, j;
+
+	snapshot = g_ptr_array_new();
+
+	for (i = 0; i < NETWORK_CONNECTION_REGISTRY_SHARDS; i++) {
+		g_mutex_lock(reg->shards[i].mutex);
+	}
+
+	for (i = 0; i < NETWORK_CONNECTION_REGISTRY_SHARDS; i++) {
+		network_connection_registry_shard *shard = &(reg->shards[i]);
+
+		for (j = 0; j < shard->entries->len; j++) {
+			network_connection_registry_entry *entry = shard->entries->pdata[j];
+
+			g_ptr_array_add(snapshot, entry->data);
+		}
+	}
+
+	for (i = NETWORK_CONNECTION_REGISTRY_SHARDS; i > 0; i--) {
+		g_mutex_unlock(reg->shards[i - 1].mutex);
+	}
+
+	return snapshot;
+}
@@ -0,0 +1,68 @@
+/* $%BEGINLICENSE%$
+ Copyright (c) 2008, 2012, Oracle and/or its affiliates. All rights reserved.
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License as
+ published by the Free Software Foundation; version 2 of the
+ License.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ 02110-1301  USA
+
+ $%ENDLICENSE%$ */
+
+
+#ifndef _NETWORK_CONNECTION_REGISTRY_H_
+#define _NETWORK_CONNECTION_REGISTRY_H_
+
+#include <glib.h>
+
+#include "network-exports.h"
+
+/**
+ * number of shards of the connection registry
+ *
+ * each shard has its own lock, connections are spread over the shards by their address
+ */
+#define NETWORK_CONNECTION_REGISTRY_SHARDS 32
+
+/**
+ * a handle for a registered item
+ *
+ * returned by network_connection_registry_add() and needed to remove the item again in O(1)
+ */
+typedef struct {
+	gpointer data;  /**< the registered item */
+
+	guint shard_ndx; /**< the shard the entry lives in */
+	guint ndx;       /**< position inside the shard's entries */
+} network_connection_registry_entry;
+
+typedef struct {
+	GMutex *mutex;
+
+	GPtrArray *entries; /**< array(network_connection_registry_entry) */
+} network_connection_registry_shard;
+
+typedef struct {
+	network_connection_registry_shard shards[NETWORK_CONNECTION_REGISTRY_SHARDS];
+} network_connection_registry;
+
+NETWORK_API network_connection_registry *network_connection_registry_new(void);
+NETWORK_API void network_connection_registry_free(network_connection_registry *reg);
+
+NETWORK_API network_connection_registry_entry *network_connection_registry_add(network_connection_registry *reg, gpointer data);
+NETWORK_API void network_connection_registry_remove(network_connection_registry *reg, network_connection_registry_entry *entry);
+
+NETWORK_API guint network_connection_registry_count(network_connection_registry *reg);
+NETWORK_API gpointer network_connection_registry_peek(network_connection_registry *reg);
+NETWORK_API GPtrArray *network_connection_registry_snapshot(network_connection_registry *reg);
+
+#endif
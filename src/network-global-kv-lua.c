@@ -0,0 +1,367 @@
+/* $%BEGINLICENSE%$
+ Copyright (c) 2008, 2012, Oracle and/or its affiliates. All rights reserved.
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License as
+ published by the Free Software Foundation; version 2 of the
+ License.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ 02110-1301  USA
+
+ $%ENDLICENSE%$ */
+#include <string.h>
+
+#include <lua.h>
+
+#include "lua-env.h"
+#include "glib-ext.h"
+
+#include "network-global-kv.h"
+#include "network-global-kv-lua.h"
+
+static void network_global_kv_lua_push_value(lua_State *L, network_global_kv_value_t *value) {
+	switch (value->type) {
+	case NETWORK_GLOBAL_KV_TYPE_BOOLEAN:
+		lua_pushboolean(L, value->b);
+		break;
+	case NETWORK_GLOBAL_KV_TYPE_NUMBER:
+		lua_pushnumber(L, value->n);
+		break;
+	case NETWORK_GLOBAL_KV_TYPE_STRING:
+		lua_pushlstring(L, value->s->str, value->s->len);
+		break;
+	}
+}
+
+/**
+ * turn the lua-value at ndx into a value of the store
+ *
+ * @param value  (out) the new value, NULL for nil
+ * @return 0 on success, -1 if the lua-type can't be stored
+ */
+static int network_global_kv_lua_to_value(lua_State *L, int ndx, network_global_kv_value_t **value) {
+	size_t s_len;
+	const char *s;
+
+	switch (lua_type(L, ndx)) {
+	case LUA_TNIL:
+		*value = NULL;
+		break;
+	case LUA_TBOOLEAN:
+		*value = network_global_kv_value_new(NETWORK_GLOBAL_KV_TYPE_BOOLEAN);
+		(*value)->b = lua_toboolean(L, ndx);
+		break;
+	case LUA_TNUMBER:
+		*value = network_global_kv_value_new(NETWORK_GLOBAL_KV_TYPE_NUMBER);
+		(*value)->n = lua_tonumber(L, ndx);
+		break;
+	case LUA_TSTRING:
+		s = lua_tolstring(L, ndx, &s_len);
+
+		*value = network_global_kv_value_new(NETWORK_GLOBAL_KV_TYPE_STRING);
+		g_string_assign_len((*value)->s, s, s_len);
+		break;
+	default:
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * get proxy.global.kv[key]
+ *
+ * @return nil or the value stored under the key
+ */
+static int proxy_global_kv_get(lua_State *L) {
+	network_global_kv_t *kv = *(network_global_kv_t **)luaL_checkself(L);
+	const char *key = luaL_checkstring(L, 2);
+	network_global_kv_value_t *value;
+
+	if (NULL == (value = network_global_kv_get(kv, key))) {
+		lua_pushnil(L);
+
+		return 1;
+	}
+
+	network_global_kv_lua_push_value(L, value);
+
+	network_global_kv_value_free(value);
+
+	return 1;
+}
+
+/**
+ * set proxy.global.kv[key] = value
+ *
+ * only nil, booleans, numbers and strings can be stored. Setting nil removes the key.
+ */
+static int proxy_global_kv_set(lua_State *L) {
+	network_global_kv_t *kv = *(network_global_kv_t **)luaL_checkself(L);
+	const char *key = luaL_checkstring(L, 2);
+	network_global_kv_value_t *value;
+
+	if (0 != network_global_kv_lua_to_value(L, 3, &value)) {
+		return luaL_error(L, "proxy.global.kv[%s] can only store nil, booleans, numbers and strings, got %s",
+				key,
+				lua_typename(L, lua_type(L, 3)));
+	}
+
+	network_global_kv_set(kv, key, value);
+
+	return 0;
+}
+
+/**
+ * proxy.global.kv()
+ *
+ * @return a table with a copy of all values, taken at the same point in time
+ */
+static int proxy_global_kv_snapshot(lua_State *L) {
+	network_global_kv_t *kv = *(network_global_kv_t **)luaL_checkself(L);
+	GHashTable *snapshot;
+	GHashTableIter iter;
+	gpointer key, value;
+
+	snapshot = network_global_kv_snapshot(kv);
+
+	lua_newtable(L);
+
+	g_hash_table_iter_init(&iter, snapshot);
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		network_global_kv_lua_push_value(L, value);
+		lua_setfield(L, -2, key);
+	}
+
+	g_hash_table_destroy(snapshot);
+
+	return 1;
+}
+
+static int proxy_global_kv_len(lua_State *L) {
+	network_global_kv_t *kv = *(network_global_kv_t **)luaL_checkself(L);
+
+	lua_pushinteger(L, network_global_kv_count(kv));
+
+	return 1;
+}
+
+int network_global_kv_lua_getmetatable(lua_State *L) {
+	static const struct luaL_reg methods[] = {
+		{ "__index", proxy_global_kv_get },
+		{ "__newindex", proxy_global_kv_set },
+		{ "__len", proxy_global_kv_len },
+		{ "__call", proxy_global_kv_snapshot },
+		{ NULL, NULL },
+	};
+
+	return proxy_getmetatable(L, methods);
+}
+
+/**
+ * get the store and the key-prefix of a module of proxy.global.config
+ *
+ * they are kept in the metatable of the module-table at ndx
+ *
+ * @return the store, the metatable is left on the stack
+ */
+static network_global_kv_t *proxy_global_config_module_get_kv(lua_State *L, int ndx, const char **prefix) {
+	network_global_kv_t *kv;
+
+	lua_getmetatable(L, ndx);
+
+	lua_getfield(L, -1, "kv");
+	kv = lua_touserdata(L, -1);
+	lua_pop(L, 1);
+
+	lua_getfield(L, -1, "prefix");
+	*prefix = lua_tostring(L, -1);
+	lua_pop(L, 1); /* the metatable still references the string */
+
+	return kv;
+}
+
+/**
+ * get proxy.global.config.<module>[option]
+ *
+ * a value set by any thread wins over the default the module-table was created with
+ */
+static int proxy_global_config_module_get(lua_State *L) {
+	network_global_kv_t *kv;
+	network_global_kv_value_t *value;
+	const char *prefix;
+
+	kv = proxy_global_config_module_get_kv(L, 1, &prefix);
+
+	if (lua_type(L, 2) == LUA_TSTRING) {
+		gchar *key = g_strconcat(prefix, lua_tostring(L, 2), NULL);
+
+		value = network_global_kv_get(kv, key);
+		g_free(key);
+
+		if (value) {
+			network_global_kv_lua_push_value(L, value);
+			network_global_kv_value_free(value);
+
+			return 1;
+		}
+	}
+
+	lua_getfield(L, -1, "defaults");
+	lua_pushvalue(L, 2);
+	lua_rawget(L, -2);
+
+	return 1;
+}
+
+/**
+ * set proxy.global.config.<module>[option] = value
+ *
+ * nil, booleans, numbers and strings are stored in proxy.global.kv and seen by all
+ * threads, setting nil brings back the default. Other values only change the
+ * defaults of the calling thread.
+ */
+static int proxy_global_config_module_set(lua_State *L) {
+	network_global_kv_t *kv;
+	network_global_kv_value_t *value;
+	const char *prefix;
+
+	kv = proxy_global_config_module_get_kv(L, 1, &prefix);
+
+	if (lua_type(L, 2) == LUA_TSTRING &&
+	    0 == network_global_kv_lua_to_value(L, 3, &value)) {
+		gchar *key = g_strconcat(prefix, lua_tostring(L, 2), NULL);
+
+		network_global_kv_set(kv, key, value);
+		g_free(key);
+
+		return 0;
+	}
+
+	lua_getfield(L, -1, "defaults");
+	lua_pushvalue(L, 2);
+	lua_pushvalue(L, 3);
+	lua_rawset(L, -3);
+
+	return 0;
+}
+
+/**
+ * proxy.global.config.<module>()
+ *
+ * @return a table with the current value of all options of the module
+ */
+static int proxy_global_config_module_snapshot(lua_State *L) {
+	network_global_kv_t *kv;
+	GHashTable *snapshot;
+	GHashTableIter iter;
+	gpointer key, value;
+	const char *prefix;
+	gsize prefix_len;
+
+	kv = proxy_global_config_module_get_kv(L, 1, &prefix);
+	prefix_len = strlen(prefix);
+
+	lua_newtable(L);
+
+	/* the defaults first ... */
+	lua_getfield(L, -2, "defaults");
+	lua_pushnil(L);
+	while (lua_next(L, -2)) {
+		lua_pushvalue(L, -2);
+		lua_insert(L, -2);
+		lua_rawset(L, -5);
+	}
+	lua_pop(L, 1);
+
+	/* ... and what got set on top */
+	snapshot = network_global_kv_snapshot(kv);
+
+	g_hash_table_iter_init(&iter, snapshot);
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		if (0 != strncmp(key, prefix, prefix_len)) continue;
+
+		network_global_kv_lua_push_value(L, value);
+		lua_setfield(L, -2, (gchar *)key + prefix_len);
+	}
+
+	g_hash_table_destroy(snapshot);
+
+	return 1;
+}
+
+/**
+ * set proxy.global.config[module] = { defaults }
+ *
+ * instead of the table a empty module-table is stored which looks up its options
+ * in proxy.global.kv under "config.<module>.<option>" and falls back to the defaults
+ */
+static int proxy_global_config_set(lua_State *L) {
+	static const struct luaL_reg methods[] = {
+		{ "__index", proxy_global_config_module_get },
+		{ "__newindex", proxy_global_config_module_set },
+		{ "__call", proxy_global_config_module_snapshot },
+		{ NULL, NULL },
+	};
+
+	if (lua_type(L, 2) != LUA_TSTRING || !lua_istable(L, 3)) {
+		lua_rawset(L, 1);
+
+		return 0;
+	}
+
+	lua_newtable(L); /* the module-table */
+
+	/* each module-table gets its own metatable to keep the defaults and the prefix */
+	lua_newtable(L);
+	luaL_register(L, NULL, methods);
+
+	lua_pushvalue(L, lua_upvalueindex(1));
+	lua_setfield(L, -2, "kv");
+
+	lua_pushfstring(L, "config.%s.", lua_tostring(L, 2));
+	lua_setfield(L, -2, "prefix");
+
+	lua_pushvalue(L, 3);
+	lua_setfield(L, -2, "defaults");
+
+	lua_setmetatable(L, -2);
+
+	lua_pushvalue(L, 2);
+	lua_insert(L, -2);
+	lua_rawset(L, 1);
+
+	return 0;
+}
+
+/**
+ * keep the options of the modules in proxy.global.config in the store
+ *
+ * each event-thread has its own proxy.global.config. A PROXY SET GLOBAL handled in
+ * one thread has to be seen by the scripts in all others.
+ *
+ * expects proxy.global.config on the top of the stack
+ */
+void network_global_kv_lua_share_config(lua_State *L, network_global_kv_t *kv) {
+	g_assert(lua_istable(L, -1));
+
+	/* a metatable of its own, auto-config.lua adds its methods to it. Keep them if
+	 * a script of the same lua_State already loaded it */
+	if (0 == lua_getmetatable(L, -1)) {
+		lua_newtable(L);
+	}
+
+	lua_pushlightuserdata(L, kv);
+	lua_pushcclosure(L, proxy_global_config_set, 1);
+	lua_setfield(L, -2, "__newindex");
+
+	lua_setmetatable(L, -2);
+}
@@ -0,0 +1,174 @@
+/* $%BEGINLICENSE%$
+ Copyright (c) 2008, 2012, Oracle and/or its affiliates. All rights reserved.
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License as
+ published by the Free Software Foundation; version 2 of the
+ License.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ 02110-1301  USA
+
+ $%ENDLICENSE%$ */
+
+#include <glib.h>
+
+#include "network-global-kv.h"
+#include "glib-ext.h"
+
+network_global_kv_value_t *network_global_kv_value_new(network_global_kv_type_t type) {
+	network_global_kv_value_t *value;
+
+	value = g_new0(network_global_kv_value_t, 1);
+	value->type = type;
+
+	if (type == NETWORK_GLOBAL_KV_TYPE_STRING) {
+		value->s = g_string_new(NULL);
+	}
+
+	return value;
+}
+
+network_global_kv_value_t *network_global_kv_value_copy(network_global_kv_value_t *value) {
+	network_global_kv_value_t *copy;
+
+	copy = network_global_kv_value_new(value->type);
+	copy->b = value->b;
+	copy->n = value->n;
+	if (value->s) g_string_assign_len(copy->s, value->s->str, value->s->len);
+
+	return copy;
+}
+
+void network_global_kv_value_free(network_global_kv_value_t *value) {
+	if (!value) return;
+
+	if (value->s) g_string_free(value->s, TRUE);
+
+	g_free(value);
+}
+
+network_global_kv_t *network_global_kv_new(void) {
+	network_global_kv_t *kv;
+	guint i;
+
+	kv = g_new0(network_global_kv_t, 1);
+
+	for (i = 0; i < NETWORK_GLOBAL_KV_SHARDS; i++) {
+		network_global_kv_shard_t *shard = &(kv->shards[i]);
+
+		shard->values = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)network_global_kv_value_free);
+		shard->mutex = g_mutex_new();
+	}
+
+	return kv;
+}
+
+void network_global_kv_free(network_global_kv_t *kv) {
+	guint i;
+
+	if (!kv) return;
+
+	for (i = 0; i < NETWORK_GLOBAL_KV_SHARDS; i++) {
+		network_global_kv_shard_t *shard = &(kv->shards[i]);
+
+		g_hash_table_destroy(shard->values);
+		g_mutex_free(shard->mutex);
+	}
+
+	g_free(kv);
+}
+
+static network_global_kv_shard_t *network_global_kv_get_shard(network_global_kv_t *kv, const gchar *key) {
+	return &(kv->shards[g_str_hash(key) % NETWORK_GLOBAL_KV_SHARDS]);
+}
+
+/**
+ * set or remove a value
+ *
+ * @param value the new value, the store takes ownership of it. NULL removes the key
+ */
+void network_global_kv_set(network_global_kv_t *kv, const gchar *key, network_global_kv_value_t *value) {
+	network_global_kv_shard_t *shard = network_global_kv_get_shard(kv, key);
+
+	g_mutex_lock(shard->mutex);
+	if (value) {
+		g_hash_table_replace(shard->values, g_strdup(key), value);
+	} else {
+		g_hash_table_remove(shard->values, key);
+	}
+	g_mutex_unlock(shard->mutex);
+}
+
+/**
+ * get a value
+ *
+ * @return a copy of the value (free it with network_global_kv_value_free()) or NULL if the key isn't known
+ */
+network_global_kv_value_t *network_global_kv_get(network_global_kv_t *kv, const gchar *key) {
+	network_global_kv_shard_t *shard = network_global_kv_get_shard(kv, key);
+	network_global_kv_value_t *value;
+
+	g_mutex_lock(shard->mutex);
+	if (NULL != (value = g_hash_table_lookup(shard->values, key))) {
+		value = network_global_kv_value_copy(value);
+	}
+	g_mutex_unlock(shard->mutex);
+
+	return value;
+}
+
+guint network_global_kv_count(network_global_kv_t *kv) {
+	guint i, count = 0;
+
+	for (i = 0; i < NETWORK_GLOBAL_KV_SHARDS; i++) {
+		network_global_kv_shard_t *shard = &(kv->shards[i]);
+
+		g_mutex_lock(shard->mutex);
+		count += g_hash_table_size(shard->values);
+		g_mutex_unlock(shard->mutex);
+	}
+
+	return count;
+}
+
+/**
+ * copy all values of the store
+ *
+ * all shards are locked while copying, the snapshot is a consistent view of the store
+ *
+ * @return hash<gchar *, network_global_kv_value_t *>, free it with g_hash_table_destroy()
+ */
+GHashTable *network_global_kv_snapshot(network_global_kv_t *kv) {
+	GHashTable *snapshot;
+	guint i;
+
+	snapshot = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)network_global_kv_value_free);
+
+	for (i = 0; i < NETWORK_GLOBAL_KV_SHARDS; i++) {
+		g_mutex_lock(kv->shards[i].mutex);
+	}
+
+	for (i = 0; i < NETWORK_GLOBAL_KV_SHARDS; i++) {
+		GHashTableIter iter;
+		gpointer key, value;
+
+		g_hash_table_iter_init(&iter, kv->shards[i].values);
+		while (g_hash_table_iter_next(&iter, &key, &value)) {
+			g_hash_table_insert(snapshot, g_strdup(key), network_global_kv_value_copy(value));
+		}
+	}
+
+	for (i = NETWORK_GLOBAL_KV_SHARDS; i > 0; i--) {
+		g_mutex_unlock(kv->shards[i - 1].mutex);
+	}
+
+	return snapshot;
+}
@@ -0,0 +1,78 @@
+/* $%BEGINLICENSE%$
+ Copyright (c) 2008, 2012, Oracle and/or its affiliates. All rights reserved.
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License as
+ published by the Free Software Foundation; version 2 of the
+ License.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ 02110-1301  USA
+
+ $%ENDLICENSE%$ */
+
+
+#ifndef _NETWORK_GLOBAL_KV_H_
+#define _NETWORK_GLOBAL_KV_H_
+
+#include <glib.h>
+
+#include "network-exports.h"
+
+/**
+ * a key-value store shared by all event-threads
+ *
+ * each event-thread has its own lua_State and with it its own proxy.global table. Data that
+ * has to be seen by all threads goes through proxy.global.kv which is backed by this store.
+ *
+ * only scalar values are stored, tables and functions can't be shared between lua_States
+ */
+typedef enum {
+	NETWORK_GLOBAL_KV_TYPE_BOOLEAN,
+	NETWORK_GLOBAL_KV_TYPE_NUMBER,
+	NETWORK_GLOBAL_KV_TYPE_STRING
+} network_global_kv_type_t;
+
+typedef struct {
+	network_global_kv_type_t type;
+
+	gboolean b;  /**< if type is BOOLEAN */
+	gdouble n;   /**< if type is NUMBER */
+	GString *s;  /**< if type is STRING */
+} network_global_kv_value_t;
+
+/**
+ * number of shards of the key-value store
+ *
+ * keys are spread over the shards by their hash, each shard has its own lock
+ */
+#define NETWORK_GLOBAL_KV_SHARDS 16
+
+typedef struct {
+	GHashTable *values; /**< hash<gchar *, network_global_kv_value_t *> */
+	GMutex *mutex;
+} network_global_kv_shard_t;
+
+typedef struct {
+	network_global_kv_shard_t shards[NETWORK_GLOBAL_KV_SHARDS];
+} network_global_kv_t;
+
+NETWORK_API network_global_kv_value_t *network_global_kv_value_new(network_global_kv_type_t type);
+NETWORK_API network_global_kv_value_t *network_global_kv_value_copy(network_global_kv_value_t *value);
+NETWORK_API void network_global_kv_value_free(network_global_kv_value_t *value);
+
+NETWORK_API network_global_kv_t *network_global_kv_new(void);
+NETWORK_API void network_global_kv_free(network_global_kv_t *kv);
+NETWORK_API void network_global_kv_set(network_global_kv_t *kv, const gchar *key, network_global_kv_value_t *value);
+NETWORK_API network_global_kv_value_t *network_global_kv_get(network_global_kv_t *kv, const gchar *key);
+NETWORK_API guint network_global_kv_count(network_global_kv_t *kv);
+NETWORK_API GHashTable *network_global_kv_snapshot(network_global_kv_t *kv);
+
+#endif
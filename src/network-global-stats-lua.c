@@ -0,0 +1,132 @@
+/* $%BEGINLICENSE%$
+ Copyright (c) 2008, 2012, Oracle and/or its affiliates. All rights reserved.
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License as
+ published by the Free Software Foundation; version 2 of the
+ License.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ 02110-1301  USA
+
+ $%ENDLICENSE%$ */
+#include <lua.h>
+
+#include "lua-env.h"
+
+#include "network-global-stats.h"
+#include "network-global-stats-lua.h"
+
+/**
+ * proxy.global.stats:inc(name[, delta])
+ *
+ * add delta (default: 1) to the counter
+ */
+static int proxy_global_stats_inc(lua_State *L) {
+	network_global_stats_t *stats = *(network_global_stats_t **)luaL_checkself(L);
+	const char *name = luaL_checkstring(L, 2);
+	lua_Number delta = luaL_optnumber(L, 3, 1);
+
+	network_global_stats_add(stats, name, (gint64)delta);
+
+	return 0;
+}
+
+/**
+ * proxy.global.stats:max(name, value)
+ *
+ * raise the high-water mark to value
+ */
+static int proxy_global_stats_max(lua_State *L) {
+	network_global_stats_t *stats = *(network_global_stats_t **)luaL_checkself(L);
+	const char *name = luaL_checkstring(L, 2);
+	lua_Number value = luaL_checknumber(L, 3);
+
+	network_global_stats_max(stats, name, (gint64)value);
+
+	return 0;
+}
+
+/**
+ * proxy.global.stats:get(name)
+ *
+ * @return the sum of the counter over all threads, the largest value for a high-water mark
+ */
+static int proxy_global_stats_get(lua_State *L) {
+	network_global_stats_t *stats = *(network_global_stats_t **)luaL_checkself(L);
+	const char *name = luaL_checkstring(L, 2);
+
+	lua_pushnumber(L, (lua_Number)network_global_stats_get(stats, name));
+
+	return 1;
+}
+
+/**
+ * proxy.global.stats:snapshot()
+ *
+ * @return a table with all counters, taken at the same point in time
+ */
+static int proxy_global_stats_snapshot(lua_State *L) {
+	network_global_stats_t *stats = *(network_global_stats_t **)luaL_checkself(L);
+	GHashTable *snapshot;
+	GHashTableIter iter;
+	gpointer key, value;
+
+	snapshot = network_global_stats_snapshot(stats);
+
+	lua_newtable(L);
+
+	g_hash_table_iter_init(&iter, snapshot);
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		lua_pushnumber(L, (lua_Number)*(gint64 *)value);
+		lua_setfield(L, -2, key);
+	}
+
+	g_hash_table_destroy(snapshot);
+
+	return 1;
+}
+
+/**
+ * proxy.global.stats:reset([prefix])
+ *
+ * remove all counters starting with prefix, all counters if no prefix is given
+ */
+static int proxy_global_stats_reset(lua_State *L) {
+	network_global_stats_t *stats = *(network_global_stats_t **)luaL_checkself(L);
+	const char *prefix = luaL_optstring(L, 2, NULL);
+
+	network_global_stats_reset(stats, prefix);
+
+	return 0;
+}
+
+/**
+ * push the metatable of proxy.global.stats
+ *
+ * the methods are looked up in the metatable itself
+ */
+int network_global_stats_lua_getmetatable(lua_State *L) {
+	static const struct luaL_reg methods[] = {
+		{ "inc", proxy_global_stats_inc },
+		{ "max", proxy_global_stats_max },
+		{ "get", proxy_global_stats_get },
+		{ "snapshot", proxy_global_stats_snapshot },
+		{ "reset", proxy_global_stats_reset },
+		{ NULL, NULL },
+	};
+
+	proxy_getmetatable(L, methods);
+
+	lua_pushvalue(L, -1); /* meta.__index = meta */
+	lua_setfield(L, -2, "__index");
+
+	return 1;
+}
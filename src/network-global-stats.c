@@ -0,0 +1,238 @@
+/* $%BEGINLICENSE%$
+ Copyright (c) 2008, 2012, Oracle and/or its affiliates. All rights reserved.
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License as
+ published by the Free Software Foundation; version 2 of the
+ License.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ 02110-1301  USA
+
+ $%ENDLICENSE%$ */
+
+#include <glib.h>
+
+#include "network-global-stats.h"
+
+/**
+ * the shard of the current thread, +1 to tell "not assigned yet" apart from shard 0
+ */
+static GStaticPrivate stats_shard_key = G_STATIC_PRIVATE_INIT;
+
+network_global_stats_t *network_global_stats_new(void) {
+	network_global_stats_t *stats;
+	guint i;
+
+	stats = g_new0(network_global_stats_t, 1);
+
+	for (i = 0; i < NETWORK_GLOBAL_STATS_SHARDS; i++) {
+		network_global_stats_shard_t *shard = &(stats->shards[i]);
+
+		shard->counters = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+		shard->mutex = g_mutex_new();
+	}
+
+	return stats;
+}
+
+void network_global_stats_free(network_global_stats_t *stats) {
+	guint i;
+
+	if (!stats) return;
+
+	for (i = 0; i < NETWORK_GLOBAL_STATS_SHARDS; i++) {
+		network_global_stats_shard_t *shard = &(stats->shards[i]);
+
+		g_hash_table_destroy(shard->counters);
+		g_mutex_free(shard->mutex);
+	}
+
+	g_free(stats);
+}
+
+/**
+ * get the shard of the current thread
+ *
+ * threads get their shard assigned on first use. If there are more threads than shards,
+ * some threads share a shard which is still correct, just a bit slower
+ */
+static network_global_stats_shard_t *network_global_stats_get_shard(network_global_stats_t *stats) {
+	guint ndx;
+
+	ndx = GPOINTER_TO_UINT(g_static_private_get(&stats_shard_key));
+	if (0 == ndx) {
+		ndx = (guint)g_atomic_int_exchange_and_add(&(stats->next_shard), 1) % NETWORK_GLOBAL_STATS_SHARDS + 1;
+
+		g_static_private_set(&stats_shard_key, GUINT_TO_POINTER(ndx), NULL);
+	}
+
+	return &(stats->shards[ndx - 1]);
+}
+
+/**
+ * get a counter of the shard, create it if it doesn't exist yet
+ *
+ * the shard has to be locked
+ */
+static network_global_stats_counter_t *network_global_stats_shard_get_counter(network_global_stats_shard_t *shard, const gchar *name, gboolean is_max) {
+	network_global_stats_counter_t *counter;
+
+	if (NULL == (counter = g_hash_table_lookup(shard->counters, name))) {
+		counter = g_new0(network_global_stats_counter_t, 1);
+		counter->is_max = is_max;
+
+		g_hash_table_insert(shard->counters, g_strdup(name), counter);
+	}
+
+	return counter;
+}
+
+/**
+ * merge the value of a shard into the value of the other shards
+ */
+static void network_global_stats_merge(gint64 *merged, gboolean is_first, network_global_stats_counter_t *counter) {
+	if (is_first) {
+		*merged = counter->value;
+	} else if (counter->is_max) {
+		if (counter->value > *merged) *merged = counter->value;
+	} else {
+		*merged += counter->value;
+	}
+}
+
+/**
+ * add delta to a counter
+ *
+ * only touches the shard of the current thread
+ */
+void network_global_stats_add(network_global_stats_t *stats, const gchar *name, gint64 delta) {
+	network_global_stats_shard_t *shard = network_global_stats_get_shard(stats);
+	network_global_stats_counter_t *counter;
+
+	g_mutex_lock(shard->mutex);
+	counter = network_global_stats_shard_get_counter(shard, name, FALSE);
+	counter->value += delta;
+	g_mutex_unlock(shard->mutex);
+}
+
+/**
+ * raise a high-water mark to value
+ *
+ * only touches the shard of the current thread, the readers get the largest value
+ * of all shards. A counter is a high-water mark if it got created by this function.
+ */
+void network_global_stats_max(network_global_stats_t *stats, const gchar *name, gint64 value) {
+	network_global_stats_shard_t *shard = network_global_stats_get_shard(stats);
+	network_global_stats_counter_t *counter;
+
+	g_mutex_lock(shard->mutex);
+	if (NULL == (counter = g_hash_table_lookup(shard->counters, name))) {
+		counter = network_global_stats_shard_get_counter(shard, name, TRUE);
+		counter->value = value;
+	} else if (value > counter->value) {
+		counter->value = value;
+	}
+	g_mutex_unlock(shard->mutex);
+}
+
+/**
+ * get the value of a counter
+ *
+ * sums up the counter over all shards, high-water marks are the largest value of all shards
+ *
+ * @return the value of the counter, 0 if it is unknown
+ */
+gint64 network_global_stats_get(network_global_stats_t *stats, const gchar *name) {
+	gint64 merged = 0;
+	gboolean is_first = TRUE;
+	guint i;
+
+	for (i = 0; i < NETWORK_GLOBAL_STATS_SHARDS; i++) {
+		network_global_stats_shard_t *shard = &(stats->shards[i]);
+		network_global_stats_counter_t *counter;
+
+		g_mutex_lock(shard->mutex);
+		if (NULL != (counter = g_hash_table_lookup(shard->counters, name))) {
+			network_global_stats_merge(&merged, is_first, counter);
+			is_first = FALSE;
+		}
+		g_mutex_unlock(shard->mutex);
+	}
+
+	return merged;
+}
+
+/**
+ * get the values of all counters
+ *
+ * all shards are locked while merging, the counters are a consistent view
+ *
+ * @return hash<gchar *, gint64 *>, free it with g_hash_table_destroy()
+ */
+GHashTable *network_global_stats_snapshot(network_global_stats_t *stats) {
+	GHashTable *snapshot;
+	guint i;
+
+	snapshot = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+
+	for (i = 0; i < NETWORK_GLOBAL_STATS_SHARDS; i++) {
+		g_mutex_lock(stats->shards[i].mutex);
+	}
+
+	for (i = 0; i < NETWORK_GLOBAL_STATS_SHARDS; i++) {
+		GHashTableIter iter;
+		gpointer key, value;
+
+		g_hash_table_iter_init(&iter, stats->shards[i].counters);
+		while (g_hash_table_iter_next(&iter, &key, &value)) {
+			gint64 *merged;
+			gboolean is_first = FALSE;
+
+			if (NULL == (merged = g_hash_table_lookup(snapshot, key))) {
+				merged = g_new0(gint64, 1);
+				is_first = TRUE;
+
+				g_hash_table_insert(snapshot, g_strdup(key), merged);
+			}
+			network_global_stats_merge(merged, is_first, value);
+		}
+	}
+
+	for (i = NETWORK_GLOBAL_STATS_SHARDS; i > 0; i--) {
+		g_mutex_unlock(stats->shards[i - 1].mutex);
+	}
+
+	return snapshot;
+}
+
+/**
+ * remove counters
+ *
+ * @param prefix only remove the counters starting with prefix, NULL for all counters
+ */
+void network_global_stats_reset(network_global_stats_t *stats, const gchar *prefix) {
+	guint i;
+
+	for (i = 0; i < NETWORK_GLOBAL_STATS_SHARDS; i++) {
+		network_global_stats_shard_t *shard = &(stats->shards[i]);
+		GHashTableIter iter;
+		gpointer key, value;
+
+		g_mutex_lock(shard->mutex);
+		g_hash_table_iter_init(&iter, shard->counters);
+		while (g_hash_table_iter_next(&iter, &key, &value)) {
+			if (NULL == prefix || g_str_has_prefix(key, prefix)) {
+				g_hash_table_iter_remove(&iter);
+			}
+		}
+		g_mutex_unlock(shard->mutex);
+	}
+}
@@ -0,0 +1,71 @@
+/* $%BEGINLICENSE%$
+ Copyright (c) 2008, 2012, Oracle and/or its affiliates. All rights reserved.
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License as
+ published by the Free Software Foundation; version 2 of the
+ License.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ 02110-1301  USA
+
+ $%ENDLICENSE%$ */
+
+
+#ifndef _NETWORK_GLOBAL_STATS_H_
+#define _NETWORK_GLOBAL_STATS_H_
+
+#include <glib.h>
+
+#include "network-exports.h"
+
+/**
+ * named counters shared by all event-threads
+ *
+ * each thread updates the counters in its own shard, only readers have to look at all
+ * shards and merge the values. Counters are created on first use.
+ *
+ * @see proxy.global.stats
+ */
+#define NETWORK_GLOBAL_STATS_SHARDS 16
+
+typedef struct {
+	gint64 value;
+
+	gboolean is_max; /**< a high-water mark, the shards are merged by taking the largest value instead of the sum */
+} network_global_stats_counter_t;
+
+typedef struct {
+	/**
+	 * protects the counters of the shard
+	 *
+	 * only the thread owning the shard writes to it, the lock is only contended by readers.
+	 * glib has no 64bit atomic operations we could use instead.
+	 */
+	GMutex *mutex;
+
+	GHashTable *counters; /**< hash<gchar *, network_global_stats_counter_t *> */
+} network_global_stats_shard_t;
+
+typedef struct {
+	network_global_stats_shard_t shards[NETWORK_GLOBAL_STATS_SHARDS];
+
+	volatile gint next_shard; /**< round-robin counter to assign shards to threads */
+} network_global_stats_t;
+
+NETWORK_API network_global_stats_t *network_global_stats_new(void);
+NETWORK_API void network_global_stats_free(network_global_stats_t *stats);
+NETWORK_API void network_global_stats_add(network_global_stats_t *stats, const gchar *name, gint64 delta);
+NETWORK_API void network_global_stats_max(network_global_stats_t *stats, const gchar *name, gint64 value);
+NETWORK_API gint64 network_global_stats_get(network_global_stats_t *stats, const gchar *name);
+NETWORK_API GHashTable *network_global_stats_snapshot(network_global_stats_t *stats);
+NETWORK_API void network_global_stats_reset(network_global_stats_t *stats, const gchar *prefix);
+
+#endif
@@ -0,0 +1,807 @@
+/* $%BEGINLICENSE%$
+ Copyright (c) 2008, 2012, Oracle and/or its affiliates. All rights reserved.
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License as
+ published by the Free Software Foundation; version 2 of the
+ License.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ 02110-1301  USA
+
+ $%ENDLICENSE%$ */
+
+/**
+ * classify the first statement of a query
+ *
+ * to route a query we only need to know what kind of statement it is. Instead of
+ * tokenizing the whole query, the bytes are scanned in place:
+ *
+ * - leading whitespace and comments are skipped, the content of executable comments
+ *   is treated as part of the query as the server would
+ * - the first keyword decides the type of statement
+ * - only for a SELECT the rest of the statement is scanned for the flags that
+ *   change the routing (FOR UPDATE, SQL_CALC_FOUND_ROWS, LAST_INSERT_ID())
+ *
+ * nothing is allocated.
+ *
+ * network_mysqld_classify_tables() uses the same scanner to find the tables a
+ * statement reads or writes for the query-cache, network_mysqld_classify_set_vars()
+ * to find the system-variables a SET changes for the session-tracking.
+ */
+
+#include <string.h>
+
+#include <glib.h>
+
+#include "network-mysqld-classify.h"
+
+#define WORD_IS(word, word_len, keyword) \
+	((word_len) == sizeof(keyword) - 1 && 0 == g_ascii_strncasecmp(word, keyword, word_len))
+
+#define NETWORK_MYSQLD_STMT_FLAG_ALL \
+	(NETWORK_MYSQLD_STMT_FLAG_FOR_UPDATE | NETWORK_MYSQLD_STMT_FLAG_SQL_CALC_FOUND_ROWS | NETWORK_MYSQLD_STMT_FLAG_LAST_INSERT_ID | \
+	 NETWORK_MYSQLD_STMT_FLAG_NONDETERMINISTIC | NETWORK_MYSQLD_STMT_FLAG_SESSION_STATE)
+
+/**
+ * max depth of (...) we track in network_mysqld_classify_tables()
+ */
+#define NETWORK_MYSQLD_CLASSIFY_MAX_DEPTH 32
+
+typedef struct {
+	const char *cur;
+	const char *end;
+
+	gboolean in_mysql_comment; /**< we are inside a executable comment */
+} network_mysqld_classify_scanner;
+
+static gboolean is_word_char(char c) {
+	return g_ascii_isalnum(c) || c == '_' || c == '$' || c == '@';
+}
+
+/**
+ * skip whitespace and comments
+ */
+static void network_mysqld_classify_skip_space(network_mysqld_classify_scanner *s) {
+	while (s->cur < s->end) {
+		const char *cur = s->cur;
+		gsize left = s->end - cur;
+
+		if (g_ascii_isspace(*cur)) {
+			s->cur++;
+		} else if (*cur == '#' ||
+		           (left >= 2 && cur[0] == '-' && cur[1] == '-' && (left == 2 || g_ascii_isspace(cur[2])))) {
+			/* comment until the end of the line */
+			const char *eol = memchr(cur, '\n', left);
+
+			s->cur = eol ? eol + 1 : s->end;
+		} else if (left >= 3 && cur[0] == '/' && cur[1] == '*' && cur[2] == '!') {
+			/* the server executes the content of a executable comment, skip the version only */
+			s->cur += 3;
+			while (s->cur < s->end && g_ascii_isdigit(*s->cur)) s->cur++;
+			s->in_mysql_comment = TRUE;
+		} else if (left >= 2 && cur[0] == '/' && cur[1] == '*') {
+			for (s->cur += 2; s->cur < s->end; s->cur++) {
+				if (s->cur[0] == '*' && s->cur + 1 < s->end && s->cur[1] == '/') {
+					s->cur += 2;
+					break;
+				}
+			}
+		} else if (s->in_mysql_comment && left >= 2 && cur[0] == '*' && cur[1] == '/') {
+			s->cur += 2;
+			s->in_mysql_comment = FALSE;
+		} else {
+			break;
+		}
+	}
+}
+
+/**
+ * get the next word
+ *
+ * @return length of the word at s->cur, 0 if there is no word
+ */
+static gsize network_mysqld_classify_next_word(network_mysqld_classify_scanner *s, const char **word) {
+	const char *start;
+
+	network_mysqld_classify_skip_space(s);
+
+	start = s->cur;
+	while (s->cur < s->end && is_word_char(*s->cur)) s->cur++;
+
+	*word = start;
+
+	return s->cur - start;
+}
+
+/**
+ * skip over a quoted string or identifier
+ *
+ * s->cur points to the opening quote
+ */
+static void network_mysqld_classify_skip_quoted(network_mysqld_classify_scanner *s) {
+	char q = *s->cur;
+
+	for (s->cur++; s->cur < s->end; s->cur++) {
+		if (*s->cur == '\\' && q != '`') {
+			s->cur++; /* skip the escaped char */
+		} else if (*s->cur == q) {
+			if (s->cur + 1 < s->end && s->cur[1] == q) {
+				s->cur++; /* a doubled quote */
+			} else {
+				s->cur++;
+				return;
+			}
+		}
+	}
+
+	s->cur = s->end;
+}
+
+/**
+ * check if a word is a function or variable that makes the result of a SELECT
+ * depend on more than the content of the tables
+ */
+static gboolean network_mysqld_classify_is_nondeterministic(const char *word, gsize word_len) {
+	static const char *words[] = {
+		"NOW", "SYSDATE", "CURDATE", "CURTIME", "CURRENT_DATE", "CURRENT_TIME", "CURRENT_TIMESTAMP",
+		"LOCALTIME", "LOCALTIMESTAMP", "UTC_DATE", "UTC_TIME", "UTC_TIMESTAMP", "UNIX_TIMESTAMP",
+		"RAND", "UUID", "UUID_SHORT",
+		"CONNECTION_ID", "FOUND_ROWS", "ROW_COUNT",
+		"USER", "CURRENT_USER", "SESSION_USER", "SYSTEM_USER", "DATABASE", "SCHEMA",
+		"SLEEP", "BENCHMARK", "GET_LOCK", "RELEASE_LOCK", "IS_FREE_LOCK", "IS_USED_LOCK", "MASTER_POS_WAIT",
+		"SQL_NO_CACHE", "OUTFILE", "DUMPFILE",
+		NULL
+	};
+	guint i;
+
+	/* @user_vars and @@system_vars */
+	if (word[0] == '@') return TRUE;
+
+	for (i = 0; words[i]; i++) {
+		if (word_len == strlen(words[i]) && 0 == g_ascii_strncasecmp(word, words[i], word_len)) return TRUE;
+	}
+
+	return FALSE;
+}
+
+/**
+ * scan the rest of a SELECT for the flags that influence the routing
+ */
+static guint network_mysqld_classify_select_flags(network_mysqld_classify_scanner *s) {
+	const char *prev_word = NULL;
+	gsize prev_word_len = 0;
+	guint flags = 0;
+
+	while (flags != NETWORK_MYSQLD_STMT_FLAG_ALL) {
+		const char *word;
+		gsize word_len;
+
+		network_mysqld_classify_skip_space(s);
+		if (s->cur >= s->end) break;
+
+		if (*s->cur == '\'' || *s->cur == '"' || *s->cur == '`') {
+			network_mysqld_classify_skip_quoted(s);
+			continue;
+		} else if (*s->cur == ';') {
+			/* only the first statement counts */
+			break;
+		} else if (!is_word_char(*s->cur)) {
+			s->cur++;
+			continue;
+		}
+
+		word_len = network_mysqld_classify_next_word(s, &word);
+
+		if (WORD_IS(word, word_len, "SQL_CALC_FOUND_ROWS")) {
+			flags |= NETWORK_MYSQLD_STMT_FLAG_SQL_CALC_FOUND_ROWS;
+		} else if (WORD_IS(word, word_len, "LAST_INSERT_ID") ||
+		           WORD_IS(word, word_len, "@@INSERT_ID") ||
+		           WORD_IS(word, word_len, "@@IDENTITY") ||
+		           WORD_IS(word, word_len, "@@LAST_INSERT_ID")) {
+			flags |= NETWORK_MYSQLD_STMT_FLAG_LAST_INSERT_ID;
+		} else if ((WORD_IS(word, word_len, "UPDATE") && WORD_IS(prev_word, prev_word_len, "FOR")) ||
+		           (WORD_IS(word, word_len, "MODE") && WORD_IS(prev_word, prev_word_len, "SHARE"))) {
+			flags |= NETWORK_MYSQLD_STMT_FLAG_FOR_UPDATE;
+		} else if (network_mysqld_classify_is_nondeterministic(word, word_len)) {
+			flags |= NETWORK_MYSQLD_STMT_FLAG_NONDETERMINISTIC;
+		}
+
+		if (WORD_IS(word, word_len, "GET_LOCK")) {
+			flags |= NETWORK_MYSQLD_STMT_FLAG_SESSION_STATE;
+		} else if (word[0] == '@' && (word_len == 1 || word[1] != '@')) {
+			/* @a := ... assigns a user-variable */
+			network_mysqld_classify_skip_space(s);
+
+			if (s->cur + 1 < s->end && s->cur[0] == ':' && s->cur[1] == '=') {
+				flags |= NETWORK_MYSQLD_STMT_FLAG_SESSION_STATE;
+			}
+
+			/* ... and so does INTO @a */
+			if (WORD_IS(prev_word, prev_word_len, "INTO")) {
+				flags |= NETWORK_MYSQLD_STMT_FLAG_SESSION_STATE;
+			}
+		}
+
+		prev_word = word;
+		prev_word_len = word_len;
+	}
+
+	return flags;
+}
+
+/**
+ * check if a SET only changes autocommit
+ *
+ * autocommit is tracked through the server-status of the result, any other SET
+ * leaves state in the session
+ *
+ * s->cur points right after the SET
+ */
+static gboolean network_mysqld_classify_is_set_autocommit(network_mysqld_classify_scanner *s) {
+	const char *word;
+	gsize word_len;
+
+	word_len = network_mysqld_classify_next_word(s, &word);
+
+	/* SESSION autocommit, @@session.autocommit */
+	if (WORD_IS(word, word_len, "SESSION") ||
+	    WORD_IS(word, word_len, "LOCAL") ||
+	    WORD_IS(word, word_len, "@@SESSION") ||
+	    WORD_IS(word, word_len, "@@LOCAL")) {
+		network_mysqld_classify_skip_space(s);
+		if (s->cur < s->end && *s->cur == '.') s->cur++;
+
+		word_len = network_mysqld_classify_next_word(s, &word);
+	}
+
+	if (!WORD_IS(word, word_len, "AUTOCOMMIT") &&
+	    !WORD_IS(word, word_len, "@@AUTOCOMMIT")) {
+		return FALSE;
+	}
+
+	/* = or := */
+	network_mysqld_classify_skip_space(s);
+	if (s->cur < s->end && *s->cur == ':') s->cur++;
+	if (s->cur >= s->end || *s->cur != '=') return FALSE;
+	s->cur++;
+
+	if (0 == network_mysqld_classify_next_word(s, &word)) return FALSE;
+
+	/* nothing else is SET */
+	network_mysqld_classify_skip_space(s);
+
+	return s->cur == s->end || *s->cur == ';';
+}
+
+/**
+ * check if more statements follow the first one
+ *
+ * empty statements and comments after the ';' don't count
+ *
+ * s->cur points into the first statement
+ */
+static gboolean network_mysqld_classify_has_next_statement(network_mysqld_classify_scanner *s) {
+	/* find the end of the first statement */
+	for (network_mysqld_classify_skip_space(s); s->cur < s->end && *s->cur != ';'; network_mysqld_classify_skip_space(s)) {
+		if (*s->cur == '\'' || *s->cur == '"' || *s->cur == '`') {
+			network_mysqld_classify_skip_quoted(s);
+		} else {
+			s->cur++;
+		}
+	}
+
+	for (network_mysqld_classify_skip_space(s); s->cur < s->end && *s->cur == ';'; network_mysqld_classify_skip_space(s)) {
+		s->cur++;
+	}
+
+	return s->cur < s->end;
+}
+
+/**
+ * classify the first statement of a query
+ *
+ * @param query      the query without the COM_QUERY byte
+ * @param query_len  length of the query
+ * @param flags      (out) NETWORK_MYSQLD_STMT_FLAG_*, may be NULL
+ * @return the type of the first statement
+ */
+network_mysqld_stmt_t network_mysqld_classify_query(const char *query, gsize query_len, guint *flags) {
+	network_mysqld_classify_scanner s;
+	network_mysqld_stmt_t stmt;
+	const char *word;
+	gsize word_len;
+	guint stmt_flags = 0;
+
+	if (flags) *flags = 0;
+
+	s.cur = query;
+	s.end = query + query_len;
+	s.in_mysql_comment = FALSE;
+
+	/* ( SELECT ... ) UNION ( SELECT ... ) */
+	for (network_mysqld_classify_skip_space(&s); s.cur < s.end && *s.cur == '('; network_mysqld_classify_skip_space(&s)) {
+		s.cur++;
+	}
+
+	word_len = network_mysqld_classify_next_word(&s, &word);
+	if (0 == word_len) return NETWORK_MYSQLD_STMT_UNKNOWN;
+
+	if (WORD_IS(word, word_len, "SELECT")) {
+		stmt_flags = network_mysqld_classify_select_flags(&s);
+
+		stmt = NETWORK_MYSQLD_STMT_SELECT;
+	} else if (WORD_IS(word, word_len, "INSERT")) {
+		stmt = NETWORK_MYSQLD_STMT_INSERT;
+	} else if (WORD_IS(word, word_len, "UPDATE")) {
+		stmt = NETWORK_MYSQLD_STMT_UPDATE;
+	} else if (WORD_IS(word, word_len, "DELETE")) {
+		stmt = NETWORK_MYSQLD_STMT_DELETE;
+	} else if (WORD_IS(word, word_len, "REPLACE")) {
+		stmt = NETWORK_MYSQLD_STMT_REPLACE;
+	} else if (WORD_IS(word, word_len, "BEGIN")) {
+		stmt = NETWORK_MYSQLD_STMT_BEGIN;
+	} else if (WORD_IS(word, word_len, "START")) {
+		word_len = network_mysqld_classify_next_word(&s, &word);
+
+		stmt = WORD_IS(word, word_len, "TRANSACTION") ? NETWORK_MYSQLD_STMT_BEGIN : NETWORK_MYSQLD_STMT_OTHER;
+	} else if (WORD_IS(word, word_len, "COMMIT")) {
+		stmt = NETWORK_MYSQLD_STMT_COMMIT;
+	} else if (WORD_IS(word, word_len, "ROLLBACK")) {
+		/* ROLLBACK [WORK] TO [SAVEPOINT] ... doesn't end the transaction */
+		word_len = network_mysqld_classify_next_word(&s, &word);
+		if (WORD_IS(word, word_len, "WORK")) {
+			word_len = network_mysqld_classify_next_word(&s, &word);
+		}
+
+		stmt = WORD_IS(word, word_len, "TO") ? NETWORK_MYSQLD_STMT_OTHER : NETWORK_MYSQLD_STMT_ROLLBACK;
+	} else if (WORD_IS(word, word_len, "SET")) {
+		if (!network_mysqld_classify_is_set_autocommit(&s)) {
+			stmt_flags = NETWORK_MYSQLD_STMT_FLAG_SESSION_STATE;
+		}
+
+		stmt = NETWORK_MYSQLD_STMT_SET;
+	} else if (WORD_IS(word, word_len, "USE")) {
+		stmt = NETWORK_MYSQLD_STMT_USE;
+	} else if (WORD_IS(word, word_len, "SHOW")) {
+		stmt = NETWORK_MYSQLD_STMT_SHOW;
+	} else if (WORD_IS(word, word_len, "CALL")) {
+		stmt = NETWORK_MYSQLD_STMT_CALL;
+	} else if (WORD_IS(word, word_len, "CREATE")) {
+		word_len = network_mysqld_classify_next_word(&s, &word);
+
+		if (WORD_IS(word, word_len, "TEMPORARY")) {
+			stmt_flags = NETWORK_MYSQLD_STMT_FLAG_SESSION_STATE;
+		}
+
+		stmt = NETWORK_MYSQLD_STMT_DDL;
+	} else if (WORD_IS(word, word_len, "DO")) {
+		/* DO GET_LOCK(...) */
+		stmt_flags = network_mysqld_classify_select_flags(&s) & NETWORK_MYSQLD_STMT_FLAG_SESSION_STATE;
+
+		stmt = NETWORK_MYSQLD_STMT_OTHER;
+	} else if (WORD_IS(word, word_len, "LOCK") ||
+	           WORD_IS(word, word_len, "HANDLER") ||
+	           WORD_IS(word, word_len, "PREPARE") ||
+	           WORD_IS(word, word_len, "XA")) {
+		stmt_flags = NETWORK_MYSQLD_STMT_FLAG_SESSION_STATE;
+
+		stmt = NETWORK_MYSQLD_STMT_OTHER;
+	} else if (WORD_IS(word, word_len, "ALTER") ||
+	           WORD_IS(word, word_len, "DROP") ||
+	           WORD_IS(word, word_len, "TRUNCATE") ||
+	           WORD_IS(word, word_len, "RENAME")) {
+		stmt = NETWORK_MYSQLD_STMT_DDL;
+	} else {
+		stmt = NETWORK_MYSQLD_STMT_OTHER;
+	}
+
+	if (flags && network_mysqld_classify_has_next_statement(&s)) {
+		stmt_flags |= NETWORK_MYSQLD_STMT_FLAG_MULTI_STATEMENT;
+	}
+
+	if (flags) *flags = stmt_flags;
+
+	return stmt;
+}
+
+/**
+ * skip the content of (...)
+ *
+ * s->cur points to the opening paren
+ */
+static void network_mysqld_classify_skip_parens(network_mysqld_classify_scanner *s) {
+	guint depth = 0;
+
+	while (s->cur < s->end) {
+		if (*s->cur == '\'' || *s->cur == '"' || *s->cur == '`') {
+			network_mysqld_classify_skip_quoted(s);
+			continue;
+		}
+
+		if (*s->cur == '(') {
+			depth++;
+		} else if (*s->cur == ')' && --depth == 0) {
+			s->cur++;
+			return;
+		}
+		s->cur++;
+	}
+}
+
+/**
+ * read a table-name like tbl, db.tbl or `db`.`tbl`
+ *
+ * @param name  the lower-cased name without the quotes
+ * @return FALSE if there is no name at s->cur
+ */
+static gboolean network_mysqld_classify_table_name(network_mysqld_classify_scanner *s, GString *name) {
+	g_string_truncate(name, 0);
+
+	for (;;) {
+		const char *part;
+		gsize part_len, i;
+
+		network_mysqld_classify_skip_space(s);
+		if (s->cur >= s->end) return FALSE;
+
+		if (*s->cur == '`') {
+			part = s->cur + 1;
+			network_mysqld_classify_skip_quoted(s);
+			part_len = s->cur - part;
+			if (part_len > 0 && part[part_len - 1] == '`') part_len--;
+		} else {
+			part_len = network_mysqld_classify_next_word(s, &part);
+			if (0 == part_len) return FALSE;
+		}
+
+		for (i = 0; i < part_len; i++) {
+			g_string_append_c(name, g_ascii_tolower(part[i]));
+		}
+
+		if (s->cur < s->end && *s->cur == '.') {
+			g_string_append_c(name, '.');
+			s->cur++;
+			continue;
+		}
+
+		return TRUE;
+	}
+}
+
+/**
+ * read a table-reference with its alias and index-hints and add the table
+ *
+ * @return -1 if we can't follow the reference (derived tables, tables of the system-schemas), 0 otherwise
+ */
+static int network_mysqld_classify_table_ref(network_mysqld_classify_scanner *s, const char *default_db, GPtrArray *tables, GString *name) {
+	gboolean has_alias = FALSE;
+	const char *word;
+	gsize word_len;
+
+	network_mysqld_classify_skip_space(s);
+	if (s->cur < s->end && *s->cur == '(') return -1;
+
+	do {
+		if (!network_mysqld_classify_table_name(s, name)) return 0;
+	} while (WORD_IS(name->str, name->len, "LOW_PRIORITY") ||
+	         WORD_IS(name->str, name->len, "HIGH_PRIORITY") ||
+	         WORD_IS(name->str, name->len, "DELAYED") ||
+	         WORD_IS(name->str, name->len, "IGNORE"));
+
+	/* INTO @var, INTO OUTFILE '...', FROM DUAL */
+	if (name->str[0] == '@' ||
+	    WORD_IS(name->str, name->len, "OUTFILE") ||
+	    WORD_IS(name->str, name->len, "DUMPFILE") ||
+	    WORD_IS(name->str, name->len, "DUAL")) {
+		return 0;
+	}
+
+	if (NULL == strchr(name->str, '.') && default_db && *default_db) {
+		gchar *db = g_ascii_strdown(default_db, -1);
+
+		g_string_prepend_c(name, '.');
+		g_string_prepend(name, db);
+
+		g_free(db);
+	}
+
+	if (0 == strncmp(name->str, "information_schema.", sizeof("information_schema.") - 1) ||
+	    0 == strncmp(name->str, "performance_schema.", sizeof("performance_schema.") - 1) ||
+	    0 == strncmp(name->str, "mysql.", sizeof("mysql.") - 1)) {
+		return -1;
+	}
+
+	g_ptr_array_add(tables, g_strndup(name->str, name->len));
+
+	/* skip the alias and the index-hints */
+	for (;;) {
+		const char *word_start;
+
+		network_mysqld_classify_skip_space(s);
+		if (s->cur >= s->end) break;
+
+		if (*s->cur == '(') {
+			network_mysqld_classify_skip_parens(s);
+			continue;
+		} else if (*s->cur == '`' && !has_alias) {
+			network_mysqld_classify_skip_quoted(s);
+			has_alias = TRUE;
+			continue;
+		} else if (!is_word_char(*s->cur)) {
+			break;
+		}
+
+		word_start = s->cur;
+		word_len = network_mysqld_classify_next_word(s, &word);
+
+		if (WORD_IS(word, word_len, "AS") ||
+		    WORD_IS(word, word_len, "PARTITION") ||
+		    WORD_IS(word, word_len, "INDEX") ||
+		    WORD_IS(word, word_len, "KEY") ||
+		    WORD_IS(word, word_len, "USE") ||
+		    WORD_IS(word, word_len, "FORCE") ||
+		    WORD_IS(word, word_len, "IGNORE")) {
+			continue;
+		} else if (!has_alias &&
+		           !WORD_IS(word, word_len, "WHERE") &&
+		           !WORD_IS(word, word_len, "JOIN") &&
+		           !WORD_IS(word, word_len, "STRAIGHT_JOIN") &&
+		           !WORD_IS(word, word_len, "ON") &&
+		           !WORD_IS(word, word_len, "USING") &&
+		           !WORD_IS(word, word_len, "SET") &&
+		           !WORD_IS(word, word_len, "FOR") &&
+		           !WORD_IS(word, word_len, "GROUP") &&
+		           !WORD_IS(word, word_len, "ORDER") &&
+		           !WORD_IS(word, word_len, "LIMIT") &&
+		           !WORD_IS(word, word_len, "HAVING") &&
+		           !WORD_IS(word, word_len, "UNION") &&
+		           !WORD_IS(word, word_len, "VALUES") &&
+		           !WORD_IS(word, word_len, "SELECT")) {
+			has_alias = TRUE;
+			continue;
+		}
+
+		/* let the caller look at it */
+		s->cur = word_start;
+		break;
+	}
+
+	return 0;
+}
+
+/**
+ * get the tables a statement reads or writes
+ *
+ * looks at the table-references after FROM, JOIN, UPDATE and INTO and the
+ * comma-separated lists of them. The names are qualified with the default-db and
+ * lower-cased.
+ *
+ * @param query       the query without the COM_QUERY byte
+ * @param query_len   length of the query
+ * @param default_db  default-db of the connection, may be NULL
+ * @param tables      the table-names are appended as gchar *, free them with g_free()
+ * @return number of tables found, -1 if the tables can't be determined (derived tables,
+ *         tables of the system-schemas, more than one statement)
+ */
+int network_mysqld_classify_tables(const char *query, gsize query_len, const char *default_db, GPtrArray *tables) {
+	network_mysqld_classify_scanner s;
+	gboolean in_from[NETWORK_MYSQLD_CLASSIFY_MAX_DEPTH];
+	const char *prev_word = NULL;
+	gsize prev_word_len = 0;
+	guint depth = 0;
+	guint tables_len = tables->len;
+	GString *name;
+	const char *word;
+	gsize word_len;
+	int ret = 0;
+
+	s.cur = query;
+	s.end = query + query_len;
+	s.in_mysql_comment = FALSE;
+
+	in_from[0] = FALSE;
+	name = g_string_new(NULL);
+
+	/* INSERT [IGNORE] tbl ... without the INTO */
+	word_len = network_mysqld_classify_next_word(&s, &word);
+	if (WORD_IS(word, word_len, "INSERT") || WORD_IS(word, word_len, "REPLACE")) {
+		const char *word_start;
+
+		do {
+			network_mysqld_classify_skip_space(&s);
+			word_start = s.cur;
+			word_len = network_mysqld_classify_next_word(&s, &word);
+		} while (WORD_IS(word, word_len, "LOW_PRIORITY") ||
+		         WORD_IS(word, word_len, "HIGH_PRIORITY") ||
+		         WORD_IS(word, word_len, "DELAYED") ||
+		         WORD_IS(word, word_len, "IGNORE"));
+
+		s.cur = word_start;
+		if (!WORD_IS(word, word_len, "INTO")) {
+			ret = network_mysqld_classify_table_ref(&s, default_db, tables, name);
+		}
+	} else {
+		/* let the loop see the first word */
+		s.cur = query;
+		s.in_mysql_comment = FALSE;
+	}
+
+	while (0 == ret) {
+		network_mysqld_classify_skip_space(&s);
+		if (s.cur >= s.end) break;
+
+		if (*s.cur == '\'' || *s.cur == '"' || *s.cur == '`') {
+			network_mysqld_classify_skip_quoted(&s);
+			continue;
+		} else if (*s.cur == ';') {
+			s.cur++;
+			network_mysqld_classify_skip_space(&s);
+
+			if (s.cur < s.end) ret = -1; /* a multi-statement */
+			break;
+		} else if (*s.cur == '(') {
+			s.cur++;
+			if (++depth == NETWORK_MYSQLD_CLASSIFY_MAX_DEPTH) {
+				ret = -1;
+				break;
+			}
+			in_from[depth] = FALSE;
+			continue;
+		} else if (*s.cur == ')') {
+			s.cur++;
+			if (depth > 0) depth--;
+			continue;
+		} else if (*s.cur == ',') {
+			s.cur++;
+			/* FROM a, b */
+			if (in_from[depth]) ret = network_mysqld_classify_table_ref(&s, default_db, tables, name);
+			continue;
+		} else if (!is_word_char(*s.cur)) {
+			s.cur++;
+			continue;
+		}
+
+		word_len = network_mysqld_classify_next_word(&s, &word);
+
+		if (WORD_IS(word, word_len, "FROM") ||
+		    WORD_IS(word, word_len, "JOIN") ||
+		    WORD_IS(word, word_len, "STRAIGHT_JOIN") ||
+		    (WORD_IS(word, word_len, "UPDATE") &&
+		     !WORD_IS(prev_word, prev_word_len, "FOR") &&
+		     !WORD_IS(prev_word, prev_word_len, "KEY"))) {
+			ret = network_mysqld_classify_table_ref(&s, default_db, tables, name);
+			in_from[depth] = TRUE;
+		} else if (WORD_IS(word, word_len, "INTO")) {
+			ret = network_mysqld_classify_table_ref(&s, default_db, tables, name);
+			in_from[depth] = FALSE;
+		} else if (WORD_IS(word, word_len, "WHERE") ||
+		           WORD_IS(word, word_len, "SET") ||
+		           WORD_IS(word, word_len, "GROUP") ||
+		           WORD_IS(word, word_len, "ORDER") ||
+		           WORD_IS(word, word_len, "LIMIT") ||
+		           WORD_IS(word, word_len, "HAVING") ||
+		           WORD_IS(word, word_len, "UNION") ||
+		           WORD_IS(word, word_len, "SELECT") ||
+		           WORD_IS(word, word_len, "VALUES")) {
+			in_from[depth] = FALSE;
+		}
+
+		prev_word = word;
+		prev_word_len = word_len;
+	}
+
+	g_string_free(name, TRUE);
+
+	return (0 == ret) ? (int)(tables->len - tables_len) : -1;
+}
+
+/**
+ * get the system-variables a SET changes in the session
+ *
+ * SET NAMES and SET CHARACTER SET change the character_set_client, _connection
+ * and _results.
+ *
+ * @param query      the query without the COM_QUERY byte
+ * @param query_len  length of the query
+ * @param names      a lower-cased copy of the name of each variable is added
+ * @return the number of variables added, -1 if it isn't a SET of session variables
+ *         only (user-variables, GLOBAL, SET TRANSACTION) or we can't parse it
+ */
+int network_mysqld_classify_set_vars(const char *query, gsize query_len, GPtrArray *names) {
+	network_mysqld_classify_scanner s;
+	const char *word;
+	gsize word_len;
+	guint names_len = names->len;
+
+	s.cur = query;
+	s.end = query + query_len;
+	s.in_mysql_comment = FALSE;
+
+	word_len = network_mysqld_classify_next_word(&s, &word);
+	if (!WORD_IS(word, word_len, "SET")) return -1;
+
+	for (;;) {
+		word_len = network_mysqld_classify_next_word(&s, &word);
+
+		/* SESSION sql_mode = ..., @@session.sql_mode = ... */
+		if (WORD_IS(word, word_len, "SESSION") ||
+		    WORD_IS(word, word_len, "LOCAL") ||
+		    WORD_IS(word, word_len, "@@SESSION") ||
+		    WORD_IS(word, word_len, "@@LOCAL")) {
+			network_mysqld_classify_skip_space(&s);
+			if (s.cur < s.end && *s.cur == '.') s.cur++;
+
+			word_len = network_mysqld_classify_next_word(&s, &word);
+		}
+
+		if (word_len > 2 && word[0] == '@' && word[1] == '@') {
+			word += 2;
+			word_len -= 2;
+
+			if (WORD_IS(word, word_len, "GLOBAL")) break;
+		}
+
+		if (0 == word_len ||
+		    word[0] == '@' || /* a user-variable */
+		    WORD_IS(word, word_len, "GLOBAL") ||
+		    WORD_IS(word, word_len, "PERSIST") ||
+		    WORD_IS(word, word_len, "PERSIST_ONLY") ||
+		    WORD_IS(word, word_len, "TRANSACTION")) {
+			break;
+		}
+
+		if (WORD_IS(word, word_len, "CHARACTER")) {
+			word_len = network_mysqld_classify_next_word(&s, &word);
+			if (!WORD_IS(word, word_len, "SET")) break;
+
+			word = "CHARSET";
+			word_len = sizeof("CHARSET") - 1;
+		}
+
+		if (WORD_IS(word, word_len, "NAMES") ||
+		    WORD_IS(word, word_len, "CHARSET")) {
+			g_ptr_array_add(names, g_strdup("character_set_client"));
+			g_ptr_array_add(names, g_strdup("character_set_connection"));
+			g_ptr_array_add(names, g_strdup("character_set_results"));
+		} else {
+			/* = or := */
+			network_mysqld_classify_skip_space(&s);
+			if (s.cur < s.end && *s.cur == ':') s.cur++;
+			if (s.cur >= s.end || *s.cur != '=') break;
+			s.cur++;
+
+			g_ptr_array_add(names, g_ascii_strdown(word, word_len));
+		}
+
+		/* skip the value up to the next , */
+		for (network_mysqld_classify_skip_space(&s); s.cur < s.end; network_mysqld_classify_skip_space(&s)) {
+			if (*s.cur == '\'' || *s.cur == '"' || *s.cur == '`') {
+				network_mysqld_classify_skip_quoted(&s);
+			} else if (*s.cur == '(') {
+				network_mysqld_classify_skip_parens(&s);
+			} else if (*s.cur == ',' || *s.cur == ';') {
+				break;
+			} else {
+				s.cur++;
+			}
+		}
+
+		if (s.cur >= s.end || *s.cur == ';') return names->len - names_len;
+
+		s.cur++; /* the , */
+	}
+
+	while (names->len > names_len) {
+		g_free(g_ptr_array_remove_index(names, names->len - 1));
+	}
+
+	return -1;
+}
@@ -0,0 +1,61 @@
+/* $%BEGINLICENSE%$
+ Copyright (c) 2008, 2012, Oracle and/or its affiliates. All rights reserved.
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License as
+ published by the Free Software Foundation; version 2 of the
+ License.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ 02110-1301  USA
+
+ $%ENDLICENSE%$ */
+
+
+#ifndef _NETWORK_MYSQLD_CLASSIFY_H_
+#define _NETWORK_MYSQLD_CLASSIFY_H_
+
+#include <glib.h>
+
+#include "network-exports.h"
+
+/**
+ * the type of the first statement of a query
+ */
+typedef enum {
+	NETWORK_MYSQLD_STMT_UNKNOWN,  /**< empty query or no keyword found */
+	NETWORK_MYSQLD_STMT_SELECT,
+	NETWORK_MYSQLD_STMT_INSERT,
+	NETWORK_MYSQLD_STMT_UPDATE,
+	NETWORK_MYSQLD_STMT_DELETE,
+	NETWORK_MYSQLD_STMT_REPLACE,
+	NETWORK_MYSQLD_STMT_BEGIN,    /**< BEGIN and START TRANSACTION */
+	NETWORK_MYSQLD_STMT_COMMIT,
+	NETWORK_MYSQLD_STMT_ROLLBACK, /**< ROLLBACK, but not ROLLBACK TO SAVEPOINT */
+	NETWORK_MYSQLD_STMT_SET,
+	NETWORK_MYSQLD_STMT_USE,
+	NETWORK_MYSQLD_STMT_SHOW,
+	NETWORK_MYSQLD_STMT_CALL,
+	NETWORK_MYSQLD_STMT_DDL,      /**< CREATE, ALTER, DROP, TRUNCATE, RENAME */
+	NETWORK_MYSQLD_STMT_OTHER     /**< any other statement */
+} network_mysqld_stmt_t;
+
+#define NETWORK_MYSQLD_STMT_FLAG_FOR_UPDATE          (1 << 0) /**< SELECT ... FOR UPDATE or LOCK IN SHARE MODE */
+#define NETWORK_MYSQLD_STMT_FLAG_SQL_CALC_FOUND_ROWS (1 << 1) /**< SELECT SQL_CALC_FOUND_ROWS ... */
+#define NETWORK_MYSQLD_STMT_FLAG_LAST_INSERT_ID      (1 << 2) /**< SELECT uses LAST_INSERT_ID() or @@insert_id */
+#define NETWORK_MYSQLD_STMT_FLAG_NONDETERMINISTIC    (1 << 3) /**< SELECT uses NOW(), RAND(), variables, ... and can't be cached */
+#define NETWORK_MYSQLD_STMT_FLAG_SESSION_STATE       (1 << 4) /**< the statement leaves state in the session: SET, temp-tables, locks, user-variables */
+#define NETWORK_MYSQLD_STMT_FLAG_MULTI_STATEMENT     (1 << 5) /**< more statements follow the first one (CLIENT_MULTI_STATEMENTS), only the first is classified */
+
+NETWORK_API network_mysqld_stmt_t network_mysqld_classify_query(const char *query, gsize query_len, guint *flags);
+NETWORK_API int network_mysqld_classify_tables(const char *query, gsize query_len, const char *default_db, GPtrArray *tables);
+NETWORK_API int network_mysqld_classify_set_vars(const char *query, gsize query_len, GPtrArray *names);
+
+#endif
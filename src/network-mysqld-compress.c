@@ -0,0 +1,290 @@
+/* $%BEGINLICENSE%$
+ Copyright (c) 2008, 2012, Oracle and/or its affiliates. All rights reserved.
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License as
+ published by the Free Software Foundation; version 2 of the
+ License.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ 02110-1301  USA
+
+ $%ENDLICENSE%$ */
+
+/**
+ * the framing of the compressed protocol (CLIENT_COMPRESS)
+ *
+ * after the handshake each side of a connection may switch to the compressed
+ * protocol on its own. The socket reads the frames into comp->recv_queue,
+ * network_mysqld_compress_inflate() turns all complete frames into the plain
+ * packets of the recv_queue_raw. On the way out network_mysqld_compress_deflate()
+ * wraps the send_queue into frames.
+ *
+ * the z_streams are kept with the socket and only reset between the frames.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#ifdef HAVE_ZLIB_H
+#include <zlib.h>
+#endif
+
+#include "network-mysqld-compress.h"
+
+#ifdef HAVE_ZLIB_H
+static void network_mysqld_compress_set_header(gchar *header, gsize len, guint8 packet_id, gsize uncompressed_len) {
+	header[0] = (len >>  0) & 0xff;
+	header[1] = (len >>  8) & 0xff;
+	header[2] = (len >> 16) & 0xff;
+	header[3] = packet_id;
+	header[4] = (uncompressed_len >>  0) & 0xff;
+	header[5] = (uncompressed_len >>  8) & 0xff;
+	header[6] = (uncompressed_len >> 16) & 0xff;
+}
+
+static gsize network_mysqld_compress_get_int24(const gchar *s) {
+	return (guchar)s[0] | ((guchar)s[1] << 8) | ((guchar)s[2] << 16);
+}
+#endif
+
+/**
+ * check if we were built with zlib
+ */
+gboolean network_mysqld_compress_is_supported(void) {
+#ifdef HAVE_ZLIB_H
+	return TRUE;
+#else
+	return FALSE;
+#endif
+}
+
+/**
+ * create the state of the compressed protocol
+ *
+ * @param min_length  payloads shorter than this are sent uncompressed
+ * @return NULL if zlib isn't available or failed to init
+ */
+network_mysqld_compress *network_mysqld_compress_new(gsize min_length) {
+#ifdef HAVE_ZLIB_H
+	network_mysqld_compress *comp;
+
+	comp = g_new0(network_mysqld_compress, 1);
+	comp->recv_queue = network_queue_new();
+	comp->send_queue = network_queue_new();
+	comp->min_length = min_length;
+	comp->packet_id_is_reset = TRUE;
+
+	comp->deflate_strm = g_new0(z_stream, 1);
+	comp->inflate_strm = g_new0(z_stream, 1);
+
+	if (Z_OK != deflateInit(comp->deflate_strm, Z_DEFAULT_COMPRESSION)) {
+		g_critical("%s: deflateInit() failed: %s", G_STRLOC, comp->deflate_strm->msg ? comp->deflate_strm->msg : "");
+		g_free(comp->deflate_strm);
+		comp->deflate_strm = NULL;
+		network_mysqld_compress_free(comp);
+		return NULL;
+	}
+	if (Z_OK != inflateInit(comp->inflate_strm)) {
+		g_critical("%s: inflateInit() failed: %s", G_STRLOC, comp->inflate_strm->msg ? comp->inflate_strm->msg : "");
+		g_free(comp->inflate_strm);
+		comp->inflate_strm = NULL;
+		network_mysqld_compress_free(comp);
+		return NULL;
+	}
+
+	return comp;
+#else
+	g_critical("%s: the compressed protocol isn't supported, built without zlib", G_STRLOC);
+
+	return NULL;
+#endif
+}
+
+void network_mysqld_compress_free(network_mysqld_compress *comp) {
+	if (!comp) return;
+
+#ifdef HAVE_ZLIB_H
+	if (comp->deflate_strm) {
+		deflateEnd(comp->deflate_strm);
+		g_free(comp->deflate_strm);
+	}
+	if (comp->inflate_strm) {
+		inflateEnd(comp->inflate_strm);
+		g_free(comp->inflate_strm);
+	}
+#endif
+
+	network_queue_free(comp->recv_queue);
+	network_queue_free(comp->send_queue);
+
+	g_free(comp);
+}
+
+/**
+ * turn the complete frames of comp->recv_queue into plain packets
+ *
+ * a incomplete frame is left in the queue until the rest is read
+ *
+ * @param comp  the compression state of the socket
+ * @param dst   queue to append the payload of the frames to (the recv_queue_raw)
+ * @return 0 on success, -1 on a broken frame
+ */
+int network_mysqld_compress_inflate(network_mysqld_compress *comp, network_queue *dst) {
+#ifdef HAVE_ZLIB_H
+	gchar header_str[NETWORK_MYSQLD_COMPRESS_HEADER_SIZE + 1];
+	GString header;
+
+	header.str = header_str;
+	header.allocated_len = sizeof(header_str);
+
+	for (;;) {
+		GString *frame;
+		gsize len, uncompressed_len;
+
+		header.len = 0;
+		if (!network_queue_peek_string(comp->recv_queue, NETWORK_MYSQLD_COMPRESS_HEADER_SIZE, &header)) break;
+
+		len              = network_mysqld_compress_get_int24(header.str);
+		uncompressed_len = network_mysqld_compress_get_int24(header.str + 4);
+
+		if (comp->recv_queue->len < NETWORK_MYSQLD_COMPRESS_HEADER_SIZE + len) break;
+
+		frame = network_queue_pop_string(comp->recv_queue, NETWORK_MYSQLD_COMPRESS_HEADER_SIZE + len, NULL);
+
+		/* our next frame continues the sequence */
+		comp->packet_id = (guint8)header.str[3] + 1;
+		comp->packet_id_is_reset = FALSE;
+
+		if (0 == len) {
+			network_queue_chunk_free(frame);
+		} else if (0 == uncompressed_len) {
+			/* the payload is stored as is, just strip the header */
+			g_string_erase(frame, 0, NETWORK_MYSQLD_COMPRESS_HEADER_SIZE);
+
+			network_queue_append(dst, frame);
+		} else {
+			z_stream *strm = comp->inflate_strm;
+			GString *payload = g_string_sized_new(uncompressed_len);
+			int ret;
+
+			inflateReset(strm);
+			strm->next_in   = (Bytef *)frame->str + NETWORK_MYSQLD_COMPRESS_HEADER_SIZE;
+			strm->avail_in  = len;
+			strm->next_out  = (Bytef *)payload->str;
+			strm->avail_out = uncompressed_len;
+
+			ret = inflate(strm, Z_FINISH);
+			if (Z_STREAM_END != ret || strm->total_out != uncompressed_len) {
+				g_critical("%s: inflate() of a frame with %"G_GSIZE_FORMAT" bytes failed: %s (ret=%d)",
+						G_STRLOC,
+						len,
+						strm->msg ? strm->msg : "length doesn't match",
+						ret);
+
+				network_queue_chunk_free(frame);
+				g_string_free(payload, TRUE);
+
+				return -1;
+			}
+
+			payload->len = uncompressed_len;
+			payload->str[payload->len] = '\0';
+
+			network_queue_chunk_free(frame);
+			network_queue_append(dst, payload);
+		}
+	}
+
+	return 0;
+#else
+	return -1;
+#endif
+}
+
+/**
+ * wrap the content of a queue into frames
+ *
+ * after network_mysqld_queue_reset() a new command starts and the sequence-id of the
+ * frames starts at 0 again, otherwise they continue the sequence.
+ *
+ * @param comp  the compression state of the socket
+ * @param src   queue to take the packets from (the send_queue), is empty afterwards
+ * @return 0 on success, -1 on error
+ */
+int network_mysqld_compress_deflate(network_mysqld_compress *comp, network_queue *src) {
+#ifdef HAVE_ZLIB_H
+	/* the first frame of a command, the seq-ids of the packets wrap and can't tell */
+	if (src->len > 0 && comp->packet_id_is_reset) {
+		comp->packet_id = 0;
+		comp->packet_id_is_reset = FALSE;
+	}
+
+	while (src->len > 0) {
+		GString *payload, *frame;
+
+		payload = network_queue_pop_string(src, MIN(src->len, NETWORK_MYSQLD_COMPRESS_MAX_PAYLOAD), NULL);
+
+		if (payload->len >= comp->min_length) {
+			z_stream *strm = comp->deflate_strm;
+			uLong bound;
+
+			deflateReset(strm);
+			bound = deflateBound(strm, payload->len);
+
+			frame = g_string_sized_new(NETWORK_MYSQLD_COMPRESS_HEADER_SIZE + bound);
+
+			strm->next_in   = (Bytef *)payload->str;
+			strm->avail_in  = payload->len;
+			strm->next_out  = (Bytef *)frame->str + NETWORK_MYSQLD_COMPRESS_HEADER_SIZE;
+			strm->avail_out = bound;
+
+			if (Z_STREAM_END != deflate(strm, Z_FINISH)) {
+				g_critical("%s: deflate() failed: %s", G_STRLOC, strm->msg ? strm->msg : "");
+
+				g_string_free(frame, TRUE);
+				network_queue_chunk_free(payload);
+
+				return -1;
+			}
+
+			if (strm->total_out < payload->len) {
+				network_mysqld_compress_set_header(frame->str, strm->total_out, comp->packet_id++, payload->len);
+				frame->len = NETWORK_MYSQLD_COMPRESS_HEADER_SIZE + strm->total_out;
+				frame->str[frame->len] = '\0';
+
+				network_queue_append(comp->send_queue, frame);
+				network_queue_chunk_free(payload);
+
+				continue;
+			}
+
+			/* it didn't get smaller, send it as is */
+			g_string_free(frame, TRUE);
+		}
+
+		/* a frame-header followed by the uncompressed payload, no need to copy it */
+		frame = g_string_sized_new(NETWORK_MYSQLD_COMPRESS_HEADER_SIZE);
+		network_mysqld_compress_set_header(frame->str, payload->len, comp->packet_id++, 0);
+		frame->len = NETWORK_MYSQLD_COMPRESS_HEADER_SIZE;
+		frame->str[frame->len] = '\0';
+
+		network_queue_append(comp->send_queue, frame);
+		network_queue_append(comp->send_queue, payload);
+	}
+
+	return 0;
+#else
+	return -1;
+#endif
+}
@@ -0,0 +1,76 @@
+/* $%BEGINLICENSE%$
+ Copyright (c) 2008, 2012, Oracle and/or its affiliates. All rights reserved.
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License as
+ published by the Free Software Foundation; version 2 of the
+ License.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ 02110-1301  USA
+
+ $%ENDLICENSE%$ */
+
+
+#ifndef _NETWORK_MYSQLD_COMPRESS_H_
+#define _NETWORK_MYSQLD_COMPRESS_H_
+
+#include <glib.h>
+
+#include "network-exports.h"
+#include "network-queue.h"
+
+/**
+ * size of the header of a compressed frame
+ *
+ * 3 bytes length of the payload, 1 byte sequence-id, 3 bytes length of the payload
+ * before compression (0 if the payload isn't compressed)
+ */
+#define NETWORK_MYSQLD_COMPRESS_HEADER_SIZE 7
+
+/**
+ * max size of the payload of a frame
+ */
+#define NETWORK_MYSQLD_COMPRESS_MAX_PAYLOAD 0xffffff
+
+/**
+ * payloads shorter than this are sent uncompressed
+ *
+ * the same as MIN_COMPRESS_LENGTH of the libmysql
+ */
+#define NETWORK_MYSQLD_COMPRESS_MIN_LENGTH 50
+
+struct z_stream_s;
+
+/**
+ * state of the compressed protocol of one side of a connection
+ *
+ * the packets of the normal protocol are the payload of the compressed frames.
+ * A packet may span several frames and a frame may contain several packets.
+ */
+typedef struct {
+	network_queue *recv_queue; /**< compressed frames as read from the socket */
+	network_queue *send_queue; /**< frames ready to be written to the socket */
+
+	guint8 packet_id;          /**< sequence-id of the next frame */
+	gboolean packet_id_is_reset; /**< a new command starts, the next frame we send has sequence-id 0 */
+	gsize min_length;          /**< payloads shorter than this aren't compressed */
+
+	struct z_stream_s *deflate_strm; /**< reused for each frame we send */
+	struct z_stream_s *inflate_strm; /**< reused for each frame we receive */
+} network_mysqld_compress;
+
+NETWORK_API gboolean network_mysqld_compress_is_supported(void);
+NETWORK_API network_mysqld_compress *network_mysqld_compress_new(gsize min_length);
+NETWORK_API void network_mysqld_compress_free(network_mysqld_compress *comp);
+NETWORK_API int network_mysqld_compress_inflate(network_mysqld_compress *comp, network_queue *dst);
+NETWORK_API int network_mysqld_compress_deflate(network_mysqld_compress *comp, network_queue *src);
+
+#endif
@@ -39,8 +39,11 @@
 #include "network-mysqld.h"
 #include "network-mysqld-proto.h"
 #include "network-mysqld-lua.h"
+#include "network-mysqld-classify.h"
 #include "network-socket-lua.h"
 #include "network-backend-lua.h"
+#include "network-global-kv-lua.h"
+#include "network-global-stats-lua.h"
 #include "network-conn-pool.h"
 #include "network-conn-pool-lua.h"
 #include "network-injection-lua.h"
@@ -53,6 +56,9 @@ network_mysqld_con_lua_t *network_mysqld_con_lua_new() {
 	st = g_new0(network_mysqld_con_lua_t, 1);
 
 	st->injected.queries = network_injection_queue_new();
+	st->multiplex_backend_ndx = -1;
+	st->multiplex_prelude = g_queue_new();
+	st->session_vars = g_ptr_array_new();
 	
 	return st;
 }
@@ -61,11 +67,58 @@ void network_mysqld_con_lua_free(network_mysqld_con_lua_t *st) {
 	if (!st) return;
 
 	network_injection_queue_free(st->injected.queries);
+	network_query_cache_con_free(st->query_cache);
+	network_stmt_con_free(st->stmts);
+	if (st->multiplex_held_packets) g_string_free(st->multiplex_held_packets, TRUE);
+
+	while (!g_queue_is_empty(st->multiplex_prelude)) g_string_free(g_queue_pop_head(st->multiplex_prelude), TRUE);
+	g_queue_free(st->multiplex_prelude);
+
+	while (st->session_vars->len > 0) g_free(g_ptr_array_remove_index(st->session_vars, st->session_vars->len - 1));
+	g_ptr_array_free(st->session_vars, TRUE);
 
 	g_free(st);
 }
 
 
+/**
+ * pick a backend of a type for this connection
+ *
+ *   proxy.connection.backend_ndx = proxy.connection:balance(proxy.BACKEND_TYPE_RO)
+ *   proxy.connection.backend_ndx = proxy.connection:balance(proxy.BACKEND_TYPE_RO, 5)
+ *
+ * by the policy of --proxy-balance or --proxy-read-only-balance, the hash
+ * policies use the username and default-db of the client. The optional
+ * max-lag in seconds overrides --proxy-read-only-max-lag for this query, -1
+ * allows any lag.
+ *
+ * @return the index of the backend, nil if all backends of that type are DOWN or lagging
+ */
+static int proxy_connection_balance(lua_State *L) {
+	network_mysqld_con *con = *(network_mysqld_con **)luaL_checkself(L);
+	lua_Integer type = luaL_checkinteger(L, 2);
+	network_socket *client = con->client;
+	network_backends_t *backends = con->srv->priv->backends;
+	gint ndx;
+
+	if (type != BACKEND_TYPE_RW && type != BACKEND_TYPE_RO) {
+		return luaL_error(L, "proxy.connection:balance() expects proxy.BACKEND_TYPE_RW or proxy.BACKEND_TYPE_RO, got %d", (int)type);
+	}
+
+	ndx = network_backends_balance_max_lag(backends, type,
+			(client && client->response) ? client->response->username : NULL,
+			client ? client->default_db : NULL,
+			luaL_optinteger(L, 3, network_backends_get_snapshot(backends)->groups[type].max_lag));
+
+	if (ndx < 0) {
+		lua_pushnil(L);
+	} else {
+		lua_pushinteger(L, ndx + 1);
+	}
+
+	return 1;
+}
+
 /**
  * get the connection information
  *
@@ -91,6 +144,8 @@ static int proxy_connection_get(lua_State *L) {
 		return luaL_error(L, "proxy.connection.mysqld_version is deprecated, use proxy.connection.server.mysqld_version instead");
 	} else if (strleq(key, keysize, C("backend_ndx"))) {
 		lua_pushinteger(L, st->backend_ndx + 1);
+	} else if (strleq(key, keysize, C("balance"))) {
+		lua_pushcfunction(L, proxy_connection_balance);
 	} else if ((con->server && (strleq(key, keysize, C("server")))) ||
 	           (con->client && (strleq(key, keysize, C("client"))))) {
 		network_socket **socket_p;
@@ -167,6 +222,8 @@ int network_mysqld_con_getmetatable(lua_State *L) {
  */
 void network_mysqld_lua_setup_global(lua_State *L , chassis_private *g) {
 	network_backends_t **backends_p;
+	network_global_kv_t **kv_p;
+	network_global_stats_t **stats_p;
 
 	int stack_top = lua_gettop(L);
 
@@ -205,6 +262,45 @@ void network_mysqld_lua_setup_global(lua_State *L , chassis_private *g) {
 
 	lua_setfield(L, -2, "backends");
 
+	/**
+	 * register proxy.global.kv[]
+	 *
+	 * each event-thread has its own proxy.global, values that have to be seen
+	 * by all threads are exchanged through proxy.global.kv. The scripts shipped
+	 * with the proxy keep their shared state in it and in proxy.global.stats.
+	 *
+	 * @see network_global_kv_lua_getmetatable()
+	 */
+	kv_p = lua_newuserdata(L, sizeof(network_global_kv_t *));
+	*kv_p = g->kv;
+
+	network_global_kv_lua_getmetatable(L);
+	lua_setmetatable(L, -2);
+
+	lua_setfield(L, -2, "kv");
+
+	/**
+	 * register proxy.global.stats
+	 *
+	 * @see network_global_stats_lua_getmetatable()
+	 */
+	stats_p = lua_newuserdata(L, sizeof(network_global_stats_t *));
+	*stats_p = g->stats;
+
+	network_global_stats_lua_getmetatable(L);
+	lua_setmetatable(L, -2);
+
+	lua_setfield(L, -2, "stats");
+
+	/**
+	 * the options in proxy.global.config.<module> are kept in proxy.global.kv
+	 *
+	 * @see network_global_kv_lua_share_config()
+	 */
+	lua_getfield(L, -1, "config");
+	network_global_kv_lua_share_config(L, g->kv);
+	lua_pop(L, 1);
+
 	lua_pop(L, 2);  /* _G.proxy.global and _G.proxy */
 
 	g_assert(lua_gettop(L) == stack_top);
@@ -252,7 +348,7 @@ int network_mysqld_lua_load_script(lua_scope *sc, const char *lua_script) {
  *
  * has to be called before any lua_pcall() is called to start a hook function
  *
- * - we use a global lua_State which is split into child-states with lua_newthread()
+ * - we use the lua_State of the connection's event-thread which is split into child-states with lua_newthread()
  * - luaL_ref() moves the state into the registry and cleans up the global stack
  * - on connection close we call luaL_unref() to hand the thread to the GC
  *
@@ -270,7 +366,7 @@ network_mysqld_register_callback_ret network_mysqld_con_lua_register_callback(ne
 	network_mysqld_con_lua_t *st   = con->plugin_con_state;
 	chassis_private *g = con->srv->priv; 
 
-	lua_scope  *sc = g->sc;
+	lua_scope  *sc = network_mysqld_con_get_lua_scope(con);
 
 	GQueue **q_p;
 	network_mysqld_con **con_p;
@@ -320,6 +416,7 @@ network_mysqld_register_callback_ret network_mysqld_con_lua_register_callback(ne
 	L = lua_newthread(sc->L);
 
 	st->L_ref = luaL_ref(sc->L, LUA_REGISTRYINDEX);
+	st->sc = sc;
 
 	stack_top = lua_gettop(L);
 
@@ -456,6 +553,32 @@ network_mysqld_register_callback_ret network_mysqld_con_lua_register_callback(ne
 	return REGISTER_CALLBACK_SUCCESS;
 }
 
+/**
+ * classify the first statement of a COM_QUERY packet
+ *
+ *   local stmt, is_for_update, is_calc_found_rows, is_insert_id = proxy.classify(packet)
+ *
+ * stmt is one of the proxy.STMT_* constants, proxy.STMT_UNKNOWN if the packet
+ * isn't a COM_QUERY
+ */
+static int network_mysqld_lua_classify(lua_State *L) {
+	size_t packet_len;
+	const char *packet = luaL_checklstring(L, 1, &packet_len);
+	network_mysqld_stmt_t stmt = NETWORK_MYSQLD_STMT_UNKNOWN;
+	guint flags = 0;
+
+	if (packet_len > 0 && packet[0] == COM_QUERY) {
+		stmt = network_mysqld_classify_query(packet + 1, packet_len - 1, &flags);
+	}
+
+	lua_pushinteger(L, stmt);
+	lua_pushboolean(L, flags & NETWORK_MYSQLD_STMT_FLAG_FOR_UPDATE);
+	lua_pushboolean(L, flags & NETWORK_MYSQLD_STMT_FLAG_SQL_CALC_FOUND_ROWS);
+	lua_pushboolean(L, flags & NETWORK_MYSQLD_STMT_FLAG_LAST_INSERT_ID);
+
+	return 4;
+}
+
 /**
  * init the global proxy object 
  */
@@ -547,6 +670,30 @@ void network_mysqld_lua_init_global_fenv(lua_State *L) {
 	DEF(MYSQL_TYPE_BIT);
 #endif
 
+#define DEF_STMT(x) \
+	lua_pushinteger(L, NETWORK_MYSQLD_STMT_##x); \
+	lua_setfield(L, -2, "STMT_" #x);
+
+	DEF_STMT(UNKNOWN);
+	DEF_STMT(SELECT);
+	DEF_STMT(INSERT);
+	DEF_STMT(UPDATE);
+	DEF_STMT(DELETE);
+	DEF_STMT(REPLACE);
+	DEF_STMT(BEGIN);
+	DEF_STMT(COMMIT);
+	DEF_STMT(ROLLBACK);
+	DEF_STMT(SET);
+	DEF_STMT(USE);
+	DEF_STMT(SHOW);
+	DEF_STMT(CALL);
+	DEF_STMT(DDL);
+	DEF_STMT(OTHER);
+#undef DEF_STMT
+
+	lua_pushcfunction(L, network_mysqld_lua_classify);
+	lua_setfield(L, -2, "classify");
+
 	/* cheat with DEF() a bit :) */
 #define PROXY_VERSION PACKAGE_VERSION_ID
 	DEF(PROXY_VERSION);
@@ -24,6 +24,9 @@
 
 #include "network-backend.h" /* query-status */
 #include "network-injection.h" /* query-status */
+#include "network-query-cache.h"
+#include "network-stmt-cache.h"
+#include "lua-scope.h"
 
 #include "network-exports.h"
 
@@ -63,9 +66,11 @@ typedef struct {
 
 	lua_State *L;                  /**< The Lua interpreter state of the current connection. */
 	int L_ref;                     /**< The reference into the lua_scope's registry (a global structure in the Lua interpreter) */
+	lua_scope *sc;                 /**< The lua_scope L was created in, the one of the connection's event-thread. */
 
 	network_backend_t *backend;
 	int backend_ndx;               /**< [lua] index into the backend-array */
+	network_backend_t *in_flight_backend; /**< the backend that has a query of this connection in flight, NULL if none */
 
 	gboolean connection_close;     /**< [lua] set by the lua code to close a connection */
 
@@ -78,6 +83,30 @@ typedef struct {
 	 * Flag indicating whether we injected a COM_CHANGE_USER packet on the proxy plugin side
 	 */
 	gboolean is_in_com_change_user;
+
+	network_query_cache_con *query_cache; /**< state of the query-cache, NULL if it is disabled */
+
+	network_stmt_con *stmts;       /**< the prepared statements of the client, NULL if they aren't multiplexed */
+
+	/**
+	 * the backend connection is returned to the pool between transactions
+	 */
+	int multiplex_backend_ndx;       /**< the backend the client is multiplexed on, -1 if it isn't */
+	gboolean multiplex_is_pinned;    /**< the session has state on the backend connection, it stays with the client */
+	gboolean multiplex_pin_next;     /**< the next statement depends on the connection of the last one (FOUND_ROWS(), LAST_INSERT_ID()) */
+	guint16 multiplex_server_status; /**< server-status of the last result */
+	GString *multiplex_held_packets; /**< the command that waits until the session of the backend connection is switched */
+	GQueue *multiplex_prelude;       /**< GString *, the commands that switch the session of the backend connection to the client's */
+	gboolean multiplex_is_waiting;   /**< the command waits for a pooled connection, multiplex_wait_timer is pending */
+	gboolean multiplex_wait_expired; /**< the command waited long enough, it fails if there is still no connection */
+	struct event multiplex_wait_timer; /**< ends the wait for a pooled connection */
+	GList *multiplex_wait_link;      /**< the link in the parked commands of the event-thread, NULL if it isn't parked there */
+
+	/**
+	 * the session-tracking of the backend connection, see network_socket->session
+	 */
+	GPtrArray *session_vars;         /**< gchar *, the system-variables the last SET changes, the server has to report them */
+	gboolean session_expects_schema; /**< the last query was a USE, the server has to report the schema */
 } network_mysqld_con_lua_t;
 
 NETWORK_API network_mysqld_con_lua_t *network_mysqld_con_lua_new();
@@ -44,6 +44,8 @@ network_mysqld_com_query_result_t *network_mysqld_com_query_result_new() {
 	com_query = g_new0(network_mysqld_com_query_result_t, 1);
 	com_query->state = PARSE_COM_QUERY_INIT;
 	com_query->query_status = MYSQLD_PACKET_NULL; /* can have 3 values: NULL for unknown, OK for a OK packet, ERR for a error-packet */
+	com_query->capabilities = CLIENT_PROTOCOL_41;
+	com_query->session_state = g_string_new(NULL);
 
 	return com_query;
 }
@@ -51,6 +53,8 @@ network_mysqld_com_query_result_t *network_mysqld_com_query_result_new() {
 void network_mysqld_com_query_result_free(network_mysqld_com_query_result_t *udata) {
 	if (!udata) return;
 
+	g_string_free(udata->session_state, TRUE);
+
 	g_free(udata);
 }
 
@@ -93,10 +97,14 @@ int network_mysqld_proto_get_com_query_result(network_packet *packet, network_my
 			query->query_status = MYSQLD_PACKET_OK;
 
 			ok_packet = network_mysqld_ok_packet_new();
+			ok_packet->capabilities = query->capabilities;
 
 			err = err || network_mysqld_proto_get_ok_packet(packet, ok_packet);
 
 			if (!err) {
+				/* each statement of a multi-statement reports its own changes */
+				g_string_append_len(query->session_state, S(ok_packet->session_state));
+
 				if (ok_packet->server_status & SERVER_MORE_RESULTS_EXISTS) {
 			
 				} else {
@@ -513,6 +521,11 @@ int network_mysqld_con_command_states_init(network_mysqld_con *con, network_pack
 	case COM_STMT_EXECUTE:
 		con->parse.data = network_mysqld_com_query_result_new();
 		con->parse.data_free = (GDestroyNotify)network_mysqld_com_query_result_free;
+
+		/* the plugin sets up the session-tracking of the server connection if it was negotiated */
+		if (con->server && con->server->session) {
+			((network_mysqld_com_query_result_t *)con->parse.data)->capabilities |= CLIENT_SESSION_TRACK;
+		}
 		break;
 	case COM_STMT_PREPARE:
 		con->parse.data = network_mysqld_com_stmt_prepare_result_new();
@@ -599,6 +612,7 @@ int network_mysqld_proto_get_query_result(network_packet *packet, network_mysqld
 	case COM_TIME:
 	case COM_REGISTER_SLAVE:
 	case COM_PROCESS_KILL:
+	case NETWORK_MYSQLD_COM_RESET_CONNECTION:
 		err = err || network_mysqld_proto_get_int8(packet, &status);
 		if (err) return -1;
 
@@ -893,6 +907,9 @@ network_mysqld_ok_packet_t *network_mysqld_ok_packet_new() {
 	network_mysqld_ok_packet_t *ok_packet;
 
 	ok_packet = g_new0(network_mysqld_ok_packet_t, 1);
+	ok_packet->capabilities = CLIENT_PROTOCOL_41;
+	ok_packet->info = g_string_new(NULL);
+	ok_packet->session_state = g_string_new(NULL);
 
 	return ok_packet;
 }
@@ -900,18 +917,24 @@ network_mysqld_ok_packet_t *network_mysqld_ok_packet_new() {
 void network_mysqld_ok_packet_free(network_mysqld_ok_packet_t *ok_packet) {
 	if (!ok_packet) return;
 
+	g_string_free(ok_packet->info, TRUE);
+	g_string_free(ok_packet->session_state, TRUE);
+
 	g_free(ok_packet);
 }
 
 
 /**
  * decode a OK packet from the network packet
+ *
+ * set ok_packet->capabilities to the negotiated capabilities before, with
+ * CLIENT_SESSION_TRACK the info is followed by the session-state changes
  */
 int network_mysqld_proto_get_ok_packet(network_packet *packet, network_mysqld_ok_packet_t *ok_packet) {
 	guint8 field_count;
 	guint64 affected, insert_id;
 	guint16 server_status, warning_count = 0;
-	guint32 capabilities = CLIENT_PROTOCOL_41;
+	guint32 capabilities = ok_packet->capabilities;
 
 	int err = 0;
 
@@ -932,6 +955,21 @@ int network_mysqld_proto_get_ok_packet(network_packet *packet, network_mysqld_ok
 		err = err || network_mysqld_proto_get_int16(packet, &warning_count);
 	}
 
+	g_string_truncate(ok_packet->info, 0);
+	g_string_truncate(ok_packet->session_state, 0);
+
+	if (capabilities & CLIENT_SESSION_TRACK) {
+		/* the info is length-encoded now and may be left out */
+		if (!err && network_packet_has_more_data(packet, 1)) {
+			err = err || network_mysqld_proto_get_lenenc_gstring(packet, ok_packet->info);
+		}
+		if (!err && (server_status & SERVER_SESSION_STATE_CHANGED)) {
+			err = err || network_mysqld_proto_get_lenenc_gstring(packet, ok_packet->session_state);
+		}
+	} else if (!err && network_packet_has_more_data(packet, 1)) {
+		err = err || network_mysqld_proto_get_gstring_len(packet, packet->data->len - packet->offset, ok_packet->info);
+	}
+
 	if (!err) {
 		ok_packet->affected_rows = affected;
 		ok_packet->insert_id     = insert_id;
@@ -943,7 +981,7 @@ int network_mysqld_proto_get_ok_packet(network_packet *packet, network_mysqld_ok
 }
 
 int network_mysqld_proto_append_ok_packet(GString *packet, network_mysqld_ok_packet_t *ok_packet) {
-	guint32 capabilities = CLIENT_PROTOCOL_41;
+	guint32 capabilities = ok_packet->capabilities;
 
 	network_mysqld_proto_append_int8(packet, 0); /* no fields */
 	network_mysqld_proto_append_lenenc_int(packet, ok_packet->affected_rows);
@@ -953,6 +991,17 @@ int network_mysqld_proto_append_ok_packet(GString *packet, network_mysqld_ok_pac
 		network_mysqld_proto_append_int16(packet, ok_packet->warnings); /* no warnings */
 	}
 
+	if (capabilities & CLIENT_SESSION_TRACK) {
+		if (ok_packet->info->len > 0 || (ok_packet->server_status & SERVER_SESSION_STATE_CHANGED)) {
+			network_mysqld_proto_append_lenenc_string_len(packet, S(ok_packet->info));
+		}
+		if (ok_packet->server_status & SERVER_SESSION_STATE_CHANGED) {
+			network_mysqld_proto_append_lenenc_string_len(packet, S(ok_packet->session_state));
+		}
+	} else {
+		g_string_append_len(packet, S(ok_packet->info));
+	}
+
 	return 0;
 }
 
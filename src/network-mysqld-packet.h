@@ -66,6 +66,9 @@ typedef struct {
 	guint64 bytes;
 
 	guint8  query_status;
+
+	guint32 capabilities;    /**< capabilities of the server connection, for the layout of the OK packets */
+	GString *session_state;  /**< the session-state changes of all OK packets of the result */
 } network_mysqld_com_query_result_t;
 
 NETWORK_API network_mysqld_com_query_result_t *network_mysqld_com_query_result_new(void);
@@ -119,6 +122,10 @@ typedef struct {
 	guint16 warnings;
 
 	gchar *msg;
+
+	guint32 capabilities;    /**< CLIENT_PROTOCOL_41 and CLIENT_SESSION_TRACK decide about the layout */
+	GString *info;           /**< the human readable info, e.g. "Rows matched: 1 ..." */
+	GString *session_state;  /**< the session-state changes, only with SERVER_SESSION_STATE_CHANGED */
 } network_mysqld_ok_packet_t;
 
 NETWORK_API network_mysqld_ok_packet_t *network_mysqld_ok_packet_new(void);
@@ -49,6 +49,25 @@
 #define COM_STMT_RESET          COM_RESET_STMT
 #endif
 
+/**
+ * session-state tracking of 5.7
+ *
+ * COM_RESET_CONNECTION is a enum in the mysql.h of 5.7, we use our own define
+ */
+#ifndef CLIENT_SESSION_TRACK
+#define CLIENT_SESSION_TRACK (1UL << 23)
+#endif
+#ifndef SERVER_SESSION_STATE_CHANGED
+#define SERVER_SESSION_STATE_CHANGED (1 << 14)
+#endif
+#define NETWORK_MYSQLD_COM_RESET_CONNECTION (0x1f)
+
+/* the types of the session-state info, a enum in the mysql.h of 5.7 too */
+#define NETWORK_MYSQLD_SESSION_TRACK_SYSTEM_VARIABLES (0)
+#define NETWORK_MYSQLD_SESSION_TRACK_SCHEMA           (1)
+#define NETWORK_MYSQLD_SESSION_TRACK_STATE_CHANGE     (2)
+#define NETWORK_MYSQLD_SESSION_TRACK_GTIDS            (3)
+
 #define MYSQLD_PACKET_OK   (0)
 #define MYSQLD_PACKET_RAW  (0xfa) /* used for proxy.response.type only */
 #define MYSQLD_PACKET_NULL (0xfb) /* 0xfb */
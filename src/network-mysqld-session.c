@@ -0,0 +1,340 @@
+/* $%BEGINLICENSE%$
+ Copyright (c) 2008, 2012, Oracle and/or its affiliates. All rights reserved.
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License as
+ published by the Free Software Foundation; version 2 of the
+ License.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ 02110-1301  USA
+
+ $%ENDLICENSE%$ */
+
+/**
+ * the session-state a server reports with CLIENT_SESSION_TRACK
+ *
+ * the OK packets carry the changes of the session as a list of entries:
+ *
+ *   type (1 byte), length-encoded data
+ *
+ * with the data of a SESSION_TRACK_SYSTEM_VARIABLES being a length-encoded name
+ * and value and the one of SESSION_TRACK_SCHEMA the length-encoded name of the
+ * new default-db.
+ *
+ * the server only reports the system-variables that are in its
+ * session_track_system_variables. A pooled connection whose session has the
+ * same fingerprint as the one a client expects can be handed out as is, if the
+ * client only expects more changes they can be replayed with a single SET.
+ */
+
+#include <string.h>
+
+#include <glib.h>
+
+#include "network-mysqld-proto.h"
+#include "network-mysqld-session.h"
+#include "glib-ext.h"
+
+#define S(x) x->str, x->len
+
+network_mysqld_session *network_mysqld_session_new(void) {
+	network_mysqld_session *session;
+
+	session = g_new0(network_mysqld_session, 1);
+	session->sysvars = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+	session->gtids = g_string_new(NULL);
+
+	return session;
+}
+
+void network_mysqld_session_free(network_mysqld_session *session) {
+	if (!session) return;
+
+	g_hash_table_destroy(session->sysvars);
+	g_string_free(session->gtids, TRUE);
+
+	g_free(session);
+}
+
+/**
+ * forget all changes
+ *
+ * call it when the server resets the session (COM_CHANGE_USER, COM_RESET_CONNECTION)
+ */
+void network_mysqld_session_clear(network_mysqld_session *session) {
+	g_hash_table_remove_all(session->sysvars);
+	session->fingerprint = 0;
+	g_string_truncate(session->gtids, 0);
+	session->is_unknown = FALSE;
+}
+
+static void network_mysqld_session_copy_sysvar(gpointer name, gpointer value, gpointer dst) {
+	network_mysqld_session_set_sysvar(dst, name, value);
+}
+
+void network_mysqld_session_copy(network_mysqld_session *dst, network_mysqld_session *src) {
+	network_mysqld_session_clear(dst);
+
+	g_hash_table_foreach(src->sysvars, network_mysqld_session_copy_sysvar, dst);
+	g_string_assign_len(dst->gtids, S(src->gtids));
+	dst->is_unknown = src->is_unknown;
+}
+
+static guint network_mysqld_session_sysvar_hash(const gchar *name, const gchar *value) {
+	return g_str_hash(name) ^ (g_str_hash(value) * 33);
+}
+
+/**
+ * remember the value of a system-variable
+ *
+ * @return 1 if the value changed, 0 otherwise
+ */
+int network_mysqld_session_set_sysvar(network_mysqld_session *session, const gchar *name, const gchar *value) {
+	const gchar *old_value;
+
+	if ((old_value = g_hash_table_lookup(session->sysvars, name))) {
+		if (0 == strcmp(old_value, value)) return 0;
+
+		session->fingerprint ^= network_mysqld_session_sysvar_hash(name, old_value);
+	}
+
+	session->fingerprint ^= network_mysqld_session_sysvar_hash(name, value);
+	g_hash_table_replace(session->sysvars, g_strdup(name), g_strdup(value));
+
+	return 1;
+}
+
+/**
+ * get a length-encoded string of the session-state
+ *
+ * @return -1 if it doesn't fit into the data
+ */
+static int network_mysqld_session_get_lenenc_string(const char **cur, const char *end, const char **s, gsize *s_len) {
+	guint64 len;
+	gsize bytes;
+
+	if (*cur >= end) return -1;
+
+	switch ((guint8)**cur) {
+	case 0xfc: bytes = 2; break;
+	case 0xfd: bytes = 3; break;
+	case 0xfe: bytes = 8; break;
+	case 0xfb:
+	case 0xff: return -1;
+	default:   bytes = 0; break;
+	}
+
+	if (bytes == 0) {
+		len = (guint8)**cur;
+		(*cur)++;
+	} else {
+		gsize i;
+
+		if ((gsize)(end - *cur) < bytes + 1) return -1;
+
+		for (i = bytes, len = 0; i > 0; i--) {
+			len = (len << 8) | (guint8)(*cur)[i];
+		}
+		*cur += bytes + 1;
+	}
+
+	if (len > (guint64)(end - *cur)) return -1;
+
+	*s = *cur;
+	*s_len = len;
+	*cur += len;
+
+	return 0;
+}
+
+/**
+ * apply the session-state changes of a OK packet
+ *
+ * @param state      the session-state info of the OK packet
+ * @param schema     (out) the new default-db, if it was reported. May be NULL
+ * @param sysvars    (out) a copy of the name of each reported system-variable is added. May be NULL
+ * @return -1 on a malformed session-state, otherwise (1 << type) of each reported type
+ */
+int network_mysqld_session_apply(network_mysqld_session *session, const char *state, gsize state_len, GString *schema, GPtrArray *sysvars) {
+	const char *cur = state, *end = state + state_len;
+	int types = 0;
+
+	while (cur < end) {
+		guint8 type = *cur++;
+		const char *data, *data_end;
+		gsize data_len;
+
+		if (0 != network_mysqld_session_get_lenenc_string(&cur, end, &data, &data_len)) return -1;
+		data_end = data + data_len;
+
+		switch (type) {
+		case NETWORK_MYSQLD_SESSION_TRACK_SYSTEM_VARIABLES: {
+			const char *name, *value;
+			gsize name_len, value_len;
+			gchar *name_str, *value_str;
+
+			if (0 != network_mysqld_session_get_lenenc_string(&data, data_end, &name, &name_len) ||
+			    0 != network_mysqld_session_get_lenenc_string(&data, data_end, &value, &value_len)) {
+				return -1;
+			}
+
+			name_str = g_strndup(name, name_len);
+			value_str = g_strndup(value, value_len);
+
+			network_mysqld_session_set_sysvar(session, name_str, value_str);
+			if (sysvars) g_ptr_array_add(sysvars, g_strdup(name_str));
+
+			g_free(value_str);
+			g_free(name_str);
+
+			break; }
+		case NETWORK_MYSQLD_SESSION_TRACK_SCHEMA: {
+			const char *name;
+			gsize name_len;
+
+			if (0 != network_mysqld_session_get_lenenc_string(&data, data_end, &name, &name_len)) return -1;
+
+			if (schema) g_string_assign_len(schema, name, name_len);
+
+			break; }
+		case NETWORK_MYSQLD_SESSION_TRACK_GTIDS: {
+			const char *gtids;
+			gsize gtids_len;
+
+			/* the encoding-specification is followed by the GTIDs */
+			if (data_len < 1) return -1;
+			data++;
+
+			if (0 != network_mysqld_session_get_lenenc_string(&data, data_end, &gtids, &gtids_len)) return -1;
+
+			g_string_assign_len(session->gtids, gtids, gtids_len);
+
+			break; }
+		default:
+			/* STATE_CHANGE only says that something changed, the transaction-state isn't tracked */
+			break;
+		}
+
+		if (type < 32) types |= 1 << type;
+	}
+
+	return types;
+}
+
+/**
+ * check if all system-variables of a have the same value in b
+ */
+gboolean network_mysqld_session_is_subset(network_mysqld_session *a, network_mysqld_session *b) {
+	GHashTableIter iter;
+	gpointer name, value;
+
+	if (g_hash_table_size(a->sysvars) > g_hash_table_size(b->sysvars)) return FALSE;
+
+	g_hash_table_iter_init(&iter, a->sysvars);
+	while (g_hash_table_iter_next(&iter, &name, &value)) {
+		const gchar *b_value = g_hash_table_lookup(b->sysvars, name);
+
+		if (NULL == b_value || 0 != strcmp(value, b_value)) return FALSE;
+	}
+
+	return TRUE;
+}
+
+/**
+ * check if two sessions have the same system-variables
+ *
+ * the fingerprints are compared first
+ */
+gboolean network_mysqld_session_is_equal(network_mysqld_session *a, network_mysqld_session *b) {
+	if (a->fingerprint != b->fingerprint) return FALSE;
+	if (g_hash_table_size(a->sysvars) != g_hash_table_size(b->sysvars)) return FALSE;
+
+	return network_mysqld_session_is_subset(a, b);
+}
+
+/**
+ * check if a value can be used in a SET without quoting
+ */
+static gboolean network_mysqld_session_is_number(const gchar *value) {
+	const gchar *cur = value;
+
+	if (*cur == '-') cur++;
+	if (*cur == '\0') return FALSE;
+
+	for (; *cur; cur++) {
+		if (!g_ascii_isdigit(*cur)) return FALSE;
+	}
+
+	return TRUE;
+}
+
+static gint network_mysqld_session_strcmp(gconstpointer a, gconstpointer b) {
+	return strcmp(*(const gchar **)a, *(const gchar **)b);
+}
+
+/**
+ * build the SET that moves a session to the system-variables of the target
+ *
+ * only the variables that have a different value in the session are set. The
+ * session has to be a subset of the target, a variable can't be set back to
+ * its default as we don't know it.
+ *
+ * @param query  "SET SESSION name = value, ..." is appended to it, if anything differs
+ * @return the number of system-variables in the SET
+ */
+int network_mysqld_session_append_set_query(network_mysqld_session *session, network_mysqld_session *target, GString *query) {
+	GHashTableIter iter;
+	gpointer name, value;
+	GPtrArray *names;
+	guint i;
+
+	names = g_ptr_array_new();
+
+	g_hash_table_iter_init(&iter, target->sysvars);
+	while (g_hash_table_iter_next(&iter, &name, &value)) {
+		const gchar *session_value = g_hash_table_lookup(session->sysvars, name);
+
+		if (NULL == session_value || 0 != strcmp(value, session_value)) {
+			g_ptr_array_add(names, name);
+		}
+	}
+
+	/* the same SET for the same sessions */
+	g_ptr_array_sort(names, network_mysqld_session_strcmp);
+
+	for (i = 0; i < names->len; i++) {
+		const gchar *cur;
+
+		name = names->pdata[i];
+		value = g_hash_table_lookup(target->sysvars, name);
+
+		g_string_append(query, i == 0 ? "SET SESSION " : ", ");
+		g_string_append(query, name);
+		g_string_append(query, " = ");
+
+		if (network_mysqld_session_is_number(value)) {
+			g_string_append(query, value);
+			continue;
+		}
+
+		g_string_append_c(query, '\'');
+		for (cur = value; *cur; cur++) {
+			if (*cur == '\'' || *cur == '\\') g_string_append_c(query, '\\');
+			g_string_append_c(query, *cur);
+		}
+		g_string_append_c(query, '\'');
+	}
+
+	i = names->len;
+	g_ptr_array_free(names, TRUE);
+
+	return i;
+}
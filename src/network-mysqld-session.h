@@ -0,0 +1,57 @@
+/* $%BEGINLICENSE%$
+ Copyright (c) 2008, 2012, Oracle and/or its affiliates. All rights reserved.
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License as
+ published by the Free Software Foundation; version 2 of the
+ License.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ 02110-1301  USA
+
+ $%ENDLICENSE%$ */
+
+
+#ifndef _NETWORK_MYSQLD_SESSION_H_
+#define _NETWORK_MYSQLD_SESSION_H_
+
+#include <glib.h>
+
+#include "network-exports.h"
+
+/**
+ * the session-state of a connection as reported by the server (CLIENT_SESSION_TRACK)
+ *
+ * only the system-variables that changed since the connection was authed are
+ * known. The fingerprint is over the system-variables only, the schema is the
+ * default_db of the network_socket.
+ */
+typedef struct {
+	GHashTable *sysvars;  /**< hash<gchar *, gchar *>, the value of each system-variable the server reported */
+	guint fingerprint;    /**< XOR of the hashes of all name=value pairs */
+
+	GString *gtids;       /**< the GTIDs of the last transaction, if the server reports them */
+
+	gboolean is_unknown;  /**< the session has state we can't track: user-variables, temp-tables, ... */
+} network_mysqld_session;
+
+NETWORK_API network_mysqld_session *network_mysqld_session_new(void);
+NETWORK_API void network_mysqld_session_free(network_mysqld_session *session);
+NETWORK_API void network_mysqld_session_clear(network_mysqld_session *session);
+NETWORK_API void network_mysqld_session_copy(network_mysqld_session *dst, network_mysqld_session *src);
+
+NETWORK_API int network_mysqld_session_set_sysvar(network_mysqld_session *session, const gchar *name, const gchar *value);
+NETWORK_API int network_mysqld_session_apply(network_mysqld_session *session, const char *state, gsize state_len, GString *schema, GPtrArray *sysvars);
+
+NETWORK_API gboolean network_mysqld_session_is_equal(network_mysqld_session *a, network_mysqld_session *b);
+NETWORK_API gboolean network_mysqld_session_is_subset(network_mysqld_session *a, network_mysqld_session *b);
+NETWORK_API int network_mysqld_session_append_set_query(network_mysqld_session *session, network_mysqld_session *target, GString *query);
+
+#endif
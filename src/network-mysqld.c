@@ -127,14 +127,17 @@
 network_socket_retval_t plugin_call_cleanup(chassis *srv, network_mysqld_con *con) {
 	NETWORK_MYSQLD_PLUGIN_FUNC(func) = NULL;
 	network_socket_retval_t retval = NETWORK_SOCKET_SUCCESS;
+	lua_scope *sc;
 
 	func = con->plugins.con_cleanup;
 	
 	if (!func) return retval;
 
-	LOCK_LUA(srv->priv->sc);
+	sc = network_mysqld_con_get_lua_scope(con);
+
+	LOCK_LUA(sc);
 	retval = (*func)(srv, con);
-	UNLOCK_LUA(srv->priv->sc);
+	UNLOCK_LUA(sc);
 
 	return retval;
 }
@@ -151,6 +154,7 @@ static network_socket_retval_t
 plugin_call_timeout(chassis *srv, network_mysqld_con *con) {
 	NETWORK_MYSQLD_PLUGIN_FUNC(func) = NULL;
 	network_socket_retval_t retval = NETWORK_SOCKET_ERROR;
+	lua_scope *sc;
 
 	func = con->plugins.con_timeout;
 	
@@ -164,9 +168,11 @@ plugin_call_timeout(chassis *srv, network_mysqld_con *con) {
 		return NETWORK_SOCKET_SUCCESS;
 	}
 
-	LOCK_LUA(srv->priv->sc);
+	sc = network_mysqld_con_get_lua_scope(con);
+
+	LOCK_LUA(sc);
 	retval = (*func)(srv, con);
-	UNLOCK_LUA(srv->priv->sc);
+	UNLOCK_LUA(sc);
 
 	return retval;
 }
@@ -177,35 +183,65 @@ chassis_private *network_mysqld_priv_init(void) {
 
 	priv = g_new0(chassis_private, 1);
 
-	priv->cons = g_ptr_array_new();
+	priv->cons = network_connection_registry_new();
 	priv->sc = lua_scope_new();
 	priv->backends  = network_backends_new();
+	priv->kv        = network_global_kv_new();
+	priv->stats     = network_global_stats_new();
 
 	return priv;
 }
 
+/**
+ * get the lua-scope the plugins of a connection have to use
+ *
+ * each event-thread has its own lua-scope which allows the lua-code of different
+ * connections to run in parallel. A connection is pinned to its event-thread and
+ * always uses the lua-scope of that thread.
+ *
+ * connections that aren't assigned to a event-thread yet use the global lua-scope
+ *
+ * @see network_mysqld_con_handle()
+ */
+lua_scope *network_mysqld_con_get_lua_scope(network_mysqld_con *con) {
+	if (con->event_thread && con->event_thread->sc) return con->event_thread->sc;
+
+	return con->srv->priv->sc;
+}
+
 void network_mysqld_priv_shutdown(chassis *chas, chassis_private *priv) {
+	GPtrArray *cons;
+	guint i;
+
 	if (!priv) return;
 
-	/* network_mysqld_con_free() changes the priv->cons directly
+	/* the event-threads are joined already, nothing else frees connections behind our back
 	 *
-	 * always free the first element until all are gone 
+	 * network_mysqld_con_free() removes the connection from priv->cons directly,
+	 * work on a copy instead of searching the shards for the next one each round
 	 */
-	while (0 != priv->cons->len) {
-		network_mysqld_con *con = priv->cons->pdata[0];
+	cons = network_connection_registry_snapshot(priv->cons);
+	for (i = 0; i < cons->len; i++) {
+		network_mysqld_con *con = cons->pdata[i];
 
 		plugin_call_cleanup(chas, con);
 		network_mysqld_con_free(con);
 	}
+	g_ptr_array_free(cons, TRUE);
+
+	g_assert_cmpint(network_connection_registry_count(priv->cons), ==, 0);
 }
 
 void network_mysqld_priv_free(chassis G_GNUC_UNUSED *chas, chassis_private *priv) {
 	if (!priv) return;
 
-	g_ptr_array_free(priv->cons, TRUE);
+	network_connection_registry_free(priv->cons);
 
 	network_backends_free(priv->backends);
 
+	network_global_kv_free(priv->kv);
+	network_global_stats_free(priv->stats);
+
 	lua_scope_free(priv->sc);
 
 	g_free(priv);
@@ -217,6 +253,9 @@ int network_mysqld_init(chassis *srv) {
 	srv->priv_shutdown = network_mysqld_priv_shutdown;
 	srv->priv      = network_mysqld_priv_init();
 
+	/* the replaced snapshots of the backends are freed once the event-threads left them */
+	srv->priv->backends->threads = srv->threads;
+
 	/* store the pointer to the chassis in the Lua registry */
 	L = srv->priv->sc->L;
 	lua_pushlightuserdata(L, (void*)srv);
@@ -229,6 +268,14 @@ int network_mysqld_init(chassis *srv) {
 network_mysqld_con *network_mysqld_con_init() {
 	return network_mysqld_con_new();
 }
+/**
+ * bounds of the adaptive flush-threshold for forwarding a result-set
+ *
+ * @see network_mysqld_con::flush_threshold
+ */
+#define NETWORK_MYSQLD_FLUSH_THRESHOLD_MIN (8 * 1024)
+#define NETWORK_MYSQLD_FLUSH_THRESHOLD_MAX (256 * 1024)
+
 /**
  * create a connection 
  *
@@ -243,6 +290,7 @@ network_mysqld_con *network_mysqld_con_new() {
 	con->auth_switch_to_method = g_string_new(NULL);
 	con->auth_switch_to_round  = 0;
 	con->auth_switch_to_data   = g_string_new(NULL);;
+	con->flush_threshold       = NETWORK_MYSQLD_FLUSH_THRESHOLD_MIN;
 
 	/* some tiny helper macros */
 #define SECONDS ( 1 )
@@ -266,7 +314,7 @@ network_mysqld_con *network_mysqld_con_new() {
 void network_mysqld_add_connection(chassis *srv, network_mysqld_con *con) {
 	con->srv = srv;
 
-	g_ptr_array_add(srv->priv->cons, con);
+	con->registry_entry = network_connection_registry_add(srv->priv->cons, con);
 }
 
 /**
@@ -286,12 +334,16 @@ void network_mysqld_con_free(network_mysqld_con *con) {
 	if (con->server) network_socket_free(con->server);
 	if (con->client) network_socket_free(con->client);
 
+#ifdef HAVE_SPLICE
+	if (con->splice) network_socket_splice_free(con->splice);
+#endif
+
 	g_string_free(con->auth_switch_to_method, TRUE);
 	g_string_free(con->auth_switch_to_data, TRUE);
 
 	/* we are still in the conns-array */
 
-	g_ptr_array_remove_fast(con->srv->priv->cons, con);
+	if (con->registry_entry) network_connection_registry_remove(con->srv->priv->cons, con->registry_entry);
 	chassis_timestamps_free(con->timestamps);
 
 	g_free(con);
@@ -324,6 +376,9 @@ static void dump_str(const char *msg, const unsigned char *s, size_t len) {
 int network_mysqld_queue_reset(network_socket *sock) {
 	sock->packet_id_is_reset = TRUE;
 
+	/* the frames of the compressed protocol start a new sequence with the command too */
+	if (sock->compress) sock->compress->packet_id_is_reset = TRUE;
+
 	return 0;
 }
 
@@ -667,6 +722,7 @@ network_socket_retval_t network_mysqld_write(chassis G_GNUC_UNUSED*chas, network
 network_socket_retval_t plugin_call(chassis *srv, network_mysqld_con *con, int state) {
 	network_socket_retval_t ret;
 	NETWORK_MYSQLD_PLUGIN_FUNC(func) = NULL;
+	lua_scope *sc;
 
 	switch (state) {
 	case CON_STATE_INIT:
@@ -724,7 +780,17 @@ network_socket_retval_t plugin_call(chassis *srv, network_mysqld_con *con, int s
 			 */
 			switch (con->auth_result_state) {
 			case MYSQLD_PACKET_OK:
-				/* OK, delivered to client, switch to command phase */
+				/* OK, delivered to client, switch to command phase
+				 *
+				 * if the plugin offered CLIENT_COMPRESS and the client took it, 
+				 * everything after the OK is compressed */
+				if (con->client->challenge && con->client->response &&
+				    (con->client->challenge->capabilities & CLIENT_COMPRESS) &&
+				    (con->client->response->client_capabilities & CLIENT_COMPRESS) &&
+				    0 != network_socket_set_compressed(con->client)) {
+					con->state = CON_STATE_ERROR;
+					break;
+				}
 				con->state = CON_STATE_READ_QUERY;
 				break;
 			case MYSQLD_PACKET_ERR:
@@ -888,9 +954,11 @@ network_socket_retval_t plugin_call(chassis *srv, network_mysqld_con *con, int s
 	}
 	if (!func) return NETWORK_SOCKET_SUCCESS;
 
-	LOCK_LUA(srv->priv->sc);
+	sc = network_mysqld_con_get_lua_scope(con);
+
+	LOCK_LUA(sc);
 	ret = (*func)(srv, con);
-	UNLOCK_LUA(srv->priv->sc);
+	UNLOCK_LUA(sc);
 
 	return ret;
 }
@@ -1014,6 +1082,133 @@ static int network_mysqld_con_track_auth_result_state(network_mysqld_con *con) {
 	return err ? -1 : 0;
 }
 
+#ifdef HAVE_SPLICE
+/**
+ * row-packets bigger than this are spliced if the resultset isn't needed
+ */
+#define NETWORK_MYSQLD_SPLICE_MIN_PACKET_LEN (64 * 1024)
+
+/**
+ * check if the rest of the next packet from the server can be spliced to the client
+ *
+ * only rows of resultsets the plugin doesn't need or copy are spliced, if they are big and 
+ * not received completely yet. We only track the packet boundaries and count the 
+ * rows like network_mysqld_proto_get_com_query_result() would do.
+ *
+ * the part of the packet that is already in the recv_queue_raw is moved to the 
+ * send-queue of the client.
+ *
+ * @return TRUE if the rest of the packet shall be spliced
+ */
+static gboolean network_mysqld_con_splice_start(network_mysqld_con *con) {
+	network_socket *recv_sock = con->server;
+	network_socket *send_sock = con->client;
+	network_mysqld_com_query_result_t *com_query;
+	GString header;
+	char header_str[NET_HEADER_SIZE + 2] = "";
+	GString *chunk;
+	guint32 packet_len;
+	guint8  packet_id;
+
+	if (con->resultset_is_needed || con->resultset_is_finished || con->resultset_is_copied) return FALSE;
+	if (con->parse.command != COM_QUERY && con->parse.command != COM_STMT_EXECUTE) return FALSE;
+	if (NULL == (com_query = con->parse.data)) return FALSE;
+	if (com_query->state != PARSE_COM_QUERY_RESULT) return FALSE; /* only the rows */
+	if (recv_sock->recv_queue->chunks->length > 0) return FALSE; /* the plugin hasn't forwarded everything yet */
+	if (recv_sock->compress || send_sock->compress) return FALSE; /* the frames have to go through zlib */
+
+	header.str = header_str;
+	header.allocated_len = sizeof(header_str);
+	header.len = 0;
+
+	/* the packet-header and the first byte of the payload */
+	if (!network_queue_peek_string(recv_sock->recv_queue_raw, NET_HEADER_SIZE + 1, &header)) {
+		return FALSE;
+	}
+
+	packet_len = network_mysqld_proto_get_packet_len(&header);
+	packet_id  = network_mysqld_proto_get_packet_id(&header);
+
+	if (packet_len < NETWORK_MYSQLD_SPLICE_MIN_PACKET_LEN) return FALSE;
+	if (recv_sock->recv_queue_raw->len >= packet_len + NET_HEADER_SIZE) return FALSE; /* we have it already */
+
+	/* a ERR packet ends the resultset and has to go through the parser. 
+	 * A EOF packet is never that big. */
+	if ((guint8)header.str[NET_HEADER_SIZE] == MYSQLD_PACKET_ERR) return FALSE;
+
+	/* let network_mysqld_con_get_packet() complain about out-of-sync packet-ids */
+	if (!recv_sock->packet_id_is_reset && packet_id != (guint8)(recv_sock->last_packet_id + 1)) return FALSE;
+
+	if (NULL == con->splice && NULL == (con->splice = network_socket_splice_new())) return FALSE;
+
+	recv_sock->last_packet_id = packet_id;
+	recv_sock->packet_id_is_reset = FALSE;
+
+	/* the raw-queue only contains the start of this packet */
+	chunk = network_queue_pop_string(recv_sock->recv_queue_raw, recv_sock->recv_queue_raw->len, NULL);
+
+	/* track the packet-id on the client side like network_mysqld_queue_append_raw() */
+	if (send_sock->packet_id_is_reset) {
+		send_sock->last_packet_id = packet_id;
+		send_sock->packet_id_is_reset = FALSE;
+	} else {
+		send_sock->last_packet_id++;
+		network_mysqld_proto_set_packet_id(chunk, send_sock->last_packet_id);
+	}
+
+	con->splice->to_read = packet_len + NET_HEADER_SIZE - chunk->len;
+
+	network_queue_append(send_sock->send_queue, chunk);
+
+	/* a row of 16M or more continues in the next packet, count it at its last packet */
+	if (packet_len < PACKET_LEN_MAX) com_query->rows++;
+	com_query->bytes += packet_len + NET_HEADER_SIZE;
+
+	return TRUE;
+}
+
+/**
+ * splice the rest of the current packet from the server to the client
+ *
+ * the data that is already in the send-queue of the client is sent first
+ *
+ * @param wait_sock  socket to wait on if we return NETWORK_SOCKET_WAIT_FOR_EVENT
+ * @param wait_ev    event to wait for if we return NETWORK_SOCKET_WAIT_FOR_EVENT
+ */
+static network_socket_retval_t network_mysqld_con_splice(chassis *srv, network_mysqld_con *con, network_socket **wait_sock, short *wait_ev) {
+	network_socket_retval_t ret;
+
+	if (con->client->send_queue->len > 0) {
+		switch ((ret = network_mysqld_write(srv, con->client))) {
+		case NETWORK_SOCKET_SUCCESS:
+			break;
+		case NETWORK_SOCKET_WAIT_FOR_EVENT:
+			*wait_sock = con->client;
+			*wait_ev   = EV_WRITE;
+			return ret;
+		default:
+			return NETWORK_SOCKET_ERROR;
+		}
+	}
+
+	switch ((ret = network_socket_splice(con->splice, con->server, con->client))) {
+	case NETWORK_SOCKET_WAIT_FOR_EVENT:
+		if (con->splice->in_pipe > 0) {
+			*wait_sock = con->client;
+			*wait_ev   = EV_WRITE;
+		} else {
+			*wait_sock = con->server;
+			*wait_ev   = EV_READ;
+		}
+		break;
+	default:
+		break;
+	}
+
+	return ret;
+}
+#endif
+
 /**
  * handle the different states of the MySQL protocol
  *
@@ -1032,6 +1227,49 @@ void network_mysqld_con_handle(int event_fd, short events, void *user_data) {
 	g_assert(con);
 
 	if (events == EV_READ) {
+#ifdef NETWORK_SOCKET_USE_READ_ALL
+		network_socket *sock = NULL;
+
+		if (con->client && event_fd == con->client->fd) {
+			sock = con->client;
+		} else if (con->server && event_fd == con->server->fd) {
+			sock = con->server;
+		} else {
+			g_error("%s.%d: neither nor", __FILE__, __LINE__);
+		}
+
+		/**
+		 * read all we can get into the recv_queue_raw 
+		 *
+		 * sock->to_read stays 0 and network_mysqld_read() only has to split the raw queue
+		 * into packets
+		 *
+		 * recv() 
+		 * - returns 0 if connection is closed
+		 * - or -1 and ECONNRESET
+		 */
+#ifdef HAVE_SPLICE
+		if (sock == con->server && con->splice && con->splice->to_read > 0) {
+			/* leave the data in the kernel, network_mysqld_con_splice() moves it */
+		} else
+#endif
+		switch (network_socket_read_all(sock)) {
+		case NETWORK_SOCKET_SUCCESS:
+		case NETWORK_SOCKET_WAIT_FOR_EVENT: /* nothing to read, the state-machine will wait again */
+			break;
+		default:
+			if (sock == con->client) {
+				/* the client closed the connection, let's keep the server side open */
+				con->state = CON_STATE_CLOSE_CLIENT;
+			} else if (con->com_quit_seen) {
+				con->state = CON_STATE_CLOSE_SERVER;
+			} else {
+				/* server side closed on use, oops, close both sides */
+				con->state = CON_STATE_ERROR;
+			}
+			break;
+		}
+#else
 		int b = -1;
 
 		/**
@@ -1081,6 +1319,7 @@ void network_mysqld_con_handle(int event_fd, short events, void *user_data) {
 				con->state = CON_STATE_ERROR;
 			}
 		}
+#endif
 	} else if (events == EV_TIMEOUT) {
 		/* if we got a timeout on CON_STATE_CONNECT_SERVER we should pick another backend */
 		switch ((retval = plugin_call_timeout(srv, con))) {
@@ -1095,7 +1334,17 @@ void network_mysqld_con_handle(int event_fd, short events, void *user_data) {
 
 #define WAIT_FOR_EVENT(ev_struct, ev_type, timeout) \
 	event_set(&(ev_struct->event), ev_struct->fd, ev_type, network_mysqld_con_handle, user_data); \
-	chassis_event_add_with_timeout(srv, &(ev_struct->event), timeout); 
+	chassis_event_thread_add_with_timeout(con->event_thread, &(ev_struct->event), timeout); 
+
+	/**
+	 * pin the connection to a event-thread
+	 *
+	 * new connections are spread round-robin over the event-threads, afterwards
+	 * all events of the connection stay in that thread
+	 */
+	if (NULL == con->event_thread) {
+		con->event_thread = chassis_event_threads_get_next(srv->threads);
+	}
 
 	/**
 	 * loop on the same connection as long as we don't end up in a stable state
@@ -1567,7 +1816,10 @@ void network_mysqld_con_handle(int event_fd, short events, void *user_data) {
 
 			g_assert(events == 0 || event_fd == recv_sock->fd);
 
-			do { 
+			if (con->command_is_parked) {
+				/* the command is still in the recv-queue, hand it to the plugin again */
+				con->command_is_parked = FALSE;
+			} else do { 
 				switch (network_mysqld_read(srv, recv_sock)) {
 				case NETWORK_SOCKET_SUCCESS:
 					break;
@@ -1617,6 +1869,11 @@ void network_mysqld_con_handle(int event_fd, short events, void *user_data) {
 			switch (plugin_call(srv, con, con->state)) {
 			case NETWORK_SOCKET_SUCCESS:
 				break;
+			case NETWORK_SOCKET_WAIT_FOR_EVENT:
+				/* the plugin parked the command and calls network_mysqld_con_handle() once it can go on */
+				con->command_is_parked = TRUE;
+				NETWORK_MYSQLD_CON_TRACK_TIME(con, "wait_for_event::read_query_parked");
+				return;
 			default:
 				g_critical("%s.%d: plugin_call(CON_STATE_READ_QUERY) failed", __FILE__, __LINE__);
 
@@ -1650,20 +1907,23 @@ void network_mysqld_con_handle(int event_fd, short events, void *user_data) {
 			 * this state will loop until all the packets from the send-queue are flushed 
 			 */
 
-			if (con->server->send_queue->offset == 0) {
+			if (!con->command_is_tracked) {
 				/* only parse the packets once */
 				network_packet packet;
 
 				packet.data = g_queue_peek_head(con->server->send_queue->chunks);
 				packet.offset = 0;
 
-				if (0 != network_mysqld_con_command_states_init(con, &packet)) {
+				if (NULL == packet.data ||
+				    0 != network_mysqld_con_command_states_init(con, &packet)) {
 					g_debug("%s: tracking mysql protocol states failed",
 							G_STRLOC);
 					con->state = CON_STATE_ERROR;
 
 					break;
 				}
+
+				con->command_is_tracked = TRUE;
 			}
 	
 			switch (network_mysqld_write(srv, con->server)) {
@@ -1688,6 +1948,9 @@ void network_mysqld_con_handle(int event_fd, short events, void *user_data) {
 			
 			if (con->state != ostate) break; /* the state has changed (e.g. CON_STATE_ERROR) */
 
+			/* the next command is parsed again */
+			con->command_is_tracked = FALSE;
+
 			/* some statements don't have a server response */
 			switch (con->parse.command) {
 			case COM_STMT_SEND_LONG_DATA: /* not acked */
@@ -1698,6 +1961,9 @@ void network_mysqld_con_handle(int event_fd, short events, void *user_data) {
 				break;
 			default:
 				con->state = CON_STATE_READ_QUERY_RESULT;
+
+				/* a new result-set, start with a small flush-threshold again */
+				con->flush_threshold = NETWORK_MYSQLD_FLUSH_THRESHOLD_MIN;
 				break;
 			}
 				
@@ -1712,12 +1978,38 @@ void network_mysqld_con_handle(int event_fd, short events, void *user_data) {
 
 				recv_sock = con->server;
 
-				g_assert(events == 0 || event_fd == recv_sock->fd);
+				g_assert(events == 0 || event_fd == recv_sock->fd || (con->splice && event_fd == con->client->fd));
+
+#ifdef HAVE_SPLICE
+				if (con->splice && (con->splice->to_read > 0 || con->splice->in_pipe > 0)) {
+					network_socket *wait_sock = NULL;
+					short wait_ev = 0;
+
+					switch (network_mysqld_con_splice(srv, con, &wait_sock, &wait_ev)) {
+					case NETWORK_SOCKET_SUCCESS:
+						break;
+					case NETWORK_SOCKET_WAIT_FOR_EVENT:
+						timeout = (wait_ev == EV_READ) ? con->read_timeout : con->write_timeout;
+
+						WAIT_FOR_EVENT(wait_sock, wait_ev, &timeout);
+						NETWORK_MYSQLD_CON_TRACK_TIME(con, "wait_for_event::splice_query_result");
+						return;
+					default:
+						con->state = CON_STATE_ERROR;
+						break;
+					}
+					if (con->state != ostate) break;
+				}
+#endif
 
 				switch (network_mysqld_read(srv, recv_sock)) {
 				case NETWORK_SOCKET_SUCCESS:
 					break;
 				case NETWORK_SOCKET_WAIT_FOR_EVENT:
+#ifdef HAVE_SPLICE
+					/* a big row we don't need: pass the rest of it through the kernel */
+					if (network_mysqld_con_splice_start(con)) continue;
+#endif
 					timeout = con->read_timeout;
 
 					WAIT_FOR_EVENT(con->server, EV_READ, &timeout);
@@ -1735,9 +2027,17 @@ void network_mysqld_con_handle(int event_fd, short events, void *user_data) {
 				case NETWORK_SOCKET_SUCCESS:
 					/* if we don't need the resultset, forward it to the client */
 					if (!con->resultset_is_finished && !con->resultset_is_needed) {
-						/* check how much data we have in the queue waiting, no need to try to send 5 bytes */
-						if (con->client->send_queue->len > 64 * 1024) {
+						/* check how much data we have in the queue waiting, no need to try to send 5 bytes 
+						 *
+						 * the first flush happens early to get the first rows out fast, 
+						 * then we double the threshold to send bigger batches with less syscalls
+						 */
+						if (con->client->send_queue->len > con->flush_threshold) {
 							con->state = CON_STATE_SEND_QUERY_RESULT;
+
+							if (con->flush_threshold < NETWORK_MYSQLD_FLUSH_THRESHOLD_MAX) {
+								con->flush_threshold *= 2;
+							}
 						}
 					}
 					break;
@@ -1757,11 +2057,20 @@ void network_mysqld_con_handle(int event_fd, short events, void *user_data) {
 			break; 
 		case CON_STATE_SEND_QUERY_RESULT:
 			/**
-			 * send the query result-set to the client */
+			 * send the query result-set to the client 
+			 *
+			 * if we already have more of the result-set from the server, tell the kernel
+			 * to wait for it before it sends out a partial frame
+			 */
+			con->client->write_more = (!con->resultset_is_finished && con->server && con->server->recv_queue_raw->len > 0);
+
 			switch (network_mysqld_write(srv, con->client)) {
 			case NETWORK_SOCKET_SUCCESS:
 				break;
 			case NETWORK_SOCKET_WAIT_FOR_EVENT:
+				/* the client doesn't keep up, no need to flush small batches to it */
+				con->flush_threshold = NETWORK_MYSQLD_FLUSH_THRESHOLD_MAX;
+
 				timeout = con->write_timeout;
 
 				WAIT_FOR_EVENT(con->client, EV_WRITE, &timeout);
@@ -2082,6 +2391,9 @@ void network_mysqld_con_accept(int G_GNUC_UNUSED event_fd, short events, void *u
 
 	client_con->plugins = listen_con->plugins;
 	client_con->config  = listen_con->config;
+
+	/* listen-sockets which are bound to a event-thread keep their connections in that thread */
+	client_con->event_thread = listen_con->event_thread;
 	
 	network_mysqld_con_handle(-1, 0, client_con);
 
@@ -52,10 +52,14 @@
 #include "network-conn-pool.h"
 #include "chassis-plugin.h"
 #include "chassis-mainloop.h"
+#include "chassis-event-thread.h"
 #include "chassis-timings.h"
 #include "sys-pedantic.h"
 #include "lua-scope.h"
 #include "network-backend.h"
+#include "network-connection-registry.h"
+#include "network-global-kv.h"
+#include "network-global-stats.h"
 #include "lua-registry-keys.h"
 
 typedef struct network_mysqld_con network_mysqld_con; /* forward declaration */
@@ -329,6 +333,12 @@ struct network_mysqld_con {
 	 * Flag indicating whether we have seen all parts belonging to one resultset.
 	 */
 	gboolean resultset_is_finished;
+	/**
+	 * Flag indicating that the plugin keeps a copy of the packets it forwards.
+	 *
+	 * If set to TRUE, all packets of the resultset have to go through the plugin and aren't spliced.
+	 */
+	gboolean resultset_is_copied;
 
 	/**
 	 * Flag indicating that we have received a COM_QUIT command.
@@ -369,6 +379,62 @@ struct network_mysqld_con {
 	struct timeval connect_timeout;
 	struct timeval read_timeout;
 	struct timeval write_timeout;
+
+	/**
+	 * the event-thread this connection is pinned to
+	 *
+	 * all events of the connection are handled by this thread, which makes
+	 * re-arming a event a local event_add()
+	 *
+	 * @see network_mysqld_con_handle()
+	 */
+	chassis_event_thread_t *event_thread;
+
+	/**
+	 * our entry in chassis_private->cons
+	 *
+	 * set by network_mysqld_add_connection(), NULL for connections that aren't registered
+	 */
+	network_connection_registry_entry *registry_entry;
+
+	/**
+	 * passthrough of big row-packets from the server to the client with splice()
+	 *
+	 * NULL until the first packet is spliced
+	 */
+	network_socket_splice_t *splice;
+
+	/**
+	 * forward the result-set to the client once this many bytes are queued
+	 *
+	 * starts small for each result-set to get the first rows out fast and grows
+	 * with each flush. If a write to the client would block, it jumps to the maximum.
+	 *
+	 * It doesn't look at the RTT of the client. The packets of a result-set are
+	 * only held back (MSG_MORE) while more of the same result-set is waiting,
+	 * the last packet of a result is never delayed for the next command.
+	 *
+	 * @see CON_STATE_READ_QUERY_RESULT
+	 */
+	gsize flush_threshold;
+
+	/**
+	 * the command in the send-queue of the server is parsed already
+	 *
+	 * on a compressed socket the send-queue is emptied by the first write, a command
+	 * that needs several writes can't be parsed again from it
+	 *
+	 * @see CON_STATE_SEND_QUERY
+	 */
+	gboolean command_is_tracked;
+
+	/**
+	 * the plugin parked the command it read in CON_STATE_READ_QUERY
+	 *
+	 * the command stays in the recv-queue of the client. The plugin is called again
+	 * with it when it calls network_mysqld_con_handle() for the connection.
+	 */
+	gboolean command_is_parked;
 };
 
 
@@ -403,15 +469,19 @@ NETWORK_API network_socket_retval_t network_mysqld_write_len(chassis *srv, netwo
 NETWORK_API network_socket_retval_t network_mysqld_con_get_packet(chassis G_GNUC_UNUSED*chas, network_socket *con);
 
 struct chassis_private {
-	GPtrArray *cons;                          /**< array(network_mysqld_con) */
+	network_connection_registry *cons;        /**< all open connections (network_mysqld_con) */
 
-	lua_scope *sc;
+	lua_scope *sc;                            /**< the lua-scope used outside of the event-threads */
 
 	network_backends_t *backends;
+
+	network_global_kv_t *kv;                  /**< proxy.global.kv, shared by the lua-scopes of all event-threads */
+	network_global_stats_t *stats;            /**< proxy.global.stats, counters with one shard per event-thread */
 };
 
 NETWORK_API int network_mysqld_init(chassis *srv);
 NETWORK_API void network_mysqld_add_connection(chassis *srv, network_mysqld_con *con);
+NETWORK_API lua_scope *network_mysqld_con_get_lua_scope(network_mysqld_con *con);
 NETWORK_API void network_mysqld_con_handle(int event_fd, short events, void *user_data);
 NETWORK_API int network_mysqld_queue_append(network_socket *sock, network_queue *queue, const char *data, size_t len);
 NETWORK_API int network_mysqld_queue_append_raw(network_socket *sock, network_queue *queue, GString *data);
@@ -0,0 +1,422 @@
+/* $%BEGINLICENSE%$
+ Copyright (c) 2008, 2012, Oracle and/or its affiliates. All rights reserved.
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License as
+ published by the Free Software Foundation; version 2 of the
+ License.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ 02110-1301  USA
+
+ $%ENDLICENSE%$ */
+
+/**
+ * a cache for the raw packets of result-sets
+ *
+ * - on a miss the proxy creates a entry with network_query_cache_entry_new() before it
+ *   sends the query and copies the packets of the result into it
+ * - network_query_cache_store() adds it to the cache, unless one of its tables
+ *   was written in the meantime
+ * - network_query_cache_get() returns copies of the packets which can be sent
+ *   to the client as is
+ *
+ * stale entries aren't removed when a table is written, but when they are looked up
+ * or fall out of the LRU.
+ *
+ * the last write of a table is kept as long as a entry in the cache reads it. The
+ * tables no entry reads are removed once there are too many of them, results that
+ * were running while one of them was written aren't stored.
+ */
+
+#include <string.h>
+
+#include <glib.h>
+
+#include "network-query-cache.h"
+#include "sys-pedantic.h"
+
+/**
+ * results may use up to this part of the cache
+ */
+#define NETWORK_QUERY_CACHE_ENTRY_RATIO 8
+
+/**
+ * max number of tables in the cache that no entry reads
+ */
+#define NETWORK_QUERY_CACHE_TABLES_UNUSED_MAX 1024
+
+network_query_cache *network_query_cache_new(gsize max_bytes, guint64 ttl) {
+	network_query_cache *cache;
+
+	cache = g_new0(network_query_cache, 1);
+	cache->entries = g_hash_table_new((GHashFunc)g_string_hash, (GEqualFunc)g_string_equal);
+	cache->lru = g_queue_new();
+	cache->tables = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+	cache->max_bytes = max_bytes;
+	cache->max_entry_bytes = max_bytes / NETWORK_QUERY_CACHE_ENTRY_RATIO;
+	cache->ttl = ttl;
+	cache->mutex = g_mutex_new();
+
+	return cache;
+}
+
+/**
+ * get the state of a table, create it if it doesn't exist yet
+ *
+ * @note the cache has to be locked
+ */
+static network_query_cache_table *network_query_cache_table_get(network_query_cache *cache, const gchar *name) {
+	network_query_cache_table *table;
+
+	if (NULL == (table = g_hash_table_lookup(cache->tables, name))) {
+		table = g_new0(network_query_cache_table, 1);
+		g_hash_table_insert(cache->tables, g_strdup(name), table);
+
+		cache->tables_unused++;
+	}
+
+	return table;
+}
+
+static gboolean network_query_cache_table_is_unused(gpointer UNUSED_PARAM(name), gpointer _table, gpointer _cache) {
+	network_query_cache_table *table = _table;
+	network_query_cache *cache = _cache;
+
+	if (table->refcount > 0) return FALSE;
+
+	if (table->written_at > cache->pruned_at) cache->pruned_at = table->written_at;
+
+	return TRUE;
+}
+
+/**
+ * remove the tables no entry reads if there are too many of them
+ *
+ * the results that are still running may read one of them, they are dropped
+ * by network_query_cache_store() if they were sent before the last write
+ * of a removed table.
+ *
+ * @note the cache has to be locked
+ */
+static void network_query_cache_tables_prune(network_query_cache *cache) {
+	if (cache->tables_unused <= NETWORK_QUERY_CACHE_TABLES_UNUSED_MAX) return;
+
+	g_hash_table_foreach_remove(cache->tables, network_query_cache_table_is_unused, cache);
+	cache->tables_unused = 0;
+}
+
+/**
+ * remove a entry from the cache and free it
+ *
+ * @note the cache has to be locked
+ */
+static void network_query_cache_remove(network_query_cache *cache, network_query_cache_entry *entry) {
+	guint i;
+
+	g_hash_table_remove(cache->entries, entry->key);
+	g_queue_delete_link(cache->lru, entry->lru_link);
+	entry->lru_link = NULL;
+
+	cache->bytes -= entry->bytes;
+
+	for (i = 0; i < entry->tables->len; i++) {
+		network_query_cache_table *table = g_hash_table_lookup(cache->tables, entry->tables->pdata[i]);
+
+		if (0 == --table->refcount) cache->tables_unused++;
+	}
+
+	network_query_cache_entry_free(entry);
+}
+
+void network_query_cache_free(network_query_cache *cache) {
+	network_query_cache_entry *entry;
+
+	if (!cache) return;
+
+	while ((entry = g_queue_peek_tail(cache->lru))) {
+		network_query_cache_remove(cache, entry);
+	}
+
+	g_hash_table_destroy(cache->entries);
+	g_queue_free(cache->lru);
+	g_hash_table_destroy(cache->tables);
+	g_mutex_free(cache->mutex);
+
+	g_free(cache);
+}
+
+/**
+ * create a entry for a query we are about to send
+ *
+ * remembers the generation of the cache. If one of the tables is written
+ * before the result is stored, the result is dropped.
+ *
+ * @param key  the cache-key, the entry takes ownership of it
+ */
+network_query_cache_entry *network_query_cache_entry_new(network_query_cache *cache, GString *key) {
+	network_query_cache_entry *entry;
+
+	entry = g_new0(network_query_cache_entry, 1);
+	entry->key = key;
+	entry->packets = g_ptr_array_new();
+	entry->tables = g_ptr_array_new();
+	entry->bytes = key->len;
+
+	g_mutex_lock(cache->mutex);
+	entry->generation = cache->generation;
+	g_mutex_unlock(cache->mutex);
+
+	return entry;
+}
+
+void network_query_cache_entry_free(network_query_cache_entry *entry) {
+	guint i;
+
+	if (!entry) return;
+
+	for (i = 0; i < entry->packets->len; i++) {
+		g_string_free(entry->packets->pdata[i], TRUE);
+	}
+	g_ptr_array_free(entry->packets, TRUE);
+
+	for (i = 0; i < entry->tables->len; i++) {
+		g_free(entry->tables->pdata[i]);
+	}
+	g_ptr_array_free(entry->tables, TRUE);
+
+	if (entry->key) g_string_free(entry->key, TRUE);
+
+	g_free(entry);
+}
+
+/**
+ * append a copy of a packet to the entry
+ *
+ * @return FALSE if the result got too big for the cache
+ */
+gboolean network_query_cache_entry_append(network_query_cache *cache, network_query_cache_entry *entry, GString *packet) {
+	if (entry->bytes + packet->len > cache->max_entry_bytes) return FALSE;
+
+	g_ptr_array_add(entry->packets, g_string_new_len(packet->str, packet->len));
+	entry->bytes += packet->len;
+
+	return TRUE;
+}
+
+/**
+ * check if one of the tables of the entry was written after the entry was created
+ *
+ * @note the cache has to be locked
+ */
+static gboolean network_query_cache_entry_is_stale(network_query_cache *cache, network_query_cache_entry *entry) {
+	guint i;
+
+	if (cache->flushed_at > entry->generation) return TRUE;
+
+	for (i = 0; i < entry->tables->len; i++) {
+		network_query_cache_table *table = g_hash_table_lookup(cache->tables, entry->tables->pdata[i]);
+
+		if (table && table->written_at > entry->generation) return TRUE;
+	}
+
+	return FALSE;
+}
+
+/**
+ * add a complete result to the cache
+ *
+ * replaces the entry with the same key and removes the least-recently used
+ * entries if the cache is full
+ *
+ * @param entry  the cache takes ownership of it, it is freed if it is stale already
+ * @param now    current time in microseconds
+ */
+void network_query_cache_store(network_query_cache *cache, network_query_cache_entry *entry, guint64 now) {
+	network_query_cache_entry *old;
+	guint i;
+
+	g_mutex_lock(cache->mutex);
+	if (entry->bytes > cache->max_entry_bytes ||
+	    entry->generation < cache->pruned_at || /* we don't know if it read one of the removed tables */
+	    network_query_cache_entry_is_stale(cache, entry)) {
+		g_mutex_unlock(cache->mutex);
+
+		network_query_cache_entry_free(entry);
+		return;
+	}
+
+	if ((old = g_hash_table_lookup(cache->entries, entry->key))) {
+		network_query_cache_remove(cache, old);
+	}
+
+	entry->expires_at = now + cache->ttl;
+
+	g_queue_push_head(cache->lru, entry);
+	entry->lru_link = cache->lru->head;
+	g_hash_table_insert(cache->entries, entry->key, entry);
+	cache->bytes += entry->bytes;
+
+	for (i = 0; i < entry->tables->len; i++) {
+		network_query_cache_table *table = network_query_cache_table_get(cache, entry->tables->pdata[i]);
+
+		if (0 == table->refcount++) cache->tables_unused--;
+	}
+
+	while (cache->bytes > cache->max_bytes) {
+		network_query_cache_remove(cache, g_queue_peek_tail(cache->lru));
+	}
+	network_query_cache_tables_prune(cache);
+	g_mutex_unlock(cache->mutex);
+}
+
+/**
+ * get the packets of a cached result
+ *
+ * @param key      the cache-key
+ * @param now      current time in microseconds
+ * @param packets  copies of the packets are appended to it
+ * @return TRUE on a hit
+ */
+gboolean network_query_cache_get(network_query_cache *cache, GString *key, guint64 now, GQueue *packets) {
+	network_query_cache_entry *entry;
+	guint i;
+
+	g_mutex_lock(cache->mutex);
+	if (NULL == (entry = g_hash_table_lookup(cache->entries, key))) {
+		g_mutex_unlock(cache->mutex);
+		return FALSE;
+	}
+
+	if (now >= entry->expires_at ||
+	    network_query_cache_entry_is_stale(cache, entry)) {
+		network_query_cache_remove(cache, entry);
+		network_query_cache_tables_prune(cache);
+		g_mutex_unlock(cache->mutex);
+		return FALSE;
+	}
+
+	/* move it to the front of the LRU */
+	g_queue_unlink(cache->lru, entry->lru_link);
+	g_queue_push_head_link(cache->lru, entry->lru_link);
+
+	for (i = 0; i < entry->packets->len; i++) {
+		GString *packet = entry->packets->pdata[i];
+
+		g_queue_push_tail(packets, g_string_new_len(packet->str, packet->len));
+	}
+	g_mutex_unlock(cache->mutex);
+
+	return TRUE;
+}
+
+/**
+ * mark a table as written
+ *
+ * @param table  name of the table as "db.table"
+ */
+void network_query_cache_invalidate_table(network_query_cache *cache, const gchar *table) {
+	g_mutex_lock(cache->mutex);
+	cache->generation++;
+
+	network_query_cache_table_get(cache, table)->written_at = cache->generation;
+	network_query_cache_tables_prune(cache);
+	g_mutex_unlock(cache->mutex);
+}
+
+/**
+ * remove all entries
+ *
+ * results of queries that are still running won't be stored either
+ */
+void network_query_cache_invalidate_all(network_query_cache *cache) {
+	network_query_cache_entry *entry;
+
+	g_mutex_lock(cache->mutex);
+	cache->generation++;
+	cache->flushed_at = cache->generation;
+
+	while ((entry = g_queue_peek_tail(cache->lru))) {
+		network_query_cache_remove(cache, entry);
+	}
+
+	/* all writes are older than the flush now */
+	g_hash_table_remove_all(cache->tables);
+	cache->tables_unused = 0;
+	g_mutex_unlock(cache->mutex);
+}
+
+network_query_cache_con *network_query_cache_con_new(void) {
+	network_query_cache_con *qc;
+
+	qc = g_new0(network_query_cache_con, 1);
+	qc->session = g_string_new(NULL);
+	qc->written_tables = g_ptr_array_new();
+	qc->prepared_tables = g_ptr_array_new();
+
+	return qc;
+}
+
+static void network_query_cache_tables_clear(GPtrArray *tables) {
+	guint i;
+
+	for (i = 0; i < tables->len; i++) {
+		g_free(tables->pdata[i]);
+	}
+	g_ptr_array_set_size(tables, 0);
+}
+
+void network_query_cache_con_free(network_query_cache_con *qc) {
+	if (!qc) return;
+
+	network_query_cache_entry_free(qc->entry);
+
+	g_string_free(qc->session, TRUE);
+
+	network_query_cache_tables_clear(qc->written_tables);
+	g_ptr_array_free(qc->written_tables, TRUE);
+	network_query_cache_tables_clear(qc->prepared_tables);
+	g_ptr_array_free(qc->prepared_tables, TRUE);
+
+	g_free(qc);
+}
+
+/**
+ * add a copy of a table-name to a list, if it isn't in it yet
+ */
+void network_query_cache_con_add_table(GPtrArray *tables, const gchar *table) {
+	guint i;
+
+	for (i = 0; i < tables->len; i++) {
+		if (0 == strcmp(tables->pdata[i], table)) return;
+	}
+
+	g_ptr_array_add(tables, g_strdup(table));
+}
+
+/**
+ * invalidate the tables the connection has written
+ *
+ * call it when the writes are committed
+ */
+void network_query_cache_con_invalidate(network_query_cache *cache, network_query_cache_con *qc) {
+	guint i;
+
+	if (qc->written_all) {
+		network_query_cache_invalidate_all(cache);
+	} else {
+		for (i = 0; i < qc->written_tables->len; i++) {
+			network_query_cache_invalidate_table(cache, qc->written_tables->pdata[i]);
+		}
+	}
+
+	qc->written_all = FALSE;
+	network_query_cache_tables_clear(qc->written_tables);
+}
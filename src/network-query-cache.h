@@ -0,0 +1,116 @@
+/* $%BEGINLICENSE%$
+ Copyright (c) 2008, 2012, Oracle and/or its affiliates. All rights reserved.
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License as
+ published by the Free Software Foundation; version 2 of the
+ License.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ 02110-1301  USA
+
+ $%ENDLICENSE%$ */
+
+
+#ifndef _NETWORK_QUERY_CACHE_H_
+#define _NETWORK_QUERY_CACHE_H_
+
+#include <glib.h>
+
+#include "network-exports.h"
+
+/**
+ * a cached result-set
+ *
+ * the packets are stored as received from the server, with their headers
+ */
+typedef struct {
+	GString *key;        /**< the cache-key, see network_query_cache_get() */
+	GPtrArray *packets;  /**< GString *, the raw packets of the result */
+	GPtrArray *tables;   /**< gchar *, the tables the query reads as "db.table" */
+
+	gsize bytes;         /**< size of the key and the packets */
+
+	guint64 generation;  /**< generation of the cache when the query was sent */
+	guint64 expires_at;  /**< in microseconds, set when the entry is stored */
+
+	GList *lru_link;     /**< link in the cache->lru list */
+} network_query_cache_entry;
+
+/**
+ * the state of a table in the cache
+ */
+typedef struct {
+	guint64 written_at;  /**< generation of the last write to the table, 0 if not written yet */
+	guint refcount;      /**< number of entries in the cache that read the table */
+} network_query_cache_table;
+
+/**
+ * a result-cache shared by all event-threads
+ *
+ * writes to a table bump the generation of the cache and remember it for the table. A entry
+ * is stale if one of its tables was written after the query was sent.
+ */
+typedef struct {
+	GHashTable *entries;  /**< hash<GString *, network_query_cache_entry *> */
+	GQueue *lru;          /**< the entries, last used first */
+	GHashTable *tables;   /**< hash<gchar *, network_query_cache_table *>, the tables that were written or are read by a entry */
+	guint tables_unused;  /**< tables no entry reads, they are removed when there are too many */
+
+	guint64 generation;   /**< bumped on each write */
+	guint64 flushed_at;   /**< generation of the last network_query_cache_invalidate_all() */
+	guint64 pruned_at;    /**< latest write to a table that was removed from ->tables */
+
+	gsize bytes;          /**< size of all entries */
+	gsize max_bytes;      /**< the least-recently used entries are removed above this */
+	gsize max_entry_bytes; /**< results bigger than this aren't cached */
+	guint64 ttl;          /**< in microseconds */
+
+	GMutex *mutex;
+} network_query_cache;
+
+/**
+ * the query-cache state of a connection
+ *
+ * writes are collected until the transaction ends and invalidate the tables then.
+ */
+typedef struct {
+	network_query_cache_entry *entry; /**< the result we copy into the cache, NULL if we don't */
+
+	GString *session;           /**< the SET statements of the connection, part of the cache-key */
+	gboolean session_is_unknown; /**< a USE statement changed the default-db or the session got too long */
+
+	GPtrArray *written_tables;  /**< gchar *, tables written since the last invalidation */
+	gboolean written_all;       /**< a statement may have written any table */
+
+	GPtrArray *prepared_tables; /**< gchar *, tables the prepared statements of the connection write */
+	gboolean prepared_all;      /**< a prepared statement may write any table */
+
+	guint16 server_status;      /**< server-status of the last result */
+} network_query_cache_con;
+
+NETWORK_API network_query_cache *network_query_cache_new(gsize max_bytes, guint64 ttl);
+NETWORK_API void network_query_cache_free(network_query_cache *cache);
+
+NETWORK_API network_query_cache_entry *network_query_cache_entry_new(network_query_cache *cache, GString *key);
+NETWORK_API void network_query_cache_entry_free(network_query_cache_entry *entry);
+NETWORK_API gboolean network_query_cache_entry_append(network_query_cache *cache, network_query_cache_entry *entry, GString *packet);
+
+NETWORK_API void network_query_cache_store(network_query_cache *cache, network_query_cache_entry *entry, guint64 now);
+NETWORK_API gboolean network_query_cache_get(network_query_cache *cache, GString *key, guint64 now, GQueue *packets);
+NETWORK_API void network_query_cache_invalidate_table(network_query_cache *cache, const gchar *table);
+NETWORK_API void network_query_cache_invalidate_all(network_query_cache *cache);
+
+NETWORK_API network_query_cache_con *network_query_cache_con_new(void);
+NETWORK_API void network_query_cache_con_free(network_query_cache_con *qc);
+NETWORK_API void network_query_cache_con_add_table(GPtrArray *tables, const gchar *table);
+NETWORK_API void network_query_cache_con_invalidate(network_query_cache *cache, network_query_cache_con *qc);
+
+#endif
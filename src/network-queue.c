@@ -25,6 +25,86 @@
 
 #include "network-queue.h"
 
+/**
+ * max number of free slabs we keep per thread
+ */
+#define NETWORK_QUEUE_CHUNK_POOL_MAX 64
+
+/**
+ * the allocated_len of a slab
+ *
+ * the GString-functions round the allocated_len up to a power of 2, a GString
+ * with this allocated_len can only come from network_queue_chunk_new(). A slab
+ * that had to grow isn't one anymore.
+ *
+ * the +1 is for the trailing \0 of the GString
+ */
+#define NETWORK_QUEUE_CHUNK_ALLOCATED_LEN (NETWORK_QUEUE_CHUNK_SIZE + 1)
+
+static GStaticPrivate chunk_pool_key = G_STATIC_PRIVATE_INIT;
+
+static void network_queue_chunk_pool_free(gpointer _pool) {
+	GQueue *pool = _pool;
+	GString *chunk;
+
+	while ((chunk = g_queue_pop_head(pool))) g_string_free(chunk, TRUE);
+
+	g_queue_free(pool);
+}
+
+/**
+ * get a empty slab of NETWORK_QUEUE_CHUNK_SIZE bytes
+ *
+ * takes it from the free-list of the current thread if possible
+ */
+GString *network_queue_chunk_new(void) {
+	GQueue *pool = g_static_private_get(&chunk_pool_key);
+	GString *chunk;
+
+	if (pool && (chunk = g_queue_pop_head(pool))) {
+		return chunk;
+	}
+
+	/* allocate the buffer ourself to mark the GString as slab */
+	chunk = g_string_new(NULL);
+	chunk->str = g_realloc(chunk->str, NETWORK_QUEUE_CHUNK_ALLOCATED_LEN);
+	chunk->allocated_len = NETWORK_QUEUE_CHUNK_ALLOCATED_LEN;
+
+	return chunk;
+}
+
+/**
+ * free a chunk or put it back into the free-list of the current thread
+ *
+ * only slabs created by network_queue_chunk_new() are recycled, all other
+ * GStrings are free()ed
+ */
+void network_queue_chunk_free(GString *chunk) {
+	GQueue *pool;
+
+	if (!chunk) return;
+
+	if (chunk->allocated_len != NETWORK_QUEUE_CHUNK_ALLOCATED_LEN) {
+		/* not a slab or it had to grow */
+		g_string_free(chunk, TRUE);
+		return;
+	}
+
+	if (NULL == (pool = g_static_private_get(&chunk_pool_key))) {
+		pool = g_queue_new();
+
+		g_static_private_set(&chunk_pool_key, pool, network_queue_chunk_pool_free);
+	}
+
+	if (pool->length >= NETWORK_QUEUE_CHUNK_POOL_MAX) {
+		g_string_free(chunk, TRUE);
+		return;
+	}
+
+	g_string_truncate(chunk, 0);
+	g_queue_push_head(pool, chunk); /* LIFO, the last used slab is still in the cache */
+}
+
 #ifndef DISABLE_DEPRECATED_DECL
 network_queue *network_queue_init() {
 	return network_queue_new();
@@ -46,7 +126,7 @@ void network_queue_free(network_queue *queue) {
 
 	if (!queue) return;
 
-	while ((packet = g_queue_pop_head(queue->chunks))) g_string_free(packet, TRUE);
+	while ((packet = g_queue_pop_head(queue->chunks))) network_queue_chunk_free(packet);
 
 	g_queue_free(queue->chunks);
 
@@ -110,6 +190,11 @@ GString *network_queue_peek_string(network_queue *queue, gsize peek_len, GString
 
 /**
  * get a string from the head of the queue and remove the chunks from the queue 
+ *
+ * if dest is NULL we try to avoid copying the data:
+ * - a chunk that contains exactly the string is returned as is
+ * - if the string is at the start of the chunk and is the bigger part of it, the
+ *   chunk is returned and the (smaller) rest is moved into a new chunk
  */
 GString *network_queue_pop_string(network_queue *queue, gsize steal_len, GString *dest) {
 	gsize we_want = steal_len;
@@ -133,6 +218,25 @@ GString *network_queue_pop_string(network_queue *queue, gsize steal_len, GString
 			return dest;
 		}
 
+		if (!dest && (queue->offset == 0) && (chunk->len > steal_len) && (steal_len >= chunk->len - steal_len)) {
+			/* split the chunk: copy the rest instead of the string we want */
+			gsize rest_len = chunk->len - steal_len;
+			GString *rest;
+
+			if (rest_len <= NETWORK_QUEUE_CHUNK_SIZE) {
+				rest = network_queue_chunk_new();
+			} else {
+				rest = g_string_sized_new(rest_len);
+			}
+			g_string_append_len(rest, chunk->str + steal_len, rest_len);
+			g_string_truncate(chunk, steal_len);
+
+			queue->chunks->head->data = rest;
+			queue->len -= steal_len;
+
+			return chunk;
+		}
+
 		if (!dest) {
 			/* if we don't have a dest-buffer yet, create one */
 			dest = g_string_sized_new(steal_len);
@@ -145,7 +249,7 @@ GString *network_queue_pop_string(network_queue *queue, gsize steal_len, GString
 
 		if (chunk->len == queue->offset) {
 			/* the chunk is done, remove it */
-			g_string_free(g_queue_pop_head(queue->chunks), TRUE);
+			network_queue_chunk_free(g_queue_pop_head(queue->chunks));
 			queue->offset = 0;
 		} else {
 			break;
@@ -26,6 +26,15 @@
 
 #include <glib.h>
 
+/**
+ * size of the slabs the sockets read into 
+ *
+ * slabs are recycled through a per-thread free-list 
+ *
+ * @see network_queue_chunk_new(), network_queue_chunk_free()
+ */
+#define NETWORK_QUEUE_CHUNK_SIZE (16 * 1024)
+
 /* a input or output stream */
 typedef struct {
 	GQueue *chunks;
@@ -41,4 +50,7 @@ NETWORK_API int network_queue_append(network_queue *queue, GString *chunk);
 NETWORK_API GString *network_queue_pop_string(network_queue *queue, gsize steal_len, GString *dest);
 NETWORK_API GString *network_queue_peek_string(network_queue *queue, gsize peek_len, GString *dest);
 
+NETWORK_API GString *network_queue_chunk_new(void);
+NETWORK_API void network_queue_chunk_free(GString *chunk);
+
 #endif
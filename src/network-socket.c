@@ -18,6 +18,9 @@
 
  $%ENDLICENSE%$ */
  
+#ifdef __linux__
+#define _GNU_SOURCE /* for splice() */
+#endif
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
@@ -111,6 +114,8 @@ network_socket *network_socket_new() {
 	s->fd           = -1;
 	s->socket_type  = SOCK_STREAM; /* let's default to TCP */
 	s->packet_id_is_reset = TRUE;
+	s->listen_backlog = 128;
+	s->compress_min_length = NETWORK_MYSQLD_COMPRESS_MIN_LENGTH;
 
 	s->src = network_address_new();
 	s->dst = network_address_new();
@@ -125,6 +130,12 @@ void network_socket_free(network_socket *s) {
 	network_queue_free(s->recv_queue);
 	network_queue_free(s->recv_queue_raw);
 
+	if (s->iov) g_array_free(s->iov, TRUE);
+
+	network_mysqld_compress_free(s->compress);
+	network_stmt_cache_free(s->prepared_stmts);
+	network_mysqld_session_free(s->session);
+
 	if (s->response) network_mysqld_auth_response_free(s->response);
 	if (s->challenge) network_mysqld_auth_challenge_free(s->challenge);
 
@@ -408,6 +419,23 @@ network_socket_retval_t network_socket_bind(network_socket * con) {
 						g_strerror(errno), errno);
 				return NETWORK_SOCKET_ERROR;
 			}
+
+			if (con->reuse_port) {
+#ifdef SO_REUSEPORT
+				if (0 != setsockopt(con->fd, SOL_SOCKET, SO_REUSEPORT, SETSOCKOPT_OPTVAL_CAST &val, sizeof(val))) {
+					g_critical("%s: setsockopt(%s, SOL_SOCKET, SO_REUSEPORT) failed: %s (%d)", 
+							G_STRLOC,
+							con->dst->name->str,
+							g_strerror(errno), errno);
+					return NETWORK_SOCKET_ERROR;
+				}
+#else
+				g_critical("%s: SO_REUSEPORT for %s isn't supported on this platform", 
+						G_STRLOC,
+						con->dst->name->str);
+				return NETWORK_SOCKET_ERROR;
+#endif
+			}
 		}
 
 		if (con->dst->addr.common.sa_family == AF_INET6) {
@@ -523,10 +551,11 @@ network_socket_retval_t network_socket_bind(network_socket * con) {
 			con->dst->addr.ipv6.sin6_port  = a.sin6_port;
 		}
 
-		if (-1 == listen(con->fd, 128)) {
-			g_critical("%s: listen(%s, 128) failed: %s (%d)",
+		if (-1 == listen(con->fd, con->listen_backlog)) {
+			g_critical("%s: listen(%s, %d) failed: %s (%d)",
 					G_STRLOC,
 					con->dst->name->str,
+					con->listen_backlog,
 					g_strerror(errno), errno);
 			return NETWORK_SOCKET_ERROR;
 		}
@@ -562,12 +591,14 @@ network_socket_retval_t network_socket_bind(network_socket * con) {
  * @param sock the socket
  */
 network_socket_retval_t network_socket_read(network_socket *sock) {
+	/* compressed frames are unpacked into the recv_queue_raw below */
+	network_queue *recv_queue = sock->compress ? sock->compress->recv_queue : sock->recv_queue_raw;
 	gssize len;
 
 	if (sock->to_read > 0) {
 		GString *packet = g_string_sized_new(sock->to_read);
 
-		g_queue_push_tail(sock->recv_queue_raw->chunks, packet);
+		g_queue_push_tail(recv_queue->chunks, packet);
 
 		if (sock->socket_type == SOCK_STREAM) {
 			len = recv(sock->fd, packet->str, sock->to_read, 0);
@@ -601,22 +632,211 @@ network_socket_retval_t network_socket_read(network_socket *sock) {
 		}
 
 		sock->to_read -= len;
-		sock->recv_queue_raw->len += len;
+		recv_queue->len += len;
 #if 0
 		sock->recv_queue_raw->offset = 0; /* offset into the first packet */
 #endif
 		packet->len = len;
+
+		if (sock->compress && 0 != network_mysqld_compress_inflate(sock->compress, sock->recv_queue_raw)) {
+			return NETWORK_SOCKET_ERROR;
+		}
+	}
+
+	return NETWORK_SOCKET_SUCCESS;
+}
+
+/**
+ * read all the data that is available on a stream-socket 
+ *
+ * reads into the free space of the last chunk of the recv_queue and only 
+ * takes a new slab if that chunk is full. A short read means we drained the
+ * socket-buffers and we stop without waiting for the EAGAIN. 
+ *
+ * @return NETWORK_SOCKET_SUCCESS if we read something, 
+ *         NETWORK_SOCKET_WAIT_FOR_EVENT if no data was available,
+ *         NETWORK_SOCKET_ERROR if the connection was closed by the peer or recv() failed
+ */
+static network_socket_retval_t network_socket_read_all_into(network_socket *sock, network_queue *recv_queue) {
+	gsize total_len = 0;
+
+	/* don't let one socket starve the others, if there is more data the next read-event will get it */
+	while (total_len < 16 * NETWORK_QUEUE_CHUNK_SIZE) {
+		GString *chunk = g_queue_peek_tail(recv_queue->chunks);
+		gsize chunk_free;
+		gssize len;
+
+		/* the chunk is too small to read into, get a new one
+		 *
+		 * the -1 is for the trailing \0 of the GString */
+		if (NULL == chunk || chunk->allocated_len - chunk->len - 1 < NETWORK_QUEUE_CHUNK_SIZE / 4) {
+			chunk = network_queue_chunk_new();
+
+			g_queue_push_tail(recv_queue->chunks, chunk);
+		}
+		chunk_free = chunk->allocated_len - chunk->len - 1;
+
+		len = recv(sock->fd, chunk->str + chunk->len, chunk_free, 0);
+		if (-1 == len) {
+#ifdef _WIN32
+			errno = WSAGetLastError();
+#endif
+			switch (errno) {
+			case EINTR:
+				continue;
+			case E_NET_WOULDBLOCK: /** the buffers are empty, try again later */
+			case EAGAIN:     
+				return total_len > 0 ? NETWORK_SOCKET_SUCCESS : NETWORK_SOCKET_WAIT_FOR_EVENT;
+			case E_NET_CONNABORTED:
+			case E_NET_CONNRESET:
+				return NETWORK_SOCKET_ERROR;
+			default:
+				g_debug("%s: recv() failed: %s (errno=%d)", G_STRLOC, g_strerror(errno), errno);
+				return NETWORK_SOCKET_ERROR;
+			}
+		} else if (len == 0) {
+			/**
+			 * connection close
+			 *
+			 * if we got data before, let the caller handle it first. 
+			 * The next read-event will see the close again. 
+			 */
+			return total_len > 0 ? NETWORK_SOCKET_SUCCESS : NETWORK_SOCKET_ERROR;
+		}
+
+		chunk->len += len;
+		chunk->str[chunk->len] = '\0';
+
+		recv_queue->len += len;
+		total_len += len;
+
+		if ((gsize)len < chunk_free) break; /* short read, the socket is drained */
 	}
 
 	return NETWORK_SOCKET_SUCCESS;
 }
 
+/**
+ * read all the data that is available on a stream-socket 
+ *
+ * on a compressed socket the frames are read into its own queue and the
+ * complete frames are unpacked into the recv_queue_raw.
+ *
+ * @see network_socket_read_all_into()
+ */
+network_socket_retval_t network_socket_read_all(network_socket *sock) {
+	network_socket_retval_t ret;
+
+	g_return_val_if_fail(sock->socket_type == SOCK_STREAM, NETWORK_SOCKET_ERROR);
+
+	if (NULL == sock->compress) return network_socket_read_all_into(sock, sock->recv_queue_raw);
+
+	ret = network_socket_read_all_into(sock, sock->compress->recv_queue);
+	if (ret == NETWORK_SOCKET_SUCCESS && 0 != network_mysqld_compress_inflate(sock->compress, sock->recv_queue_raw)) {
+		return NETWORK_SOCKET_ERROR;
+	}
+
+	return ret;
+}
+
+#ifdef HAVE_SPLICE
+/**
+ * create the pipe for a splice()-passthrough
+ *
+ * @return NULL if the pipe can't be created
+ */
+network_socket_splice_t *network_socket_splice_new(void) {
+	network_socket_splice_t *sp;
+
+	sp = g_new0(network_socket_splice_t, 1);
+
+	if (0 != pipe(sp->pipe_fds)) {
+		g_critical("%s: pipe() failed: %s (%d)",
+				G_STRLOC,
+				g_strerror(errno), errno);
+		g_free(sp);
+
+		return NULL;
+	}
+
+	fcntl(sp->pipe_fds[0], F_SETFL, O_NONBLOCK);
+	fcntl(sp->pipe_fds[1], F_SETFL, O_NONBLOCK);
+
+	return sp;
+}
+
+void network_socket_splice_free(network_socket_splice_t *sp) {
+	if (!sp) return;
+
+	close(sp->pipe_fds[0]);
+	close(sp->pipe_fds[1]);
+
+	g_free(sp);
+}
+
+/**
+ * move ->to_read bytes from src to dst through a pipe without copying them into user-space
+ *
+ * the pipe is always drained before we read more from the source. If we have to wait
+ * the caller can use sp->in_pipe to decide for what:
+ * - sp->in_pipe > 0: wait until dst is writable
+ * - otherwise: wait until src is readable
+ *
+ * @return NETWORK_SOCKET_SUCCESS if all bytes are written to dst
+ */
+network_socket_retval_t network_socket_splice(network_socket_splice_t *sp, network_socket *src, network_socket *dst) {
+	while (sp->in_pipe > 0 || sp->to_read > 0) {
+		gssize len;
+
+		if (sp->in_pipe > 0) {
+			len = splice(sp->pipe_fds[0], NULL, dst->fd, NULL, sp->in_pipe, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+		} else {
+			len = splice(src->fd, NULL, sp->pipe_fds[1], NULL, sp->to_read, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+		}
+
+		if (-1 == len) {
+			switch (errno) {
+			case EINTR:
+				continue;
+			case E_NET_WOULDBLOCK:
+			case EAGAIN:
+				return NETWORK_SOCKET_WAIT_FOR_EVENT;
+			case EPIPE:
+			case E_NET_CONNRESET:
+			case E_NET_CONNABORTED:
+				/** remote side closed the connection */
+				return NETWORK_SOCKET_ERROR;
+			default:
+				g_message("%s: splice(%s -> %s) failed: %s", 
+						G_STRLOC, 
+						src->dst->name->str, 
+						dst->dst->name->str, 
+						g_strerror(errno));
+				return NETWORK_SOCKET_ERROR;
+			}
+		} else if (len == 0) {
+			/* the source closed the connection */
+			return NETWORK_SOCKET_ERROR;
+		}
+
+		if (sp->in_pipe > 0) {
+			sp->in_pipe -= len;
+		} else {
+			sp->to_read -= len;
+			sp->in_pipe += len;
+		}
+	}
+
+	return NETWORK_SOCKET_SUCCESS;
+}
+#endif
+
 #ifdef HAVE_WRITEV
 /**
  * write data to the socket
  *
  */
-static network_socket_retval_t network_socket_write_writev(network_socket *con, int send_chunks) {
+static network_socket_retval_t network_socket_write_writev(network_socket *con, network_queue *send_queue, int send_chunks) {
 	/* send the whole queue */
 	GList *chunk;
 	struct iovec *iov;
@@ -624,53 +844,71 @@ static network_socket_retval_t network_socket_write_writev(network_socket *con,
 	gint chunk_count;
 	gssize len;
 	int os_errno;
-	gint max_chunk_count;
+	static gint max_chunk_count = 0; /* the same for all threads, no need to lock it */
 
 	if (send_chunks == 0) return NETWORK_SOCKET_SUCCESS;
 
-	chunk_count = send_chunks > 0 ? send_chunks : (gint)con->send_queue->chunks->length;
+	chunk_count = send_chunks > 0 ? send_chunks : (gint)send_queue->chunks->length;
 	
 	if (chunk_count == 0) return NETWORK_SOCKET_SUCCESS;
 
-	max_chunk_count = sysconf(_SC_IOV_MAX);
+	if (max_chunk_count == 0) {
+		gint iov_max = sysconf(_SC_IOV_MAX);
 
-	if (max_chunk_count < 0) { /* option is unknown */
+		if (iov_max < 0) { /* option is unknown */
 #if defined(UIO_MAXIOV)
-		max_chunk_count = UIO_MAXIOV; /* as defined in POSIX */
+			iov_max = UIO_MAXIOV; /* as defined in POSIX */
 #elif defined(IOV_MAX)
-		max_chunk_count = IOV_MAX; /* on older Linux'es */
+			iov_max = IOV_MAX; /* on older Linux'es */
 #else
-		g_assert_not_reached(); /* make sure we provide a work-around in case sysconf() fails on us */
+			g_assert_not_reached(); /* make sure we provide a work-around in case sysconf() fails on us */
 #endif
+		}
+
+		max_chunk_count = iov_max;
 	}
 
 	chunk_count = chunk_count > max_chunk_count ? max_chunk_count : chunk_count;
 
 	g_assert_cmpint(chunk_count, >, 0); /* make sure it is never negative */
 
-	iov = g_new0(struct iovec, chunk_count);
+	/* reuse the iovec-array of the last write */
+	if (NULL == con->iov) {
+		con->iov = g_array_sized_new(FALSE, FALSE, sizeof(struct iovec), chunk_count);
+	}
+	g_array_set_size(con->iov, chunk_count);
+	iov = (struct iovec *)con->iov->data;
 
-	for (chunk = con->send_queue->chunks->head, chunk_id = 0; 
+	for (chunk = send_queue->chunks->head, chunk_id = 0; 
 	     chunk && chunk_id < chunk_count; 
 	     chunk_id++, chunk = chunk->next) {
 		GString *s = chunk->data;
 	
 		if (chunk_id == 0) {
-			g_assert(con->send_queue->offset < s->len);
+			g_assert(send_queue->offset < s->len);
 
-			iov[chunk_id].iov_base = s->str + con->send_queue->offset;
-			iov[chunk_id].iov_len  = s->len - con->send_queue->offset;
+			iov[chunk_id].iov_base = s->str + send_queue->offset;
+			iov[chunk_id].iov_len  = s->len - send_queue->offset;
 		} else {
 			iov[chunk_id].iov_base = s->str;
 			iov[chunk_id].iov_len  = s->len;
 		}
 	}
 
+#ifdef MSG_MORE
+	if (con->write_more) {
+		struct msghdr msg;
+
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov    = iov;
+		msg.msg_iovlen = chunk_count;
+
+		len = sendmsg(con->fd, &msg, MSG_MORE);
+	} else
+#endif
 	len = writev(con->fd, iov, chunk_count);
 	os_errno = errno;
 
-	g_free(iov);
-
 	if (-1 == len) {
 		switch (os_errno) {
 		case E_NET_WOULDBLOCK:
@@ -692,24 +930,24 @@ static network_socket_retval_t network_socket_write_writev(network_socket *con,
 		return NETWORK_SOCKET_ERROR;
 	}
 
-	con->send_queue->offset += len;
-	con->send_queue->len    -= len;
+	send_queue->offset += len;
+	send_queue->len    -= len;
 
 	/* check all the chunks which we have sent out */
-	for (chunk = con->send_queue->chunks->head; chunk; ) {
+	for (chunk = send_queue->chunks->head; chunk; ) {
 		GString *s = chunk->data;
 
-		if (con->send_queue->offset >= s->len) {
-			con->send_queue->offset -= s->len;
+		if (send_queue->offset >= s->len) {
+			send_queue->offset -= s->len;
 #ifdef NETWORK_DEBUG_TRACE_IO
 			/* to trace the data we sent to the socket, enable this */
 			g_debug_hexdump(G_STRLOC, S(s));
 #endif
-			g_string_free(s, TRUE);
+			network_queue_chunk_free(s);
 			
-			g_queue_delete_link(con->send_queue->chunks, chunk);
+			g_queue_delete_link(send_queue->chunks, chunk);
 
-			chunk = con->send_queue->chunks->head;
+			chunk = send_queue->chunks->head;
 		} else {
 			return NETWORK_SOCKET_WAIT_FOR_EVENT;
 		}
@@ -724,22 +962,22 @@ static network_socket_retval_t network_socket_write_writev(network_socket *con,
  *
  * use a loop over send() to be compatible with win32
  */
-static network_socket_retval_t network_socket_write_send(network_socket *con, int send_chunks) {
+static network_socket_retval_t network_socket_write_send(network_socket *con, network_queue *send_queue, int send_chunks) {
 	/* send the whole queue */
 	GList *chunk;
 
 	if (send_chunks == 0) return NETWORK_SOCKET_SUCCESS;
 
-	for (chunk = con->send_queue->chunks->head; chunk; ) {
+	for (chunk = send_queue->chunks->head; chunk; ) {
 		GString *s = chunk->data;
 		gssize len;
 
-		g_assert(con->send_queue->offset < s->len);
+		g_assert(send_queue->offset < s->len);
 
 		if (con->socket_type == SOCK_STREAM) {
-			len = send(con->fd, s->str + con->send_queue->offset, s->len - con->send_queue->offset, 0);
+			len = send(con->fd, s->str + send_queue->offset, s->len - send_queue->offset, 0);
 		} else {
-			len = sendto(con->fd, s->str + con->send_queue->offset, s->len - con->send_queue->offset, 0, &(con->dst->addr.common), con->dst->len);
+			len = sendto(con->fd, s->str + send_queue->offset, s->len - send_queue->offset, 0, &(con->dst->addr.common), con->dst->len);
 		}
 		if (-1 == len) {
 #ifdef _WIN32
@@ -758,7 +996,7 @@ static network_socket_retval_t network_socket_write_send(network_socket *con, in
 				g_message("%s: send(%s, %"G_GSIZE_FORMAT") failed: %s", 
 						G_STRLOC, 
 						con->dst->name->str, 
-						s->len - con->send_queue->offset, 
+						s->len - send_queue->offset, 
 						g_strerror(errno));
 				return NETWORK_SOCKET_ERROR;
 			}
@@ -766,17 +1004,17 @@ static network_socket_retval_t network_socket_write_send(network_socket *con, in
 			return NETWORK_SOCKET_ERROR;
 		}
 
-		con->send_queue->offset += len;
+		send_queue->offset += len;
 
-		if (con->send_queue->offset == s->len) {
-			g_string_free(s, TRUE);
+		if (send_queue->offset == s->len) {
+			network_queue_chunk_free(s);
 			
-			g_queue_delete_link(con->send_queue->chunks, chunk);
-			con->send_queue->offset = 0;
+			g_queue_delete_link(send_queue->chunks, chunk);
+			send_queue->offset = 0;
 
 			if (send_chunks > 0 && --send_chunks == 0) break;
 
-			chunk = con->send_queue->chunks->head;
+			chunk = send_queue->chunks->head;
 		} else {
 			return NETWORK_SOCKET_WAIT_FOR_EVENT;
 		}
@@ -794,14 +1032,91 @@ static network_socket_retval_t network_socket_write_send(network_socket *con, in
  * @returns NETWORK_SOCKET_SUCCESS on success, NETWORK_SOCKET_ERROR on error and NETWORK_SOCKET_WAIT_FOR_EVENT if the call would have blocked 
  */
 network_socket_retval_t network_socket_write(network_socket *con, int send_chunks) {
+	network_queue *send_queue = con->send_queue;
+	network_socket_retval_t ret;
+
+	if (con->compress && send_chunks != 0) {
+		/* wrap all we have into frames, the chunks don't map to frames */
+		if (0 != network_mysqld_compress_deflate(con->compress, con->send_queue)) {
+			return NETWORK_SOCKET_ERROR;
+		}
+		send_queue = con->compress->send_queue;
+		send_chunks = -1;
+	}
+
 	if (con->socket_type == SOCK_STREAM) {
 #ifdef HAVE_WRITEV
-		return network_socket_write_writev(con, send_chunks);
+		ret = network_socket_write_writev(con, send_queue, send_chunks);
 #else
-		return network_socket_write_send(con, send_chunks);
+		ret = network_socket_write_send(con, send_queue, send_chunks);
 #endif
 	} else {
-		return network_socket_write_send(con, send_chunks);
+		ret = network_socket_write_send(con, send_queue, send_chunks);
+	}
+
+	/* ->write_more only applies to this write, don't hold back the next one */
+	con->write_more = FALSE;
+
+	return ret;
+}
+
+/**
+ * switch the socket to the compressed protocol
+ *
+ * the data that is already in the queues was sent and received before the
+ * switch and stays uncompressed. Everything that is appended from now on is
+ * sent as compressed frames.
+ *
+ * @param sock  the socket, sock->compress_min_length is the threshold for compressing a frame
+ * @return 0 on success, -1 if the compressed protocol isn't available
+ */
+int network_socket_set_compressed(network_socket *sock) {
+	network_mysqld_compress *comp;
+	GString *chunk;
+
+	if (sock->compress) return 0;
+
+	if (NULL == (comp = network_mysqld_compress_new(sock->compress_min_length))) return -1;
+
+	/* move the pending plain data in front of the frames */
+	while ((chunk = g_queue_pop_head(sock->send_queue->chunks))) {
+		g_queue_push_tail(comp->send_queue->chunks, chunk);
+	}
+	comp->send_queue->offset = sock->send_queue->offset;
+	comp->send_queue->len    = sock->send_queue->len;
+	sock->send_queue->offset = 0;
+	sock->send_queue->len    = 0;
+
+	sock->compress = comp;
+
+	return 0;
+}
+
+/**
+ * check if a idle connection is still open
+ *
+ * a idle connection has nothing to read. If there is something, it is either the
+ * close of the peer or data we don't expect, the connection can't be used in
+ * both cases. Only works for non-blocking sockets.
+ *
+ * @return TRUE if the connection is open and idle
+ */
+gboolean network_socket_is_alive(network_socket *sock) {
+	char c;
+
+	if (sock->fd < 0) return FALSE;
+
+	if (-1 != recv(sock->fd, &c, 1, MSG_PEEK)) return FALSE;
+
+#ifdef _WIN32
+	errno = WSAGetLastError();
+#endif
+	switch (errno) {
+	case E_NET_WOULDBLOCK:
+	case EAGAIN:
+		return TRUE;
+	default:
+		return FALSE;
 	}
 }
 
@@ -28,6 +28,9 @@
 
 #include "network-exports.h"
 #include "network-queue.h"
+#include "network-mysqld-compress.h"
+#include "network-stmt-cache.h"
+#include "network-mysqld-session.h"
 
 #ifdef HAVE_SYS_TIME_H
 /**
@@ -61,6 +64,18 @@
 
 #include "network-address.h"
 
+/**
+ * read from the sockets until they would block instead of asking ioctl(FIONREAD) first 
+ *
+ * on Linux recv() reliably signals a closed connection by returning 0 which allows
+ * to skip the FIONREAD probe for each read-event
+ *
+ * @see network_socket_read_all()
+ */
+#ifdef __linux__
+#define NETWORK_SOCKET_USE_READ_ALL
+#endif
+
 typedef enum {
 	NETWORK_SOCKET_SUCCESS,
 	NETWORK_SOCKET_WAIT_FOR_EVENT,
@@ -105,14 +120,62 @@ typedef struct {
 	 * statement balancing
 	 */	
 	GString *default_db;     /** default-db of this side of the connection */
+
+	/**
+	 * listen-socket options used by network_socket_bind()
+	 */
+	int listen_backlog;      /** backlog for listen(), defaults to 128 */
+	gboolean reuse_port;     /** set SO_REUSEPORT to allow several listen-sockets on the same address */
+
+	GArray *iov;             /** iovec-array for writev(), kept between the writes */
+	gboolean write_more;     /** more data follows right away, let the kernel coalesce it (MSG_MORE) */
+
+	/**
+	 * the compressed protocol
+	 *
+	 * set by network_socket_set_compressed() after the handshake, NULL if the
+	 * socket talks the normal protocol
+	 */
+	network_mysqld_compress *compress;
+	gsize compress_min_length; /** payloads shorter than this aren't compressed */
+
+	network_stmt_cache *prepared_stmts; /** statements prepared on this backend connection, NULL if they aren't tracked */
+
+	/**
+	 * the session-state of the connection
+	 *
+	 * on the server side the state the server reported, on the client side the
+	 * state the client expects. NULL if CLIENT_SESSION_TRACK isn't used.
+	 */
+	network_mysqld_session *session;
 } network_socket;
 
+/**
+ * state of a splice()-passthrough from one socket to another
+ *
+ * @see network_socket_splice()
+ */
+typedef struct {
+	int pipe_fds[2];    /**< the pipe that buffers the data in the kernel */
+
+	gsize to_read;      /**< bytes which still have to be read from the source */
+	gsize in_pipe;      /**< bytes in the pipe which aren't written to the destination yet */
+} network_socket_splice_t;
+
 NETWORK_API network_socket *network_socket_init(void) G_GNUC_DEPRECATED;
 NETWORK_API network_socket *network_socket_new(void);
 NETWORK_API void network_socket_free(network_socket *s);
 NETWORK_API network_socket_retval_t network_socket_write(network_socket *con, int send_chunks);
 NETWORK_API network_socket_retval_t network_socket_read(network_socket *con);
+NETWORK_API network_socket_retval_t network_socket_read_all(network_socket *con);
+#ifdef HAVE_SPLICE
+NETWORK_API network_socket_splice_t *network_socket_splice_new(void);
+NETWORK_API void network_socket_splice_free(network_socket_splice_t *sp);
+NETWORK_API network_socket_retval_t network_socket_splice(network_socket_splice_t *sp, network_socket *src, network_socket *dst);
+#endif
 NETWORK_API network_socket_retval_t network_socket_to_read(network_socket *sock);
+NETWORK_API gboolean network_socket_is_alive(network_socket *sock);
+NETWORK_API int network_socket_set_compressed(network_socket *sock);
 NETWORK_API network_socket_retval_t network_socket_set_non_blocking(network_socket *sock);
 NETWORK_API network_socket_retval_t network_socket_connect(network_socket *con);
 NETWORK_API network_socket_retval_t network_socket_connect_finish(network_socket *sock);
@@ -0,0 +1,263 @@
+/* $%BEGINLICENSE%$
+ Copyright (c) 2008, 2012, Oracle and/or its affiliates. All rights reserved.
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License as
+ published by the Free Software Foundation; version 2 of the
+ License.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ 02110-1301  USA
+
+ $%ENDLICENSE%$ */
+
+/**
+ * prepared statements across pooled backend connections
+ *
+ * the statement-ids a client sees are virtual and map to the query they were
+ * prepared from. Each backend connection knows which queries are prepared on
+ * it under which statement-id. A command for a statement that isn't prepared
+ * on the backend that got picked for it is held back until the proxy prepared
+ * the query there again.
+ *
+ * statements that are replaced or fall out of the LRU are closed with the
+ * next command that is sent to the backend, as COM_STMT_CLOSE has no response.
+ */
+
+#include <string.h>
+
+#include <glib.h>
+
+#include "network-mysqld-proto.h"
+#include "network-stmt-cache.h"
+#include "string-len.h"
+
+static void network_stmt_cache_entry_free(network_stmt_cache_entry *entry) {
+	if (!entry) return;
+
+	g_string_free(entry->query, TRUE);
+
+	g_free(entry);
+}
+
+network_stmt_cache *network_stmt_cache_new(guint max_stmts) {
+	network_stmt_cache *cache;
+
+	cache = g_new0(network_stmt_cache, 1);
+	cache->stmts = g_hash_table_new((GHashFunc)g_string_hash, (GEqualFunc)g_string_equal);
+	cache->lru = g_queue_new();
+	cache->closed = g_queue_new();
+	cache->max_stmts = max_stmts;
+
+	return cache;
+}
+
+/**
+ * remove a entry from the cache and free it
+ */
+static void network_stmt_cache_remove_entry(network_stmt_cache *cache, network_stmt_cache_entry *entry) {
+	g_hash_table_remove(cache->stmts, entry->query);
+	g_queue_delete_link(cache->lru, entry->lru_link);
+
+	network_stmt_cache_entry_free(entry);
+}
+
+void network_stmt_cache_free(network_stmt_cache *cache) {
+	if (!cache) return;
+
+	network_stmt_cache_clear(cache);
+
+	g_hash_table_destroy(cache->stmts);
+	g_queue_free(cache->lru);
+	g_queue_free(cache->closed);
+
+	g_free(cache);
+}
+
+/**
+ * get the statement-id of a query on this connection
+ *
+ * @return FALSE if the query isn't prepared on the connection
+ */
+gboolean network_stmt_cache_get(network_stmt_cache *cache, GString *query, guint32 *stmt_id) {
+	network_stmt_cache_entry *entry;
+
+	if (NULL == (entry = g_hash_table_lookup(cache->stmts, query))) return FALSE;
+
+	/* move it to the front of the LRU */
+	g_queue_unlink(cache->lru, entry->lru_link);
+	g_queue_push_head_link(cache->lru, entry->lru_link);
+
+	*stmt_id = entry->stmt_id;
+
+	return TRUE;
+}
+
+/**
+ * remember a statement the server prepared
+ *
+ * if the query was prepared already or the cache is full, the older
+ * statement is queued to be closed
+ *
+ * @param query    the query, a copy is kept
+ * @param stmt_id  the statement-id from the COM_STMT_PREPARE response
+ */
+void network_stmt_cache_add(network_stmt_cache *cache, GString *query, guint32 stmt_id) {
+	network_stmt_cache_entry *entry;
+
+	if ((entry = g_hash_table_lookup(cache->stmts, query))) {
+		g_queue_push_tail(cache->closed, GUINT_TO_POINTER(entry->stmt_id));
+		network_stmt_cache_remove_entry(cache, entry);
+	}
+
+	entry = g_new0(network_stmt_cache_entry, 1);
+	entry->query = g_string_new_len(S(query));
+	entry->stmt_id = stmt_id;
+
+	g_queue_push_head(cache->lru, entry);
+	entry->lru_link = cache->lru->head;
+	g_hash_table_insert(cache->stmts, entry->query, entry);
+
+	while (g_hash_table_size(cache->stmts) > cache->max_stmts) {
+		entry = g_queue_peek_tail(cache->lru);
+
+		g_queue_push_tail(cache->closed, GUINT_TO_POINTER(entry->stmt_id));
+		network_stmt_cache_remove_entry(cache, entry);
+	}
+}
+
+/**
+ * forget a statement the client is closing on the server
+ *
+ * @return FALSE if the query isn't prepared on the connection
+ */
+gboolean network_stmt_cache_remove(network_stmt_cache *cache, GString *query) {
+	network_stmt_cache_entry *entry;
+
+	if (NULL == (entry = g_hash_table_lookup(cache->stmts, query))) return FALSE;
+
+	network_stmt_cache_remove_entry(cache, entry);
+
+	return TRUE;
+}
+
+/**
+ * forget all statements
+ *
+ * call it when the server dropped them (COM_CHANGE_USER)
+ */
+void network_stmt_cache_clear(network_stmt_cache *cache) {
+	network_stmt_cache_entry *entry;
+
+	while ((entry = g_queue_peek_tail(cache->lru))) {
+		network_stmt_cache_remove_entry(cache, entry);
+	}
+
+	while (!g_queue_is_empty(cache->closed)) g_queue_pop_head(cache->closed);
+}
+
+/**
+ * append a COM_STMT_CLOSE for each statement that was dropped from the cache
+ *
+ * the server doesn't respond to them, they can follow any command in the send-queue
+ */
+void network_stmt_cache_append_closes(network_stmt_cache *cache, network_queue *send_queue) {
+	while (!g_queue_is_empty(cache->closed)) {
+		GString *packet = g_string_sized_new(NET_HEADER_SIZE + 5);
+
+		g_string_append_len(packet, C("\x05\x00\x00\x00")); /* len = 5, packet-id = 0 */
+		g_string_append_c(packet, COM_STMT_CLOSE);
+		g_string_append_len(packet, C("\x00\x00\x00\x00"));
+
+		network_stmt_set_id(packet, GPOINTER_TO_UINT(g_queue_pop_head(cache->closed)));
+
+		network_queue_append(send_queue, packet);
+	}
+}
+
+static void g_string_free_true(gpointer data) {
+	g_string_free(data, TRUE);
+}
+
+network_stmt_con *network_stmt_con_new(void) {
+	network_stmt_con *sc;
+
+	sc = g_new0(network_stmt_con, 1);
+	sc->queries = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_string_free_true);
+	sc->prepare_query = g_string_new(NULL);
+
+	return sc;
+}
+
+void network_stmt_con_free(network_stmt_con *sc) {
+	if (!sc) return;
+
+	g_hash_table_destroy(sc->queries);
+	g_string_free(sc->prepare_query, TRUE);
+	if (sc->held_packets) g_string_free(sc->held_packets, TRUE);
+
+	g_free(sc);
+}
+
+/**
+ * hand out a new statement-id for a query the client prepared
+ *
+ * @param query  the query, a copy is kept
+ * @return the statement-id the client sees
+ */
+guint32 network_stmt_con_add(network_stmt_con *sc, GString *query) {
+	do {
+		sc->last_stmt_id++;
+	} while (sc->last_stmt_id == 0 ||
+		 g_hash_table_lookup(sc->queries, GUINT_TO_POINTER(sc->last_stmt_id)));
+
+	g_hash_table_insert(sc->queries, GUINT_TO_POINTER(sc->last_stmt_id), g_string_new_len(S(query)));
+
+	return sc->last_stmt_id;
+}
+
+/**
+ * get the query of a statement-id the client uses
+ *
+ * @return NULL if the statement-id wasn't handed out by us
+ */
+GString *network_stmt_con_get(network_stmt_con *sc, guint32 stmt_id) {
+	return g_hash_table_lookup(sc->queries, GUINT_TO_POINTER(stmt_id));
+}
+
+void network_stmt_con_remove(network_stmt_con *sc, guint32 stmt_id) {
+	g_hash_table_remove(sc->queries, GUINT_TO_POINTER(stmt_id));
+}
+
+/**
+ * forget all statements of the client
+ *
+ * call it when the client sends a COM_CHANGE_USER
+ */
+void network_stmt_con_clear(network_stmt_con *sc) {
+	g_hash_table_remove_all(sc->queries);
+}
+
+/**
+ * replace the statement-id of a packet
+ *
+ * the COM_STMT_* commands and the response to COM_STMT_PREPARE both have the
+ * statement-id right after the first byte of the payload
+ *
+ * @param packet  the packet, including the header
+ */
+void network_stmt_set_id(GString *packet, guint32 stmt_id) {
+	g_return_if_fail(packet->len >= NET_HEADER_SIZE + 5);
+
+	packet->str[NET_HEADER_SIZE + 1] = (stmt_id >>  0) & 0xff;
+	packet->str[NET_HEADER_SIZE + 2] = (stmt_id >>  8) & 0xff;
+	packet->str[NET_HEADER_SIZE + 3] = (stmt_id >> 16) & 0xff;
+	packet->str[NET_HEADER_SIZE + 4] = (stmt_id >> 24) & 0xff;
+}
@@ -0,0 +1,94 @@
+/* $%BEGINLICENSE%$
+ Copyright (c) 2008, 2012, Oracle and/or its affiliates. All rights reserved.
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License as
+ published by the Free Software Foundation; version 2 of the
+ License.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ 02110-1301  USA
+
+ $%ENDLICENSE%$ */
+
+
+#ifndef _NETWORK_STMT_CACHE_H_
+#define _NETWORK_STMT_CACHE_H_
+
+#include <glib.h>
+
+#include "network-exports.h"
+#include "network-queue.h"
+
+/**
+ * max number of statements we keep prepared on a backend connection
+ *
+ * the least-recently used statements are closed above this
+ */
+#define NETWORK_STMT_CACHE_MAX_STMTS 256
+
+/**
+ * a statement prepared on a backend connection
+ */
+typedef struct {
+	GString *query;   /**< the query the statement was prepared from */
+	guint32 stmt_id;  /**< the statement-id the server assigned */
+
+	GList *lru_link;  /**< link in the cache->lru list */
+} network_stmt_cache_entry;
+
+/**
+ * the prepared statements of a backend connection
+ *
+ * kept with the network_socket of the backend and stays valid while the
+ * connection is in the pool
+ */
+typedef struct {
+	GHashTable *stmts;  /**< hash<GString *, network_stmt_cache_entry *>, the statements by their query */
+	GQueue *lru;        /**< the entries, last used first */
+	guint max_stmts;
+
+	GQueue *closed;     /**< guint32, statement-ids we have to send a COM_STMT_CLOSE for */
+} network_stmt_cache;
+
+/**
+ * the prepared statements of a client connection
+ *
+ * the client only sees virtual statement-ids which are mapped to the query
+ * they were prepared from. The statement-id on the backend is looked up in
+ * the network_stmt_cache of the backend connection that executes it.
+ */
+typedef struct {
+	GHashTable *queries;   /**< hash<guint32, GString *>, the query of each statement-id the client knows */
+	guint32 last_stmt_id;  /**< the last statement-id we handed out */
+
+	GString *prepare_query; /**< query of the COM_STMT_PREPARE that was sent to the backend */
+	gboolean is_preparing;  /**< the next packet of the backend is the response to the prepare_query */
+	GString *held_packets;  /**< the command that waits until its statement is prepared on the backend again */
+} network_stmt_con;
+
+NETWORK_API network_stmt_cache *network_stmt_cache_new(guint max_stmts);
+NETWORK_API void network_stmt_cache_free(network_stmt_cache *cache);
+NETWORK_API gboolean network_stmt_cache_get(network_stmt_cache *cache, GString *query, guint32 *stmt_id);
+NETWORK_API void network_stmt_cache_add(network_stmt_cache *cache, GString *query, guint32 stmt_id);
+NETWORK_API gboolean network_stmt_cache_remove(network_stmt_cache *cache, GString *query);
+NETWORK_API void network_stmt_cache_clear(network_stmt_cache *cache);
+NETWORK_API void network_stmt_cache_append_closes(network_stmt_cache *cache, network_queue *send_queue);
+
+NETWORK_API network_stmt_con *network_stmt_con_new(void);
+NETWORK_API void network_stmt_con_free(network_stmt_con *sc);
+NETWORK_API guint32 network_stmt_con_add(network_stmt_con *sc, GString *query);
+NETWORK_API GString *network_stmt_con_get(network_stmt_con *sc, guint32 stmt_id);
+NETWORK_API void network_stmt_con_remove(network_stmt_con *sc, guint32 stmt_id);
+NETWORK_API void network_stmt_con_clear(network_stmt_con *sc);
+
+NETWORK_API void network_stmt_set_id(GString *packet, guint32 stmt_id);
+
+#endif
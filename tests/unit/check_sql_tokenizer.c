@@ -29,6 +29,7 @@
 
 #if GLIB_CHECK_VERSION(2, 16, 0)
 #define C(x) x, sizeof(x) - 1
+#define S(x) (x)->str, (x)->len
 
 #define START_TEST(x) void (x)(void)
 #define END_TEST
@@ -714,6 +715,113 @@ void test_literal_digit() {
 
 }
 
+/**
+ * @test normalize queries and fingerprint them
+ */
+START_TEST(test_tokenizer_fingerprint) {
+	GString *norm_a = g_string_new(NULL);
+	GString *norm_b = g_string_new(NULL);
+	guint64 fp_a, fp_b;
+
+	g_assert_cmpint(0, ==, sql_tokenizer_fingerprint(C("SELECT * FROM tbl WHERE id = 1 /* foo */"), norm_a, &fp_a));
+	g_assert_cmpstr(norm_a->str, ==, "SELECT * FROM `tbl` WHERE `id` = ? ");
+
+	/* case of keywords and constants don't change the fingerprint */
+	g_assert_cmpint(0, ==, sql_tokenizer_fingerprint(C("select *\nfrom tbl where id = 'abc'"), norm_b, &fp_b));
+	g_assert_cmpstr(norm_a->str, ==, norm_b->str);
+	g_assert(fp_a == fp_b);
+	g_assert(fp_a == sql_fingerprint_hash(norm_a->str, norm_a->len));
+
+	/* ... the identifiers do */
+	g_string_truncate(norm_b, 0);
+	g_assert_cmpint(0, ==, sql_tokenizer_fingerprint(C("SELECT * FROM tbl2 WHERE id = 1"), norm_b, &fp_b));
+	g_assert(fp_a != fp_b);
+
+	/* the literal-keywords are only upper-cased at the start of the query */
+	g_string_truncate(norm_a, 0);
+	g_assert_cmpint(0, ==, sql_tokenizer_fingerprint(C("start transaction"), norm_a, NULL));
+	g_assert_cmpstr(norm_a->str, ==, "START TRANSACTION ");
+
+	g_string_truncate(norm_a, 0);
+	g_assert_cmpint(0, ==, sql_tokenizer_fingerprint(C("SELECT begin, @a, /*!40101 foo */ NOW()"), norm_a, NULL));
+	g_assert_cmpstr(norm_a->str, ==, "SELECT `begin` , @a , /*!40101 foo */ NOW( ) ");
+
+	/* folding while scanning gives the same as normalizing the token list, also if the last token is a comment */
+	{
+		GPtrArray *tokens = sql_tokens_new();
+		const char *query = "SELECT 'a''b\\'c', `x``y` FROM t /*!40101 foo */ -- bar\n";
+
+		g_string_truncate(norm_a, 0);
+		g_string_truncate(norm_b, 0);
+		g_assert_cmpint(0, ==, sql_tokenizer_fingerprint(query, strlen(query), norm_a, &fp_a));
+		g_assert_cmpint(0, ==, sql_tokenizer(tokens, query, strlen(query)));
+		sql_tokens_normalize(tokens, norm_b);
+		g_assert_cmpstr(norm_a->str, ==, norm_b->str);
+		g_assert(fp_a == sql_fingerprint_hash(S(norm_b)));
+
+		sql_tokens_free(tokens);
+	}
+
+	g_string_free(norm_a, TRUE);
+	g_string_free(norm_b, TRUE);
+} END_TEST
+
+/**
+ * @test tokens in a arena are the same as the ones on the heap
+ */
+START_TEST(test_tokenizer_arena) {
+	GPtrArray *tokens;
+	sql_tokens_arena *arena, *reused;
+	GString *long_query;
+	gsize i;
+
+#define Q "SELECT 'abc''d', `e``f` /* a comment * with a star */ FROM tbl WHERE id = 1.5 -- end\n"
+	tokens = sql_tokens_new();
+	g_assert_cmpint(0, ==, sql_tokenizer(tokens, C(Q)));
+
+	arena = sql_tokens_arena_new();
+	g_assert_cmpint(0, ==, sql_tokenizer_arena(arena, C(Q)));
+#undef Q
+
+	g_assert_cmpint(tokens->len, ==, arena->tokens->len);
+	for (i = 0; i < tokens->len; i++) {
+		sql_token *heap_token = tokens->pdata[i];
+		sql_token *arena_token = arena->tokens->pdata[i];
+
+		g_assert_cmpint(heap_token->token_id, ==, arena_token->token_id);
+		g_assert_cmpint(heap_token->text->len, ==, arena_token->text->len);
+		g_assert_cmpstr(heap_token->text->str, ==, arena_token->text->str);
+	}
+	sql_tokens_free(tokens);
+
+	/* a freed arena is handed out again */
+	sql_tokens_arena_free(arena);
+	reused = sql_tokens_arena_new();
+	g_assert(reused == arena);
+	g_assert_cmpint(reused->tokens->len, ==, 0);
+
+	/* a query that needs more than one block, the blocks are merged on reset */
+	long_query = g_string_new(NULL);
+	for (i = 0; i < 2000; i++) {
+		g_string_append(long_query, "SELECT 'a string', 1 ; ");
+	}
+	g_assert_cmpint(0, ==, sql_tokenizer_arena(reused, S(long_query)));
+	g_assert_cmpint(reused->tokens->len, ==, 2000 * 4);
+	for (i = 0; i < reused->tokens->len; i += 4) {
+		sql_token *token = reused->tokens->pdata[i + 1];
+
+		g_assert_cmpint(token->token_id, ==, TK_STRING);
+		g_assert_cmpstr(token->text->str, ==, "a string");
+	}
+	g_assert_cmpint(reused->blocks->len, >, 1);
+
+	sql_tokens_arena_reset(reused);
+	g_assert_cmpint(reused->blocks->len, ==, 1);
+	g_assert_cmpint(reused->tokens->len, ==, 0);
+
+	g_string_free(long_query, TRUE);
+	sql_tokens_arena_free(reused);
+} END_TEST
 
 int main(int argc, char **argv) {
 	g_test_init(&argc, &argv, NULL);
@@ -731,6 +839,8 @@ int main(int argc, char **argv) {
 	g_test_add_func("/core/tokenizer_startstate_reset_comment", test_startstate_reset_comment);
 
 	g_test_add_func("/core/tokenizer_literal_digit", test_literal_digit);
+	g_test_add_func("/core/tokenizer_fingerprint", test_tokenizer_fingerprint);
+	g_test_add_func("/core/tokenizer_arena", test_tokenizer_arena);
 
 	return g_test_run();
 }
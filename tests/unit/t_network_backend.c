@@ -128,6 +128,369 @@ void t_network_backends_check() {
 	network_backends_free(backends);
 }
 
+/**
+ * the first sample is taken as is, the next ones are weighted
+ */
+void t_network_backend_latency_update() {
+	network_backend_t *backend;
+
+	backend = network_backend_new();
+	g_assert(backend->connect_latency == 0.0);
+
+	network_backend_latency_update(&backend->connect_latency, 1000);
+	g_assert_cmpfloat(backend->connect_latency, ==, 1000);
+
+	network_backend_latency_update(&backend->connect_latency, 2000);
+	g_assert_cmpfloat(backend->connect_latency, ==, 1000 + NETWORK_BACKEND_LATENCY_WEIGHT * 1000);
+
+	network_backend_free(backend);
+}
+
+/**
+ * a backend goes DOWN after 'fall' failed checks and UP after 'rise' successful ones
+ */
+void t_network_backend_check_done() {
+	network_backends_t *backends;
+	network_backend_t *backend;
+
+	backends = network_backends_new();
+	g_assert_cmpint(network_backends_add(backends, "127.0.0.1", BACKEND_TYPE_RW), ==, 0);
+	backend = network_backends_get(backends, 0);
+
+	/* UNKNOWN goes UP with the first successful check */
+	g_assert_cmpint(1, ==, network_backend_check_done(backend, TRUE, 2, 3));
+	g_assert_cmpint(BACKEND_STATE_UP, ==, backend->state);
+	g_assert_cmpint(0, ==, network_backend_check_done(backend, TRUE, 2, 3));
+
+	/* a success in between resets the failures */
+	g_assert_cmpint(0, ==, network_backend_check_done(backend, FALSE, 2, 3));
+	g_assert_cmpint(0, ==, network_backend_check_done(backend, FALSE, 2, 3));
+	g_assert_cmpint(0, ==, network_backend_check_done(backend, TRUE, 2, 3));
+	g_assert_cmpint(0, ==, network_backend_check_done(backend, FALSE, 2, 3));
+	g_assert_cmpint(0, ==, network_backend_check_done(backend, FALSE, 2, 3));
+	g_assert_cmpint(BACKEND_STATE_UP, ==, backend->state);
+
+	g_assert_cmpint(1, ==, network_backend_check_done(backend, FALSE, 2, 3));
+	g_assert_cmpint(BACKEND_STATE_DOWN, ==, backend->state);
+
+	g_assert_cmpint(0, ==, network_backend_check_done(backend, TRUE, 2, 3));
+	g_assert_cmpint(BACKEND_STATE_DOWN, ==, backend->state);
+	g_assert_cmpint(1, ==, network_backend_check_done(backend, TRUE, 2, 3));
+	g_assert_cmpint(BACKEND_STATE_UP, ==, backend->state);
+
+	/* the checker wakes up the DOWN backends, not the timer */
+	backend->state = BACKEND_STATE_DOWN;
+	backend->state_since.tv_sec -= 5;
+	backends->backend_last_check.tv_sec -= 1;
+	backends->is_health_checked = TRUE;
+	g_assert_cmpint(0, ==, network_backends_check(backends));
+	g_assert_cmpint(BACKEND_STATE_DOWN, ==, backend->state);
+
+	network_backends_free(backends);
+}
+
+/**
+ * @test the weight is split off the address
+ */
+void t_network_backends_add_weight() {
+	network_backends_t *backends;
+
+	backends = network_backends_new();
+
+	g_assert_cmpint(network_backends_add(backends, "127.0.0.1:3306@3", BACKEND_TYPE_RW), ==, 0);
+	g_assert_cmpint(network_backends_get(backends, 0)->weight, ==, 3);
+	g_assert_cmpstr(network_backends_get(backends, 0)->addr->name->str, ==, "127.0.0.1:3306");
+
+	g_assert_cmpint(network_backends_add(backends, "127.0.0.1:3307", BACKEND_TYPE_RW), ==, 0);
+	g_assert_cmpint(network_backends_get(backends, 1)->weight, ==, 1);
+
+	g_assert_cmpint(network_backends_add(backends, "127.0.0.1:3308@0", BACKEND_TYPE_RW), ==, -1);
+	g_assert_cmpint(network_backends_add(backends, "127.0.0.1:3308@101", BACKEND_TYPE_RW), ==, -1);
+
+	g_assert_cmpint(network_backends_count(backends), ==, 2);
+
+	network_backends_free(backends);
+}
+
+/**
+ * @test the weighted round-robin follows the weights and skips DOWN backends
+ */
+void t_network_backends_balance_wrr() {
+	network_backends_t *backends;
+	guint picks[2] = { 0, 0 };
+	guint i;
+
+	backends = network_backends_new();
+	g_assert_cmpint(network_backends_add(backends, "127.0.0.1:3306@3", BACKEND_TYPE_RW), ==, 0);
+	g_assert_cmpint(network_backends_add(backends, "127.0.0.1:3307", BACKEND_TYPE_RW), ==, 0);
+	g_assert_cmpint(network_backends_add(backends, "127.0.0.1:3308", BACKEND_TYPE_RO), ==, 0);
+	network_backends_set_balance(backends, BACKEND_TYPE_RW, BACKEND_BALANCE_WRR);
+
+	for (i = 0; i < 8; i++) {
+		gint ndx = network_backends_balance(backends, BACKEND_TYPE_RW, NULL, NULL);
+
+		g_assert_cmpint(ndx, >=, 0);
+		g_assert_cmpint(ndx, <, 2);
+		picks[ndx]++;
+	}
+	g_assert_cmpint(picks[0], ==, 6);
+	g_assert_cmpint(picks[1], ==, 2);
+
+	network_backends_get(backends, 0)->state = BACKEND_STATE_DOWN;
+	for (i = 0; i < 4; i++) {
+		g_assert_cmpint(network_backends_balance(backends, BACKEND_TYPE_RW, NULL, NULL), ==, 1);
+	}
+
+	network_backends_get(backends, 1)->state = BACKEND_STATE_DOWN;
+	g_assert_cmpint(network_backends_balance(backends, BACKEND_TYPE_RW, NULL, NULL), ==, -1);
+
+	/* the other group isn't affected */
+	g_assert_cmpint(network_backends_balance(backends, BACKEND_TYPE_RO, NULL, NULL), ==, 2);
+
+	network_backends_free(backends);
+}
+
+/**
+ * @test the same user gets the same backend, only the users of a DOWN backend move
+ */
+void t_network_backends_balance_hash() {
+	network_backends_t *backends;
+	gint before[32];
+	GString *user;
+	guint i;
+
+	backends = network_backends_new();
+	g_assert_cmpint(network_backends_add(backends, "127.0.0.1:3306", BACKEND_TYPE_RO), ==, 0);
+	g_assert_cmpint(network_backends_add(backends, "127.0.0.1:3307", BACKEND_TYPE_RO), ==, 0);
+	g_assert_cmpint(network_backends_add(backends, "127.0.0.1:3308", BACKEND_TYPE_RO), ==, 0);
+	network_backends_set_balance(backends, BACKEND_TYPE_RO, BACKEND_BALANCE_HASH_USER);
+	user = g_string_new(NULL);
+
+	for (i = 0; i < G_N_ELEMENTS(before); i++) {
+		g_string_printf(user, "user%u", i);
+
+		before[i] = network_backends_balance(backends, BACKEND_TYPE_RO, user, NULL);
+		g_assert_cmpint(before[i], >=, 0);
+		g_assert_cmpint(before[i], ==, network_backends_balance(backends, BACKEND_TYPE_RO, user, NULL));
+	}
+
+	network_backends_get(backends, 0)->state = BACKEND_STATE_DOWN;
+
+	for (i = 0; i < G_N_ELEMENTS(before); i++) {
+		gint ndx;
+
+		g_string_printf(user, "user%u", i);
+		ndx = network_backends_balance(backends, BACKEND_TYPE_RO, user, NULL);
+
+		g_assert_cmpint(ndx, !=, 0);
+		if (before[i] != 0) g_assert_cmpint(ndx, ==, before[i]);
+	}
+
+	/* without a username we fall back to the round-robin */
+	g_assert_cmpint(network_backends_balance(backends, BACKEND_TYPE_RO, NULL, NULL), >, 0);
+
+	g_string_free(user, TRUE);
+	network_backends_free(backends);
+}
+
+/**
+ * @test p2c takes the backend with less queries in flight, latency the fastest one
+ */
+void t_network_backends_balance_p2c_latency() {
+	network_backends_t *backends;
+	network_backend_t *a, *b;
+
+	backends = network_backends_new();
+	g_assert_cmpint(network_backends_add(backends, "127.0.0.1:3306", BACKEND_TYPE_RW), ==, 0);
+	g_assert_cmpint(network_backends_add(backends, "127.0.0.1:3307", BACKEND_TYPE_RW), ==, 0);
+	a = network_backends_get(backends, 0);
+	b = network_backends_get(backends, 1);
+
+	network_backends_set_balance(backends, BACKEND_TYPE_RW, BACKEND_BALANCE_P2C);
+	a->in_flight = 5;
+	b->in_flight = 1;
+	g_assert_cmpint(network_backends_balance(backends, BACKEND_TYPE_RW, NULL, NULL), ==, 1);
+
+	network_backends_set_balance(backends, BACKEND_TYPE_RW, BACKEND_BALANCE_LATENCY);
+	a->connect_latency = 300;
+	b->connect_latency = 500;
+	b->query_latency = 900;
+	network_backends_update_latency(backends);
+	g_assert_cmpint(network_backends_balance(backends, BACKEND_TYPE_RW, NULL, NULL), ==, 0);
+
+	/* the fastest is DOWN, fall back to the queries in flight */
+	a->state = BACKEND_STATE_DOWN;
+	g_assert_cmpint(network_backends_balance(backends, BACKEND_TYPE_RW, NULL, NULL), ==, 1);
+
+	network_backends_free(backends);
+}
+
+/**
+ * @test a unknown lag isn't lagging, a stopped replication always is
+ */
+void t_network_backend_is_lagging() {
+	network_backend_t *backend;
+
+	backend = network_backend_new();
+
+	g_assert_cmpint(backend->replication_lag, ==, NETWORK_BACKEND_LAG_UNKNOWN);
+	g_assert(!network_backend_is_lagging(backend, 0));
+
+	backend->replication_lag = 10;
+	g_assert(!network_backend_is_lagging(backend, -1));
+	g_assert(!network_backend_is_lagging(backend, 10));
+	g_assert(network_backend_is_lagging(backend, 9));
+
+	backend->replication_lag = NETWORK_BACKEND_LAG_STOPPED;
+	g_assert(!network_backend_is_lagging(backend, -1));
+	g_assert(network_backend_is_lagging(backend, 3600));
+
+	network_backend_free(backend);
+}
+
+/**
+ * @test lagging backends are skipped, the max-lag of the group can be overridden
+ */
+void t_network_backends_balance_max_lag() {
+	network_backends_t *backends;
+	guint i;
+
+	backends = network_backends_new();
+	g_assert_cmpint(network_backends_add(backends, "127.0.0.1:3306", BACKEND_TYPE_RO), ==, 0);
+	g_assert_cmpint(network_backends_add(backends, "127.0.0.1:3307", BACKEND_TYPE_RO), ==, 0);
+	network_backends_set_balance(backends, BACKEND_TYPE_RO, BACKEND_BALANCE_WRR);
+	network_backends_set_max_lag(backends, BACKEND_TYPE_RO, 5);
+
+	network_backends_get(backends, 0)->replication_lag = 60;
+	network_backends_get(backends, 1)->replication_lag = 2;
+
+	for (i = 0; i < 4; i++) {
+		g_assert_cmpint(network_backends_balance(backends, BACKEND_TYPE_RO, NULL, NULL), ==, 1);
+	}
+
+	/* all of them lag */
+	g_assert_cmpint(network_backends_balance_max_lag(backends, BACKEND_TYPE_RO, NULL, NULL, 1), ==, -1);
+
+	/* any lag will do */
+	g_assert_cmpint(network_backends_balance_max_lag(backends, BACKEND_TYPE_RO, NULL, NULL, -1), >=, 0);
+
+	/* the latency policy skips a lagging fastest backend */
+	network_backends_set_balance(backends, BACKEND_TYPE_RO, BACKEND_BALANCE_LATENCY);
+	network_backends_get(backends, 0)->connect_latency = 100;
+	network_backends_get(backends, 1)->connect_latency = 900;
+	network_backends_update_latency(backends);
+	g_assert_cmpint(network_backends_balance(backends, BACKEND_TYPE_RO, NULL, NULL), ==, 1);
+	g_assert_cmpint(network_backends_balance_max_lag(backends, BACKEND_TYPE_RO, NULL, NULL, 60), ==, 0);
+
+	network_backends_free(backends);
+}
+
+/**
+ * @test changing the backends publishes a new snapshot, the old one stays readable
+ */
+void t_network_backends_snapshot() {
+	network_backends_t *backends;
+	network_backends_snapshot_t *snapshot;
+	guint version;
+
+	backends = network_backends_new();
+	snapshot = network_backends_get_snapshot(backends);
+	g_assert(snapshot != NULL);
+	g_assert_cmpint(snapshot->backends->len, ==, 0);
+	version = snapshot->version;
+
+	g_assert_cmpint(network_backends_add(backends, "127.0.0.1:3306", BACKEND_TYPE_RW), ==, 0);
+	snapshot = network_backends_get_snapshot(backends);
+	g_assert_cmpint(snapshot->version, >, version);
+	g_assert_cmpint(snapshot->backends->len, ==, 1);
+	g_assert_cmpint(snapshot->groups[BACKEND_TYPE_RW].members->len, ==, 1);
+	g_assert_cmpint(snapshot->groups[BACKEND_TYPE_RO].members->len, ==, 0);
+
+	/* a known backend doesn't change the snapshot */
+	version = snapshot->version;
+	g_assert_cmpint(network_backends_add(backends, "127.0.0.1:3306", BACKEND_TYPE_RW), ==, -1);
+	g_assert(network_backends_get_snapshot(backends) == snapshot);
+	g_assert_cmpint(network_backends_get_snapshot(backends)->version, ==, version);
+
+	network_backends_free(backends);
+}
+
+/**
+ * @test a drained backend keeps its index but gets no new clients until it is added again
+ */
+void t_network_backends_drain() {
+	network_backends_t *backends;
+	guint i;
+
+	backends = network_backends_new();
+	g_assert_cmpint(network_backends_add(backends, "127.0.0.1:3306", BACKEND_TYPE_RW), ==, 0);
+	g_assert_cmpint(network_backends_add(backends, "127.0.0.1:3307", BACKEND_TYPE_RW), ==, 0);
+	network_backends_set_balance(backends, BACKEND_TYPE_RW, BACKEND_BALANCE_WRR);
+
+	g_assert_cmpint(network_backends_drain(backends, 2), ==, -1);
+	g_assert_cmpint(network_backends_drain(backends, 0), ==, 0);
+	g_assert(network_backends_get(backends, 0)->is_drained);
+	g_assert_cmpint(network_backends_count(backends), ==, 2);
+
+	for (i = 0; i < 4; i++) {
+		g_assert_cmpint(network_backends_balance(backends, BACKEND_TYPE_RW, NULL, NULL), ==, 1);
+	}
+
+	network_backends_get(backends, 1)->state = BACKEND_STATE_DOWN;
+	g_assert_cmpint(network_backends_balance(backends, BACKEND_TYPE_RW, NULL, NULL), ==, -1);
+
+	/* adding it again brings it back at the same index */
+	g_assert_cmpint(network_backends_add(backends, "127.0.0.1:3306@2", BACKEND_TYPE_RW), ==, 0);
+	g_assert_cmpint(network_backends_count(backends), ==, 2);
+	g_assert(!network_backends_get(backends, 0)->is_drained);
+	g_assert_cmpint(network_backends_get(backends, 0)->weight, ==, 2);
+	g_assert_cmpint(network_backends_balance(backends, BACKEND_TYPE_RW, NULL, NULL), ==, 0);
+
+	network_backends_free(backends);
+}
+
+/**
+ * @test a new weight changes the schedule of the weighted round-robin
+ */
+void t_network_backends_set_weight() {
+	network_backends_t *backends;
+	guint picks[2] = { 0, 0 };
+	guint i;
+
+	backends = network_backends_new();
+	g_assert_cmpint(network_backends_add(backends, "127.0.0.1:3306", BACKEND_TYPE_RW), ==, 0);
+	g_assert_cmpint(network_backends_add(backends, "127.0.0.1:3307", BACKEND_TYPE_RW), ==, 0);
+	network_backends_set_balance(backends, BACKEND_TYPE_RW, BACKEND_BALANCE_WRR);
+
+	g_assert_cmpint(network_backends_set_weight(backends, 0, 0), ==, -1);
+	g_assert_cmpint(network_backends_set_weight(backends, 0, NETWORK_BACKEND_MAX_WEIGHT + 1), ==, -1);
+	g_assert_cmpint(network_backends_set_weight(backends, 2, 1), ==, -1);
+	g_assert_cmpint(network_backends_set_weight(backends, 1, 3), ==, 0);
+	g_assert_cmpint(network_backends_get(backends, 1)->weight, ==, 3);
+
+	for (i = 0; i < 8; i++) {
+		gint ndx = network_backends_balance(backends, BACKEND_TYPE_RW, NULL, NULL);
+
+		g_assert_cmpint(ndx, >=, 0);
+		g_assert_cmpint(ndx, <, 2);
+		picks[ndx]++;
+	}
+	g_assert_cmpint(picks[0], ==, 2);
+	g_assert_cmpint(picks[1], ==, 6);
+
+	network_backends_free(backends);
+}
+
+void t_network_backends_balance_from_string() {
+	backend_balance_t policy;
+
+	g_assert_cmpint(0, ==, network_backends_balance_from_string("wrr", &policy));
+	g_assert_cmpint(BACKEND_BALANCE_WRR, ==, policy);
+	g_assert_cmpint(0, ==, network_backends_balance_from_string("hash-schema", &policy));
+	g_assert_cmpint(BACKEND_BALANCE_HASH_SCHEMA, ==, policy);
+	g_assert_cmpint(-1, ==, network_backends_balance_from_string("random", &policy));
+}
+
 int main(int argc, char **argv) {
 #ifdef WIN32
 	WSADATA wsaData;
@@ -148,6 +511,18 @@ int main(int argc, char **argv) {
 	g_test_add_func("/core/network_backend_new", t_network_backend_new);
 	g_test_add_func("/core/network_backends_add", t_network_backends_add);
 	g_test_add_func("/core/network_backends_check", t_network_backends_check);
+	g_test_add_func("/core/network_backend_latency_update", t_network_backend_latency_update);
+	g_test_add_func("/core/network_backend_check_done", t_network_backend_check_done);
+	g_test_add_func("/core/network_backends_add_weight", t_network_backends_add_weight);
+	g_test_add_func("/core/network_backends_balance_wrr", t_network_backends_balance_wrr);
+	g_test_add_func("/core/network_backends_balance_hash", t_network_backends_balance_hash);
+	g_test_add_func("/core/network_backends_balance_p2c_latency", t_network_backends_balance_p2c_latency);
+	g_test_add_func("/core/network_backends_balance_from_string", t_network_backends_balance_from_string);
+	g_test_add_func("/core/network_backend_is_lagging", t_network_backend_is_lagging);
+	g_test_add_func("/core/network_backends_balance_max_lag", t_network_backends_balance_max_lag);
+	g_test_add_func("/core/network_backends_snapshot", t_network_backends_snapshot);
+	g_test_add_func("/core/network_backends_drain", t_network_backends_drain);
+	g_test_add_func("/core/network_backends_set_weight", t_network_backends_set_weight);
 
 	return g_test_run();
 }
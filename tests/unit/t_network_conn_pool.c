@@ -0,0 +1,292 @@
+/* $%BEGINLICENSE%$
+ Copyright (c) 2009, 2012, Oracle and/or its affiliates. All rights reserved.
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License as
+ published by the Free Software Foundation; version 2 of the
+ License.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ 02110-1301  USA
+
+ $%ENDLICENSE%$ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "network-mysqld-packet.h"
+#include "network-conn-pool.h"
+
+#if GLIB_CHECK_VERSION(2, 16, 0)
+
+/**
+ * create a authed socket that isn't connected
+ */
+static network_socket *t_pool_socket_new(const char *username, const char *default_db, guint8 charset) {
+	network_socket *sock;
+
+	sock = network_socket_new();
+	sock->response = network_mysqld_auth_response_new(0);
+	g_string_assign(sock->response->username, username);
+	sock->response->charset = charset;
+	g_string_assign(sock->default_db, default_db);
+
+	return sock;
+}
+
+/**
+ * @test connections are found by user, default-db and charset
+ */
+void t_pool_get_authed() {
+	network_connection_pool *pool;
+	network_socket *x, *y, *x_utf8, *sock;
+	GString *user_a, *user_b, *db_y, *db_z;
+
+	pool = network_connection_pool_new();
+	user_a = g_string_new("a");
+	user_b = g_string_new("b");
+	db_y = g_string_new("y");
+	db_z = g_string_new("z");
+
+	x = t_pool_socket_new("a", "x", 8);
+	y = t_pool_socket_new("a", "y", 8);
+	x_utf8 = t_pool_socket_new("a", "x", 33);
+
+	network_connection_pool_add(pool, x);
+	network_connection_pool_add(pool, y);
+	network_connection_pool_add(pool, x_utf8);
+
+	g_assert_cmpint(network_connection_pool_get_idle(pool, user_a), ==, 3);
+	g_assert_cmpint(network_connection_pool_get_idle(pool, user_b), ==, 0);
+	g_assert_cmpint(network_connection_pool_get_idle(pool, NULL), ==, 3);
+
+	g_assert(NULL == network_connection_pool_get_authed(pool, user_b, db_y, 8, NULL));
+
+	/* same default-db */
+	sock = network_connection_pool_get_authed(pool, user_a, db_y, 8, NULL);
+	g_assert(sock == y);
+	network_connection_pool_add(pool, sock);
+
+	/* no connection with that default-db, only the charset has to match */
+	sock = network_connection_pool_get_authed(pool, user_a, db_z, 33, NULL);
+	g_assert(sock == x_utf8);
+	network_socket_free(sock);
+
+	g_assert(NULL == network_connection_pool_get_authed(pool, user_a, db_z, 33, NULL));
+	g_assert_cmpint(network_connection_pool_get_idle(pool, user_a), ==, 2);
+
+	g_string_free(db_z, TRUE);
+	g_string_free(db_y, TRUE);
+	g_string_free(user_b, TRUE);
+	g_string_free(user_a, TRUE);
+	network_connection_pool_free(pool);
+}
+
+/**
+ * @test the oldest connections are closed if there are more than max_idle_connections
+ */
+void t_pool_max_idle() {
+	network_connection_pool *pool;
+	network_socket *first, *sock;
+	GString *user_a;
+	guint i;
+
+	pool = network_connection_pool_new();
+	pool->max_idle_connections = 2;
+	user_a = g_string_new("a");
+
+	first = t_pool_socket_new("a", "", 8);
+	network_connection_pool_add(pool, first);
+
+	for (i = 0; i < 2; i++) {
+		network_connection_pool_add(pool, t_pool_socket_new("a", "", 8));
+	}
+
+	g_assert_cmpint(network_connection_pool_get_idle(pool, NULL), ==, 2);
+
+	for (i = 0; i < 2; i++) {
+		sock = network_connection_pool_get_authed(pool, user_a, NULL, 8, NULL);
+		g_assert(sock != NULL);
+		g_assert(sock != first);
+		network_socket_free(sock);
+	}
+
+	g_assert(NULL == network_connection_pool_get_authed(pool, user_a, NULL, 8, NULL));
+
+	g_string_free(user_a, TRUE);
+	network_connection_pool_free(pool);
+}
+
+/**
+ * @test a connection of another user is only taken if it has more than min_idle_connections
+ */
+void t_pool_min_idle() {
+	network_connection_pool *pool;
+	network_socket *sock;
+
+	pool = network_connection_pool_new();
+	pool->min_idle_connections = 1;
+
+	network_connection_pool_add(pool, t_pool_socket_new("a", "", 8));
+	g_assert(NULL == network_connection_pool_get_authed(pool, NULL, NULL, 0, NULL));
+
+	network_connection_pool_add(pool, t_pool_socket_new("a", "", 8));
+	sock = network_connection_pool_get_authed(pool, NULL, NULL, 0, NULL);
+	g_assert(sock != NULL);
+	network_socket_free(sock);
+
+	g_assert_cmpint(network_connection_pool_get_idle(pool, NULL), ==, 1);
+
+	network_connection_pool_free(pool);
+}
+
+/**
+ * @test the oldest connections of a thread move to the overflow, closed ones aren't handed out
+ */
+void t_pool_overflow() {
+	network_connection_pool *pool;
+	network_connection_pool_entry *entry;
+	network_socket *sock;
+	GString *user_a;
+	guint i;
+
+	pool = network_connection_pool_new();
+	user_a = g_string_new("a");
+
+	for (i = 0; i <= NETWORK_CONNECTION_POOL_LOCAL_IDLE; i++) {
+		entry = network_connection_pool_add(pool, t_pool_socket_new("a", "", 8));
+		g_assert(entry != NULL);
+	}
+
+	g_assert_cmpint(pool->overflow.entries->length, ==, 1);
+	g_assert_cmpint(network_connection_pool_get_idle(pool, user_a), ==, NETWORK_CONNECTION_POOL_LOCAL_IDLE + 1);
+
+	for (i = 0; i < NETWORK_CONNECTION_POOL_LOCAL_IDLE; i++) {
+		sock = network_connection_pool_get_authed(pool, user_a, NULL, 8, NULL);
+		g_assert(sock != NULL);
+		network_socket_free(sock);
+	}
+
+	/* the one in the overflow has no open fd */
+	g_assert(NULL == network_connection_pool_get_authed(pool, user_a, NULL, 8, NULL));
+	g_assert_cmpint(network_connection_pool_get_idle(pool, NULL), ==, 0);
+
+	g_string_free(user_a, TRUE);
+	network_connection_pool_free(pool);
+}
+
+/**
+ * @test connections that idled for max_idle_time aren't handed out and get reaped
+ */
+void t_pool_max_idle_time() {
+	network_connection_pool *pool;
+	network_connection_pool_entry *entry;
+	network_socket *fresh, *sock;
+	GString *user_a;
+
+	pool = network_connection_pool_new();
+	pool->max_idle_time = 10;
+	user_a = g_string_new("a");
+
+	entry = network_connection_pool_add(pool, t_pool_socket_new("a", "", 8));
+	entry->added_ts.tv_sec -= 10;
+	fresh = t_pool_socket_new("a", "", 8);
+	network_connection_pool_add(pool, fresh);
+
+	/* the oldest is taken first, but it is too old */
+	sock = network_connection_pool_get(pool, user_a, NULL);
+	g_assert(sock == fresh);
+	network_socket_free(sock);
+	g_assert_cmpint(network_connection_pool_get_idle(pool, NULL), ==, 0);
+
+	/* the shared connections are in the overflow */
+	network_connection_pool_add_shared(pool, t_pool_socket_new("a", "", 8));
+	network_connection_pool_add_shared(pool, t_pool_socket_new("a", "", 8));
+	g_assert_cmpint(pool->overflow.entries->length, ==, 2);
+
+	entry = g_queue_peek_head(pool->overflow.entries);
+	entry->added_ts.tv_sec -= 10;
+
+	g_assert_cmpint(network_connection_pool_reap(pool), ==, 1);
+	g_assert_cmpint(network_connection_pool_get_idle(pool, user_a), ==, 1);
+
+	pool->max_idle_time = 0;
+	entry = g_queue_peek_head(pool->overflow.entries);
+	entry->added_ts.tv_sec -= 10;
+	g_assert_cmpint(network_connection_pool_reap(pool), ==, 0);
+
+	g_string_free(user_a, TRUE);
+	network_connection_pool_free(pool);
+}
+
+static void t_pool_waiter_wakeup(gpointer user_data) {
+	guint *woken = user_data;
+
+	(*woken)++;
+}
+
+/**
+ * @test waiters are woken up once by the next added connection, which goes to the overflow
+ */
+void t_pool_wait() {
+	network_connection_pool *pool;
+	network_connection_pool_waiter waiter;
+	guint woken = 0;
+
+	pool = network_connection_pool_new();
+	waiter.wakeup = t_pool_waiter_wakeup;
+	waiter.user_data = &woken;
+
+	network_connection_pool_wait(pool, &waiter);
+	network_connection_pool_wait(pool, &waiter);
+
+	g_assert(NULL == network_connection_pool_add(pool, t_pool_socket_new("a", "", 8)));
+	g_assert_cmpint(woken, ==, 1);
+	g_assert_cmpint(pool->overflow.entries->length, ==, 1);
+
+	/* nobody waits anymore, back to the shard of the thread */
+	g_assert(NULL != network_connection_pool_add(pool, t_pool_socket_new("a", "", 8)));
+	g_assert_cmpint(woken, ==, 1);
+
+	network_connection_pool_wait(pool, &waiter);
+	network_connection_pool_unwait(pool, &waiter);
+	network_connection_pool_add_shared(pool, t_pool_socket_new("a", "", 8));
+	g_assert_cmpint(woken, ==, 1);
+
+	network_connection_pool_wait(pool, &waiter);
+	network_connection_pool_add_shared(pool, t_pool_socket_new("a", "", 8));
+	g_assert_cmpint(woken, ==, 2);
+
+	network_connection_pool_free(pool);
+}
+
+int main(int argc, char **argv) {
+	g_thread_init(NULL);
+
+	g_test_init(&argc, &argv, NULL);
+	g_test_bug_base("http://bugs.mysql.com/");
+
+	g_test_add_func("/core/network_conn_pool_get_authed", t_pool_get_authed);
+	g_test_add_func("/core/network_conn_pool_max_idle", t_pool_max_idle);
+	g_test_add_func("/core/network_conn_pool_min_idle", t_pool_min_idle);
+	g_test_add_func("/core/network_conn_pool_overflow", t_pool_overflow);
+	g_test_add_func("/core/network_conn_pool_max_idle_time", t_pool_max_idle_time);
+	g_test_add_func("/core/network_conn_pool_wait", t_pool_wait);
+
+	return g_test_run();
+}
+#else
+int main() {
+	return 77;
+}
+#endif
@@ -0,0 +1,93 @@
+/* $%BEGINLICENSE%$
+ Copyright (c) 2009, 2012, Oracle and/or its affiliates. All rights reserved.
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License as
+ published by the Free Software Foundation; version 2 of the
+ License.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ 02110-1301  USA
+
+ $%ENDLICENSE%$ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "network-connection-registry.h"
+
+#if GLIB_CHECK_VERSION(2, 16, 0)
+
+#define ITEMS 100
+
+/**
+ * @test add and remove items in any order
+ */
+void test_network_connection_registry_add_remove() {
+	network_connection_registry *reg;
+	network_connection_registry_entry *entries[ITEMS];
+	int items[ITEMS];
+	GPtrArray *snapshot;
+	int i;
+
+	reg = network_connection_registry_new();
+	g_assert(reg);
+
+	g_assert(NULL == network_connection_registry_peek(reg));
+
+	for (i = 0; i < ITEMS; i++) {
+		entries[i] = network_connection_registry_add(reg, &(items[i]));
+		g_assert(entries[i]);
+	}
+	g_assert_cmpint(network_connection_registry_count(reg), ==, ITEMS);
+
+	/* remove every 2nd item, this moves the others around in the shards */
+	for (i = 0; i < ITEMS; i += 2) {
+		network_connection_registry_remove(reg, entries[i]);
+	}
+	g_assert_cmpint(network_connection_registry_count(reg), ==, ITEMS / 2);
+
+	snapshot = network_connection_registry_snapshot(reg);
+	g_assert_cmpint(snapshot->len, ==, ITEMS / 2);
+	for (i = 0; i < (int)snapshot->len; i++) {
+		int ndx = (int *)snapshot->pdata[i] - items;
+
+		g_assert_cmpint(ndx % 2, ==, 1);
+	}
+	g_ptr_array_free(snapshot, TRUE);
+
+	/* the moved entries still know where they are */
+	for (i = 1; i < ITEMS; i += 2) {
+		network_connection_registry_remove(reg, entries[i]);
+	}
+	g_assert_cmpint(network_connection_registry_count(reg), ==, 0);
+	g_assert(NULL == network_connection_registry_peek(reg));
+
+	network_connection_registry_free(reg);
+}
+
+int main(int argc, char **argv) {
+	g_thread_init(NULL);
+
+	g_test_init(&argc, &argv, NULL);
+	g_test_bug_base("http://bugs.mysql.com/");
+
+	g_test_add_func("/core/network_connection_registry_add_remove", test_network_connection_registry_add_remove);
+
+	return g_test_run();
+}
+#else
+int main() {
+	return 77;
+}
+#endif
@@ -0,0 +1,84 @@
+/* $%BEGINLICENSE%$
+ Copyright (c) 2009, 2012, Oracle and/or its affiliates. All rights reserved.
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License as
+ published by the Free Software Foundation; version 2 of the
+ License.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ 02110-1301  USA
+
+ $%ENDLICENSE%$ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "network-global-kv.h"
+#include "glib-ext.h"
+
+#if GLIB_CHECK_VERSION(2, 16, 0)
+#define C(x) x, sizeof(x) - 1
+
+/**
+ * @test set, replace and remove values
+ */
+void test_network_global_kv_set_get() {
+	network_global_kv_t *kv;
+	network_global_kv_value_t *value;
+
+	kv = network_global_kv_new();
+	g_assert(kv);
+
+	g_assert(NULL == network_global_kv_get(kv, "foo"));
+
+	value = network_global_kv_value_new(NETWORK_GLOBAL_KV_TYPE_NUMBER);
+	value->n = 1.0;
+	network_global_kv_set(kv, "foo", value);
+	g_assert_cmpint(network_global_kv_count(kv), ==, 1);
+
+	/* replace it with a string */
+	value = network_global_kv_value_new(NETWORK_GLOBAL_KV_TYPE_STRING);
+	g_string_assign_len(value->s, C("bar"));
+	network_global_kv_set(kv, "foo", value);
+	g_assert_cmpint(network_global_kv_count(kv), ==, 1);
+
+	/* we get a copy */
+	value = network_global_kv_get(kv, "foo");
+	g_assert(value);
+	g_assert_cmpint(value->type, ==, NETWORK_GLOBAL_KV_TYPE_STRING);
+	g_assert_cmpstr(value->s->str, ==, "bar");
+	network_global_kv_value_free(value);
+
+	network_global_kv_set(kv, "foo", NULL);
+	g_assert_cmpint(network_global_kv_count(kv), ==, 0);
+	g_assert(NULL == network_global_kv_get(kv, "foo"));
+
+	network_global_kv_free(kv);
+}
+
+int main(int argc, char **argv) {
+	g_thread_init(NULL);
+
+	g_test_init(&argc, &argv, NULL);
+	g_test_bug_base("http://bugs.mysql.com/");
+
+	g_test_add_func("/core/network_global_kv_set_get", test_network_global_kv_set_get);
+
+	return g_test_run();
+}
+#else
+int main() {
+	return 77;
+}
+#endif
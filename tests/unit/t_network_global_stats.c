@@ -0,0 +1,154 @@
+/* $%BEGINLICENSE%$
+ Copyright (c) 2009, 2012, Oracle and/or its affiliates. All rights reserved.
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License as
+ published by the Free Software Foundation; version 2 of the
+ License.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ 02110-1301  USA
+
+ $%ENDLICENSE%$ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "network-global-stats.h"
+
+#if GLIB_CHECK_VERSION(2, 16, 0)
+
+#define THREADS 4
+#define LOOPS 1000
+
+static gpointer stats_inc_thread(gpointer _stats) {
+	network_global_stats_t *stats = _stats;
+	int i;
+
+	for (i = 0; i < LOOPS; i++) {
+		network_global_stats_add(stats, "queries", 1);
+	}
+
+	return NULL;
+}
+
+/**
+ * @test counters of several threads are merged on read
+ */
+void test_network_global_stats_merge() {
+	network_global_stats_t *stats;
+	GThread *threads[THREADS];
+	GHashTable *snapshot;
+	gint64 *counter;
+	int i;
+
+	stats = network_global_stats_new();
+	g_assert(stats);
+
+	g_assert_cmpint(network_global_stats_get(stats, "queries"), ==, 0);
+
+	for (i = 0; i < THREADS; i++) {
+		threads[i] = g_thread_create(stats_inc_thread, stats, TRUE, NULL);
+		g_assert(threads[i]);
+	}
+	for (i = 0; i < THREADS; i++) {
+		g_thread_join(threads[i]);
+	}
+
+	network_global_stats_add(stats, "bytes", 100);
+
+	g_assert_cmpint(network_global_stats_get(stats, "queries"), ==, THREADS * LOOPS);
+
+	snapshot = network_global_stats_snapshot(stats);
+	g_assert_cmpint(g_hash_table_size(snapshot), ==, 2);
+	counter = g_hash_table_lookup(snapshot, "queries");
+	g_assert(counter);
+	g_assert_cmpint(*counter, ==, THREADS * LOOPS);
+	counter = g_hash_table_lookup(snapshot, "bytes");
+	g_assert(counter);
+	g_assert_cmpint(*counter, ==, 100);
+	g_hash_table_destroy(snapshot);
+
+	network_global_stats_reset(stats, "que");
+	g_assert_cmpint(network_global_stats_get(stats, "queries"), ==, 0);
+	g_assert_cmpint(network_global_stats_get(stats, "bytes"), ==, 100);
+
+	network_global_stats_free(stats);
+}
+
+static gpointer stats_max_thread(gpointer _stats) {
+	network_global_stats_t *stats = _stats;
+	int i;
+
+	for (i = 0; i < LOOPS; i++) {
+		network_global_stats_max(stats, "max_conns", i);
+	}
+
+	return NULL;
+}
+
+/**
+ * @test high-water marks are merged by taking the largest value
+ */
+void test_network_global_stats_max() {
+	network_global_stats_t *stats;
+	GThread *threads[THREADS];
+	GHashTable *snapshot;
+	gint64 *counter;
+	int i;
+
+	stats = network_global_stats_new();
+	g_assert(stats);
+
+	for (i = 0; i < THREADS; i++) {
+		threads[i] = g_thread_create(stats_max_thread, stats, TRUE, NULL);
+		g_assert(threads[i]);
+	}
+	for (i = 0; i < THREADS; i++) {
+		g_thread_join(threads[i]);
+	}
+
+	/* a smaller value doesn't lower it */
+	network_global_stats_max(stats, "max_conns", 1);
+	network_global_stats_add(stats, "conns", 1);
+
+	g_assert_cmpint(network_global_stats_get(stats, "max_conns"), ==, LOOPS - 1);
+
+	snapshot = network_global_stats_snapshot(stats);
+	counter = g_hash_table_lookup(snapshot, "max_conns");
+	g_assert(counter);
+	g_assert_cmpint(*counter, ==, LOOPS - 1);
+	counter = g_hash_table_lookup(snapshot, "conns");
+	g_assert(counter);
+	g_assert_cmpint(*counter, ==, 1);
+	g_hash_table_destroy(snapshot);
+
+	network_global_stats_free(stats);
+}
+
+int main(int argc, char **argv) {
+	g_thread_init(NULL);
+
+	g_test_init(&argc, &argv, NULL);
+	g_test_bug_base("http://bugs.mysql.com/");
+
+	g_test_add_func("/core/network_global_stats_merge", test_network_global_stats_merge);
+	g_test_add_func("/core/network_global_stats_max", test_network_global_stats_max);
+
+	return g_test_run();
+}
+#else
+int main() {
+	return 77;
+}
+#endif
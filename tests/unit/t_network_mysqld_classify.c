@@ -0,0 +1,265 @@
+/* $%BEGINLICENSE%$
+ Copyright (c) 2009, 2012, Oracle and/or its affiliates. All rights reserved.
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License as
+ published by the Free Software Foundation; version 2 of the
+ License.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ 02110-1301  USA
+
+ $%ENDLICENSE%$ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "network-mysqld-classify.h"
+
+#if GLIB_CHECK_VERSION(2, 16, 0)
+#define C(x) x, sizeof(x) - 1
+
+/**
+ * @test the first keyword decides the type, comments are skipped
+ */
+void test_network_mysqld_classify_stmt() {
+	guint flags;
+
+	g_assert_cmpint(NETWORK_MYSQLD_STMT_UNKNOWN, ==, network_mysqld_classify_query(C(""), &flags));
+	g_assert_cmpint(NETWORK_MYSQLD_STMT_UNKNOWN, ==, network_mysqld_classify_query(C("/* only a comment */"), &flags));
+	g_assert_cmpint(NETWORK_MYSQLD_STMT_SELECT, ==, network_mysqld_classify_query(C("SELECT 1"), &flags));
+	g_assert_cmpint(NETWORK_MYSQLD_STMT_SELECT, ==, network_mysqld_classify_query(C("/* c */ -- foo\n# bar\n select 1"), &flags));
+	g_assert_cmpint(NETWORK_MYSQLD_STMT_SELECT, ==, network_mysqld_classify_query(C("(SELECT 1) UNION (SELECT 2)"), &flags));
+	g_assert_cmpint(NETWORK_MYSQLD_STMT_INSERT, ==, network_mysqld_classify_query(C("insert into t values (1)"), &flags));
+	g_assert_cmpint(NETWORK_MYSQLD_STMT_DDL, ==, network_mysqld_classify_query(C("CREATE TABLE t (id INT)"), &flags));
+	g_assert_cmpint(NETWORK_MYSQLD_STMT_OTHER, ==, network_mysqld_classify_query(C("KILL 1"), &flags));
+
+	/* the content of executable comments is part of the query */
+	g_assert_cmpint(NETWORK_MYSQLD_STMT_SET, ==, network_mysqld_classify_query(C("/*!40101 SET NAMES utf8 */"), &flags));
+
+	g_assert_cmpint(NETWORK_MYSQLD_STMT_BEGIN, ==, network_mysqld_classify_query(C("BEGIN"), &flags));
+	g_assert_cmpint(NETWORK_MYSQLD_STMT_BEGIN, ==, network_mysqld_classify_query(C("start transaction"), &flags));
+	g_assert_cmpint(NETWORK_MYSQLD_STMT_OTHER, ==, network_mysqld_classify_query(C("START SLAVE"), &flags));
+	g_assert_cmpint(NETWORK_MYSQLD_STMT_COMMIT, ==, network_mysqld_classify_query(C("COMMIT"), &flags));
+	g_assert_cmpint(NETWORK_MYSQLD_STMT_ROLLBACK, ==, network_mysqld_classify_query(C("ROLLBACK WORK"), &flags));
+	g_assert_cmpint(NETWORK_MYSQLD_STMT_OTHER, ==, network_mysqld_classify_query(C("ROLLBACK WORK TO SAVEPOINT a"), &flags));
+}
+
+/**
+ * @test the flags of a SELECT
+ */
+void test_network_mysqld_classify_flags() {
+	guint flags;
+
+	network_mysqld_classify_query(C("SELECT * FROM t"), &flags);
+	g_assert_cmpint(flags, ==, 0);
+
+	network_mysqld_classify_query(C("SELECT SQL_CALC_FOUND_ROWS * FROM t WHERE id = 1 FOR UPDATE"), &flags);
+	g_assert_cmpint(flags, ==, NETWORK_MYSQLD_STMT_FLAG_SQL_CALC_FOUND_ROWS | NETWORK_MYSQLD_STMT_FLAG_FOR_UPDATE);
+
+	network_mysqld_classify_query(C("SELECT * FROM t LOCK IN SHARE MODE"), &flags);
+	g_assert_cmpint(flags, ==, NETWORK_MYSQLD_STMT_FLAG_FOR_UPDATE);
+
+	network_mysqld_classify_query(C("SELECT last_insert_id()"), &flags);
+	g_assert_cmpint(flags, ==, NETWORK_MYSQLD_STMT_FLAG_LAST_INSERT_ID);
+
+	network_mysqld_classify_query(C("SELECT @@insert_id"), &flags);
+	g_assert_cmpint(flags, ==, NETWORK_MYSQLD_STMT_FLAG_LAST_INSERT_ID);
+
+	/* strings and later statements don't count, but that there are more is flagged */
+	network_mysqld_classify_query(C("SELECT 'for update', \"last_insert_id\" FROM t; SELECT 1 FOR UPDATE"), &flags);
+	g_assert_cmpint(flags, ==, NETWORK_MYSQLD_STMT_FLAG_MULTI_STATEMENT);
+
+	/* only SELECTs have flags */
+	network_mysqld_classify_query(C("UPDATE t SET a = LAST_INSERT_ID()"), &flags);
+	g_assert_cmpint(flags, ==, 0);
+
+	network_mysqld_classify_query(C("SELECT * FROM t WHERE ts > NOW() - INTERVAL 1 DAY"), &flags);
+	g_assert_cmpint(flags, ==, NETWORK_MYSQLD_STMT_FLAG_NONDETERMINISTIC);
+
+	network_mysqld_classify_query(C("SELECT @a := id FROM t"), &flags);
+	g_assert_cmpint(flags, ==, NETWORK_MYSQLD_STMT_FLAG_NONDETERMINISTIC | NETWORK_MYSQLD_STMT_FLAG_SESSION_STATE);
+}
+
+/**
+ * @test statements that leave state in the session
+ */
+void test_network_mysqld_classify_session_state() {
+	guint flags;
+
+	network_mysqld_classify_query(C("SET NAMES utf8"), &flags);
+	g_assert_cmpint(flags, ==, NETWORK_MYSQLD_STMT_FLAG_SESSION_STATE);
+
+	network_mysqld_classify_query(C("SET @a = 1"), &flags);
+	g_assert_cmpint(flags, ==, NETWORK_MYSQLD_STMT_FLAG_SESSION_STATE);
+
+	/* autocommit is tracked through the server-status */
+	network_mysqld_classify_query(C("SET autocommit = 0"), &flags);
+	g_assert_cmpint(flags, ==, 0);
+
+	network_mysqld_classify_query(C("SET @@session.autocommit=1;"), &flags);
+	g_assert_cmpint(flags, ==, 0);
+
+	network_mysqld_classify_query(C("SET autocommit = 0, sql_mode = ''"), &flags);
+	g_assert_cmpint(flags, ==, NETWORK_MYSQLD_STMT_FLAG_SESSION_STATE);
+
+	network_mysqld_classify_query(C("CREATE TEMPORARY TABLE t (id INT)"), &flags);
+	g_assert_cmpint(flags, ==, NETWORK_MYSQLD_STMT_FLAG_SESSION_STATE);
+
+	network_mysqld_classify_query(C("CREATE TABLE t (id INT)"), &flags);
+	g_assert_cmpint(flags, ==, 0);
+
+	network_mysqld_classify_query(C("LOCK TABLES t WRITE"), &flags);
+	g_assert_cmpint(flags, ==, NETWORK_MYSQLD_STMT_FLAG_SESSION_STATE);
+
+	network_mysqld_classify_query(C("DO GET_LOCK('a', 10)"), &flags);
+	g_assert_cmpint(flags, ==, NETWORK_MYSQLD_STMT_FLAG_SESSION_STATE);
+
+	network_mysqld_classify_query(C("SELECT GET_LOCK('a', 10)"), &flags);
+	g_assert_cmpint(flags, ==, NETWORK_MYSQLD_STMT_FLAG_NONDETERMINISTIC | NETWORK_MYSQLD_STMT_FLAG_SESSION_STATE);
+
+	network_mysqld_classify_query(C("SELECT id INTO @a FROM t"), &flags);
+	g_assert_cmpint(flags, ==, NETWORK_MYSQLD_STMT_FLAG_NONDETERMINISTIC | NETWORK_MYSQLD_STMT_FLAG_SESSION_STATE);
+
+	/* reading a variable doesn't change the session */
+	network_mysqld_classify_query(C("SELECT @a, @@sql_mode"), &flags);
+	g_assert_cmpint(flags, ==, NETWORK_MYSQLD_STMT_FLAG_NONDETERMINISTIC);
+}
+
+/**
+ * @test statements after the first ';' are flagged, empty ones and comments aren't
+ */
+void test_network_mysqld_classify_multi_statement() {
+	guint flags;
+
+	g_assert_cmpint(NETWORK_MYSQLD_STMT_SELECT, ==, network_mysqld_classify_query(C("SELECT * FROM t; UPDATE t SET a = 1"), &flags));
+	g_assert_cmpint(flags, ==, NETWORK_MYSQLD_STMT_FLAG_MULTI_STATEMENT);
+
+	network_mysqld_classify_query(C("SELECT 1; SET @a:=1"), &flags);
+	g_assert_cmpint(flags, ==, NETWORK_MYSQLD_STMT_FLAG_MULTI_STATEMENT);
+
+	network_mysqld_classify_query(C("INSERT INTO t VALUES (';'); DO GET_LOCK('a', 10)"), &flags);
+	g_assert_cmpint(flags, ==, NETWORK_MYSQLD_STMT_FLAG_MULTI_STATEMENT);
+
+	network_mysqld_classify_query(C("SELECT * FROM t ;; -- done\n /* really */ ;"), &flags);
+	g_assert_cmpint(flags, ==, 0);
+
+	network_mysqld_classify_query(C("SELECT 'a;b', `c;d` FROM t # ; SELECT 2"), &flags);
+	g_assert_cmpint(flags, ==, 0);
+}
+
+/**
+ * assert the tables of a query
+ *
+ * @param expected  the expected tables, separated by space
+ */
+static void assert_tables(const char *query, const char *default_db, int ret, const char *expected) {
+	GPtrArray *tables = g_ptr_array_new();
+	GString *names = g_string_new(NULL);
+	guint i;
+
+	g_assert_cmpint(ret, ==, network_mysqld_classify_tables(query, strlen(query), default_db, tables));
+
+	for (i = 0; i < tables->len; i++) {
+		if (i > 0) g_string_append_c(names, ' ');
+		g_string_append(names, tables->pdata[i]);
+		g_free(tables->pdata[i]);
+	}
+	g_assert_cmpstr(names->str, ==, expected);
+
+	g_string_free(names, TRUE);
+	g_ptr_array_free(tables, TRUE);
+}
+
+/**
+ * @test the tables of a statement are qualified with the default-db
+ */
+void test_network_mysqld_classify_tables() {
+	assert_tables("SELECT 1", "db", 0, "");
+	assert_tables("SELECT * FROM t1", "db", 1, "db.t1");
+	assert_tables("SELECT * FROM `Other`.`T1` AS a, t2 b USE INDEX (i1, i2), t3 WHERE a.id = b.id", "db", 3, "other.t1 db.t2 db.t3");
+	assert_tables("SELECT * FROM t1 LEFT JOIN t2 ON t1.id = t2.id, t3 WHERE t1.x IN (SELECT x FROM t4)", "db", 4, "db.t1 db.t2 db.t3 db.t4");
+	assert_tables("SELECT a, b FROM t1 WHERE c IN (1, 2) ORDER BY a, b", NULL, 1, "t1");
+	assert_tables("(SELECT a FROM t1) UNION (SELECT a FROM t2)", "db", 2, "db.t1 db.t2");
+
+	assert_tables("INSERT INTO t1 (a, b) VALUES (1, 2), (3, 4) ON DUPLICATE KEY UPDATE a = 5", "db", 1, "db.t1");
+	assert_tables("INSERT IGNORE t1 SELECT * FROM t2", "db", 2, "db.t1 db.t2");
+	assert_tables("UPDATE LOW_PRIORITY t1, t2 SET t1.a = t2.a", "db", 2, "db.t1 db.t2");
+	assert_tables("DELETE FROM t1 WHERE id = 1;", "db", 1, "db.t1");
+	assert_tables("SELECT 'FROM x', `from` FROM t1", "db", 1, "db.t1");
+
+	/* we can't follow these */
+	assert_tables("SELECT * FROM (SELECT 1) AS d", "db", -1, "");
+	assert_tables("SELECT * FROM information_schema.tables", "db", -1, "");
+	assert_tables("SELECT * FROM t1; DELETE FROM t2", "db", -1, "db.t1");
+}
+
+/**
+ * assert the system-variables of a SET
+ *
+ * @param expected  the expected names, separated by space
+ */
+static void assert_set_vars(const char *query, int ret, const char *expected) {
+	GPtrArray *vars = g_ptr_array_new();
+	GString *names = g_string_new(NULL);
+	guint i;
+
+	g_assert_cmpint(ret, ==, network_mysqld_classify_set_vars(query, strlen(query), vars));
+
+	for (i = 0; i < vars->len; i++) {
+		if (i > 0) g_string_append_c(names, ' ');
+		g_string_append(names, vars->pdata[i]);
+		g_free(vars->pdata[i]);
+	}
+	g_assert_cmpstr(names->str, ==, expected);
+
+	g_string_free(names, TRUE);
+	g_ptr_array_free(vars, TRUE);
+}
+
+/**
+ * @test the system-variables a SET changes in the session
+ */
+void test_network_mysqld_classify_set_vars() {
+	assert_set_vars("SET sql_mode = 'ANSI,TRADITIONAL', SESSION Time_Zone = '+00:00'", 2, "sql_mode time_zone");
+	assert_set_vars("SET @@session.wait_timeout := 10, @@LOCAL.autocommit=1, @@net_write_timeout = IF(1, 2, 3);", 3, "wait_timeout autocommit net_write_timeout");
+	assert_set_vars("SET NAMES 'utf8' COLLATE 'utf8_bin'", 3, "character_set_client character_set_connection character_set_results");
+	assert_set_vars("SET CHARACTER SET latin1", 3, "character_set_client character_set_connection character_set_results");
+
+	/* we can't track these */
+	assert_set_vars("SET sql_mode = '', @a = 1", -1, "");
+	assert_set_vars("SET GLOBAL sql_mode = ''", -1, "");
+	assert_set_vars("SET @@global.sql_mode = ''", -1, "");
+	assert_set_vars("SET TRANSACTION ISOLATION LEVEL READ COMMITTED", -1, "");
+	assert_set_vars("SET sql_mode", -1, "");
+	assert_set_vars("SELECT 1", -1, "");
+}
+
+int main(int argc, char **argv) {
+	g_test_init(&argc, &argv, NULL);
+	g_test_bug_base("http://bugs.mysql.com/");
+
+	g_test_add_func("/core/network_mysqld_classify_stmt", test_network_mysqld_classify_stmt);
+	g_test_add_func("/core/network_mysqld_classify_flags", test_network_mysqld_classify_flags);
+	g_test_add_func("/core/network_mysqld_classify_session_state", test_network_mysqld_classify_session_state);
+	g_test_add_func("/core/network_mysqld_classify_multi_statement", test_network_mysqld_classify_multi_statement);
+	g_test_add_func("/core/network_mysqld_classify_tables", test_network_mysqld_classify_tables);
+	g_test_add_func("/core/network_mysqld_classify_set_vars", test_network_mysqld_classify_set_vars);
+
+	return g_test_run();
+}
+#else
+int main() {
+	return 77;
+}
+#endif
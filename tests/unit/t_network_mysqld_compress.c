@@ -0,0 +1,201 @@
+/* $%BEGINLICENSE%$
+ Copyright (c) 2009, 2012, Oracle and/or its affiliates. All rights reserved.
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License as
+ published by the Free Software Foundation; version 2 of the
+ License.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ 02110-1301  USA
+
+ $%ENDLICENSE%$ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "network-mysqld-compress.h"
+
+#if GLIB_CHECK_VERSION(2, 16, 0)
+#define C(x) x, sizeof(x) - 1
+#define S(x) x->str, x->len
+
+/**
+ * append a packet with a 4 byte header to the queue
+ */
+static void queue_append_packet(network_queue *q, guint8 packet_id, const char *payload, gsize payload_len) {
+	GString *packet = g_string_sized_new(payload_len + 4);
+
+	g_string_append_c(packet, (payload_len >>  0) & 0xff);
+	g_string_append_c(packet, (payload_len >>  8) & 0xff);
+	g_string_append_c(packet, (payload_len >> 16) & 0xff);
+	g_string_append_c(packet, packet_id);
+	g_string_append_len(packet, payload, payload_len);
+
+	network_queue_append(q, packet);
+}
+
+/**
+ * move all chunks from one queue to the other, like the socket would do
+ */
+static void queue_move(network_queue *dst, network_queue *src) {
+	network_queue_append(dst, network_queue_pop_string(src, src->len, NULL));
+}
+
+/**
+ * @test packets survive a deflate() and inflate() and big payloads get smaller
+ */
+void t_compress_roundtrip() {
+	network_mysqld_compress *client, *server;
+	network_queue *send_queue, *recv_queue;
+	GString *big, *frame_header, *orig, *result;
+
+	client = network_mysqld_compress_new(NETWORK_MYSQLD_COMPRESS_MIN_LENGTH);
+	server = network_mysqld_compress_new(NETWORK_MYSQLD_COMPRESS_MIN_LENGTH);
+	send_queue = network_queue_new();
+	recv_queue = network_queue_new();
+
+	big = g_string_new("\x03");
+	while (big->len < 10000) g_string_append(big, "SELECT * FROM tbl; ");
+
+	queue_append_packet(send_queue, 0, S(big));
+	queue_append_packet(send_queue, 1, C("\x01"));
+	orig = network_queue_peek_string(send_queue, send_queue->len, NULL);
+
+	g_assert_cmpint(0, ==, network_mysqld_compress_deflate(client, send_queue));
+	g_assert_cmpint(send_queue->len, ==, 0);
+	g_assert_cmpint(client->send_queue->len, <, orig->len);
+
+	frame_header = network_queue_peek_string(client->send_queue, NETWORK_MYSQLD_COMPRESS_HEADER_SIZE, NULL);
+	g_assert_cmpint(frame_header->str[3], ==, 0); /* a new command starts with frame 0 */
+	g_assert_cmpint((guchar)frame_header->str[4] | ((guchar)frame_header->str[5] << 8), ==, orig->len);
+	g_string_free(frame_header, TRUE);
+
+	queue_move(server->recv_queue, client->send_queue);
+	g_assert_cmpint(0, ==, network_mysqld_compress_inflate(server, recv_queue));
+	g_assert_cmpint(server->recv_queue->len, ==, 0);
+	g_assert_cmpint(server->packet_id, ==, 1);
+
+	result = network_queue_peek_string(recv_queue, recv_queue->len, NULL);
+	g_assert_cmpint(result->len, ==, orig->len);
+	g_assert(0 == memcmp(result->str, orig->str, orig->len));
+
+	g_string_free(result, TRUE);
+	g_string_free(orig, TRUE);
+	g_string_free(big, TRUE);
+	network_queue_free(recv_queue);
+	network_queue_free(send_queue);
+	network_mysqld_compress_free(server);
+	network_mysqld_compress_free(client);
+}
+
+/**
+ * @test small payloads are sent uncompressed and continue the sequence
+ */
+void t_compress_small_payload() {
+	network_mysqld_compress *comp;
+	network_queue *send_queue;
+	GString *frame;
+
+	comp = network_mysqld_compress_new(NETWORK_MYSQLD_COMPRESS_MIN_LENGTH);
+	send_queue = network_queue_new();
+
+	/* we received frame 0, the response starts with frame 1 */
+	comp->packet_id = 1;
+	comp->packet_id_is_reset = FALSE;
+	queue_append_packet(send_queue, 1, C("\x00\x00\x00\x02\x00\x00\x00"));
+
+	g_assert_cmpint(0, ==, network_mysqld_compress_deflate(comp, send_queue));
+	g_assert_cmpint(comp->send_queue->len, ==, NETWORK_MYSQLD_COMPRESS_HEADER_SIZE + 4 + 7);
+
+	frame = network_queue_peek_string(comp->send_queue, comp->send_queue->len, NULL);
+	g_assert_cmpint(frame->str[0], ==, 4 + 7);
+	g_assert_cmpint(frame->str[3], ==, 1);
+	g_assert_cmpint(frame->str[4], ==, 0); /* not compressed */
+	g_assert_cmpint(frame->str[5], ==, 0);
+	g_assert_cmpint(frame->str[6], ==, 0);
+	g_assert_cmpint(frame->str[NETWORK_MYSQLD_COMPRESS_HEADER_SIZE + 3], ==, 1); /* the packet-id of the packet */
+	g_string_free(frame, TRUE);
+
+	g_assert_cmpint(comp->packet_id, ==, 2);
+
+	/* the packet-ids wrapped in a big result-set, the frames go on */
+	queue_append_packet(send_queue, 0, C("\x00\x00\x00\x02\x00\x00\x00"));
+	g_assert_cmpint(0, ==, network_mysqld_compress_deflate(comp, send_queue));
+	g_assert_cmpint(comp->packet_id, ==, 3);
+
+	/* only a new command starts with frame 0 again */
+	comp->packet_id_is_reset = TRUE;
+	queue_append_packet(send_queue, 0, C("\x03"));
+	g_assert_cmpint(0, ==, network_mysqld_compress_deflate(comp, send_queue));
+	g_assert_cmpint(comp->packet_id, ==, 1);
+
+	network_queue_free(send_queue);
+	network_mysqld_compress_free(comp);
+}
+
+/**
+ * @test a incomplete frame stays in the queue until the rest arrives
+ */
+void t_compress_partial_frame() {
+	network_mysqld_compress *comp;
+	network_queue *send_queue, *recv_queue;
+	GString *frames, *part;
+	gsize half;
+
+	comp = network_mysqld_compress_new(0);
+	send_queue = network_queue_new();
+	recv_queue = network_queue_new();
+
+	queue_append_packet(send_queue, 0, C("\x03SELECT 1"));
+	g_assert_cmpint(0, ==, network_mysqld_compress_deflate(comp, send_queue));
+
+	frames = network_queue_pop_string(comp->send_queue, comp->send_queue->len, NULL);
+	half = frames->len / 2;
+
+	part = g_string_new_len(frames->str, half);
+	network_queue_append(comp->recv_queue, part);
+	g_assert_cmpint(0, ==, network_mysqld_compress_inflate(comp, recv_queue));
+	g_assert_cmpint(recv_queue->len, ==, 0);
+
+	part = g_string_new_len(frames->str + half, frames->len - half);
+	network_queue_append(comp->recv_queue, part);
+	g_assert_cmpint(0, ==, network_mysqld_compress_inflate(comp, recv_queue));
+	g_assert_cmpint(recv_queue->len, ==, 4 + sizeof("\x03SELECT 1") - 1);
+
+	g_string_free(frames, TRUE);
+	network_queue_free(recv_queue);
+	network_queue_free(send_queue);
+	network_mysqld_compress_free(comp);
+}
+
+int main(int argc, char **argv) {
+	g_test_init(&argc, &argv, NULL);
+	g_test_bug_base("http://bugs.mysql.com/");
+
+	if (!network_mysqld_compress_is_supported()) {
+		/* built without zlib */
+		return 77;
+	}
+
+	g_test_add_func("/core/network_mysqld_compress_roundtrip", t_compress_roundtrip);
+	g_test_add_func("/core/network_mysqld_compress_small_payload", t_compress_small_payload);
+	g_test_add_func("/core/network_mysqld_compress_partial_frame", t_compress_partial_frame);
+
+	return g_test_run();
+}
+#else
+int main() {
+	return 77;
+}
+#endif
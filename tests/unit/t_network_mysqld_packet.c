@@ -108,6 +108,53 @@ static void t_ok_packet_append(void) {
 	network_packet_free(packet);
 }
 
+/**
+ * @test with CLIENT_SESSION_TRACK the info and the session-state are length-encoded
+ */
+static void t_ok_packet_session_track(void) {
+	network_mysqld_ok_packet_t *ok_packet;
+	network_packet *packet;
+
+	ok_packet = network_mysqld_ok_packet_new();
+	packet = network_packet_new();
+	packet->data = g_string_new(NULL);
+
+	ok_packet->capabilities = CLIENT_PROTOCOL_41 | CLIENT_SESSION_TRACK;
+	ok_packet->server_status = SERVER_SESSION_STATE_CHANGED;
+	g_string_assign_len(ok_packet->session_state, C("\x01\x03\x02" "db"));
+
+	g_assert_cmpint(0, ==, network_mysqld_proto_append_ok_packet(packet->data, ok_packet));
+	g_assert_cmpint(TRUE, ==, g_memeq(S(packet->data), C("\x00\x00\x00\x00\x40\x00\x00" "\x00" "\x05\x01\x03\x02" "db")));
+
+	network_mysqld_ok_packet_free(ok_packet);
+
+	ok_packet = network_mysqld_ok_packet_new();
+	ok_packet->capabilities = CLIENT_PROTOCOL_41 | CLIENT_SESSION_TRACK;
+	g_assert_cmpint(0, ==, network_mysqld_proto_get_ok_packet(packet, ok_packet));
+	g_assert_cmpint(SERVER_SESSION_STATE_CHANGED, ==, ok_packet->server_status);
+	g_assert_cmpint(0, ==, ok_packet->info->len);
+	g_assert_cmpint(TRUE, ==, g_memeq(S(ok_packet->session_state), C("\x01\x03\x02" "db")));
+
+	/* without it, the info is the rest of the packet */
+	g_string_assign_len(packet->data, C("\x00\x01\x00\x02\x00\x00\x00" "Rows matched: 1"));
+	packet->offset = 0;
+	ok_packet->capabilities = CLIENT_PROTOCOL_41;
+	g_assert_cmpint(0, ==, network_mysqld_proto_get_ok_packet(packet, ok_packet));
+	g_assert_cmpstr("Rows matched: 1", ==, ok_packet->info->str);
+	g_assert_cmpint(0, ==, ok_packet->session_state->len);
+
+	/* the session-state is cut off */
+	g_string_assign_len(packet->data, C("\x00\x00\x00\x00\x40\x00\x00" "\x00" "\x05\x01"));
+	packet->offset = 0;
+	ok_packet->capabilities = CLIENT_PROTOCOL_41 | CLIENT_SESSION_TRACK;
+	g_assert_cmpint(-1, ==, network_mysqld_proto_get_ok_packet(packet, ok_packet));
+
+	network_mysqld_ok_packet_free(ok_packet);
+
+	g_string_free(packet->data, TRUE);
+	network_packet_free(packet);
+}
+
 static void t_err_packet_new(void) {
 	network_mysqld_err_packet_t *err_packet;
 
@@ -1760,6 +1807,7 @@ int main(int argc, char **argv) {
 
 	g_test_add_func("/core/ok-packet-new", t_ok_packet_new);
 	g_test_add_func("/core/ok-packet-append", t_ok_packet_append);
+	g_test_add_func("/core/ok-packet-session-track", t_ok_packet_session_track);
 	g_test_add_func("/core/eof-packet-new", t_eof_packet_new);
 	g_test_add_func("/core/eof-packet-append", t_eof_packet_append);
 	g_test_add_func("/core/err-packet-new", t_err_packet_new);
@@ -0,0 +1,154 @@
+/* $%BEGINLICENSE%$
+ Copyright (c) 2009, 2012, Oracle and/or its affiliates. All rights reserved.
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License as
+ published by the Free Software Foundation; version 2 of the
+ License.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ 02110-1301  USA
+
+ $%ENDLICENSE%$ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "network-mysqld-proto.h"
+#include "network-mysqld-session.h"
+
+#if GLIB_CHECK_VERSION(2, 16, 0)
+#define C(x) x, sizeof(x) - 1
+
+/**
+ * @test the session-state entries of a OK packet are applied
+ */
+void t_session_apply() {
+	network_mysqld_session *session;
+	GString *schema;
+	GPtrArray *sysvars;
+	int types;
+
+	session = network_mysqld_session_new();
+	schema = g_string_new(NULL);
+	sysvars = g_ptr_array_new();
+
+	types = network_mysqld_session_apply(session, C(
+			"\x00\x0f" "\x0a" "autocommit" "\x03" "OFF"
+			"\x01\x03" "\x02" "db"
+			"\x02\x02" "\x01" "1"
+			"\x00\x0e" "\x08" "sql_mode" "\x04" "ANSI"),
+			schema, sysvars);
+	g_assert_cmpint(types, ==,
+			(1 << NETWORK_MYSQLD_SESSION_TRACK_SYSTEM_VARIABLES) |
+			(1 << NETWORK_MYSQLD_SESSION_TRACK_SCHEMA) |
+			(1 << NETWORK_MYSQLD_SESSION_TRACK_STATE_CHANGE));
+
+	g_assert_cmpstr(schema->str, ==, "db");
+	g_assert_cmpint(sysvars->len, ==, 2);
+	g_assert_cmpstr(sysvars->pdata[0], ==, "autocommit");
+	g_assert_cmpstr(sysvars->pdata[1], ==, "sql_mode");
+	g_assert_cmpstr(g_hash_table_lookup(session->sysvars, "autocommit"), ==, "OFF");
+
+	/* the GTIDs follow the encoding-specification */
+	types = network_mysqld_session_apply(session, C("\x03\x06" "\x00" "\x04" "a:10"), NULL, NULL);
+	g_assert_cmpint(types, ==, 1 << NETWORK_MYSQLD_SESSION_TRACK_GTIDS);
+	g_assert_cmpstr(session->gtids->str, ==, "a:10");
+
+	/* truncated */
+	g_assert_cmpint(-1, ==, network_mysqld_session_apply(session, C("\x00\x0f" "\x0a" "autocommit"), NULL, NULL));
+	g_assert_cmpint(-1, ==, network_mysqld_session_apply(session, C("\x01\x03" "\x05" "db"), NULL, NULL));
+
+	while (sysvars->len) g_free(g_ptr_array_remove_index(sysvars, 0));
+	g_ptr_array_free(sysvars, TRUE);
+	g_string_free(schema, TRUE);
+	network_mysqld_session_free(session);
+}
+
+/**
+ * @test the fingerprint doesn't depend on the order of the changes
+ */
+void t_session_fingerprint() {
+	network_mysqld_session *a, *b;
+
+	a = network_mysqld_session_new();
+	b = network_mysqld_session_new();
+
+	g_assert(network_mysqld_session_is_equal(a, b));
+
+	network_mysqld_session_set_sysvar(a, "sql_mode", "ANSI");
+	network_mysqld_session_set_sysvar(a, "time_zone", "+00:00");
+	g_assert_cmpint(0, ==, network_mysqld_session_set_sysvar(a, "time_zone", "+00:00"));
+
+	network_mysqld_session_set_sysvar(b, "time_zone", "SYSTEM");
+	network_mysqld_session_set_sysvar(b, "sql_mode", "ANSI");
+	g_assert(!network_mysqld_session_is_equal(a, b));
+
+	g_assert_cmpint(1, ==, network_mysqld_session_set_sysvar(b, "time_zone", "+00:00"));
+	g_assert_cmpint(a->fingerprint, ==, b->fingerprint);
+	g_assert(network_mysqld_session_is_equal(a, b));
+
+	network_mysqld_session_copy(b, a);
+	g_assert(network_mysqld_session_is_equal(a, b));
+
+	network_mysqld_session_clear(a);
+	g_assert_cmpint(a->fingerprint, ==, 0);
+	g_assert(network_mysqld_session_is_subset(a, b));
+	g_assert(!network_mysqld_session_is_subset(b, a));
+
+	network_mysqld_session_free(a);
+	network_mysqld_session_free(b);
+}
+
+/**
+ * @test only the variables that differ are SET
+ */
+void t_session_set_query() {
+	network_mysqld_session *pooled, *client;
+	GString *query;
+
+	pooled = network_mysqld_session_new();
+	client = network_mysqld_session_new();
+	query = g_string_new(NULL);
+
+	network_mysqld_session_set_sysvar(pooled, "sql_mode", "ANSI");
+	network_mysqld_session_set_sysvar(client, "sql_mode", "ANSI");
+	g_assert_cmpint(0, ==, network_mysqld_session_append_set_query(pooled, client, query));
+	g_assert_cmpint(query->len, ==, 0);
+
+	network_mysqld_session_set_sysvar(client, "wait_timeout", "600");
+	network_mysqld_session_set_sysvar(client, "time_zone", "Europe/Berlin");
+	network_mysqld_session_set_sysvar(client, "lc_messages", "it's");
+	g_assert_cmpint(3, ==, network_mysqld_session_append_set_query(pooled, client, query));
+	g_assert_cmpstr(query->str, ==, "SET SESSION lc_messages = 'it\\'s', time_zone = 'Europe/Berlin', wait_timeout = 600");
+
+	g_string_free(query, TRUE);
+	network_mysqld_session_free(pooled);
+	network_mysqld_session_free(client);
+}
+
+int main(int argc, char **argv) {
+	g_test_init(&argc, &argv, NULL);
+	g_test_bug_base("http://bugs.mysql.com/");
+
+	g_test_add_func("/core/network_mysqld_session_apply", t_session_apply);
+	g_test_add_func("/core/network_mysqld_session_fingerprint", t_session_fingerprint);
+	g_test_add_func("/core/network_mysqld_session_set_query", t_session_set_query);
+
+	return g_test_run();
+}
+#else
+int main() {
+	return 77;
+}
+#endif
@@ -0,0 +1,205 @@
+/* $%BEGINLICENSE%$
+ Copyright (c) 2009, 2012, Oracle and/or its affiliates. All rights reserved.
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License as
+ published by the Free Software Foundation; version 2 of the
+ License.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ 02110-1301  USA
+
+ $%ENDLICENSE%$ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "network-query-cache.h"
+
+#if GLIB_CHECK_VERSION(2, 16, 0)
+#define C(x) x, sizeof(x) - 1
+
+/**
+ * create a entry with one packet for a table
+ */
+static network_query_cache_entry *entry_new(network_query_cache *cache, const char *key, const char *table) {
+	network_query_cache_entry *entry;
+	GString *packet;
+
+	entry = network_query_cache_entry_new(cache, g_string_new(key));
+	g_ptr_array_add(entry->tables, g_strdup(table));
+
+	packet = g_string_new_len(C("\x01\x00\x00\x01\x01"));
+	g_assert(network_query_cache_entry_append(cache, entry, packet));
+	g_string_free(packet, TRUE);
+
+	return entry;
+}
+
+/**
+ * check if the key is in the cache
+ */
+static gboolean cache_has(network_query_cache *cache, const char *key, guint64 now) {
+	GString *k = g_string_new(key);
+	GQueue *packets = g_queue_new();
+	GString *packet;
+	gboolean is_hit;
+
+	is_hit = network_query_cache_get(cache, k, now, packets);
+	if (is_hit) g_assert_cmpint(packets->length, ==, 1);
+
+	while ((packet = g_queue_pop_head(packets))) g_string_free(packet, TRUE);
+	g_queue_free(packets);
+	g_string_free(k, TRUE);
+
+	return is_hit;
+}
+
+/**
+ * @test stored results are returned until the TTL is over
+ */
+void t_query_cache_ttl() {
+	network_query_cache *cache = network_query_cache_new(1024, 100);
+
+	g_assert(!cache_has(cache, "q1", 0));
+
+	network_query_cache_store(cache, entry_new(cache, "q1", "db.t1"), 0);
+	g_assert(cache_has(cache, "q1", 0));
+	g_assert(cache_has(cache, "q1", 99));
+	g_assert(!cache_has(cache, "q1", 100));
+	g_assert_cmpint(cache->bytes, ==, 0);
+
+	network_query_cache_free(cache);
+}
+
+/**
+ * @test a write to a table invalidates the results that read it
+ */
+void t_query_cache_invalidate() {
+	network_query_cache *cache = network_query_cache_new(1024, 100);
+	network_query_cache_entry *running;
+
+	network_query_cache_store(cache, entry_new(cache, "q1", "db.t1"), 0);
+	network_query_cache_store(cache, entry_new(cache, "q2", "db.t2"), 0);
+
+	network_query_cache_invalidate_table(cache, "db.t1");
+	g_assert(!cache_has(cache, "q1", 0));
+	g_assert(cache_has(cache, "q2", 0));
+
+	/* the table is written while the query runs */
+	running = entry_new(cache, "q1", "db.t1");
+	network_query_cache_invalidate_table(cache, "db.t1");
+	network_query_cache_store(cache, running, 0);
+	g_assert(!cache_has(cache, "q1", 0));
+
+	/* written before the query was sent */
+	network_query_cache_store(cache, entry_new(cache, "q1", "db.t1"), 0);
+	g_assert(cache_has(cache, "q1", 0));
+
+	running = entry_new(cache, "q3", "db.t3");
+	network_query_cache_invalidate_all(cache);
+	network_query_cache_store(cache, running, 0);
+	g_assert(!cache_has(cache, "q1", 0));
+	g_assert(!cache_has(cache, "q2", 0));
+	g_assert(!cache_has(cache, "q3", 0));
+	g_assert_cmpint(cache->bytes, ==, 0);
+
+	network_query_cache_free(cache);
+}
+
+/**
+ * @test only the tables the cached results read are kept
+ */
+void t_query_cache_tables() {
+	network_query_cache *cache = network_query_cache_new(1024, 100);
+	network_query_cache_entry *running;
+	int i;
+
+	network_query_cache_store(cache, entry_new(cache, "q1", "db.t1"), 0);
+
+	running = entry_new(cache, "q2", "db.t2");
+	network_query_cache_invalidate_table(cache, "db.t2");
+
+	for (i = 0; i < 10000; i++) {
+		gchar *table = g_strdup_printf("db.w%d", i);
+
+		network_query_cache_invalidate_table(cache, table);
+		g_free(table);
+	}
+	g_assert_cmpint(g_hash_table_size(cache->tables), <, 10000);
+	g_assert(NULL != g_hash_table_lookup(cache->tables, "db.t1"));
+
+	/* the write to db.t2 may be gone, but the result is still dropped */
+	network_query_cache_store(cache, running, 0);
+	g_assert(!cache_has(cache, "q2", 0));
+
+	g_assert(cache_has(cache, "q1", 0));
+	network_query_cache_invalidate_table(cache, "db.t1");
+	g_assert(!cache_has(cache, "q1", 0));
+
+	network_query_cache_free(cache);
+}
+
+/**
+ * @test the least-recently used results are removed if the cache is full
+ */
+void t_query_cache_lru() {
+	network_query_cache *cache;
+	network_query_cache_entry *entry;
+	gsize entry_bytes;
+
+	/* room for 2 entries */
+	cache = network_query_cache_new(1024, 100);
+	entry = entry_new(cache, "q1", "db.t1");
+	entry_bytes = entry->bytes;
+	network_query_cache_entry_free(entry);
+
+	cache->max_bytes = entry_bytes * 2;
+	cache->max_entry_bytes = entry_bytes;
+
+	network_query_cache_store(cache, entry_new(cache, "q1", "db.t1"), 0);
+	network_query_cache_store(cache, entry_new(cache, "q2", "db.t1"), 0);
+	g_assert(cache_has(cache, "q1", 0)); /* q2 is the least-recently used now */
+
+	network_query_cache_store(cache, entry_new(cache, "q3", "db.t1"), 0);
+	g_assert(cache_has(cache, "q1", 0));
+	g_assert(!cache_has(cache, "q2", 0));
+	g_assert(cache_has(cache, "q3", 0));
+	g_assert_cmpint(cache->bytes, ==, entry_bytes * 2);
+
+	/* a second packet makes it too big for the cache */
+	entry = entry_new(cache, "q4", "db.t1");
+	g_assert(!network_query_cache_entry_append(cache, entry, entry->packets->pdata[0]));
+	network_query_cache_entry_free(entry);
+
+	network_query_cache_free(cache);
+}
+
+int main(int argc, char **argv) {
+	g_thread_init(NULL);
+
+	g_test_init(&argc, &argv, NULL);
+	g_test_bug_base("http://bugs.mysql.com/");
+
+	g_test_add_func("/core/network_query_cache_ttl", t_query_cache_ttl);
+	g_test_add_func("/core/network_query_cache_invalidate", t_query_cache_invalidate);
+	g_test_add_func("/core/network_query_cache_tables", t_query_cache_tables);
+	g_test_add_func("/core/network_query_cache_lru", t_query_cache_lru);
+
+	return g_test_run();
+}
+#else
+int main() {
+	return 77;
+}
+#endif
@@ -123,6 +123,74 @@ void test_network_queue_pop_string() {
 	network_queue_free(q);
 }
 
+/**
+ * @test the string we pop is the bigger part of the chunk, the chunk gets split
+ */
+void test_network_queue_pop_string_split() {
+	network_queue *q;
+	GString *s;
+
+	q = network_queue_new();
+	g_assert(q);
+
+	network_queue_append(q, g_string_new("12345678"));
+	g_assert_cmpint(q->len, ==, 8);
+
+	s = network_queue_pop_string(q, 5, NULL);
+	g_assert(s);
+	g_assert_cmpint(s->len, ==, 5);
+	g_assert_cmpstr(s->str, ==, "12345");
+	g_string_free(s, TRUE);
+	g_assert_cmpint(q->len, ==, 3);
+	g_assert_cmpint(q->offset, ==, 0);
+
+	s = network_queue_pop_string(q, 3, NULL);
+	g_assert(s);
+	g_assert_cmpstr(s->str, ==, "678");
+	g_string_free(s, TRUE);
+	g_assert_cmpint(q->len, ==, 0);
+
+	network_queue_free(q);
+}
+
+/**
+ * @test slabs are recycled by network_queue_chunk_free()
+ */
+void test_network_queue_chunk_new() {
+	GString *s, *s2;
+	gsize slab_len;
+
+	s = network_queue_chunk_new();
+	g_assert(s);
+	g_assert_cmpint(s->len, ==, 0);
+	g_assert_cmpint(s->allocated_len, >, NETWORK_QUEUE_CHUNK_SIZE);
+	slab_len = s->allocated_len;
+
+	g_string_append_len(s, C("foo"));
+	network_queue_chunk_free(s);
+
+	s2 = network_queue_chunk_new();
+	g_assert(s2 == s);
+	g_assert_cmpint(s2->len, ==, 0);
+
+	network_queue_chunk_free(s2);
+
+	/* other GStrings are just free()ed, even if they have the size of a slab */
+	network_queue_chunk_free(g_string_new("foo"));
+	network_queue_chunk_free(g_string_sized_new(NETWORK_QUEUE_CHUNK_SIZE - 1));
+
+	s = network_queue_chunk_new();
+	g_assert_cmpint(s->allocated_len, ==, slab_len);
+
+	/* a slab that had to grow isn't recycled */
+	g_string_set_size(s, 2 * NETWORK_QUEUE_CHUNK_SIZE);
+	network_queue_chunk_free(s);
+
+	s = network_queue_chunk_new();
+	g_assert_cmpint(s->allocated_len, ==, slab_len);
+	network_queue_chunk_free(s);
+}
+
 int main(int argc, char **argv) {
 	g_test_init(&argc, &argv, NULL);
 	g_test_bug_base("http://bugs.mysql.com/");
@@ -130,6 +198,8 @@ int main(int argc, char **argv) {
 	g_test_add_func("/core/network_queue_append", test_network_queue_append);
 	g_test_add_func("/core/network_queue_peek_string", test_network_queue_peek_string);
 	g_test_add_func("/core/network_queue_pop_string", test_network_queue_pop_string);
+	g_test_add_func("/core/network_queue_pop_string_split", test_network_queue_pop_string_split);
+	g_test_add_func("/core/network_queue_chunk_new", test_network_queue_chunk_new);
 
 	return g_test_run();
 }
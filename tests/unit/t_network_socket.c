@@ -335,6 +335,47 @@ void t_network_socket_connect(void) {
 	network_socket_free(sock);
 }
 
+#ifndef WIN32
+/**
+ * @test  check if network_socket_read_all() 
+ *   - reads all available data without ->to_read set
+ *   - signals an empty socket with WAIT_FOR_EVENT
+ *   - signals a closed connection with ERROR
+ */
+void t_network_socket_read_all(void) {
+	network_socket *sock;
+	int fds[2];
+
+	g_assert_cmpint(0, ==, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+	g_assert_cmpint(0, ==, fcntl(fds[0], F_SETFL, O_NONBLOCK));
+
+	sock = network_socket_new();
+	sock->fd = fds[0];
+
+	/* nothing to read yet */
+	g_assert_cmpint(NETWORK_SOCKET_WAIT_FOR_EVENT, ==, network_socket_read_all(sock));
+	g_assert_cmpint(0, ==, sock->recv_queue_raw->len);
+
+	g_assert_cmpint(3, ==, write(fds[1], C("foo")));
+	g_assert_cmpint(NETWORK_SOCKET_SUCCESS, ==, network_socket_read_all(sock));
+	g_assert_cmpint(3, ==, sock->recv_queue_raw->len);
+	g_assert_cmpint(0, ==, sock->to_read);
+
+	/* the next read is appended to the same chunk */
+	g_assert_cmpint(3, ==, write(fds[1], C("bar")));
+	g_assert_cmpint(NETWORK_SOCKET_SUCCESS, ==, network_socket_read_all(sock));
+	g_assert_cmpint(6, ==, sock->recv_queue_raw->len);
+	g_assert_cmpint(1, ==, sock->recv_queue_raw->chunks->length);
+	g_assert_cmpstr("foobar", ==, ((GString *)g_queue_peek_head(sock->recv_queue_raw->chunks))->str);
+
+	/* the peer closed the connection */
+	close(fds[1]);
+	g_assert_cmpint(NETWORK_SOCKET_ERROR, ==, network_socket_read_all(sock));
+
+	network_socket_free(sock);
+}
+#endif
+
 /**
  * @test  check if the network_socket_connect() works by 
  *   - setting up a listening socket
@@ -663,6 +704,7 @@ int main(int argc, char **argv) {
 	g_test_add_func("/core/network_socket_is_local_ipv6",t_network_socket_is_local_ipv6);
 
 #ifndef WIN32
+	g_test_add_func("/core/network_socket_read_all", t_network_socket_read_all);
 	g_test_add_func("/core/network_socket_is_local_unix",t_network_socket_is_local_unix);
 
 	g_test_add("/core/network_socket_rem_local_unix", local_unix_t,
@@ -0,0 +1,158 @@
+/* $%BEGINLICENSE%$
+ Copyright (c) 2009, 2012, Oracle and/or its affiliates. All rights reserved.
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License as
+ published by the Free Software Foundation; version 2 of the
+ License.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ 02110-1301  USA
+
+ $%ENDLICENSE%$ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "network-mysqld-proto.h"
+#include "network-stmt-cache.h"
+
+#if GLIB_CHECK_VERSION(2, 16, 0)
+#define C(x) x, sizeof(x) - 1
+#define S(x) x->str, x->len
+
+/**
+ * @test the client sees its own statement-ids which map to the query
+ */
+void t_stmt_con_ids() {
+	network_stmt_con *sc;
+	GString *q1, *q2;
+	guint32 id1, id2;
+
+	sc = network_stmt_con_new();
+	q1 = g_string_new("SELECT ?");
+	q2 = g_string_new("SELECT ?, ?");
+
+	id1 = network_stmt_con_add(sc, q1);
+	id2 = network_stmt_con_add(sc, q1);
+	g_assert_cmpint(id1, ==, 1);
+	g_assert_cmpint(id2, ==, 2); /* each prepare gets its own id, even for the same query */
+
+	g_assert(g_string_equal(q1, network_stmt_con_get(sc, id1)));
+	g_assert(NULL == network_stmt_con_get(sc, 3));
+
+	network_stmt_con_remove(sc, id1);
+	g_assert(NULL == network_stmt_con_get(sc, id1));
+
+	/* ids that are still in use are skipped on wrap-around */
+	sc->last_stmt_id = G_MAXUINT32;
+	g_assert_cmpint(network_stmt_con_add(sc, q2), ==, 1);
+	g_assert_cmpint(network_stmt_con_add(sc, q2), ==, 3);
+
+	network_stmt_con_clear(sc);
+	g_assert(NULL == network_stmt_con_get(sc, id2));
+
+	g_string_free(q2, TRUE);
+	g_string_free(q1, TRUE);
+	network_stmt_con_free(sc);
+}
+
+/**
+ * @test replaced and evicted statements are closed with the next command
+ */
+void t_stmt_cache_closes() {
+	network_stmt_cache *cache;
+	network_queue *send_queue;
+	GString *q1, *q2, *q3, *packets;
+	guint32 stmt_id;
+
+	cache = network_stmt_cache_new(2);
+	send_queue = network_queue_new();
+	q1 = g_string_new("SELECT 1");
+	q2 = g_string_new("SELECT 2");
+	q3 = g_string_new("SELECT 3");
+
+	network_stmt_cache_add(cache, q1, 10);
+	network_stmt_cache_add(cache, q2, 20);
+	g_assert(network_stmt_cache_get(cache, q1, &stmt_id));
+	g_assert_cmpint(stmt_id, ==, 10);
+
+	/* q2 is the least-recently used statement now */
+	network_stmt_cache_add(cache, q3, 30);
+	g_assert(!network_stmt_cache_get(cache, q2, &stmt_id));
+
+	/* prepared again, the old statement is closed */
+	network_stmt_cache_add(cache, q1, 11);
+	g_assert(network_stmt_cache_get(cache, q1, &stmt_id));
+	g_assert_cmpint(stmt_id, ==, 11);
+
+	network_stmt_cache_append_closes(cache, send_queue);
+	g_assert_cmpint(send_queue->len, ==, 2 * (NET_HEADER_SIZE + 5));
+
+	packets = network_queue_pop_string(send_queue, send_queue->len, NULL);
+	g_assert(0 == memcmp(packets->str, C("\x05\x00\x00\x00\x19\x14\x00\x00\x00")));
+	g_assert(0 == memcmp(packets->str + NET_HEADER_SIZE + 5, C("\x05\x00\x00\x00\x19\x0a\x00\x00\x00")));
+	g_string_free(packets, TRUE);
+
+	/* nothing left to close */
+	network_stmt_cache_append_closes(cache, send_queue);
+	g_assert_cmpint(send_queue->len, ==, 0);
+
+	/* the client closed it itself */
+	g_assert(network_stmt_cache_remove(cache, q3));
+	g_assert(!network_stmt_cache_remove(cache, q3));
+
+	network_stmt_cache_add(cache, q3, 31);
+	network_stmt_cache_add(cache, q3, 32);
+	network_stmt_cache_clear(cache);
+	g_assert(!network_stmt_cache_get(cache, q1, &stmt_id));
+	network_stmt_cache_append_closes(cache, send_queue);
+	g_assert_cmpint(send_queue->len, ==, 0);
+
+	g_string_free(q3, TRUE);
+	g_string_free(q2, TRUE);
+	g_string_free(q1, TRUE);
+	network_queue_free(send_queue);
+	network_stmt_cache_free(cache);
+}
+
+/**
+ * @test the statement-id is patched in place
+ */
+void t_stmt_set_id() {
+	GString *packet;
+
+	packet = g_string_new_len(C("\x0a\x00\x00\x00\x17\x01\x00\x00\x00\x00\x01\x00\x00\x00"));
+
+	network_stmt_set_id(packet, 0x04030201);
+	g_assert_cmpint(packet->len, ==, NET_HEADER_SIZE + 10);
+	g_assert(0 == memcmp(packet->str, C("\x0a\x00\x00\x00\x17\x01\x02\x03\x04\x00\x01\x00\x00\x00")));
+
+	g_string_free(packet, TRUE);
+}
+
+int main(int argc, char **argv) {
+	g_test_init(&argc, &argv, NULL);
+	g_test_bug_base("http://bugs.mysql.com/");
+
+	g_test_add_func("/core/network_stmt_con_ids", t_stmt_con_ids);
+	g_test_add_func("/core/network_stmt_cache_closes", t_stmt_cache_closes);
+	g_test_add_func("/core/network_stmt_set_id", t_stmt_set_id);
+
+	return g_test_run();
+}
+#else
+int main() {
+	return 77;
+}
+#endif